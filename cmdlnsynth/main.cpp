@@ -21,15 +21,37 @@
 #include <QScopedPointer>
 #include <QCoreApplication>
 #include <QCommandLineParser>
+#include <QElapsedTimer>
 #include <QFileInfo>
+#include <QTimer>
 #include "synthcontroller.h"
+#include "statsexporter.h"
+#include "metricsserver.h"
+#include "loadtest.h"
+#include "sessionplayer.h"
+#include "sessionrecorder.h"
+#include "encodepipeline.h"
+#include "netmidisender.h"
+#include "pipeoutput.h"
 #include "programsettings.h"
+#include "soundfontlibrary.h"
+#include "startuptrace.h"
+#include "tracer.h"
 
 #if QT_VERSION >= QT_VERSION_CHECK(5,15,0)
     #define endl Qt::endl
 #endif
 
 static QScopedPointer<SynthController> synth;
+static QScopedPointer<StatsExporter> exporter;
+static QScopedPointer<MetricsServer> metrics;
+static QScopedPointer<LoadTest> loadTest;
+static QScopedPointer<SessionRecorder> recorder;
+static QScopedPointer<SessionPlayer> player;
+static QScopedPointer<NetMidiSender> sender;
+static QScopedPointer<SynthRenderer> pipeRenderer;
+static QScopedPointer<PipeOutput> pipeOutput;
+static QScopedPointer<SoundfontLibrary> library;
 
 void signalHandler(int sig)
 {
@@ -43,8 +65,49 @@ void signalHandler(int sig)
     qApp->quit();
 }
 
+/**
+ * Brings the soundfont library index up to date with the configured
+ * directories, reading only the new or changed fonts.
+ */
+static void updateLibrary()
+{
+    library.reset(new SoundfontLibrary);
+    if (!library->load()) {
+        fputs(("Soundfont library index: " + library->errorString() + "\n").toLocal8Bit(), stderr);
+    }
+    const int parsed = library->update(ProgramSettings::instance()->soundfontDirectories());
+    if (parsed > 0) {
+        library->save();
+    }
+    fprintf(stderr, "Soundfont library: %d fonts, %d presets, %d fonts read\n",
+            int(library->fonts().size()), library->presetCount(), parsed);
+}
+
+/**
+ * Loads the first library preset found by the query, extracted into a
+ * soundfont with only its samples, and selects it.
+ */
+static bool openLibraryPreset(SynthRenderer *renderer, const QString &query)
+{
+    const auto entries = library->find(query);
+    if (entries.isEmpty()) {
+        fputs(("Preset not found: " + query + "\n").toLocal8Bit(), stderr);
+        return false;
+    }
+    const QString fileName = library->presetFile(entries.first());
+    if (fileName.isEmpty()) {
+        fputs(("Unable to extract the preset: " + library->errorString() + "\n").toLocal8Bit(), stderr);
+        return false;
+    }
+    renderer->openSoundfont(fileName);
+    renderer->selectPreset(library->preset(entries.first()).bank, library->preset(entries.first()).program);
+    fputs(("Preset " + library->describe(entries.first()) + "\n").toLocal8Bit(), stderr);
+    return true;
+}
+
 int main(int argc, char *argv[])
 {
+    StartupTrace::start();
     QCoreApplication app(argc, argv);
     QCoreApplication::setOrganizationName("FluidLite");
     QCoreApplication::setApplicationName("fluidlite-cmdln");
@@ -58,24 +121,188 @@ int main(int argc, char *argv[])
     QCommandLineOption driverOption({"d", "driver"}, "MIDI Driver.", "driver");
     QCommandLineOption portOption({"p", "port"}, "MIDI Port.", "port");
     QCommandLineOption listOption({"s", "subs"}, "List available MIDI Ports.");
+    QCommandLineOption extraPortOption("extra-port", "Additional MIDI port playing the next 16 channels, on a driver not used by another port. May be repeated.", "driver:port");
     QCommandLineOption bufferOption({"b", "buffer"},"Audio buffer time in milliseconds.", "buffer_time", "60");
     QCommandLineOption reverbOption({"r", "reverb"}, "Reverb type (none=0,presets=1,2,3,4,5).", "reverb_type", "3");
     QCommandLineOption wetOption({"w", "wet"}, "Reverb Level (0..100).", "reverb_level", "75");
     QCommandLineOption chorusOption({"c", "chorus"}, "Chorus type (none=0,active=1).", "chorus_type", "0");
     QCommandLineOption levelOption({"l", "level"}, "Chorus level (0..100).", "chorus_level", "0");
     QCommandLineOption deviceOption({"a", "audiodevice"}, "Audio Device Name", "device_name", "default");
+    QCommandLineOption shmTapOption("shm-tap", "Publish the rendered audio into a POSIX shared memory ring for other processes.", "name");
+    QCommandLineOption pipeOption("pipe", "Write the raw audio to the standard output (-) or to a named pipe, without an audio device.", "path");
+    QCommandLineOption pipeFormatOption("pipe-format", "Raw audio sample format: float or s16.", "format", "float");
+    QCommandLineOption pipePacingOption("pipe-pacing", "Raw audio pacing: the back-pressure of the pipe, or the real-time clock.", "pipe|clock", "pipe");
+    QCommandLineOption extraOutputOption("extra-output", "Additional audio device playing the same audio, rendered once. May be repeated.", "device_name");
     parser.addOption(driverOption);
     parser.addOption(portOption);
     parser.addOption(listOption);
+    parser.addOption(extraPortOption);
     parser.addOption(bufferOption);
     parser.addOption(reverbOption);
     parser.addOption(chorusOption);
     parser.addOption(wetOption);
     parser.addOption(levelOption);
+    QCommandLineOption realtimeOption("realtime", "Real-time mode: FIFO scheduling, locked memory and flushed denormals.");
+    QCommandLineOption priorityOption("priority", "Real-time priority of the audio thread (1..99).", "priority", QString::number(ProgramSettings::DEFAULT_REALTIME_PRIORITY));
+    QCommandLineOption cpuOption("cpu", "CPU core for the audio thread in real-time mode (-1=any).", "cpu", QString::number(ProgramSettings::DEFAULT_CPU_AFFINITY));
     parser.addOption(deviceOption);
-    parser.addPositionalArgument("files", "SoundFont Files (.sf2;.sf3)", "[files ...]");
+    parser.addOption(extraOutputOption);
+    parser.addOption(shmTapOption);
+    parser.addOption(pipeOption);
+    parser.addOption(pipeFormatOption);
+    parser.addOption(pipePacingOption);
+    parser.addOption(realtimeOption);
+    parser.addOption(priorityOption);
+    parser.addOption(cpuOption);
+    QCommandLineOption traceOption("startup-trace", "Print the start-up milestones and the time to first audio.");
+    parser.addOption(traceOption);
+    QCommandLineOption timelineOption("trace", "Record a timeline of the audio and MIDI events into a Chrome/Perfetto JSON file.", "trace_file");
+    parser.addOption(timelineOption);
+    QCommandLineOption statsFileOption("stats-file", "Write the statistics periodically as JSON into a file.", "stats_file");
+    QCommandLineOption statsIntervalOption("stats-interval", "Statistics file update interval in milliseconds.", "interval", QString::number(StatsExporter::DEFAULT_INTERVAL));
+    parser.addOption(statsFileOption);
+    parser.addOption(statsIntervalOption);
+    QCommandLineOption statsAppendOption("stats-append", "Append the statistics to the file as JSON lines.");
+    QCommandLineOption metricsPortOption("metrics-port", "Serve Prometheus metrics at /metrics and JSON statistics at /stats over HTTP on a local TCP port.", "port");
+    QCommandLineOption metricsSocketOption("metrics-socket", "Serve Prometheus metrics at /metrics and JSON statistics at /stats over HTTP on a local socket.", "socket_name");
+    parser.addOption(statsAppendOption);
+    parser.addOption(metricsPortOption);
+    parser.addOption(metricsSocketOption);
+    QCommandLineOption profileOption("profile", "Attribute the rendering time to MIDI channels and presets, and print the report at exit.");
+    parser.addOption(profileOption);
+    QCommandLineOption drumCacheOption("drum-cache", "Play the percussion hits from a cache of renderings when possible.");
+    QCommandLineOption drumCacheSizeOption("drum-cache-size", "Maximum memory for the drum cache in megabytes.", "megabytes", QString::number(DrumCache::DEFAULT_MEMORY_LIMIT / (1024 * 1024)));
+    parser.addOption(drumCacheOption);
+    parser.addOption(drumCacheSizeOption);
+    QCommandLineOption loadOption("load", "Play a synthetic MIDI load instead of a MIDI port: " + LoadGenerator::patternNames().join(", ") + ".", "pattern");
+    QCommandLineOption loadRateOption("load-rate", "Synthetic MIDI load rate in events per second.", "events", QString::number(LoadGenerator::DEFAULT_RATE));
+    QCommandLineOption loadPolyphonyOption("load-polyphony", "Maximum number of notes held by the synthetic MIDI load.", "notes", QString::number(LoadGenerator::DEFAULT_POLYPHONY));
+    QCommandLineOption loadTestOption("load-test", "Increase the synthetic MIDI load until it is not sustainable, print the maximum rate and quit.");
+    parser.addOption(loadOption);
+    parser.addOption(loadRateOption);
+    parser.addOption(loadPolyphonyOption);
+    parser.addOption(loadTestOption);
+    QCommandLineOption captureOption("capture", "Record the incoming MIDI events and the settings into a session log.", "file");
+    QCommandLineOption replayOption("replay", "Play a session log in real time instead of a MIDI port, print the statistics and quit.", "file");
+    QCommandLineOption replayOfflineOption("replay-offline", "Render a session log without audio output, print the render time profile and the output hash, and quit.", "file");
+    parser.addOption(captureOption);
+    parser.addOption(replayOption);
+    parser.addOption(replayOfflineOption);
+    QCommandLineOption renderOutputOption("render-output", "Encode the offline render into a file, by its extension: " + AudioEncoder::formats().join(", ") + ". May be repeated.", "file");
+    parser.addOption(renderOutputOption);
+    QCommandLineOption netTestOption("net-loopback-test", "Send timestamped MIDI with simulated jitter over loopback UDP to the timestamped network input, print its statistics and quit.", "seconds");
+    QCommandLineOption netJitterOption("net-jitter", "Maximum simulated network jitter in milliseconds.", "msecs", "20");
+    parser.addOption(netTestOption);
+    parser.addOption(netJitterOption);
+    QCommandLineOption engineProfileOption("engine-profile", "Engine profile, setting the sample rate, synthesis block, polyphony, interpolation, effects and buffer time.", "name", ProgramSettings::DEFAULT_ENGINE_PROFILE);
+    QCommandLineOption listEngineProfilesOption("list-engine-profiles", "List the engine profiles and quit.");
+    parser.addOption(engineProfileOption);
+    parser.addOption(listEngineProfilesOption);
+    QCommandLineOption soundfontDirOption("soundfont-dir", "Directory scanned for the soundfont library. May be repeated.", "directory");
+    QCommandLineOption findPresetOption("find-preset", "Find soundfont library presets by bank:program or name, print them and quit.", "query");
+    QCommandLineOption presetOption("preset", "Load only the first soundfont library preset found by bank:program or name, and select it.", "query");
+    parser.addOption(soundfontDirOption);
+    parser.addOption(findPresetOption);
+    parser.addOption(presetOption);
+    parser.addPositionalArgument("files", "SoundFont Files (.sf2;.sf3) or soundfont images (.sfimg)", "[files ...]");
     parser.process(app);
+    StartupTrace::setEnabled(parser.isSet(traceOption));
+    if (parser.isSet(timelineOption)) {
+        QString traceFile = parser.value(timelineOption);
+        Tracer::setEnabled(true);
+        Tracer::setThreadName("main");
+        QObject::connect(&app, &QCoreApplication::aboutToQuit, [traceFile]{
+            if (!Tracer::writeJson(traceFile.toStdString())) {
+                fputs("Unable to write the trace file.\n", stderr);
+            }
+        });
+    }
     ProgramSettings::instance()->ReadFromNativeStorage();
+    StartupTrace::mark("settings read");
+    if (parser.isSet(listEngineProfilesOption)) {
+        for (const EngineProfile &profile : EngineProfile::all()) {
+            fputs(profile.description().c_str(), stdout);
+            fputs("\n", stdout);
+        }
+        return EXIT_SUCCESS;
+    }
+    if (parser.isSet(engineProfileOption)) {
+        if (!ProgramSettings::instance()->selectEngineProfile(parser.value(engineProfileOption))) {
+            fputs("Wrong engine profile.\n", stderr);
+            parser.showHelp(1);
+        }
+    }
+    if (parser.isSet(soundfontDirOption)) {
+        QStringList directories = parser.values(soundfontDirOption);
+        directories.removeAll(QString());
+        ProgramSettings::instance()->setSoundfontDirectories(directories);
+    }
+    if (parser.isSet(findPresetOption) || parser.isSet(presetOption)) {
+        updateLibrary();
+        StartupTrace::mark("soundfont library updated");
+    }
+    if (parser.isSet(findPresetOption)) {
+        QElapsedTimer timer;
+        timer.start();
+        const auto entries = library->find(parser.value(findPresetOption));
+        const qint64 nsecs = timer.nsecsElapsed();
+        foreach(const auto &entry, entries) {
+            fputs((library->describe(entry) + '\t' + library->font(entry).path + '\n').toLocal8Bit(), stdout);
+        }
+        fprintf(stderr, "%d presets found in %.1f us\n", int(entries.size()), nsecs / 1e3);
+        return entries.isEmpty() ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+    if (parser.isSet(replayOfflineOption)) {
+        SessionPlayer offline;
+        if (!offline.load(parser.value(replayOfflineOption))) {
+            fputs("Unable to read the session log.\n", stderr);
+            return EXIT_FAILURE;
+        }
+        // a bare engine, without MIDI backends nor audio output, with the
+        // same MIDI channels and engine profile as the captured session,
+        // unless another profile is requested to compare their DSP load
+        const SessionSettings &settings = offline.settings();
+        const QString profileName = parser.isSet(engineProfileOption) ? parser.value(engineProfileOption) : settings.engineProfile;
+        const EngineProfile *found = EngineProfile::find(profileName.toStdString());
+        EngineProfile profile = found != nullptr ? *found : EngineProfile::defaults();
+        if (!parser.isSet(engineProfileOption) && settings.sampleRate > 0) {
+            profile.sampleRate = settings.sampleRate;
+        }
+        SynthEngine engine(profile, 1 + settings.extraPorts.size());
+        settings.apply(&engine);
+        engine.setProfiling(parser.isSet(profileOption));
+        // the encoders run in their own threads, behind the synthesis
+        EncodePipeline pipeline(engine.sampleRate(), engine.channels());
+        foreach(const auto &fileName, parser.values(renderOutputOption)) {
+            if (!pipeline.addOutput(fileName)) {
+                fputs(("Unable to encode " + pipeline.errorString() + "\n").toLocal8Bit(), stderr);
+                return EXIT_FAILURE;
+            }
+        }
+        pipeline.start();
+        const SessionPlayer::Result result = offline.renderOffline(&engine, pipeline.isEmpty() ? nullptr : &pipeline);
+        const bool encoded = pipeline.finish();
+        fputs(("Engine profile " + profile.description() + "\n").c_str(), stdout);
+        fputs(result.report().toLocal8Bit(), stdout);
+        if (!pipeline.isEmpty()) {
+            fputs(pipeline.report(result.renderNsecs).toLocal8Bit(), stdout);
+        }
+        if (!encoded) {
+            fputs(("Unable to encode " + pipeline.errorString() + "\n").toLocal8Bit(), stderr);
+            return EXIT_FAILURE;
+        }
+        if (parser.isSet(profileOption)) {
+            fputs(engine.profiler().report().c_str(), stderr);
+        }
+        return EXIT_SUCCESS;
+    }
+    if (parser.isSet(replayOption)) {
+        player.reset(new SessionPlayer);
+        if (!player->load(parser.value(replayOption))) {
+            fputs("Unable to read the session log.\n", stderr);
+            return EXIT_FAILURE;
+        }
+    }
     if (parser.isSet(driverOption)) {
         QString driverName = parser.value(driverOption);
         if (!driverName.isEmpty()) {
@@ -88,6 +315,15 @@ int main(int argc, char *argv[])
             ProgramSettings::instance()->setPortName(portName);
         }
     }
+    if (parser.isSet(extraPortOption)) {
+        QStringList ports = parser.values(extraPortOption);
+        ports.removeAll(QString());
+        if (ports.size() >= MidiEvent::MAX_BANKS) {
+            fputs("Too many MIDI ports.\n", stderr);
+            parser.showHelp(1);
+        }
+        ProgramSettings::instance()->setExtraPorts(ports);
+    }
     if (parser.isSet(bufferOption)) {
         int n = parser.value(bufferOption).toInt();
         if (n > 0)
@@ -142,7 +378,109 @@ int main(int argc, char *argv[])
             parser.showHelp(1);
         }
     }
-    synth.reset(new SynthController(ProgramSettings::instance()->bufferTime()));
+    if (parser.isSet(extraOutputOption)) {
+        QStringList devices = parser.values(extraOutputOption);
+        devices.removeAll(QString());
+        ProgramSettings::instance()->setExtraOutputs(devices);
+    }
+    if (parser.isSet(shmTapOption)) {
+        ProgramSettings::instance()->setSharedMemoryTap(parser.value(shmTapOption));
+    }
+    if (parser.isSet(realtimeOption)) {
+        ProgramSettings::instance()->setRealtimeMode(true);
+    }
+    if (parser.isSet(priorityOption)) {
+        int n = parser.value(priorityOption).toInt();
+        if (n >= 1 && n <= 99)
+            ProgramSettings::instance()->setRealtimePriority(n);
+        else {
+            fputs("Wrong real-time priority.\n", stderr);
+            parser.showHelp(1);
+        }
+    }
+    if (parser.isSet(cpuOption)) {
+        bool ok = false;
+        int n = parser.value(cpuOption).toInt(&ok);
+        if (ok && n >= -1)
+            ProgramSettings::instance()->setCpuAffinity(n);
+        else {
+            fputs("Wrong CPU number.\n", stderr);
+            parser.showHelp(1);
+        }
+    }
+    if (parser.isSet(pipeOption)) {
+        // no controller nor audio output: a writer thread reads the renderer
+        const QString format = parser.value(pipeFormatOption);
+        const QString pacing = parser.value(pipePacingOption);
+        if ((format != "float" && format != "s16") || (pacing != "pipe" && pacing != "clock")) {
+            fputs("Wrong raw audio format or pacing.\n", stderr);
+            parser.showHelp(1);
+        }
+#if defined(SIGPIPE)
+        signal(SIGPIPE, SIG_IGN);
+#endif
+        pipeRenderer.reset(new SynthRenderer(1 + ProgramSettings::instance()->extraPorts().size(),
+                                             ProgramSettings::instance()->engineProfile()));
+        pipeRenderer->setMidiDriver(ProgramSettings::instance()->midiDriver());
+        foreach(const auto &arg, parser.positionalArguments()) {
+            QFileInfo argFile(arg);
+            if (argFile.exists()) {
+                ProgramSettings::instance()->setSoundFontFile(argFile.filePath());
+                pipeRenderer->openSoundfont(argFile.filePath());
+            }
+        }
+        if (parser.isSet(presetOption)) {
+            openLibraryPreset(pipeRenderer.data(), parser.value(presetOption));
+        }
+        pipeRenderer->subscribe(ProgramSettings::instance()->portName());
+        QString portErrors;
+        if (!pipeRenderer->setExtraPorts(ProgramSettings::instance()->extraPorts(), &portErrors)) {
+            fputs((portErrors + "\n").toLocal8Bit(), stderr);
+        }
+        pipeRenderer->setReverbLevel(ProgramSettings::instance()->reverbLevel());
+        pipeRenderer->initReverb(ProgramSettings::instance()->reverbType());
+        pipeRenderer->setChorusLevel(ProgramSettings::instance()->chorusLevel());
+        pipeRenderer->initChorus(ProgramSettings::instance()->chorusType());
+        if (ProgramSettings::instance()->realtimeMode()) {
+            pipeRenderer->setRealtimeMode(true,
+                                          ProgramSettings::instance()->realtimePriority(),
+                                          ProgramSettings::instance()->cpuAffinity());
+        }
+        pipeOutput.reset(new PipeOutput(pipeRenderer.data()));
+        pipeOutput->setSampleFormat(format == "s16" ? PipeOutput::Int16 : PipeOutput::Float32);
+        pipeOutput->setPacing(pacing == "clock" ? PipeOutput::RealtimeClock : PipeOutput::BackPressure);
+        pipeOutput->setPeriodFrames(pipeRenderer->format().framesForDuration(ProgramSettings::instance()->bufferTime() * 1000));
+        if (!pipeOutput->open(parser.value(pipeOption))) {
+            fputs(("Unable to open the pipe: " + pipeOutput->errorString() + "\n").toLocal8Bit(), stderr);
+            return EXIT_FAILURE;
+        }
+        fprintf(stderr, "Raw audio: %s, %d Hz, %d channels\n", qPrintable(format),
+                pipeRenderer->format().sampleRate(), pipeRenderer->format().channelCount());
+        QObject::connect(pipeOutput.data(), &PipeOutput::finished, &app, []{
+            if (!pipeOutput->errorString().isEmpty()) {
+                fputs(("Raw audio stream closed: " + pipeOutput->errorString() + "\n").toLocal8Bit(), stderr);
+            }
+            qApp->quit();
+        });
+        QObject::connect(&app, &QCoreApplication::aboutToQuit, []{
+            pipeOutput->stop();
+        });
+        QObject::connect(&app, &QCoreApplication::aboutToQuit, ProgramSettings::instance(), &ProgramSettings::SaveToNativeStorage);
+        pipeOutput->start();
+        return app.exec();
+    }
+    const int bufferTime = !player.isNull() && player->settings().bufferTime > 0 ?
+                player->settings().bufferTime : ProgramSettings::instance()->bufferTime();
+    int midiBanks = 1 + ProgramSettings::instance()->extraPorts().size();
+    QString engineProfile = ProgramSettings::instance()->engineProfile();
+    if (!player.isNull()) {
+        // the renderer is created with the channels and profile of the session
+        midiBanks = 1 + player->settings().extraPorts.size();
+        if (!parser.isSet(engineProfileOption) && !player->settings().engineProfile.isEmpty()) {
+            engineProfile = player->settings().engineProfile;
+        }
+    }
+    synth.reset(new SynthController(bufferTime, midiBanks, engineProfile));
     synth->renderer()->setMidiDriver(ProgramSettings::instance()->midiDriver());
     if (parser.isSet(listOption)) {
         auto avail = synth->renderer()->connections();
@@ -153,6 +491,7 @@ int main(int argc, char *argv[])
                 fputs("\n", stdout);
             }
         }
+        synth->probeAudioDevices();
         auto audioavail = synth->availableAudioDevices();
         fputs("Available Audio Devices:\n", stdout);
         foreach(const auto &p, audioavail) {
@@ -172,23 +511,167 @@ int main(int argc, char *argv[])
                 synth->renderer()->openSoundfont(argFile.filePath());
             }
         }
+        StartupTrace::mark("soundfont loaded");
+    }
+    if (parser.isSet(presetOption) && openLibraryPreset(synth->renderer(), parser.value(presetOption))) {
+        StartupTrace::mark("library preset loaded");
     }
     synth->setAudioDeviceName(ProgramSettings::instance()->audioDeviceName());
-    synth->renderer()->subscribe(ProgramSettings::instance()->portName());
+    synth->setExtraOutputs(ProgramSettings::instance()->extraOutputs());
+    if (!ProgramSettings::instance()->sharedMemoryTap().isEmpty()) {
+        synth->openSharedMemoryTap(ProgramSettings::instance()->sharedMemoryTap());
+    }
+    if (parser.isSet(loadOption) || parser.isSet(loadTestOption)) {
+        const QString pattern = parser.isSet(loadOption) ? parser.value(loadOption) : LoadGenerator::patternNames().last();
+        if (!LoadGenerator::patternNames().contains(pattern)) {
+            fputs("Wrong load pattern.\n", stderr);
+            parser.showHelp(1);
+        }
+        const double rate = parser.value(loadRateOption).toDouble();
+        const int polyphony = parser.value(loadPolyphonyOption).toInt();
+        if (rate <= 0 || polyphony <= 0) {
+            fputs("Wrong load rate or polyphony.\n", stderr);
+            parser.showHelp(1);
+        }
+        synth->renderer()->setMidiDriver(LoadGenerator::BACKEND_NAME);
+        LoadGenerator *generator = synth->renderer()->loadGenerator();
+        generator->setRate(rate);
+        generator->setPolyphony(polyphony);
+        synth->renderer()->subscribe(pattern);
+        if (parser.isSet(loadTestOption)) {
+            loadTest.reset(new LoadTest(synth.get(), generator));
+            QObject::connect(loadTest.data(), &LoadTest::stepFinished, [](double rate, bool passed){
+                fprintf(stderr, "%.0f events/s: %s\n", rate, passed ? "passed" : "failed");
+            });
+            QObject::connect(loadTest.data(), &LoadTest::finished, &app, [](double rate){
+                fprintf(stdout, "Engine profile %s\n", synth->renderer()->engine().profile().description().c_str());
+                fprintf(stdout, "Sustainable MIDI load: %.0f events/s\n", rate);
+                qApp->quit();
+            });
+        }
+    } else if (parser.isSet(netTestOption)) {
+        const int seconds = parser.value(netTestOption).toInt();
+        const int jitter = parser.value(netJitterOption).toInt();
+        if (seconds <= 0 || jitter < 0) {
+            fputs("Wrong network test duration or jitter.\n", stderr);
+            parser.showHelp(1);
+        }
+        synth->renderer()->setMidiDriver(NetMidiInput::BACKEND_NAME);
+        synth->renderer()->subscribe(QString::number(NetMidiInput::DEFAULT_PORT));
+        sender.reset(new NetMidiSender);
+        sender->start(QHostAddress::LocalHost, NetMidiInput::DEFAULT_PORT, jitter);
+        QTimer::singleShot(seconds * 1000, &app, []{
+            sender->stop();
+            fprintf(stdout, "sent packets: %llu\n", sender->sentPackets());
+            foreach(const auto &line, synth->renderer()->netMidiInput()->getDiagnostics()) {
+                fputs((line + '\n').toLocal8Bit(), stdout);
+            }
+            qApp->quit();
+        });
+    } else if (player.isNull()) {
+        synth->renderer()->subscribe(ProgramSettings::instance()->portName());
+        QString portErrors;
+        if (!synth->renderer()->setExtraPorts(ProgramSettings::instance()->extraPorts(), &portErrors)) {
+            fputs((portErrors + "\n").toLocal8Bit(), stderr);
+        }
+    }
     synth->renderer()->setReverbLevel(ProgramSettings::instance()->reverbLevel());
     synth->renderer()->initReverb(ProgramSettings::instance()->reverbType());
     synth->renderer()->setChorusLevel(ProgramSettings::instance()->chorusLevel());
     synth->renderer()->initChorus(ProgramSettings::instance()->chorusType());
+    if (!player.isNull()) {
+        player->settings().apply(&synth->renderer()->engine());
+        QObject::connect(player.data(), &SessionPlayer::finished, &app, []{
+            QTimer::singleShot(int(SessionPlayer::TAIL_SECONDS * 1000), qApp, []{
+                fputs(synth->stats().toJsonLine(), stdout);
+                qApp->quit();
+            });
+        });
+    }
+    if (parser.isSet(captureOption)) {
+        recorder.reset(new SessionRecorder);
+        if (recorder->start(parser.value(captureOption), SessionSettings::current(synth->renderer()))) {
+            synth->renderer()->setRecorder(recorder.data());
+            QObject::connect(&app, &QCoreApplication::aboutToQuit, []{
+                synth->renderer()->setRecorder(nullptr);
+                recorder->stop();
+            });
+        } else {
+            fputs("Unable to write the session log.\n", stderr);
+        }
+    }
+    if (ProgramSettings::instance()->realtimeMode()) {
+        synth->renderer()->setRealtimeMode(true,
+                                           ProgramSettings::instance()->realtimePriority(),
+                                           ProgramSettings::instance()->cpuAffinity());
+        QTimer::singleShot(1000, &app, []{
+            fputs(synth->renderer()->realtimeStatus().toLocal8Bit(), stderr);
+            fputs("\n", stderr);
+        });
+    }
+    if (parser.isSet(statsFileOption)) {
+        exporter.reset(new StatsExporter(synth.get()));
+        int interval = parser.value(statsIntervalOption).toInt();
+        if (interval <= 0) {
+            fputs("Wrong statistics interval.\n", stderr);
+            parser.showHelp(1);
+        }
+        if (!exporter->exportToFile(parser.value(statsFileOption), interval, parser.isSet(statsAppendOption))) {
+            fputs("Unable to write the statistics file.\n", stderr);
+        }
+    }
+    if (parser.isSet(metricsPortOption) || parser.isSet(metricsSocketOption)) {
+        metrics.reset(new MetricsServer(synth.get()));
+        if (parser.isSet(metricsPortOption)) {
+            bool ok = false;
+            const quint16 port = parser.value(metricsPortOption).toUShort(&ok);
+            if (!ok || port == 0) {
+                fputs("Wrong metrics port.\n", stderr);
+                parser.showHelp(1);
+            }
+            if (!metrics->listen(port)) {
+                fputs("Unable to listen on the metrics port.\n", stderr);
+            }
+        }
+        if (parser.isSet(metricsSocketOption)) {
+            if (!metrics->listen(parser.value(metricsSocketOption))) {
+                fputs("Unable to listen on the metrics socket.\n", stderr);
+            }
+        }
+    }
+    if (parser.isSet(drumCacheOption)) {
+        int megabytes = parser.value(drumCacheSizeOption).toInt();
+        if (megabytes <= 0) {
+            fputs("Wrong drum cache size.\n", stderr);
+            parser.showHelp(1);
+        }
+        synth->renderer()->setDrumCaching(true, size_t(megabytes) * 1024 * 1024);
+    }
+    if (parser.isSet(profileOption)) {
+        synth->renderer()->setProfiling(true);
+        QObject::connect(&app, &QCoreApplication::aboutToQuit, []{
+            fputs(synth->renderer()->profiler().report().c_str(), stderr);
+        });
+    }
     QObject::connect(synth.get(), &SynthController::underrunDetected, &app, []{
         fputs("Underrun error detected. Please increase the audio buffer size.\n", stderr);
     });
     QObject::connect(synth.get(), &SynthController::stallDetected, &app, []{
         fputs("Audio stall error detected. Please increase the audio buffer size.\n", stderr);
+        if (!loadTest.isNull()) {
+            return;
+        }
         synth->stop();
         qApp->quit();
     });
     //QObject::connect(&app, &QCoreApplication::aboutToQuit, synth.get(), &SynthController::stop);
     QObject::connect(&app, &QCoreApplication::aboutToQuit, ProgramSettings::instance(), &ProgramSettings::SaveToNativeStorage);
     synth->start();
+    if (!loadTest.isNull()) {
+        loadTest->start(parser.value(loadRateOption).toDouble());
+    }
+    if (!player.isNull()) {
+        player->play(&synth->renderer()->engine());
+    }
     return app.exec();
 }
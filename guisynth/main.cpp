@@ -20,10 +20,13 @@
 #include <QCommandLineParser>
 #include <QFileInfo>
 #include "programsettings.h"
+#include "startuptrace.h"
+#include "tracer.h"
 #include "mainwindow.h"
 
 int main(int argc, char *argv[])
 {
+    StartupTrace::start();
     QApplication app(argc, argv);
     QApplication::setOrganizationName("FluidLite");
     QApplication::setApplicationName("fluidlite_guisynth");
@@ -41,10 +44,36 @@ int main(int argc, char *argv[])
     parser.addOption(portOption);
     parser.addOption(listOption);
     parser.addOption(bufferOption);
+    QCommandLineOption realtimeOption("realtime", "Real-time mode: FIFO scheduling, locked memory and flushed denormals.");
+    QCommandLineOption priorityOption("priority", "Real-time priority of the audio thread (1..99).", "priority", QString::number(ProgramSettings::DEFAULT_REALTIME_PRIORITY));
+    QCommandLineOption cpuOption("cpu", "CPU core for the audio thread in real-time mode (-1=any).", "cpu", QString::number(ProgramSettings::DEFAULT_CPU_AFFINITY));
     parser.addOption(deviceOption);
-    parser.addPositionalArgument("file", "SoundFont File (*.sf2; *.sf3)");
+    parser.addOption(realtimeOption);
+    parser.addOption(priorityOption);
+    parser.addOption(cpuOption);
+    QCommandLineOption traceOption("startup-trace", "Print the start-up milestones and the time to first audio.");
+    parser.addOption(traceOption);
+    QCommandLineOption timelineOption("trace", "Record a timeline of the audio and MIDI events into a Chrome/Perfetto JSON file.", "trace_file");
+    parser.addOption(timelineOption);
+    QCommandLineOption engineProfileOption("engine-profile", "Engine profile, setting the sample rate, synthesis block, polyphony, interpolation, effects and buffer time.", "name", ProgramSettings::DEFAULT_ENGINE_PROFILE);
+    parser.addOption(engineProfileOption);
+    QCommandLineOption soundfontDirOption("soundfont-dir", "Directory scanned for the soundfont library. May be repeated.", "directory");
+    parser.addOption(soundfontDirOption);
+    parser.addPositionalArgument("file", "SoundFont File (*.sf2; *.sf3) or soundfont image (*.sfimg)");
     parser.process(app);
+    StartupTrace::setEnabled(parser.isSet(traceOption));
+    if (parser.isSet(timelineOption)) {
+        QString traceFile = parser.value(timelineOption);
+        Tracer::setEnabled(true);
+        Tracer::setThreadName("main");
+        QObject::connect(&app, &QCoreApplication::aboutToQuit, [traceFile]{
+            if (!Tracer::writeJson(traceFile.toStdString())) {
+                fputs("Unable to write the trace file.\n", stderr);
+            }
+        });
+    }
     ProgramSettings::instance()->ReadFromNativeStorage();
+    StartupTrace::mark("settings read");
     if (parser.isSet(driverOption)) {
         QString driverName = parser.value(driverOption);
         if (!driverName.isEmpty()) {
@@ -57,6 +86,12 @@ int main(int argc, char *argv[])
             ProgramSettings::instance()->setPortName(portName);
         }
     }
+    if (parser.isSet(engineProfileOption)) {
+        if (!ProgramSettings::instance()->selectEngineProfile(parser.value(engineProfileOption))) {
+            fputs("Wrong engine profile.\n", stderr);
+            parser.showHelp(1);
+        }
+    }
     if (parser.isSet(bufferOption)) {
         int n = parser.value(bufferOption).toInt();
         if (n > 0)
@@ -75,6 +110,33 @@ int main(int argc, char *argv[])
             parser.showHelp(1);
         }
     }
+    if (parser.isSet(soundfontDirOption)) {
+        QStringList directories = parser.values(soundfontDirOption);
+        directories.removeAll(QString());
+        ProgramSettings::instance()->setSoundfontDirectories(directories);
+    }
+    if (parser.isSet(realtimeOption)) {
+        ProgramSettings::instance()->setRealtimeMode(true);
+    }
+    if (parser.isSet(priorityOption)) {
+        int n = parser.value(priorityOption).toInt();
+        if (n >= 1 && n <= 99)
+            ProgramSettings::instance()->setRealtimePriority(n);
+        else {
+            fputs("Wrong real-time priority.\n", stderr);
+            parser.showHelp(1);
+        }
+    }
+    if (parser.isSet(cpuOption)) {
+        bool ok = false;
+        int n = parser.value(cpuOption).toInt(&ok);
+        if (ok && n >= -1)
+            ProgramSettings::instance()->setCpuAffinity(n);
+        else {
+            fputs("Wrong CPU number.\n", stderr);
+            parser.showHelp(1);
+        }
+    }
     MainWindow w;
     if (parser.isSet(listOption)) {
         w.listPorts();
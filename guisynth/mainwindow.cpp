@@ -17,8 +17,11 @@
 */
 
 #include <QCloseEvent>
+#include <QCompleter>
 #include <QFileDialog>
 #include <QMessageBox>
+#include <QScreen>
+#include <QStatusBar>
 #include <drumstick/pianokeybd.h>
 #include "mainwindow.h"
 #include "programsettings.h"
@@ -28,10 +31,22 @@ MainWindow::MainWindow(QWidget *parent) :
     QMainWindow(parent),
     m_ui(new Ui::MainWindow)
 {
-    m_synth.reset(new SynthController(ProgramSettings::instance()->bufferTime()));
+    m_synth.reset(new SynthController(ProgramSettings::instance()->bufferTime(),
+                                      1 + ProgramSettings::instance()->extraPorts().size(),
+                                      ProgramSettings::instance()->engineProfile()));
     m_synth->renderer()->setMidiDriver(ProgramSettings::instance()->midiDriver());
     m_synth->renderer()->subscribe(ProgramSettings::instance()->portName());
+    m_synth->renderer()->setExtraPorts(ProgramSettings::instance()->extraPorts());
     m_synth->setAudioDeviceName(ProgramSettings::instance()->audioDeviceName());
+    m_synth->setExtraOutputs(ProgramSettings::instance()->extraOutputs());
+    if (!ProgramSettings::instance()->sharedMemoryTap().isEmpty()) {
+        m_synth->openSharedMemoryTap(ProgramSettings::instance()->sharedMemoryTap());
+    }
+    if (ProgramSettings::instance()->realtimeMode()) {
+        m_synth->renderer()->setRealtimeMode(true,
+                                             ProgramSettings::instance()->realtimePriority(),
+                                             ProgramSettings::instance()->cpuAffinity());
+    }
 
     m_ui->setupUi(this);
 
@@ -47,9 +62,16 @@ MainWindow::MainWindow(QWidget *parent) :
     m_ui->combo_Chorus->addItem(QStringLiteral("Active"), 1);
     m_ui->combo_Chorus->addItem(QStringLiteral("None"), 0);
     m_ui->combo_Chorus->setCurrentIndex(1);
+    for (const EngineProfile &profile : EngineProfile::all()) {
+        const QString name = QString::fromStdString(profile.name);
+        m_ui->combo_Profile->addItem(name, name);
+        m_ui->combo_Profile->setItemData(m_ui->combo_Profile->count() - 1,
+                                         QString::fromStdString(profile.description()), Qt::ToolTipRole);
+    }
 
     connect(m_synth.get(), &SynthController::underrunDetected, this, &MainWindow::underrunMessage);
     connect(m_synth.get(), &SynthController::stallDetected, this, &MainWindow::stallMessage);
+    connect(m_synth.get(), &SynthController::audioDevicesChanged, this, &MainWindow::audioDevicesChanged);
     connect(m_ui->slider_Volume, &QSlider::valueChanged, this, &MainWindow::volumeChanged);
     connect(m_ui->spin_Buffer, SIGNAL(valueChanged(int)), this, SLOT(bufferSizeChanged(int)));
     connect(m_ui->spin_Octave, SIGNAL(valueChanged(int)), this, SLOT(octaveChanged(int)));
@@ -57,14 +79,17 @@ MainWindow::MainWindow(QWidget *parent) :
     connect(m_ui->combo_MIDI, SIGNAL(currentIndexChanged(int)), this, SLOT(subscriptionChanged(int)));
     connect(m_ui->combo_Reverb, SIGNAL(currentIndexChanged(int)), SLOT(reverbTypeChanged(int)));
     connect(m_ui->combo_Chorus, SIGNAL(currentIndexChanged(int)), SLOT(chorusTypeChanged(int)));
+    connect(m_ui->combo_Profile, SIGNAL(currentIndexChanged(int)), SLOT(engineProfileChanged(int)));
+    connect(m_ui->combo_Preset, SIGNAL(activated(int)), SLOT(libraryPresetChanged(int)));
     connect(m_ui->dial_Reverb, &QDial::valueChanged, this, &MainWindow::reverbChanged);
     connect(m_ui->dial_Chorus, &QDial::valueChanged, this, &MainWindow::chorusChanged);
     connect(m_ui->openButton, &QToolButton::clicked, this, &MainWindow::openFile);
     connect(m_ui->pianoKeybd, &drumstick::widgets::PianoKeybd::noteOn, this, &MainWindow::noteOn);
     connect(m_ui->pianoKeybd, &drumstick::widgets::PianoKeybd::noteOff, this, &MainWindow::noteOff);
-    connect(m_synth->renderer(), SIGNAL(midiNoteOn(int,int)), this, SLOT(showNoteOn(int,int)));
-    connect(m_synth->renderer(), SIGNAL(midiNoteOff(int,int)), this, SLOT(showNoteOff(int,int)));
+    connect(&m_keyboardTimer, &QTimer::timeout, this, &MainWindow::updateKeyboard);
     m_sf2File = QString();
+    m_keys.serial = m_synth->renderer()->keyboardState().serial();
+    m_shownKeys[0] = m_shownKeys[1] = 0;
     initialize();
 }
 
@@ -80,6 +105,10 @@ MainWindow::initialize()
     m_ui->combo_MIDI->setCurrentText(ProgramSettings::instance()->portName());
     m_ui->combo_Audio->setCurrentText(m_synth->audioDeviceName());
     m_ui->spin_Buffer->setValue(ProgramSettings::instance()->bufferTime());
+    {
+        const QSignalBlocker blocker(m_ui->combo_Profile);
+        m_ui->combo_Profile->setCurrentIndex(m_ui->combo_Profile->findData(ProgramSettings::instance()->engineProfile()));
+    }
     int reverb = m_ui->combo_Reverb->findData(ProgramSettings::instance()->reverbType());
     m_ui->combo_Reverb->setCurrentIndex(reverb);
     m_ui->dial_Reverb->setValue(ProgramSettings::instance()->reverbLevel());
@@ -92,7 +121,15 @@ MainWindow::initialize()
     f.setPointSize(72);
     m_ui->pianoKeybd->setFont(f);
     readFile(ProgramSettings::instance()->soundFontFile());
+    updateLibrary();
     m_synth->start();
+    qreal refreshRate = QGuiApplication::primaryScreen()->refreshRate();
+    m_keyboardTimer.start(qRound(1000.0 / (refreshRate > 0 ? refreshRate : 60.0)));
+    if (m_synth->renderer()->realtimeMode()) {
+        QTimer::singleShot(1000, this, [=]{
+            statusBar()->showMessage(m_synth->renderer()->realtimeStatus());
+        });
+    }
 }
 
 void
@@ -154,6 +191,14 @@ void MainWindow::deviceChanged(int value)
     ProgramSettings::instance()->setAudioDeviceName(m_ui->combo_Audio->itemText(value));
 }
 
+void MainWindow::audioDevicesChanged()
+{
+    const QSignalBlocker blocker(m_ui->combo_Audio);
+    m_ui->combo_Audio->clear();
+    m_ui->combo_Audio->addItems(m_synth->availableAudioDevices());
+    m_ui->combo_Audio->setCurrentText(m_synth->audioDeviceName());
+}
+
 void MainWindow::subscriptionChanged(int value)
 {
     //qDebug() << Q_FUNC_INFO << value << m_ui->combo_MIDI->itemText(value);
@@ -168,6 +213,84 @@ void MainWindow::bufferSizeChanged(int value)
     ProgramSettings::instance()->setBufferTime(value);
 }
 
+/**
+ * Selects an engine profile and applies its buffer time. The sample rate
+ * and the synthesis block of the engine are fixed when it is created, so
+ * the rest of the profile is applied when the program starts again.
+ */
+void MainWindow::engineProfileChanged(int index)
+{
+    const QString name = m_ui->combo_Profile->itemData(index).toString();
+    //qDebug() << Q_FUNC_INFO << name;
+    if (!ProgramSettings::instance()->selectEngineProfile(name)) {
+        return;
+    }
+    m_ui->spin_Buffer->setValue(ProgramSettings::instance()->bufferTime());
+    if (name.toStdString() != m_synth->renderer()->engine().profile().name) {
+        statusBar()->showMessage(QString("The engine profile %1 will be used after restarting the program").arg(name));
+    } else {
+        statusBar()->clearMessage();
+    }
+}
+
+/**
+ * Brings the soundfont library up to date, reading only the new or changed
+ * fonts, and lists its presets. Typing in the list finds them by name.
+ */
+void MainWindow::updateLibrary()
+{
+    m_library.load();
+    if (m_library.update(ProgramSettings::instance()->soundfontDirectories()) > 0) {
+        m_library.save();
+    }
+    const QSignalBlocker blocker(m_ui->combo_Preset);
+    m_ui->combo_Preset->clear();
+    for (int f = 0; f < m_library.fonts().size(); ++f) {
+        for (int p = 0; p < m_library.fonts()[f].presets.size(); ++p) {
+            SoundfontLibrary::Entry entry;
+            entry.font = f;
+            entry.preset = p;
+            m_ui->combo_Preset->addItem(m_library.describe(entry), f);
+            m_ui->combo_Preset->setItemData(m_ui->combo_Preset->count() - 1, p, Qt::UserRole + 1);
+            m_ui->combo_Preset->setItemData(m_ui->combo_Preset->count() - 1, m_library.font(entry).path, Qt::ToolTipRole);
+        }
+    }
+    m_ui->combo_Preset->setCurrentIndex(-1);
+    m_ui->combo_Preset->completer()->setFilterMode(Qt::MatchContains);
+    m_ui->combo_Preset->completer()->setCaseSensitivity(Qt::CaseInsensitive);
+    m_ui->combo_Preset->completer()->setCompletionMode(QCompleter::PopupCompletion);
+    m_ui->combo_Preset->setEnabled(m_ui->combo_Preset->count() > 0);
+}
+
+/**
+ * Loads only the samples of the chosen library preset, replacing the
+ * previous library preset, and selects it.
+ */
+void MainWindow::libraryPresetChanged(int index)
+{
+    SoundfontLibrary::Entry entry;
+    entry.font = m_ui->combo_Preset->itemData(index).toInt();
+    entry.preset = m_ui->combo_Preset->itemData(index, Qt::UserRole + 1).toInt();
+    //qDebug() << Q_FUNC_INFO << index << entry.font << entry.preset;
+    if (index < 0 || entry.font >= m_library.fonts().size()) {
+        return;
+    }
+    const QString fileName = m_library.presetFile(entry);
+    if (fileName.isEmpty()) {
+        statusBar()->showMessage(QString("Unable to load the preset: %1").arg(m_library.errorString()));
+        return;
+    }
+    if (fileName != m_presetFile) {
+        if (!m_presetFile.isEmpty()) {
+            m_synth->renderer()->closeSoundfont(m_presetFile);
+        }
+        m_synth->renderer()->openSoundfont(fileName);
+        m_presetFile = fileName;
+    }
+    m_synth->renderer()->selectPreset(m_library.preset(entry).bank, m_library.preset(entry).program);
+    statusBar()->showMessage(QString("%1 loaded from %2").arg(m_library.describe(entry), m_library.font(entry).path));
+}
+
 void MainWindow::octaveChanged(int value)
 {
     m_ui->pianoKeybd->setBaseOctave(value);
@@ -212,7 +335,7 @@ MainWindow::openFile()
 {
     QString songFile = QFileDialog::getOpenFileName(this,
         tr("Open SoundFont file"),  QDir::homePath(),
-        tr("SoundFont Files (*.sf2 *.sf3)"));
+        tr("SoundFont Files (*.sf2 *.sf3 *.sfimg)"));
     if (songFile.isEmpty()) {
         m_ui->lblSong->setText("[empty]");
     } else {
@@ -250,12 +373,30 @@ void MainWindow::noteOff(int midiNote, int vel)
     m_synth->renderer()->noteOff(0, midiNote, vel);
 }
 
-void MainWindow::showNoteOn(int midiNote, int vel)
-{
-    m_ui->pianoKeybd->showNoteOn(midiNote, vel);
-}
-
-void MainWindow::showNoteOff(int midiNote, int vel)
+void MainWindow::updateKeyboard()
 {
-    m_ui->pianoKeybd->showNoteOff(midiNote, vel);
+    const KeyboardState &state = m_synth->renderer()->keyboardState();
+    if (state.serial() == m_keys.serial) {
+        return;
+    }
+    state.snapshot(m_keys);
+    quint64 keys[2] = {0, 0};
+    for (int chan = 0; chan < KeyboardState::MIDI_CHANNELS; ++chan) {
+        keys[0] |= m_keys.pressed[chan][0];
+        keys[1] |= m_keys.pressed[chan][1];
+    }
+    for (int i = 0; i < 2; ++i) {
+        quint64 changed = keys[i] ^ m_shownKeys[i];
+        for (int bit = 0; changed != 0; ++bit, changed >>= 1) {
+            if (changed & 1) {
+                int midiNote = i * 64 + bit;
+                if ((keys[i] >> bit) & 1) {
+                    m_ui->pianoKeybd->showNoteOn(midiNote, m_keys.velocityOf(midiNote));
+                } else {
+                    m_ui->pianoKeybd->showNoteOff(midiNote);
+                }
+            }
+        }
+        m_shownKeys[i] = keys[i];
+    }
 }
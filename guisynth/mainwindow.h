@@ -21,7 +21,9 @@
 
 #include <QMainWindow>
 #include <QScopedPointer>
+#include <QTimer>
 #include "synthcontroller.h"
+#include "soundfontlibrary.h"
 
 namespace Ui {
 class MainWindow;
@@ -37,6 +39,7 @@ public:
     void initialize();
     void readFile(const QString &file);
     void listPorts();
+    void updateLibrary();
 
 protected:
     virtual void showEvent(QShowEvent *ev);
@@ -48,8 +51,11 @@ private slots:
     void reverbChanged(int value);
     void chorusChanged(int value);
     void deviceChanged(int value);
+    void audioDevicesChanged();
     void subscriptionChanged(int value);
     void bufferSizeChanged(int value);
+    void engineProfileChanged(int index);
+    void libraryPresetChanged(int index);
     void octaveChanged(int value);
     void volumeChanged(int value);
     void openFile();
@@ -57,13 +63,17 @@ private slots:
     void stallMessage();
     void noteOn( int midiNote, int vel );
     void noteOff( int midiNote, int vel );
-    void showNoteOn( int midiNote, int vel );
-    void showNoteOff( int midiNote, int vel );
+    void updateKeyboard();
 
 private:
     Ui::MainWindow *m_ui;
     QScopedPointer<SynthController> m_synth;
     QString m_sf2File;
+    SoundfontLibrary m_library;
+    QString m_presetFile;
+    QTimer m_keyboardTimer;
+    KeyboardState::Snapshot m_keys;
+    quint64 m_shownKeys[2];
 };
 
 #endif // MAINWINDOW_H
@@ -0,0 +1,314 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <QFile>
+#include <QFileInfo>
+#include <QtEndian>
+#include "audioencoder.h"
+
+#if defined(FLAC_SUPPORT)
+#include <FLAC/stream_encoder.h>
+#endif
+#if defined(OPUS_SUPPORT)
+#include <opusenc.h>
+#endif
+
+const int AudioEncoder::FLAC_BITS = 24;
+const int AudioEncoder::FLAC_COMPRESSION = 5;
+const int AudioEncoder::OPUS_BITRATE = 128000;
+
+AudioEncoder::~AudioEncoder()
+{ }
+
+const QString &AudioEncoder::errorString() const
+{
+    return m_error;
+}
+
+/**
+ * IEEE float WAV file. The sizes in the header are written when closing.
+ */
+class WavEncoder : public AudioEncoder
+{
+public:
+    bool open(const QString &fileName, int sampleRate, int channels) override
+    {
+        m_file.setFileName(fileName);
+        if (!m_file.open(QIODevice::WriteOnly)) {
+            m_error = m_file.errorString();
+            return false;
+        }
+        m_sampleRate = sampleRate;
+        m_channels = channels;
+        m_frames = 0;
+        return writeHeader();
+    }
+
+    bool write(const float *frames, int count) override
+    {
+        const qint64 len = qint64(count) * m_channels * sizeof(float);
+#if Q_BYTE_ORDER == Q_BIG_ENDIAN
+        m_swapped.resize(size_t(count) * m_channels);
+        qToLittleEndian<float>(frames, m_swapped.size(), m_swapped.data());
+        frames = m_swapped.data();
+#endif
+        if (m_file.write(reinterpret_cast<const char *>(frames), len) != len) {
+            m_error = m_file.errorString();
+            return false;
+        }
+        m_frames += quint64(count);
+        return true;
+    }
+
+    bool close() override
+    {
+        const bool ok = m_file.seek(0) && writeHeader();
+        m_file.close();
+        return ok;
+    }
+
+    QString name() const override
+    {
+        return QStringLiteral("wav");
+    }
+
+private:
+    bool writeHeader()
+    {
+        const quint32 blockAlign = quint32(m_channels * sizeof(float));
+        const quint32 dataBytes = quint32(std::min<quint64>(m_frames * blockAlign, 0xffffffffu - HEADER_BYTES));
+        QByteArray header;
+        header.reserve(HEADER_BYTES);
+        auto u16 = [&header](quint16 value) {
+            char bytes[2];
+            qToLittleEndian(value, bytes);
+            header.append(bytes, 2);
+        };
+        auto u32 = [&header](quint32 value) {
+            char bytes[4];
+            qToLittleEndian(value, bytes);
+            header.append(bytes, 4);
+        };
+        header.append("RIFF", 4);
+        u32(HEADER_BYTES - 8 + dataBytes);
+        header.append("WAVEfmt ", 8);
+        u32(18);
+        u16(WAVE_FORMAT_IEEE_FLOAT);
+        u16(quint16(m_channels));
+        u32(quint32(m_sampleRate));
+        u32(quint32(m_sampleRate) * blockAlign);
+        u16(quint16(blockAlign));
+        u16(32);
+        u16(0);
+        header.append("fact", 4);
+        u32(4);
+        u32(quint32(std::min<quint64>(m_frames, 0xffffffffu)));
+        header.append("data", 4);
+        u32(dataBytes);
+        if (m_file.write(header) != header.size()) {
+            m_error = m_file.errorString();
+            return false;
+        }
+        return true;
+    }
+
+    static const int HEADER_BYTES = 58;
+    static const quint16 WAVE_FORMAT_IEEE_FLOAT = 3;
+
+    QFile m_file;
+    int m_sampleRate = 0;
+    int m_channels = 0;
+    quint64 m_frames = 0;
+#if Q_BYTE_ORDER == Q_BIG_ENDIAN
+    std::vector<float> m_swapped;
+#endif
+};
+
+#if defined(FLAC_SUPPORT)
+/**
+ * 24-bit FLAC file, written by the libFLAC stream encoder.
+ */
+class FlacEncoder : public AudioEncoder
+{
+public:
+    ~FlacEncoder() override
+    {
+        if (m_encoder != nullptr) {
+            FLAC__stream_encoder_delete(m_encoder);
+        }
+    }
+
+    bool open(const QString &fileName, int sampleRate, int channels) override
+    {
+        m_encoder = FLAC__stream_encoder_new();
+        if (m_encoder == nullptr) {
+            m_error = QStringLiteral("unable to create the FLAC encoder");
+            return false;
+        }
+        m_channels = channels;
+        FLAC__stream_encoder_set_verify(m_encoder, false);
+        FLAC__stream_encoder_set_compression_level(m_encoder, FLAC_COMPRESSION);
+        FLAC__stream_encoder_set_channels(m_encoder, unsigned(channels));
+        FLAC__stream_encoder_set_bits_per_sample(m_encoder, FLAC_BITS);
+        FLAC__stream_encoder_set_sample_rate(m_encoder, unsigned(sampleRate));
+        const FLAC__StreamEncoderInitStatus status = FLAC__stream_encoder_init_file(
+                    m_encoder, QFile::encodeName(fileName).constData(), nullptr, nullptr);
+        if (status != FLAC__STREAM_ENCODER_INIT_STATUS_OK) {
+            m_error = QString::fromLatin1(FLAC__StreamEncoderInitStatusString[status]);
+            return false;
+        }
+        return true;
+    }
+
+    bool write(const float *frames, int count) override
+    {
+        const float scale = float((1 << (FLAC_BITS - 1)) - 1);
+        m_samples.resize(size_t(count) * m_channels);
+        for (size_t i = 0; i < m_samples.size(); ++i) {
+            const float value = std::max(-1.0f, std::min(1.0f, frames[i]));
+            m_samples[i] = FLAC__int32(std::lrint(value * scale));
+        }
+        if (!FLAC__stream_encoder_process_interleaved(m_encoder, m_samples.data(), unsigned(count))) {
+            m_error = QString::fromLatin1(FLAC__stream_encoder_get_resolved_state_string(m_encoder));
+            return false;
+        }
+        return true;
+    }
+
+    bool close() override
+    {
+        if (!FLAC__stream_encoder_finish(m_encoder)) {
+            m_error = QString::fromLatin1(FLAC__stream_encoder_get_resolved_state_string(m_encoder));
+            return false;
+        }
+        return true;
+    }
+
+    QString name() const override
+    {
+        return QStringLiteral("flac");
+    }
+
+private:
+    FLAC__StreamEncoder *m_encoder = nullptr;
+    int m_channels = 0;
+    std::vector<FLAC__int32> m_samples;
+};
+#endif
+
+#if defined(OPUS_SUPPORT)
+/**
+ * Ogg Opus file, written by libopusenc, which resamples the audio to the
+ * 48 kHz rate of Opus.
+ */
+class OpusEncoder : public AudioEncoder
+{
+public:
+    ~OpusEncoder() override
+    {
+        if (m_encoder != nullptr) {
+            ope_encoder_destroy(m_encoder);
+        }
+        if (m_comments != nullptr) {
+            ope_comments_destroy(m_comments);
+        }
+    }
+
+    bool open(const QString &fileName, int sampleRate, int channels) override
+    {
+        m_comments = ope_comments_create();
+        int error = OPE_OK;
+        m_encoder = ope_encoder_create_file(QFile::encodeName(fileName).constData(), m_comments,
+                                            sampleRate, channels, 0, &error);
+        if (m_encoder == nullptr) {
+            m_error = QString::fromLatin1(ope_strerror(error));
+            return false;
+        }
+        ope_encoder_ctl(m_encoder, OPUS_SET_BITRATE(OPUS_BITRATE));
+        return true;
+    }
+
+    bool write(const float *frames, int count) override
+    {
+        const int error = ope_encoder_write_float(m_encoder, frames, count);
+        if (error != OPE_OK) {
+            m_error = QString::fromLatin1(ope_strerror(error));
+            return false;
+        }
+        return true;
+    }
+
+    bool close() override
+    {
+        const int error = ope_encoder_drain(m_encoder);
+        if (error != OPE_OK) {
+            m_error = QString::fromLatin1(ope_strerror(error));
+            return false;
+        }
+        return true;
+    }
+
+    QString name() const override
+    {
+        return QStringLiteral("opus");
+    }
+
+private:
+    OggOpusComments *m_comments = nullptr;
+    OggOpusEnc *m_encoder = nullptr;
+};
+#endif
+
+/**
+ * Returns a new encoder for the extension of the file name, or null when
+ * the format is not available.
+ */
+AudioEncoder *AudioEncoder::create(const QString &fileName)
+{
+    const QString suffix = QFileInfo(fileName).suffix().toLower();
+    if (suffix == "wav") {
+        return new WavEncoder;
+    }
+#if defined(FLAC_SUPPORT)
+    if (suffix == "flac") {
+        return new FlacEncoder;
+    }
+#endif
+#if defined(OPUS_SUPPORT)
+    if (suffix == "opus") {
+        return new OpusEncoder;
+    }
+#endif
+    return nullptr;
+}
+
+QStringList AudioEncoder::formats()
+{
+    QStringList result{"wav"};
+#if defined(FLAC_SUPPORT)
+    result << "flac";
+#endif
+#if defined(OPUS_SUPPORT)
+    result << "opus";
+#endif
+    return result;
+}
@@ -0,0 +1,54 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef AUDIOENCODER_H
+#define AUDIOENCODER_H
+
+#include <QString>
+#include <QStringList>
+
+/**
+ * Writes interleaved float audio into a file. The format is chosen by the
+ * file name extension: WAV (32-bit float) is always available, FLAC
+ * (24-bit) and Opus when the library was built with libFLAC and
+ * libopusenc. An encoder is used from a single thread.
+ */
+class AudioEncoder
+{
+public:
+    virtual ~AudioEncoder();
+
+    virtual bool open(const QString &fileName, int sampleRate, int channels) = 0;
+    virtual bool write(const float *frames, int count) = 0;
+    virtual bool close() = 0;
+    virtual QString name() const = 0;
+    const QString &errorString() const;
+
+    static AudioEncoder *create(const QString &fileName);
+    static QStringList formats();
+
+    static const int FLAC_BITS;
+    static const int FLAC_COMPRESSION;
+    static const int OPUS_BITRATE;
+
+protected:
+    QString m_error;
+};
+
+#endif // AUDIOENCODER_H
@@ -0,0 +1,216 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <algorithm>
+#include <chrono>
+#include <QTextStream>
+#include "encodepipeline.h"
+
+const int EncodePipeline::DEFAULT_CHUNK_FRAMES = 8192;
+const int EncodePipeline::DEFAULT_QUEUE_CHUNKS = 16;
+
+static qint64 steadyNsecs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+EncodePipeline::EncodePipeline(int sampleRate, int channels, int chunkFrames, int queueChunks):
+    m_sampleRate(sampleRate),
+    m_channels(channels),
+    m_chunkFrames(chunkFrames),
+    m_queueChunks(queueChunks),
+    m_chunkFill(0),
+    m_frames(0),
+    m_blockedNsecs(0),
+    m_startNsecs(0),
+    m_wallNsecs(0)
+{ }
+
+EncodePipeline::~EncodePipeline()
+{
+    finish();
+}
+
+/**
+ * Opens an encoder for a file, by its extension. Must be called before
+ * start().
+ */
+bool EncodePipeline::addOutput(const QString &fileName)
+{
+    std::unique_ptr<AudioEncoder> encoder(AudioEncoder::create(fileName));
+    if (!encoder) {
+        m_error = QString("unsupported format: %1 (available: %2)").arg(fileName, AudioEncoder::formats().join(", "));
+        return false;
+    }
+    if (!encoder->open(fileName, m_sampleRate, m_channels)) {
+        m_error = QString("%1: %2").arg(fileName, encoder->errorString());
+        return false;
+    }
+    std::unique_ptr<Stage> stage(new Stage);
+    stage->fileName = fileName;
+    stage->encoder = std::move(encoder);
+    m_stages.push_back(std::move(stage));
+    return true;
+}
+
+bool EncodePipeline::isEmpty() const
+{
+    return m_stages.empty();
+}
+
+const QString &EncodePipeline::errorString() const
+{
+    return m_error;
+}
+
+void EncodePipeline::start()
+{
+    m_startNsecs = steadyNsecs();
+    for (const auto &stage : m_stages) {
+        Stage *s = stage.get();
+        s->thread = std::thread([this, s]{ encode(s); });
+    }
+}
+
+/**
+ * Copies rendered frames into the current chunk, queueing it for every
+ * encoder when full. Called from the rendering thread.
+ */
+void EncodePipeline::push(const float *frames, int count)
+{
+    while (count > 0) {
+        if (!m_chunk) {
+            m_chunk = std::make_shared<std::vector<float>>(size_t(m_chunkFrames) * m_channels);
+            m_chunkFill = 0;
+        }
+        const int n = std::min(count, m_chunkFrames - m_chunkFill);
+        std::copy(frames, frames + n * m_channels, m_chunk->data() + m_chunkFill * m_channels);
+        m_chunkFill += n;
+        frames += n * m_channels;
+        count -= n;
+        if (m_chunkFill == m_chunkFrames) {
+            flushChunk();
+        }
+    }
+}
+
+void EncodePipeline::flushChunk()
+{
+    if (!m_chunk || m_chunkFill == 0) {
+        return;
+    }
+    m_chunk->resize(size_t(m_chunkFill) * m_channels);
+    m_frames += quint64(m_chunkFill);
+    const Chunk chunk = m_chunk;
+    m_chunk.reset();
+    for (const auto &stage : m_stages) {
+        std::unique_lock<std::mutex> lock(stage->mutex);
+        if (int(stage->queue.size()) >= m_queueChunks) {
+            const qint64 start = steadyNsecs();
+            stage->notFull.wait(lock, [this, &stage]{ return int(stage->queue.size()) < m_queueChunks; });
+            m_blockedNsecs += steadyNsecs() - start;
+        }
+        stage->queue.push_back(chunk);
+        lock.unlock();
+        stage->notEmpty.notify_one();
+    }
+}
+
+/**
+ * Queues the last partial chunk, waits for every encoder to write all its
+ * chunks and closes the files. Returns false when any of them failed.
+ */
+bool EncodePipeline::finish()
+{
+    if (m_stages.empty() || !m_stages.front()->thread.joinable()) {
+        return m_error.isEmpty();
+    }
+    flushChunk();
+    for (const auto &stage : m_stages) {
+        {
+            std::lock_guard<std::mutex> lock(stage->mutex);
+            stage->done = true;
+        }
+        stage->notEmpty.notify_one();
+    }
+    bool ok = true;
+    for (const auto &stage : m_stages) {
+        stage->thread.join();
+        if (!stage->encoder->close() && !stage->failed) {
+            stage->failed = true;
+        }
+        if (stage->failed) {
+            m_error = QString("%1: %2").arg(stage->fileName, stage->encoder->errorString());
+            ok = false;
+        }
+    }
+    m_wallNsecs = steadyNsecs() - m_startNsecs;
+    return ok;
+}
+
+void EncodePipeline::encode(Stage *stage)
+{
+    for (;;) {
+        Chunk chunk;
+        {
+            std::unique_lock<std::mutex> lock(stage->mutex);
+            const qint64 start = steadyNsecs();
+            stage->notEmpty.wait(lock, [stage]{ return !stage->queue.empty() || stage->done; });
+            stage->waitNsecs += steadyNsecs() - start;
+            if (stage->queue.empty()) {
+                return;
+            }
+            chunk = stage->queue.front();
+            stage->queue.pop_front();
+        }
+        stage->notFull.notify_one();
+        // after a failure the chunks are still consumed, so the
+        // rendering thread never waits forever
+        if (!stage->failed) {
+            const qint64 start = steadyNsecs();
+            stage->failed = !stage->encoder->write(chunk->data(), int(chunk->size()) / m_channels);
+            stage->busyNsecs += steadyNsecs() - start;
+        }
+    }
+}
+
+/**
+ * Returns the throughput of the whole render and the share of the elapsed
+ * time spent by each stage working and waiting, given the time spent by
+ * the synthesis.
+ */
+QString EncodePipeline::report(qint64 renderNsecs) const
+{
+    QString result;
+    QTextStream out(&result);
+    const double wall = m_wallNsecs > 0 ? double(m_wallNsecs) : 1.0;
+    const double seconds = m_sampleRate > 0 ? m_frames / double(m_sampleRate) : 0;
+    out << "Encoded " << m_frames << " frames (" << seconds << " s) in " << m_wallNsecs / 1e6 << " ms, "
+        << seconds * 1e9 / wall << "x real time\n";
+    out << "  synthesis: " << 100.0 * renderNsecs / wall << "% busy, "
+        << 100.0 * m_blockedNsecs / wall << "% waiting for the encoders\n";
+    for (const auto &stage : m_stages) {
+        out << "  " << stage->encoder->name() << " (" << stage->fileName << "): "
+            << 100.0 * stage->busyNsecs / wall << "% busy, "
+            << 100.0 * stage->waitNsecs / wall << "% waiting for audio\n";
+    }
+    out.flush();
+    return result;
+}
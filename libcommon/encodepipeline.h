@@ -0,0 +1,92 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef ENCODEPIPELINE_H
+#define ENCODEPIPELINE_H
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <QString>
+#include "audioencoder.h"
+
+/**
+ * Encodes the audio of an offline render into several files at once, each
+ * one by an AudioEncoder in its own thread. The rendering thread pushes
+ * the audio in chunks shared by every encoder, through one bounded queue
+ * per encoder, so encoding overlaps with the synthesis; it only waits
+ * when the slowest encoder is a whole queue behind.
+ */
+class EncodePipeline
+{
+public:
+    EncodePipeline(int sampleRate, int channels,
+                   int chunkFrames = DEFAULT_CHUNK_FRAMES, int queueChunks = DEFAULT_QUEUE_CHUNKS);
+    ~EncodePipeline();
+
+    bool addOutput(const QString &fileName);
+    bool isEmpty() const;
+    const QString &errorString() const;
+
+    void start();
+    void push(const float *frames, int count);
+    bool finish();
+    QString report(qint64 renderNsecs) const;
+
+    static const int DEFAULT_CHUNK_FRAMES;
+    static const int DEFAULT_QUEUE_CHUNKS;
+
+private:
+    typedef std::shared_ptr<const std::vector<float>> Chunk;
+
+    struct Stage {
+        QString fileName;
+        std::unique_ptr<AudioEncoder> encoder;
+        std::deque<Chunk> queue;
+        std::mutex mutex;
+        std::condition_variable notEmpty;
+        std::condition_variable notFull;
+        std::thread thread;
+        bool done = false;
+        bool failed = false;
+        qint64 busyNsecs = 0;
+        qint64 waitNsecs = 0;
+    };
+
+    void flushChunk();
+    void encode(Stage *stage);
+
+    int m_sampleRate;
+    int m_channels;
+    int m_chunkFrames;
+    int m_queueChunks;
+    std::vector<std::unique_ptr<Stage>> m_stages;
+    std::shared_ptr<std::vector<float>> m_chunk;
+    int m_chunkFill;
+    quint64 m_frames;
+    qint64 m_blockedNsecs;
+    qint64 m_startNsecs;
+    qint64 m_wallNsecs;
+    QString m_error;
+};
+
+#endif // ENCODEPIPELINE_H
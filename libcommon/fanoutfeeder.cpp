@@ -0,0 +1,71 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <limits>
+#include "fanoutfeeder.h"
+#include "tracer.h"
+
+FanoutFeeder::FanoutFeeder(const FanoutRing *ring, int targetFrames, QObject *parent):
+    QIODevice(parent),
+    m_reader(*ring, targetFrames),
+    m_channels(ring->channels())
+{ }
+
+qint64 FanoutFeeder::readData(char *data, qint64 maxlen)
+{
+    TraceScope trace("audio", "fanout", maxlen);
+    const qint64 frameBytes = m_channels * sizeof(float);
+    const qint64 frames = maxlen / frameBytes;
+    m_reader.read(reinterpret_cast<float *>(data), int(frames));
+    return frames * frameBytes;
+}
+
+qint64 FanoutFeeder::writeData(const char *data, qint64 len)
+{
+    Q_UNUSED(data);
+    Q_UNUSED(len);
+    return 0;
+}
+
+qint64 FanoutFeeder::size() const
+{
+    return std::numeric_limits<qint64>::max();
+}
+
+qint64 FanoutFeeder::bytesAvailable() const
+{
+    return std::numeric_limits<qint64>::max();
+}
+
+void FanoutFeeder::start()
+{
+    open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+}
+
+void FanoutFeeder::stop()
+{
+    if (isOpen()) {
+        close();
+    }
+}
+
+FanoutReader::Stats FanoutFeeder::stats() const
+{
+    return m_reader.stats();
+}
@@ -0,0 +1,53 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef FANOUTFEEDER_H
+#define FANOUTFEEDER_H
+
+#include <QIODevice>
+#include "fanoutring.h"
+
+/**
+ * The device read by an extra audio output. It never renders the synth:
+ * the audio rendered once for the main output is read back from a shared
+ * FanoutRing, resampled to follow the clock of this output's device.
+ */
+class FanoutFeeder : public QIODevice
+{
+    Q_OBJECT
+
+public:
+    FanoutFeeder(const FanoutRing *ring, int targetFrames, QObject *parent = nullptr);
+
+    /* QIODevice */
+    qint64 readData(char *data, qint64 maxlen) override;
+    qint64 writeData(const char *data, qint64 len) override;
+    qint64 size() const override;
+    qint64 bytesAvailable() const override;
+
+    void start();
+    void stop();
+    FanoutReader::Stats stats() const;
+
+private:
+    FanoutReader m_reader;
+    int m_channels;
+};
+
+#endif // FANOUTFEEDER_H
@@ -0,0 +1,311 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QDebug>
+#include <QElapsedTimer>
+#include "loadgenerator.h"
+
+using namespace drumstick::rt;
+
+const QString LoadGenerator::BACKEND_NAME = QStringLiteral("LoadGenerator");
+const double LoadGenerator::DEFAULT_RATE = 1000.0;
+const int LoadGenerator::DEFAULT_POLYPHONY = 64;
+const int LoadGenerator::TICK_INTERVAL = 1;
+
+static const int MIDI_CHANNELS = 16;
+static const int ALL_NOTES_OFF_PERIOD = 500;
+static const int CONTROLLERS[] = { 1, 7, 10, 11, 71, 74, 91, 93 };
+
+LoadGenerator::LoadGenerator(QObject *parent):
+    MIDIInput(parent),
+    m_publicName(BACKEND_NAME),
+    m_quit(false),
+    m_rate(DEFAULT_RATE),
+    m_polyphony(DEFAULT_POLYPHONY),
+    m_generated(0),
+    m_chordChannel(0),
+    m_chordRoot(0),
+    m_chordNotes(0),
+    m_chordNote(0),
+    m_seed(1)
+{ }
+
+LoadGenerator::~LoadGenerator()
+{
+    close();
+}
+
+QStringList LoadGenerator::patternNames()
+{
+    return { QStringLiteral("chords"), QStringLiteral("controllers"), QStringLiteral("programs"),
+             QStringLiteral("all-notes-off"), QStringLiteral("mixed") };
+}
+
+void LoadGenerator::initialize(QSettings *settings)
+{
+    Q_UNUSED(settings)
+}
+
+QString LoadGenerator::backendName()
+{
+    return BACKEND_NAME;
+}
+
+QString LoadGenerator::publicName()
+{
+    return m_publicName;
+}
+
+void LoadGenerator::setPublicName(QString name)
+{
+    m_publicName = name;
+}
+
+QList<MIDIConnection> LoadGenerator::connections(bool advanced)
+{
+    Q_UNUSED(advanced)
+    QList<MIDIConnection> result;
+    const QStringList names = patternNames();
+    for (int i = 0; i < names.size(); ++i) {
+        result << MIDIConnection(names[i], i);
+    }
+    return result;
+}
+
+void LoadGenerator::setExcludedConnections(QStringList conns)
+{
+    Q_UNUSED(conns)
+}
+
+void LoadGenerator::open(const MIDIConnection &conn)
+{
+    //qDebug() << Q_FUNC_INFO << conn.first;
+    close();
+    const int pattern = patternNames().indexOf(conn.first);
+    if (pattern < 0) {
+        return;
+    }
+    m_connection = conn;
+    m_quit = false;
+    m_thread = QThread::create([this, pattern]{ run(Pattern(pattern)); });
+    m_thread->start();
+}
+
+void LoadGenerator::close()
+{
+    if (!m_thread.isNull()) {
+        m_quit = true;
+        m_thread->wait();
+        delete m_thread;
+    }
+    m_connection = MIDIConnection();
+}
+
+MIDIConnection LoadGenerator::currentConnection()
+{
+    return m_connection;
+}
+
+void LoadGenerator::setMIDIThruDevice(MIDIOutput *device)
+{
+    Q_UNUSED(device)
+}
+
+void LoadGenerator::enableMIDIThru(bool enable)
+{
+    Q_UNUSED(enable)
+}
+
+bool LoadGenerator::isEnabledMIDIThru()
+{
+    return false;
+}
+
+QStringList LoadGenerator::getDiagnostics()
+{
+    return QStringList();
+}
+
+bool LoadGenerator::getStatus()
+{
+    return true;
+}
+
+double LoadGenerator::rate() const
+{
+    return m_rate;
+}
+
+/**
+ * Changes the event rate, also while generating.
+ */
+void LoadGenerator::setRate(double eventsPerSecond)
+{
+    m_rate = qMax(0.0, eventsPerSecond);
+}
+
+int LoadGenerator::polyphony() const
+{
+    return m_polyphony;
+}
+
+void LoadGenerator::setPolyphony(int notes)
+{
+    m_polyphony = qBound(1, notes, 1024);
+}
+
+quint64 LoadGenerator::generatedEvents() const
+{
+    return m_generated;
+}
+
+/**
+ * Emits the events due every tick. Late ticks are caught up to a tenth of
+ * a second of events at most.
+ */
+void LoadGenerator::run(Pattern pattern)
+{
+    m_sounding.clear();
+    m_sounding.reserve(1024);
+    m_chordNotes = 0;
+    QElapsedTimer clock;
+    clock.start();
+    qint64 last = 0;
+    double budget = 0;
+    while (!m_quit) {
+        const qint64 now = clock.nsecsElapsed();
+        const double rate = m_rate;
+        budget = qMin(budget + (now - last) * 1e-9 * rate, rate / 10 + 1);
+        last = now;
+        while (budget >= 1 && !m_quit) {
+            generate(pattern);
+            budget -= 1;
+        }
+        QThread::msleep(TICK_INTERVAL);
+    }
+    releaseNotes(m_sounding.size());
+}
+
+void LoadGenerator::generate(Pattern pattern)
+{
+    switch (pattern) {
+    case Chords:
+        playChordNote();
+        break;
+    case Controllers:
+        sendController();
+        break;
+    case Programs:
+        sendProgram();
+        break;
+    case AllNotesOff:
+        if (m_generated % ALL_NOTES_OFF_PERIOD == 0) {
+            sendAllNotesOff();
+        } else {
+            playChordNote();
+        }
+        break;
+    case Mixed: {
+        const unsigned dice = random(100);
+        if (dice < 60) {
+            playChordNote();
+        } else if (dice < 85) {
+            sendController();
+        } else if (dice < 95) {
+            sendPitchBend();
+        } else if (dice < 99) {
+            sendProgram();
+        } else {
+            sendAllNotesOff();
+        }
+        break;
+    }
+    }
+}
+
+/**
+ * Plays random chords of three to six notes, releasing the oldest notes
+ * when the polyphony is exhausted.
+ */
+void LoadGenerator::playChordNote()
+{
+    if (m_sounding.size() >= m_polyphony) {
+        releaseNotes(1);
+        return;
+    }
+    if (m_chordNotes == 0) {
+        m_chordChannel = int(random(MIDI_CHANNELS));
+        m_chordRoot = 36 + int(random(48));
+        m_chordNotes = 3 + int(random(4));
+        m_chordNote = 0;
+    }
+    static const int intervals[] = { 0, 4, 7, 11, 14, 17 };
+    const int note = qMin(127, m_chordRoot + intervals[m_chordNote++]);
+    --m_chordNotes;
+    m_sounding.append({m_chordChannel, note});
+    ++m_generated;
+    emit midiNoteOn(m_chordChannel, note, 40 + int(random(88)));
+}
+
+void LoadGenerator::releaseNotes(int count)
+{
+    count = qMin(count, m_sounding.size());
+    for (int i = 0; i < count; ++i) {
+        ++m_generated;
+        emit midiNoteOff(m_sounding[i].chan, m_sounding[i].note, 0);
+    }
+    m_sounding.remove(0, count);
+}
+
+void LoadGenerator::sendController()
+{
+    const int controller = CONTROLLERS[random(sizeof(CONTROLLERS) / sizeof(CONTROLLERS[0]))];
+    ++m_generated;
+    emit midiController(int(random(MIDI_CHANNELS)), controller, int(random(128)));
+}
+
+void LoadGenerator::sendProgram()
+{
+    ++m_generated;
+    emit midiProgram(int(random(MIDI_CHANNELS)), int(random(128)));
+}
+
+void LoadGenerator::sendPitchBend()
+{
+    ++m_generated;
+    emit midiPitchBend(int(random(MIDI_CHANNELS)), int(random(16384)) - 8192);
+}
+
+void LoadGenerator::sendAllNotesOff()
+{
+    for (int chan = 0; chan < MIDI_CHANNELS; ++chan) {
+        ++m_generated;
+        emit midiController(chan, 123, 0);
+    }
+    m_sounding.clear();
+    m_chordNotes = 0;
+}
+
+/* xorshift32: deterministic, and cheap enough for high event rates */
+unsigned LoadGenerator::random(unsigned range)
+{
+    m_seed ^= m_seed << 13;
+    m_seed ^= m_seed >> 17;
+    m_seed ^= m_seed << 5;
+    return m_seed % range;
+}
@@ -0,0 +1,111 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LOADGENERATOR_H
+#define LOADGENERATOR_H
+
+#include <atomic>
+#include <QPointer>
+#include <QVector>
+#include <QThread>
+#include <drumstick/rtmidiinput.h>
+
+/**
+ * A MIDI input backend producing synthetic events at a configurable rate,
+ * for stress and capacity testing without MIDI hardware. The connections
+ * are the available event patterns. The events are emitted from a worker
+ * thread through the same signals as any other Drumstick input backend.
+ */
+class LoadGenerator : public drumstick::rt::MIDIInput
+{
+    Q_OBJECT
+
+public:
+    enum Pattern {
+        Chords,
+        Controllers,
+        Programs,
+        AllNotesOff,
+        Mixed
+    };
+
+    explicit LoadGenerator(QObject *parent = nullptr);
+    virtual ~LoadGenerator();
+
+    /* drumstick::rt::MIDIInput */
+    virtual void initialize(QSettings *settings);
+    virtual QString backendName();
+    virtual QString publicName();
+    virtual void setPublicName(QString name);
+    virtual QList<drumstick::rt::MIDIConnection> connections(bool advanced = false);
+    virtual void setExcludedConnections(QStringList conns);
+    virtual void open(const drumstick::rt::MIDIConnection &conn);
+    virtual void close();
+    virtual drumstick::rt::MIDIConnection currentConnection();
+    virtual void setMIDIThruDevice(drumstick::rt::MIDIOutput *device);
+    virtual void enableMIDIThru(bool enable);
+    virtual bool isEnabledMIDIThru();
+    virtual QStringList getDiagnostics();
+    virtual bool getStatus();
+
+    double rate() const;
+    void setRate(double eventsPerSecond);
+    int polyphony() const;
+    void setPolyphony(int notes);
+    quint64 generatedEvents() const;
+
+    static const QString BACKEND_NAME;
+    static const double DEFAULT_RATE;
+    static const int DEFAULT_POLYPHONY;
+    static const int TICK_INTERVAL;
+    static QStringList patternNames();
+
+private:
+    struct Note {
+        int chan;
+        int note;
+    };
+
+    void run(Pattern pattern);
+    void generate(Pattern pattern);
+    void playChordNote();
+    void releaseNotes(int count);
+    void sendController();
+    void sendProgram();
+    void sendAllNotesOff();
+    void sendPitchBend();
+    unsigned random(unsigned range);
+
+    QString m_publicName;
+    drumstick::rt::MIDIConnection m_connection;
+    QPointer<QThread> m_thread;
+    std::atomic<bool> m_quit;
+    std::atomic<double> m_rate;
+    std::atomic<int> m_polyphony;
+    std::atomic<quint64> m_generated;
+
+    /* worker thread only */
+    QVector<Note> m_sounding;
+    int m_chordChannel;
+    int m_chordRoot;
+    int m_chordNotes;
+    int m_chordNote;
+    quint32 m_seed;
+};
+
+#endif // LOADGENERATOR_H
@@ -0,0 +1,87 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QDebug>
+#include "loadtest.h"
+#include "loadgenerator.h"
+#include "synthcontroller.h"
+
+const int LoadTest::STEP_TIME = 2000;
+const double LoadTest::GROWTH = 1.5;
+const double LoadTest::MAX_RATE = 1e6;
+const int LoadTest::REFINEMENTS = 4;
+
+LoadTest::LoadTest(SynthController *controller, LoadGenerator *generator, QObject *parent):
+    QObject(parent),
+    m_controller(controller),
+    m_generator(generator),
+    m_rate(0),
+    m_passed(0),
+    m_failed(0),
+    m_refinements(0)
+{
+    connect(&m_timer, &QTimer::timeout, this, &LoadTest::step);
+}
+
+void LoadTest::start(double initialRate)
+{
+    //qDebug() << Q_FUNC_INFO << initialRate;
+    m_passed = 0;
+    m_failed = 0;
+    m_refinements = 0;
+    setRate(initialRate);
+    m_timer.start(STEP_TIME);
+}
+
+double LoadTest::sustainableRate() const
+{
+    return m_passed;
+}
+
+void LoadTest::setRate(double rate)
+{
+    m_rate = rate;
+    m_generator->setRate(rate);
+    m_previous = m_controller->stats();
+}
+
+void LoadTest::step()
+{
+    const SynthStats current = m_controller->stats();
+    const bool passed = current.xruns == m_previous.xruns
+                        && current.stalls == m_previous.stalls
+                        && current.droppedEvents == m_previous.droppedEvents;
+    emit stepFinished(m_rate, passed);
+    if (passed) {
+        m_passed = m_rate;
+    } else {
+        m_failed = m_rate;
+    }
+    if (m_failed == 0) {
+        if (m_rate * GROWTH <= MAX_RATE) {
+            setRate(m_rate * GROWTH);
+            return;
+        }
+    } else if (m_refinements++ < REFINEMENTS) {
+        setRate((m_passed + m_failed) / 2);
+        return;
+    }
+    m_timer.stop();
+    m_generator->setRate(m_passed);
+    emit finished(m_passed);
+}
@@ -0,0 +1,70 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LOADTEST_H
+#define LOADTEST_H
+
+#include <QObject>
+#include <QTimer>
+#include "synthstats.h"
+
+class SynthController;
+class LoadGenerator;
+
+/**
+ * Finds the maximum sustainable MIDI event rate. The rate of a load
+ * generator grows geometrically while every step passes without xruns or
+ * dropped events. After the first failed step, the rate is bisected
+ * between the last passed and the first failed rates.
+ */
+class LoadTest : public QObject
+{
+    Q_OBJECT
+
+public:
+    LoadTest(SynthController *controller, LoadGenerator *generator, QObject *parent = nullptr);
+
+    void start(double initialRate);
+    double sustainableRate() const;
+
+    static const int STEP_TIME;
+    static const double GROWTH;
+    static const double MAX_RATE;
+    static const int REFINEMENTS;
+
+signals:
+    void stepFinished(double rate, bool passed);
+    void finished(double sustainableRate);
+
+private slots:
+    void step();
+
+private:
+    void setRate(double rate);
+
+    SynthController *m_controller;
+    LoadGenerator *m_generator;
+    QTimer m_timer;
+    SynthStats m_previous;
+    double m_rate;
+    double m_passed;
+    double m_failed;
+    int m_refinements;
+};
+
+#endif // LOADTEST_H
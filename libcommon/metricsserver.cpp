@@ -0,0 +1,149 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QDebug>
+#include <QTcpSocket>
+#include <QLocalSocket>
+#include "metricsserver.h"
+#include "synthcontroller.h"
+
+const int MetricsServer::MAX_REQUEST_SIZE = 8192;
+
+MetricsServer::MetricsServer(SynthController *controller, QObject *parent):
+    QObject(parent),
+    m_controller(controller)
+{ }
+
+MetricsServer::~MetricsServer()
+{
+    if (!m_tcpServer.isNull()) {
+        m_tcpServer->close();
+    }
+    if (!m_localServer.isNull()) {
+        m_localServer->close();
+    }
+}
+
+bool MetricsServer::listen(quint16 port)
+{
+    //qDebug() << Q_FUNC_INFO << port;
+    m_tcpServer.reset(new QTcpServer);
+    connect(m_tcpServer.data(), &QTcpServer::newConnection, this, &MetricsServer::acceptTcpClient);
+    if (!m_tcpServer->listen(QHostAddress::LocalHost, port)) {
+        qWarning() << Q_FUNC_INFO << m_tcpServer->errorString();
+        m_tcpServer.reset();
+        return false;
+    }
+    return true;
+}
+
+bool MetricsServer::listen(const QString &socketName)
+{
+    //qDebug() << Q_FUNC_INFO << socketName;
+    m_localServer.reset(new QLocalServer);
+    connect(m_localServer.data(), &QLocalServer::newConnection, this, &MetricsServer::acceptLocalClient);
+    QLocalServer::removeServer(socketName);
+    if (!m_localServer->listen(socketName)) {
+        qWarning() << Q_FUNC_INFO << m_localServer->errorString();
+        m_localServer.reset();
+        return false;
+    }
+    return true;
+}
+
+void MetricsServer::acceptTcpClient()
+{
+    while (m_tcpServer->hasPendingConnections()) {
+        QTcpSocket *socket = m_tcpServer->nextPendingConnection();
+        connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+        addClient(socket);
+    }
+}
+
+void MetricsServer::acceptLocalClient()
+{
+    while (m_localServer->hasPendingConnections()) {
+        QLocalSocket *socket = m_localServer->nextPendingConnection();
+        connect(socket, &QLocalSocket::disconnected, socket, &QObject::deleteLater);
+        addClient(socket);
+    }
+}
+
+void MetricsServer::addClient(QIODevice *client)
+{
+    connect(client, &QIODevice::readyRead, this, [this, client]{ readRequest(client); });
+}
+
+/**
+ * Answers a single request per connection, once the request headers
+ * have been received completely.
+ */
+void MetricsServer::readRequest(QIODevice *client)
+{
+    if (client->bytesAvailable() > MAX_REQUEST_SIZE) {
+        client->close();
+        return;
+    }
+    QByteArray request = client->peek(MAX_REQUEST_SIZE);
+    if (!request.contains("\r\n\r\n")) {
+        return;
+    }
+    client->readAll();
+    disconnect(client, &QIODevice::readyRead, this, nullptr);
+    const QList<QByteArray> requestLine = request.left(request.indexOf("\r\n")).split(' ');
+    if (requestLine.size() < 2 || (requestLine[0] != "GET" && requestLine[0] != "HEAD")) {
+        client->write("HTTP/1.0 405 Method Not Allowed\r\nConnection: close\r\nContent-Length: 0\r\n\r\n");
+    } else {
+        QByteArray reply = response(requestLine[1]);
+        if (requestLine[0] == "HEAD") {
+            reply.truncate(reply.indexOf("\r\n\r\n") + 4);
+        }
+        client->write(reply);
+    }
+    if (auto tcpSocket = qobject_cast<QTcpSocket*>(client)) {
+        tcpSocket->disconnectFromHost();
+    } else if (auto localSocket = qobject_cast<QLocalSocket*>(client)) {
+        localSocket->disconnectFromServer();
+    }
+}
+
+QByteArray MetricsServer::response(const QByteArray &path) const
+{
+    QByteArray status = "200 OK";
+    QByteArray contentType;
+    QByteArray body;
+    const QByteArray resource = path.left(path.indexOf('?'));
+    if (resource == "/metrics") {
+        contentType = "text/plain; version=0.0.4; charset=utf-8";
+        body = m_controller->stats().toPrometheus();
+    } else if (resource == "/stats") {
+        contentType = "application/json";
+        body = m_controller->stats().toJsonLine();
+    } else if (resource == "/profile" && m_controller->renderer()->profiling()) {
+        contentType = "text/plain; charset=utf-8";
+        body = QByteArray::fromStdString(m_controller->renderer()->profiler().report());
+    } else {
+        status = "404 Not Found";
+        contentType = "text/plain; charset=utf-8";
+        body = "Not found\n";
+    }
+    return "HTTP/1.0 " + status + "\r\n"
+           "Content-Type: " + contentType + "\r\n"
+           "Content-Length: " + QByteArray::number(body.size()) + "\r\n"
+           "Connection: close\r\n\r\n" + body;
+}
@@ -0,0 +1,62 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef METRICSSERVER_H
+#define METRICSSERVER_H
+
+#include <QObject>
+#include <QScopedPointer>
+#include <QTcpServer>
+#include <QLocalServer>
+
+class SynthController;
+
+/**
+ * A minimal HTTP server publishing the statistics of a SynthController,
+ * in the Prometheus text format at /metrics and as JSON at /stats, either
+ * on a TCP port of the loopback interface or on a local socket. When the
+ * renderer is profiling, the profile report is served at /profile.
+ */
+class MetricsServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit MetricsServer(SynthController *controller, QObject *parent = nullptr);
+    virtual ~MetricsServer();
+
+    bool listen(quint16 port);
+    bool listen(const QString &socketName);
+
+    static const int MAX_REQUEST_SIZE;
+
+private slots:
+    void acceptTcpClient();
+    void acceptLocalClient();
+
+private:
+    void addClient(QIODevice *client);
+    void readRequest(QIODevice *client);
+    QByteArray response(const QByteArray &path) const;
+
+    SynthController *m_controller;
+    QScopedPointer<QTcpServer> m_tcpServer;
+    QScopedPointer<QLocalServer> m_localServer;
+};
+
+#endif // METRICSSERVER_H
@@ -0,0 +1,323 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <chrono>
+#include <QDebug>
+#include <QUdpSocket>
+#include <QtEndian>
+#include "netmidiinput.h"
+#include "synthrenderer.h"
+
+using namespace drumstick::rt;
+
+const QString NetMidiInput::BACKEND_NAME = QStringLiteral("Timestamped Network");
+const quint16 NetMidiInput::DEFAULT_PORT = 21948;
+const int NetMidiInput::PORTS = 4;
+const int NetMidiInput::HEADER_SIZE = 12;
+const int NetMidiInput::RECEIVE_TIMEOUT = 100;
+
+NetMidiInput::NetMidiInput(QObject *parent):
+    MIDIInput(parent),
+    m_publicName(BACKEND_NAME),
+    m_quit(false),
+    m_renderer(nullptr),
+    m_firstChannel(0),
+    m_jitter(SynthRenderer::DEFAULT_SAMPLE_RATE),
+    m_malformed(0),
+    m_dropped(0)
+{ }
+
+NetMidiInput::~NetMidiInput()
+{
+    close();
+}
+
+void NetMidiInput::initialize(QSettings *settings)
+{
+    Q_UNUSED(settings)
+}
+
+QString NetMidiInput::backendName()
+{
+    return BACKEND_NAME;
+}
+
+QString NetMidiInput::publicName()
+{
+    return m_publicName;
+}
+
+void NetMidiInput::setPublicName(QString name)
+{
+    m_publicName = name;
+}
+
+QList<MIDIConnection> NetMidiInput::connections(bool advanced)
+{
+    Q_UNUSED(advanced)
+    QList<MIDIConnection> result;
+    for (int i = 0; i < PORTS; ++i) {
+        result << MIDIConnection(QString::number(DEFAULT_PORT + i), DEFAULT_PORT + i);
+    }
+    return result;
+}
+
+void NetMidiInput::setExcludedConnections(QStringList conns)
+{
+    Q_UNUSED(conns)
+}
+
+void NetMidiInput::open(const MIDIConnection &conn)
+{
+    //qDebug() << Q_FUNC_INFO << conn.first;
+    close();
+    const quint16 port = quint16(conn.second.toUInt());
+    if (port == 0) {
+        return;
+    }
+    m_connection = conn;
+    m_quit = false;
+    m_jitter.reset();
+    m_dropped = 0;
+    m_thread = QThread::create([this, port]{ run(port); });
+    m_thread->start();
+}
+
+void NetMidiInput::close()
+{
+    if (!m_thread.isNull()) {
+        m_quit = true;
+        m_thread->wait();
+        delete m_thread;
+    }
+    m_connection = MIDIConnection();
+}
+
+MIDIConnection NetMidiInput::currentConnection()
+{
+    return m_connection;
+}
+
+void NetMidiInput::setMIDIThruDevice(MIDIOutput *device)
+{
+    Q_UNUSED(device)
+}
+
+void NetMidiInput::enableMIDIThru(bool enable)
+{
+    Q_UNUSED(enable)
+}
+
+bool NetMidiInput::isEnabledMIDIThru()
+{
+    return false;
+}
+
+QStringList NetMidiInput::getDiagnostics()
+{
+    const JitterBuffer::Stats s = stats();
+    return { QString("packets: %1").arg(s.packets),
+             QString("playout delay: %1 us").arg(s.delayUsecs),
+             QString("late packets: %1").arg(s.late),
+             QString("reordered packets: %1").arg(s.reordered),
+             QString("lost packets: %1").arg(s.lost),
+             QString("duplicated packets: %1").arg(s.duplicates),
+             QString("malformed packets: %1").arg(m_malformed.load()),
+             QString("dropped events: %1").arg(m_dropped.load()) };
+}
+
+bool NetMidiInput::getStatus()
+{
+    return true;
+}
+
+/**
+ * Delivers the events to the channels of a renderer starting at
+ * firstChannel, at the frames given by the jitter buffer. Must be called
+ * while the input is closed.
+ */
+void NetMidiInput::setRenderer(SynthRenderer *renderer, int firstChannel)
+{
+    m_renderer = renderer;
+    m_firstChannel = firstChannel;
+    m_jitter.setSampleRate(renderer->format().sampleRate());
+}
+
+JitterBuffer::Stats NetMidiInput::stats() const
+{
+    return m_jitter.stats();
+}
+
+/**
+ * Events received in time but rejected by the renderer's scheduler.
+ */
+quint64 NetMidiInput::droppedEvents() const
+{
+    return m_dropped.load(std::memory_order_relaxed);
+}
+
+/**
+ * Builds a datagram, for senders and tests.
+ */
+QByteArray NetMidiInput::packet(quint32 sequence, qint64 usecs, const QByteArray &midi)
+{
+    QByteArray result(HEADER_SIZE, Qt::Uninitialized);
+    qToLittleEndian<quint32>(sequence, result.data());
+    qToLittleEndian<qint64>(usecs, result.data() + 4);
+    return result + midi;
+}
+
+void NetMidiInput::run(quint16 port)
+{
+    QUdpSocket socket;
+    if (!socket.bind(QHostAddress::Any, port)) {
+        qWarning() << Q_FUNC_INFO << socket.errorString();
+        return;
+    }
+    QByteArray datagram;
+    while (!m_quit) {
+        if (!socket.waitForReadyRead(RECEIVE_TIMEOUT)) {
+            continue;
+        }
+        while (socket.hasPendingDatagrams()) {
+            const qint64 arrival = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now().time_since_epoch()).count();
+            datagram.resize(int(qMax<qint64>(socket.pendingDatagramSize(), 0)));
+            const qint64 size = socket.readDatagram(datagram.data(), datagram.size());
+            if (size >= 0) {
+                receive(datagram.constData(), int(size), arrival);
+            }
+        }
+    }
+}
+
+void NetMidiInput::receive(const char *data, int size, qint64 arrivalNsecs)
+{
+    if (size <= HEADER_SIZE) {
+        ++m_malformed;
+        return;
+    }
+    const quint32 sequence = qFromLittleEndian<quint32>(data);
+    const qint64 usecs = qFromLittleEndian<qint64>(data + 4);
+    qint64 frame = -1;
+    if (m_renderer != nullptr) {
+        frame = m_jitter.schedule(sequence, usecs, m_renderer->frameAt(arrivalNsecs));
+        if (frame < 0) {
+            return;
+        }
+    }
+    const uchar *midi = reinterpret_cast<const uchar *>(data + HEADER_SIZE);
+    const uchar *end = reinterpret_cast<const uchar *>(data + size);
+    while (midi < end) {
+        const int status = *midi++;
+        int length;
+        switch (status & 0xf0) {
+        case 0x80:
+        case 0x90:
+        case 0xa0:
+        case 0xb0:
+        case 0xe0:
+            length = 2;
+            break;
+        case 0xc0:
+        case 0xd0:
+            length = 1;
+            break;
+        default:
+            // system and running status messages are not supported
+            ++m_malformed;
+            return;
+        }
+        if (end - midi < length) {
+            ++m_malformed;
+            return;
+        }
+        if (!dispatch(frame, status, midi[0] & 0x7f, length > 1 ? midi[1] & 0x7f : 0)) {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+        midi += length;
+    }
+}
+
+/**
+ * Emits the event, or schedules it into the renderer. Returns false when
+ * the renderer's scheduler is full and the event is lost.
+ */
+bool NetMidiInput::dispatch(qint64 frame, int status, int data1, int data2)
+{
+    const int chan = status & 0x0f;
+    if (m_renderer == nullptr) {
+        switch (status & 0xf0) {
+        case 0x80:
+            emit midiNoteOff(chan, data1, data2);
+            break;
+        case 0x90:
+            emit midiNoteOn(chan, data1, data2);
+            break;
+        case 0xa0:
+            emit midiKeyPressure(chan, data1, data2);
+            break;
+        case 0xb0:
+            emit midiController(chan, data1, data2);
+            break;
+        case 0xc0:
+            emit midiProgram(chan, data1);
+            break;
+        case 0xd0:
+            emit midiChannelPressure(chan, data1);
+            break;
+        case 0xe0:
+            emit midiPitchBend(chan, ((data2 << 7) | data1) - 8192);
+            break;
+        }
+        return true;
+    }
+    MidiEvent ev;
+    ev.chan = quint8(m_firstChannel + chan);
+    ev.param1 = qint16(data1);
+    ev.param2 = qint16(data2);
+    switch (status & 0xf0) {
+    case 0x80:
+        ev.type = MidiEvent::NoteOff;
+        break;
+    case 0x90:
+        ev.type = MidiEvent::NoteOn;
+        break;
+    case 0xa0:
+        ev.type = MidiEvent::KeyPressure;
+        break;
+    case 0xb0:
+        ev.type = MidiEvent::Controller;
+        break;
+    case 0xc0:
+        ev.type = MidiEvent::Program;
+        ev.param2 = 0;
+        break;
+    case 0xd0:
+        ev.type = MidiEvent::ChannelPressure;
+        ev.param2 = 0;
+        break;
+    default:
+        ev.type = MidiEvent::PitchBend;
+        ev.param1 = qint16(((data2 << 7) | data1) - 8192);
+        ev.param2 = 0;
+        break;
+    }
+    return m_renderer->scheduleEvent(frame, ev);
+}
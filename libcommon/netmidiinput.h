@@ -0,0 +1,96 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef NETMIDIINPUT_H
+#define NETMIDIINPUT_H
+
+#include <atomic>
+#include <QPointer>
+#include <QThread>
+#include <drumstick/rtmidiinput.h>
+#include "jitterbuffer.h"
+
+class SynthRenderer;
+
+/**
+ * A MIDI input backend receiving timestamped MIDI over UDP. Every datagram
+ * carries a header and complete MIDI channel messages:
+ *
+ *   sequence number (4 bytes) | sender time in microseconds (8 bytes) | MIDI
+ *
+ * with little endian integers. The connections are the UDP ports to listen
+ * on. Attached to a SynthRenderer, the events go through a jitter buffer
+ * and are applied at the output frame matching their timestamp; otherwise
+ * they are emitted as they arrive, like any other Drumstick input backend.
+ * Duplicated packets are discarded, and the events the renderer can't
+ * schedule are counted as dropped.
+ */
+class NetMidiInput : public drumstick::rt::MIDIInput
+{
+    Q_OBJECT
+
+public:
+    explicit NetMidiInput(QObject *parent = nullptr);
+    virtual ~NetMidiInput();
+
+    /* drumstick::rt::MIDIInput */
+    virtual void initialize(QSettings *settings);
+    virtual QString backendName();
+    virtual QString publicName();
+    virtual void setPublicName(QString name);
+    virtual QList<drumstick::rt::MIDIConnection> connections(bool advanced = false);
+    virtual void setExcludedConnections(QStringList conns);
+    virtual void open(const drumstick::rt::MIDIConnection &conn);
+    virtual void close();
+    virtual drumstick::rt::MIDIConnection currentConnection();
+    virtual void setMIDIThruDevice(drumstick::rt::MIDIOutput *device);
+    virtual void enableMIDIThru(bool enable);
+    virtual bool isEnabledMIDIThru();
+    virtual QStringList getDiagnostics();
+    virtual bool getStatus();
+
+    void setRenderer(SynthRenderer *renderer, int firstChannel);
+    JitterBuffer::Stats stats() const;
+    quint64 droppedEvents() const;
+
+    static QByteArray packet(quint32 sequence, qint64 usecs, const QByteArray &midi);
+
+    static const QString BACKEND_NAME;
+    static const quint16 DEFAULT_PORT;
+    static const int PORTS;
+    static const int HEADER_SIZE;
+    static const int RECEIVE_TIMEOUT;
+
+private:
+    void run(quint16 port);
+    void receive(const char *data, int size, qint64 arrivalNsecs);
+    bool dispatch(qint64 frame, int status, int data1, int data2);
+
+    QString m_publicName;
+    drumstick::rt::MIDIConnection m_connection;
+    QPointer<QThread> m_thread;
+    std::atomic<bool> m_quit;
+    SynthRenderer *m_renderer;
+    int m_firstChannel;
+    JitterBuffer m_jitter;
+    std::atomic<quint64> m_malformed;
+    std::atomic<quint64> m_dropped;
+};
+
+#endif // NETMIDIINPUT_H
@@ -0,0 +1,107 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <QDebug>
+#include <QUdpSocket>
+#include "netmidisender.h"
+#include "netmidiinput.h"
+
+const int NetMidiSender::NOTE_INTERVAL = 10;
+const int NetMidiSender::TICK_INTERVAL = 1;
+
+NetMidiSender::NetMidiSender(QObject *parent):
+    QObject(parent),
+    m_quit(false),
+    m_sent(0)
+{ }
+
+NetMidiSender::~NetMidiSender()
+{
+    stop();
+}
+
+void NetMidiSender::start(const QHostAddress &address, quint16 port, int jitterMsecs)
+{
+    stop();
+    m_quit = false;
+    m_sent = 0;
+    m_thread = QThread::create([this, address, port, jitterMsecs]{ run(address, port, jitterMsecs); });
+    m_thread->start();
+}
+
+void NetMidiSender::stop()
+{
+    if (!m_thread.isNull()) {
+        m_quit = true;
+        m_thread->wait();
+        delete m_thread;
+    }
+}
+
+quint64 NetMidiSender::sentPackets() const
+{
+    return m_sent;
+}
+
+void NetMidiSender::run(QHostAddress address, quint16 port, int jitterMsecs)
+{
+    struct Pending {
+        qint64 sendTime;
+        QByteArray datagram;
+    };
+    auto now = []{
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count();
+    };
+    QUdpSocket socket;
+    std::minstd_rand random(1);
+    std::uniform_int_distribution<qint64> jitter(0, qMax(0, jitterMsecs) * 1000);
+    std::vector<Pending> pending;
+    quint32 sequence = 0;
+    int note = 0;
+    qint64 nextNote = now();
+    while (!m_quit) {
+        const qint64 time = now();
+        for (; nextNote <= time; nextNote += NOTE_INTERVAL * 1000) {
+            // a scale on the first channel, each note lasting one interval
+            QByteArray midi;
+            midi.append(char(0x80)).append(char(60 + note)).append(char(0));
+            note = (note + 1) % 12;
+            midi.append(char(0x90)).append(char(60 + note)).append(char(100));
+            pending.push_back({nextNote + jitter(random), NetMidiInput::packet(sequence++, nextNote, midi)});
+        }
+        std::stable_sort(pending.begin(), pending.end(), [](const Pending &a, const Pending &b) {
+            return a.sendTime < b.sendTime;
+        });
+        auto due = std::find_if(pending.begin(), pending.end(), [time](const Pending &p) {
+            return p.sendTime > time;
+        });
+        for (auto it = pending.begin(); it != due; ++it) {
+            if (socket.writeDatagram(it->datagram, address, port) > 0) {
+                ++m_sent;
+            }
+        }
+        pending.erase(pending.begin(), due);
+        QThread::msleep(TICK_INTERVAL);
+    }
+}
@@ -0,0 +1,58 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef NETMIDISENDER_H
+#define NETMIDISENDER_H
+
+#include <atomic>
+#include <QHostAddress>
+#include <QObject>
+#include <QPointer>
+#include <QThread>
+
+/**
+ * Sends a steady pattern of timestamped notes to a NetMidiInput, holding
+ * every datagram for a random delay up to a maximum jitter before sending
+ * it, which produces bursts and reordering like a congested network. Used
+ * to exercise the jitter buffer over the loopback interface.
+ */
+class NetMidiSender : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit NetMidiSender(QObject *parent = nullptr);
+    virtual ~NetMidiSender();
+
+    void start(const QHostAddress &address, quint16 port, int jitterMsecs);
+    void stop();
+    quint64 sentPackets() const;
+
+    static const int NOTE_INTERVAL;
+    static const int TICK_INTERVAL;
+
+private:
+    void run(QHostAddress address, quint16 port, int jitterMsecs);
+
+    QPointer<QThread> m_thread;
+    std::atomic<bool> m_quit;
+    std::atomic<quint64> m_sent;
+};
+
+#endif // NETMIDISENDER_H
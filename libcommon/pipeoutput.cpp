@@ -0,0 +1,240 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <thread>
+#include <QDebug>
+#include "pipeoutput.h"
+#include "tracer.h"
+
+#if defined(Q_OS_UNIX)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+const QString PipeOutput::STANDARD_OUTPUT = QStringLiteral("-");
+const int PipeOutput::DEFAULT_PERIOD_FRAMES = 4096;
+
+PipeOutput::PipeOutput(SynthRenderer *renderer, QObject *parent):
+    QObject(parent),
+    m_renderer(renderer),
+    m_fd(-1),
+    m_ownedFd(false),
+    m_sampleFormat(Float32),
+    m_pacing(BackPressure),
+    m_periodFrames(DEFAULT_PERIOD_FRAMES),
+    m_quit(false),
+    m_written(0),
+    m_error(0)
+{ }
+
+PipeOutput::~PipeOutput()
+{
+    stop();
+    close();
+}
+
+/**
+ * Opens the standard output, given as "-", or a named pipe, which is
+ * created when it doesn't exist. Opening a named pipe waits for its
+ * reader. The pipe buffer is enlarged to hold two periods when possible.
+ */
+bool PipeOutput::open(const QString &path)
+{
+    //qDebug() << Q_FUNC_INFO << path;
+    close();
+#if defined(Q_OS_UNIX)
+    if (path == STANDARD_OUTPUT) {
+        m_fd = STDOUT_FILENO;
+        m_ownedFd = false;
+    } else {
+        const QByteArray fileName = path.toLocal8Bit();
+        if (mkfifo(fileName.constData(), 0644) != 0 && errno != EEXIST) {
+            m_error = errno;
+            return false;
+        }
+        m_fd = ::open(fileName.constData(), O_WRONLY);
+        if (m_fd < 0) {
+            m_error = errno;
+            return false;
+        }
+        m_ownedFd = true;
+    }
+#if defined(F_SETPIPE_SZ)
+    struct stat st;
+    if (fstat(m_fd, &st) == 0 && S_ISFIFO(st.st_mode)) {
+        const int frameBytes = m_renderer->format().channelCount() * int(sizeof(float));
+        fcntl(m_fd, F_SETPIPE_SZ, m_periodFrames * frameBytes * 2);
+    }
+#endif
+    m_error = 0;
+    return true;
+#else
+    Q_UNUSED(path);
+    m_error = ENOSYS;
+    return false;
+#endif
+}
+
+void PipeOutput::close()
+{
+#if defined(Q_OS_UNIX)
+    if (m_fd >= 0 && m_ownedFd) {
+        ::close(m_fd);
+    }
+#endif
+    m_fd = -1;
+    m_ownedFd = false;
+}
+
+void PipeOutput::setSampleFormat(SampleFormat format)
+{
+    m_sampleFormat = format;
+}
+
+void PipeOutput::setPacing(Pacing pacing)
+{
+    m_pacing = pacing;
+}
+
+/**
+ * The number of frames rendered and written at once. It should be large,
+ * to keep the number of system calls low.
+ */
+void PipeOutput::setPeriodFrames(int frames)
+{
+    m_periodFrames = frames;
+}
+
+/**
+ * Starts streaming from a worker thread. Emits finished() when stopped,
+ * or when the stream can't be written anymore, like after the downstream
+ * process has closed the pipe.
+ */
+void PipeOutput::start()
+{
+    stop();
+    m_quit = false;
+    m_renderer->start();
+    m_thread = QThread::create([this]{ run(); });
+    connect(m_thread.data(), &QThread::finished, this, &PipeOutput::finished);
+    m_thread->start(QThread::TimeCriticalPriority);
+}
+
+void PipeOutput::stop()
+{
+    if (!m_thread.isNull()) {
+        m_quit = true;
+        m_thread->wait();
+        delete m_thread;
+        m_renderer->stop();
+    }
+}
+
+bool PipeOutput::isRunning() const
+{
+    return !m_thread.isNull() && m_thread->isRunning();
+}
+
+quint64 PipeOutput::writtenFrames() const
+{
+    return m_written.load(std::memory_order_relaxed);
+}
+
+QString PipeOutput::errorString() const
+{
+    const int error = m_error.load(std::memory_order_relaxed);
+    return error == 0 ? QString() : QString::fromLocal8Bit(strerror(error));
+}
+
+void PipeOutput::run()
+{
+    Tracer::setThreadName("pipe output");
+    const int channels = m_renderer->format().channelCount();
+    const int sampleRate = m_renderer->format().sampleRate();
+    const qint64 floatBytes = qint64(m_periodFrames) * channels * sizeof(float);
+    std::vector<float> buffer(size_t(m_periodFrames) * channels);
+    std::vector<qint16> samples(m_sampleFormat == Int16 ? buffer.size() : 0);
+    const auto period = std::chrono::nanoseconds(qint64(m_periodFrames) * 1000000000 / sampleRate);
+    auto origin = std::chrono::steady_clock::now();
+    quint64 periods = 0;
+    while (!m_quit) {
+        m_renderer->render(reinterpret_cast<char *>(buffer.data()), floatBytes);
+        bool written;
+        if (m_sampleFormat == Int16) {
+            for (size_t i = 0; i < buffer.size(); ++i) {
+                const float value = std::max(-1.0f, std::min(1.0f, buffer[i]));
+                samples[i] = qint16(std::lrint(value * 32767.0f));
+            }
+            written = writeAll(reinterpret_cast<const char *>(samples.data()), qint64(samples.size() * sizeof(qint16)));
+        } else {
+            written = writeAll(reinterpret_cast<const char *>(buffer.data()), floatBytes);
+        }
+        if (!written) {
+            break;
+        }
+        if (m_written.fetch_add(quint64(m_periodFrames), std::memory_order_relaxed) == 0) {
+            // the startup trace and its listeners live in the main thread
+            SynthRenderer *renderer = m_renderer;
+            QMetaObject::invokeMethod(renderer, [renderer]{ renderer->notifyFirstAudio(); }, Qt::QueuedConnection);
+        }
+        if (m_pacing == RealtimeClock) {
+            ++periods;
+            const auto deadline = origin + period * periods;
+            const auto now = std::chrono::steady_clock::now();
+            if (now > deadline + period) {
+                // blocked downstream for longer than a period: start over
+                // instead of writing the missed periods in a burst
+                origin = now;
+                periods = 0;
+            } else {
+                std::this_thread::sleep_until(deadline);
+            }
+        }
+    }
+}
+
+bool PipeOutput::writeAll(const char *data, qint64 len)
+{
+#if defined(Q_OS_UNIX)
+    while (len > 0) {
+        const ssize_t rc = ::write(m_fd, data, size_t(len));
+        if (rc < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            m_error = errno;
+            return false;
+        }
+        data += rc;
+        len -= rc;
+    }
+    return true;
+#else
+    Q_UNUSED(data);
+    Q_UNUSED(len);
+    m_error = ENOSYS;
+    return false;
+#endif
+}
@@ -0,0 +1,88 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef PIPEOUTPUT_H
+#define PIPEOUTPUT_H
+
+#include <atomic>
+#include <vector>
+#include <QObject>
+#include <QPointer>
+#include <QThread>
+#include "synthrenderer.h"
+
+/**
+ * Streams the raw audio of a SynthRenderer to the standard output or to a
+ * named pipe, without any audio output device, from a worker thread that
+ * writes large buffers. The stream is paced either by the back-pressure of
+ * the downstream pipe, blocking in each write, or by the steady clock at
+ * the real-time rate. The MIDI inputs of the renderer keep playing.
+ */
+class PipeOutput : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum SampleFormat {
+        Float32,
+        Int16
+    };
+
+    enum Pacing {
+        BackPressure,
+        RealtimeClock
+    };
+
+    explicit PipeOutput(SynthRenderer *renderer, QObject *parent = nullptr);
+    virtual ~PipeOutput();
+
+    bool open(const QString &path);
+    void close();
+    void setSampleFormat(SampleFormat format);
+    void setPacing(Pacing pacing);
+    void setPeriodFrames(int frames);
+    void start();
+    void stop();
+    bool isRunning() const;
+    quint64 writtenFrames() const;
+    QString errorString() const;
+
+    static const QString STANDARD_OUTPUT;
+    static const int DEFAULT_PERIOD_FRAMES;
+
+signals:
+    void finished();
+
+private:
+    void run();
+    bool writeAll(const char *data, qint64 len);
+
+    SynthRenderer *m_renderer;
+    int m_fd;
+    bool m_ownedFd;
+    SampleFormat m_sampleFormat;
+    Pacing m_pacing;
+    int m_periodFrames;
+    QPointer<QThread> m_thread;
+    std::atomic<bool> m_quit;
+    std::atomic<quint64> m_written;
+    std::atomic<int> m_error;
+};
+
+#endif // PIPEOUTPUT_H
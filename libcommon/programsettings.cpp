@@ -18,6 +18,7 @@
 
 #include <QDebug>
 #include "programsettings.h"
+#include "engineprofile.h"
 
 const QString ProgramSettings::DEFAULT_MIDI_DRIVER =
 #if defined(Q_OS_LINUX)
@@ -38,6 +39,10 @@ const int ProgramSettings::DEFAULT_REVERB_LEVEL = 75;
 const int ProgramSettings::DEFAULT_CHORUS_TYPE = 0;
 const int ProgramSettings::DEFAULT_CHORUS_LEVEL = 0;
 const int ProgramSettings::DEFAULT_VOLUME_LEVEL = 90;
+const bool ProgramSettings::DEFAULT_REALTIME_MODE = false;
+const int ProgramSettings::DEFAULT_REALTIME_PRIORITY = 20;
+const int ProgramSettings::DEFAULT_CPU_AFFINITY = -1;
+const QString ProgramSettings::DEFAULT_ENGINE_PROFILE = QLatin1String(EngineProfile::DEFAULT_NAME);
 
 ProgramSettings::ProgramSettings(QObject *parent) : QObject(parent)
 {
@@ -59,6 +64,14 @@ void ProgramSettings::ResetDefaults()
     m_chorusType = DEFAULT_CHORUS_TYPE;
     m_chorusLevel = DEFAULT_CHORUS_LEVEL;
     m_volumeLevel = DEFAULT_VOLUME_LEVEL;
+    m_realtimeMode = DEFAULT_REALTIME_MODE;
+    m_realtimePriority = DEFAULT_REALTIME_PRIORITY;
+    m_cpuAffinity = DEFAULT_CPU_AFFINITY;
+    m_engineProfile = DEFAULT_ENGINE_PROFILE;
+    m_extraPorts.clear();
+    m_extraOutputs.clear();
+    m_sharedMemoryTap.clear();
+    m_soundfontDirectories.clear();
     emit ValuesChanged();
 }
 
@@ -101,6 +114,16 @@ void ProgramSettings::internalRead(QSettings &settings)
     m_audioDeviceName = settings.value("AudioDevice", DEFAULT_AUDIO_DEVICE).toString();
     m_volumeLevel = settings.value("VolumeLevel", DEFAULT_VOLUME_LEVEL).toInt();
     m_soundFontFile = settings.value("SoundFont", QString()).toString();
+    m_realtimeMode = settings.value("RealtimeMode", DEFAULT_REALTIME_MODE).toBool();
+    m_realtimePriority = settings.value("RealtimePriority", DEFAULT_REALTIME_PRIORITY).toInt();
+    m_cpuAffinity = settings.value("CpuAffinity", DEFAULT_CPU_AFFINITY).toInt();
+    m_engineProfile = settings.value("EngineProfile", DEFAULT_ENGINE_PROFILE).toString();
+    m_extraPorts = settings.value("ExtraPorts", QStringList()).toStringList();
+    m_extraOutputs = settings.value("ExtraOutputs", QStringList()).toStringList();
+    m_sharedMemoryTap = settings.value("SharedMemoryTap", QString()).toString();
+    m_soundfontDirectories = settings.value("SoundfontDirectories", QStringList()).toStringList();
+    m_midiBackendPaths = settings.value("MIDIBackendPaths", QVariantMap()).toMap();
+    m_audioDeviceProbes = settings.value("AudioDeviceProbes", QVariantMap()).toMap();
     emit ValuesChanged();
 }
 
@@ -117,9 +140,151 @@ void ProgramSettings::internalSave(QSettings &settings)
     settings.setValue("AudioDevice", m_audioDeviceName);
     settings.setValue("VolumeLevel", m_volumeLevel);
     settings.setValue("SoundFont", m_soundFontFile);
+    settings.setValue("RealtimeMode", m_realtimeMode);
+    settings.setValue("RealtimePriority", m_realtimePriority);
+    settings.setValue("CpuAffinity", m_cpuAffinity);
+    settings.setValue("EngineProfile", m_engineProfile);
+    settings.setValue("ExtraPorts", m_extraPorts);
+    settings.setValue("ExtraOutputs", m_extraOutputs);
+    settings.setValue("SharedMemoryTap", m_sharedMemoryTap);
+    settings.setValue("SoundfontDirectories", m_soundfontDirectories);
+    settings.setValue("MIDIBackendPaths", m_midiBackendPaths);
+    settings.setValue("AudioDeviceProbes", m_audioDeviceProbes);
     settings.sync();
 }
 
+bool ProgramSettings::realtimeMode() const
+{
+    return m_realtimeMode;
+}
+
+void ProgramSettings::setRealtimeMode(bool newRealtimeMode)
+{
+    m_realtimeMode = newRealtimeMode;
+}
+
+int ProgramSettings::realtimePriority() const
+{
+    return m_realtimePriority;
+}
+
+void ProgramSettings::setRealtimePriority(int newRealtimePriority)
+{
+    m_realtimePriority = newRealtimePriority;
+}
+
+int ProgramSettings::cpuAffinity() const
+{
+    return m_cpuAffinity;
+}
+
+void ProgramSettings::setCpuAffinity(int newCpuAffinity)
+{
+    m_cpuAffinity = newCpuAffinity;
+}
+
+/**
+ * The name of the EngineProfile used to create the synthesis engine.
+ */
+const QString &ProgramSettings::engineProfile() const
+{
+    return m_engineProfile;
+}
+
+void ProgramSettings::setEngineProfile(const QString &newEngineProfile)
+{
+    m_engineProfile = newEngineProfile;
+}
+
+/**
+ * Selects a built-in engine profile together with its buffer time.
+ * Returns false, changing nothing, when there is no profile by that name.
+ */
+bool ProgramSettings::selectEngineProfile(const QString &name)
+{
+    const EngineProfile *profile = EngineProfile::find(name.toStdString());
+    if (profile == nullptr) {
+        return false;
+    }
+    m_engineProfile = name;
+    m_bufferTime = profile->bufferTime;
+    return true;
+}
+
+/**
+ * The MIDI input ports played by the banks of 16 channels after the first
+ * one, as "driver:port" strings.
+ */
+const QStringList &ProgramSettings::extraPorts() const
+{
+    return m_extraPorts;
+}
+
+void ProgramSettings::setExtraPorts(const QStringList &newExtraPorts)
+{
+    m_extraPorts = newExtraPorts;
+}
+
+/**
+ * The audio devices playing the synth besides the main one.
+ */
+const QStringList &ProgramSettings::extraOutputs() const
+{
+    return m_extraOutputs;
+}
+
+void ProgramSettings::setExtraOutputs(const QStringList &newExtraOutputs)
+{
+    m_extraOutputs = newExtraOutputs;
+}
+
+/**
+ * The name of the POSIX shared memory object publishing the rendered
+ * audio to other processes, or empty to publish nothing.
+ */
+const QString &ProgramSettings::sharedMemoryTap() const
+{
+    return m_sharedMemoryTap;
+}
+
+void ProgramSettings::setSharedMemoryTap(const QString &newSharedMemoryTap)
+{
+    m_sharedMemoryTap = newSharedMemoryTap;
+}
+
+/**
+ * The directories scanned for the soundfont library.
+ */
+const QStringList &ProgramSettings::soundfontDirectories() const
+{
+    return m_soundfontDirectories;
+}
+
+void ProgramSettings::setSoundfontDirectories(const QStringList &newSoundfontDirectories)
+{
+    m_soundfontDirectories = newSoundfontDirectories;
+}
+
+const QVariantMap &ProgramSettings::midiBackendPaths() const
+{
+    return m_midiBackendPaths;
+}
+
+void ProgramSettings::setMidiBackendPaths(const QVariantMap &newMidiBackendPaths)
+{
+    m_midiBackendPaths = newMidiBackendPaths;
+}
+
+const QVariantMap &ProgramSettings::audioDeviceProbes() const
+{
+    return m_audioDeviceProbes;
+}
+
+void ProgramSettings::setAudioDeviceProbes(const QVariantMap &newAudioDeviceProbes)
+{
+    m_audioDeviceProbes = newAudioDeviceProbes;
+}
+
 int ProgramSettings::volumeLevel() const
 {
     return m_volumeLevel;
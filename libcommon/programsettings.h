@@ -21,7 +21,9 @@
 
 #include <QObject>
 #include <QString>
+#include <QStringList>
 #include <QSettings>
+#include <QVariantMap>
 
 class ProgramSettings : public QObject
 {
@@ -60,6 +62,37 @@ public:
     const QString &soundFontFile() const;
     void setSoundFontFile(const QString &newSoundFontFile);
 
+    bool realtimeMode() const;
+    void setRealtimeMode(bool newRealtimeMode);
+
+    int realtimePriority() const;
+    void setRealtimePriority(int newRealtimePriority);
+
+    int cpuAffinity() const;
+    void setCpuAffinity(int newCpuAffinity);
+
+    const QString &engineProfile() const;
+    void setEngineProfile(const QString &newEngineProfile);
+    bool selectEngineProfile(const QString &name);
+
+    const QStringList &extraPorts() const;
+    void setExtraPorts(const QStringList &newExtraPorts);
+
+    const QStringList &extraOutputs() const;
+    void setExtraOutputs(const QStringList &newExtraOutputs);
+
+    const QString &sharedMemoryTap() const;
+    void setSharedMemoryTap(const QString &newSharedMemoryTap);
+
+    const QStringList &soundfontDirectories() const;
+    void setSoundfontDirectories(const QStringList &newSoundfontDirectories);
+
+    const QVariantMap &midiBackendPaths() const;
+    void setMidiBackendPaths(const QVariantMap &newMidiBackendPaths);
+
+    const QVariantMap &audioDeviceProbes() const;
+    void setAudioDeviceProbes(const QVariantMap &newAudioDeviceProbes);
+
     static const QString DEFAULT_MIDI_DRIVER;
     static const QString DEFAULT_AUDIO_DEVICE;
     static const int DEFAULT_BUFFER_TIME;
@@ -68,6 +101,10 @@ public:
     static const int DEFAULT_CHORUS_TYPE;
     static const int DEFAULT_CHORUS_LEVEL;
     static const int DEFAULT_VOLUME_LEVEL;
+    static const bool DEFAULT_REALTIME_MODE;
+    static const int DEFAULT_REALTIME_PRIORITY;
+    static const int DEFAULT_CPU_AFFINITY;
+    static const QString DEFAULT_ENGINE_PROFILE;
 
 signals:
     void ValuesChanged();
@@ -94,6 +131,16 @@ private:
     int m_volumeLevel;
     QString m_audioDeviceName;
     QString m_soundFontFile;
+    bool m_realtimeMode;
+    int m_realtimePriority;
+    int m_cpuAffinity;
+    QString m_engineProfile;
+    QStringList m_extraPorts;
+    QStringList m_extraOutputs;
+    QString m_sharedMemoryTap;
+    QStringList m_soundfontDirectories;
+    QVariantMap m_midiBackendPaths;
+    QVariantMap m_audioDeviceProbes;
 };
 
 #endif // PROGRAMSETTINGS_H
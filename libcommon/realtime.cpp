@@ -0,0 +1,161 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cerrno>
+#include <cstring>
+#include "realtime.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#endif
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+#if defined(__SSE__) || defined(_M_X64) || defined(_M_IX86)
+#include <xmmintrin.h>
+#endif
+
+const int RealtimeSupport::PREFAULT_STACK_SIZE = 256 * 1024;
+
+bool RealtimeSupport::setFifoScheduling(int priority, int *error)
+{
+#if defined(__unix__) || defined(__APPLE__)
+    int min = sched_get_priority_min(SCHED_FIFO);
+    int max = sched_get_priority_max(SCHED_FIFO);
+    struct sched_param param;
+    std::memset(&param, 0, sizeof(param));
+    param.sched_priority = priority < min ? min : (priority > max ? max : priority);
+    int rc = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (error != nullptr) {
+        *error = rc;
+    }
+    return rc == 0;
+#else
+    (void) priority;
+    if (error != nullptr) {
+        *error = ENOSYS;
+    }
+    return false;
+#endif
+}
+
+bool RealtimeSupport::setNormalScheduling()
+{
+#if defined(__unix__) || defined(__APPLE__)
+    struct sched_param param;
+    std::memset(&param, 0, sizeof(param));
+    return pthread_setschedparam(pthread_self(), SCHED_OTHER, &param) == 0;
+#else
+    return false;
+#endif
+}
+
+bool RealtimeSupport::setAffinity(int cpu)
+{
+#if defined(__linux__)
+    if (cpu < 0 || cpu >= CPU_SETSIZE) {
+        return false;
+    }
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(cpu, &cpuset);
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset) == 0;
+#else
+    (void) cpu;
+    return false;
+#endif
+}
+
+bool RealtimeSupport::flushDenormals()
+{
+#if defined(__SSE__) || defined(_M_X64) || defined(_M_IX86)
+    // FTZ (bit 15) and DAZ (bit 6) of the MXCSR register
+    _mm_setcsr(_mm_getcsr() | 0x8040);
+    return true;
+#elif defined(__aarch64__)
+    uint64_t fpcr;
+    __asm__ __volatile__("mrs %0, fpcr" : "=r"(fpcr));
+    fpcr |= (1 << 24);
+    __asm__ __volatile__("msr fpcr, %0" : : "r"(fpcr));
+    return true;
+#elif defined(__arm__) && defined(__ARM_FP)
+    uint32_t fpscr;
+    __asm__ __volatile__("vmrs %0, fpscr" : "=r"(fpscr));
+    fpscr |= (1 << 24);
+    __asm__ __volatile__("vmsr fpscr, %0" : : "r"(fpscr));
+    return true;
+#else
+    return false;
+#endif
+}
+
+void RealtimeSupport::prefaultStack()
+{
+    volatile char buffer[PREFAULT_STACK_SIZE];
+    for (int i = 0; i < PREFAULT_STACK_SIZE; i += 4096) {
+        buffer[i] = 0;
+    }
+}
+
+int64_t RealtimeSupport::threadId()
+{
+#if defined(__linux__)
+    return static_cast<int64_t>(syscall(SYS_gettid));
+#else
+    return 0;
+#endif
+}
+
+bool RealtimeSupport::lockMemory()
+{
+#if defined(__linux__)
+    return mlockall(MCL_CURRENT | MCL_FUTURE) == 0;
+#else
+    return false;
+#endif
+}
+
+void RealtimeSupport::unlockMemory()
+{
+#if defined(__linux__)
+    munlockall();
+#endif
+}
+
+bool RealtimeSupport::limitRealtimeRuntime(int64_t usecs)
+{
+#if defined(__linux__) && defined(RLIMIT_RTTIME)
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_RTTIME, &rl) != 0) {
+        return false;
+    }
+    if (rl.rlim_max != RLIM_INFINITY && rl.rlim_max < static_cast<rlim_t>(usecs)) {
+        usecs = static_cast<int64_t>(rl.rlim_max);
+    }
+    rl.rlim_cur = static_cast<rlim_t>(usecs);
+    rl.rlim_max = static_cast<rlim_t>(usecs);
+    return setrlimit(RLIMIT_RTTIME, &rl) == 0;
+#else
+    (void) usecs;
+    return false;
+#endif
+}
@@ -0,0 +1,47 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef REALTIME_H
+#define REALTIME_H
+
+#include <cstdint>
+
+/**
+ * Operating system helpers to harden the thread rendering audio.
+ * Every function acts on the calling thread, unless stated otherwise,
+ * and returns false when the platform or the permissions don't allow it.
+ */
+class RealtimeSupport
+{
+public:
+    static bool setFifoScheduling(int priority, int *error = nullptr);
+    static bool setNormalScheduling();
+    static bool setAffinity(int cpu);
+    static bool flushDenormals();
+    static void prefaultStack();
+    static int64_t threadId();
+
+    /* process wide */
+    static bool lockMemory();
+    static void unlockMemory();
+    static bool limitRealtimeRuntime(int64_t usecs);
+
+    static const int PREFAULT_STACK_SIZE;
+};
+
+#endif // REALTIME_H
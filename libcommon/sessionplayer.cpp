@@ -0,0 +1,237 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <algorithm>
+#include <chrono>
+#include <QDebug>
+#include <QFile>
+#include <QElapsedTimer>
+#include <QCryptographicHash>
+#include <QTextStream>
+#include <QtEndian>
+#include "sessionplayer.h"
+#include "encodepipeline.h"
+
+const double SessionPlayer::TAIL_SECONDS = 1.0;
+const double SessionPlayer::MAX_TAIL_SECONDS = 30.0;
+
+QString SessionPlayer::Result::report() const
+{
+    QString result;
+    QTextStream out(&result);
+    const double seconds = sampleRate > 0 ? frames / double(sampleRate) : 0;
+    out << "Rendered " << frames << " frames (" << seconds << " s) in " << renderNsecs / 1e6 << " ms";
+    if (renderNsecs > 0) {
+        out << ", " << seconds * 1e9 / renderNsecs << "x real time";
+    }
+    out << '\n';
+    out << "DSP load per block: p50 " << load.load50 << "% p95 " << load.load95
+        << "% p99 " << load.load99 << "% max " << load.loadMax << "%\n";
+    out << "Output SHA-256: " << hash.toHex() << '\n';
+    out.flush();
+    return result;
+}
+
+SessionPlayer::SessionPlayer(QObject *parent):
+    QObject(parent),
+    m_quit(false)
+{ }
+
+SessionPlayer::~SessionPlayer()
+{
+    stop();
+}
+
+static bool readVarint(const uchar *&data, const uchar *end, quint64 &value)
+{
+    value = 0;
+    for (int shift = 0; data < end && shift < 64; shift += 7) {
+        const uchar byte = *data++;
+        value |= quint64(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool SessionPlayer::load(const QString &fileName)
+{
+    //qDebug() << Q_FUNC_INFO << fileName;
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning() << Q_FUNC_INFO << file.errorString();
+        return false;
+    }
+    const QByteArray contents = file.readAll();
+    const int headerSize = SessionRecorder::MAGIC.size() + 1 + 4;
+    if (contents.size() < headerSize || !contents.startsWith(SessionRecorder::MAGIC)
+            || quint8(contents[SessionRecorder::MAGIC.size()]) != SessionRecorder::VERSION) {
+        qWarning() << Q_FUNC_INFO << "not a session log:" << fileName;
+        return false;
+    }
+    const uchar *data = reinterpret_cast<const uchar *>(contents.constData());
+    const uchar *end = data + contents.size();
+    const quint32 jsonSize = qFromLittleEndian<quint32>(data + headerSize - 4);
+    data += headerSize;
+    if (jsonSize > quint32(end - data)) {
+        qWarning() << Q_FUNC_INFO << "truncated session log:" << fileName;
+        return false;
+    }
+    m_settings = SessionSettings::fromJson(QByteArray(reinterpret_cast<const char *>(data), int(jsonSize)));
+    data += jsonSize;
+    m_events.clear();
+    qint64 nsecs = 0;
+    quint64 delta;
+    while (data < end) {
+        if (!readVarint(data, end, delta) || end - data < 6) {
+            qWarning() << Q_FUNC_INFO << "truncated session log:" << fileName;
+            break;
+        }
+        Event ev;
+        nsecs += qint64(delta);
+        ev.nsecs = nsecs;
+        ev.event.type = MidiEvent::Type(data[0]);
+        ev.event.chan = data[1];
+        ev.event.param1 = qFromLittleEndian<qint16>(data + 2);
+        ev.event.param2 = qFromLittleEndian<qint16>(data + 4);
+        data += 6;
+        if (ev.event.type <= MidiEvent::PitchBend) {
+            m_events.push_back(ev);
+        }
+    }
+    return true;
+}
+
+const SessionSettings &SessionPlayer::settings() const
+{
+    return m_settings;
+}
+
+int SessionPlayer::eventCount() const
+{
+    return int(m_events.size());
+}
+
+qint64 SessionPlayer::duration() const
+{
+    return m_events.empty() ? 0 : m_events.back().nsecs;
+}
+
+/**
+ * Feeds the events to an engine playing through the audio output, from
+ * a worker thread sleeping until the timestamp of each one, like a MIDI
+ * input backend would. Emits finished() after the last event.
+ */
+void SessionPlayer::play(SynthEngine *engine)
+{
+    stop();
+    m_quit = false;
+    m_thread = QThread::create([this, engine]{ run(engine); });
+    connect(m_thread.data(), &QThread::finished, this, &SessionPlayer::finished);
+    m_thread->start();
+}
+
+void SessionPlayer::stop()
+{
+    if (!m_thread.isNull()) {
+        m_quit = true;
+        m_thread->wait();
+        delete m_thread;
+    }
+}
+
+bool SessionPlayer::isPlaying() const
+{
+    return !m_thread.isNull() && m_thread->isRunning();
+}
+
+void SessionPlayer::run(SynthEngine *engine)
+{
+    QElapsedTimer clock;
+    clock.start();
+    for (const Event &ev : m_events) {
+        while (!m_quit) {
+            const qint64 wait = ev.nsecs - clock.nsecsElapsed();
+            if (wait <= 0) {
+                break;
+            }
+            QThread::usleep(quint64(std::min<qint64>(wait / 1000 + 1, 10000)));
+        }
+        if (m_quit) {
+            return;
+        }
+        engine->postEvent(ev.event);
+    }
+}
+
+/**
+ * Renders the whole session in synthesis blocks, posting before each block
+ * the events whose timestamp falls before its start, and then until the
+ * output has been silent for TAIL_SECONDS. The engine must not be
+ * playing through an audio output, and the drum cache should be disabled,
+ * because its worker thread makes the output depend on the timing.
+ * The audio is also pushed into an encode pipeline, when given.
+ */
+SessionPlayer::Result SessionPlayer::renderOffline(SynthEngine *engine, EncodePipeline *pipeline)
+{
+    Result result;
+    const int sampleRate = engine->sampleRate();
+    result.sampleRate = sampleRate;
+    const int channels = engine->channels();
+    const int blockFrames = engine->blockFrames();
+    const qint64 blockNsecs = qint64(blockFrames) * 1000000000 / sampleRate;
+    const quint64 tailFrames = quint64(TAIL_SECONDS * sampleRate);
+    const quint64 maxFrames = quint64((duration() / 1e9 + MAX_TAIL_SECONDS) * sampleRate);
+    std::vector<float> block(size_t(blockFrames) * channels);
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    RenderMetrics metrics;
+    size_t next = 0;
+    quint64 silentFrames = 0;
+    while (result.frames < maxFrames) {
+        const qint64 blockStart = qint64(result.frames * 1000000000 / sampleRate);
+        for (; next < m_events.size() && m_events[next].nsecs <= blockStart; ++next) {
+            engine->postEvent(m_events[next].event);
+        }
+        const auto start = std::chrono::steady_clock::now();
+        engine->render(block.data(), blockFrames);
+        const qint64 nsecs = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        metrics.addBuffer(nsecs, blockNsecs);
+        result.renderNsecs += nsecs;
+        result.frames += blockFrames;
+        hash.addData(reinterpret_cast<const char *>(block.data()), int(block.size() * sizeof(float)));
+        if (pipeline != nullptr) {
+            pipeline->push(block.data(), blockFrames);
+        }
+        if (next < m_events.size()) {
+            continue;
+        }
+        if (std::all_of(block.begin(), block.end(), [](float sample) { return sample == 0.0f; })) {
+            silentFrames += blockFrames;
+            if (silentFrames >= tailFrames) {
+                break;
+            }
+        } else {
+            silentFrames = 0;
+        }
+    }
+    result.load = metrics.collect(result.renderNsecs);
+    result.hash = hash.result();
+    return result;
+}
@@ -0,0 +1,88 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef SESSIONPLAYER_H
+#define SESSIONPLAYER_H
+
+#include <atomic>
+#include <vector>
+#include <QObject>
+#include <QPointer>
+#include <QThread>
+#include "sessionrecorder.h"
+#include "rendermetrics.h"
+
+class EncodePipeline;
+
+/**
+ * Replays a session log written by SessionRecorder, either in real time
+ * into the engine of a running SynthRenderer, or offline, rendering the
+ * audio as fast as possible with every event applied at the synthesis
+ * block containing its timestamp. The offline rendering is deterministic,
+ * so its output hash identifies the audio produced by the session.
+ */
+class SessionPlayer : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Event {
+        qint64 nsecs;
+        MidiEvent event;
+    };
+
+    struct Result {
+        quint64 frames = 0;
+        int sampleRate = 0;
+        qint64 renderNsecs = 0;
+        RenderMetrics::Summary load;
+        QByteArray hash;
+
+        QString report() const;
+    };
+
+    explicit SessionPlayer(QObject *parent = nullptr);
+    virtual ~SessionPlayer();
+
+    bool load(const QString &fileName);
+    const SessionSettings &settings() const;
+    int eventCount() const;
+    qint64 duration() const;
+
+    void play(SynthEngine *engine);
+    void stop();
+    bool isPlaying() const;
+    Result renderOffline(SynthEngine *engine, EncodePipeline *pipeline = nullptr);
+
+    static const double TAIL_SECONDS;
+    static const double MAX_TAIL_SECONDS;
+
+signals:
+    void finished();
+
+private:
+    void run(SynthEngine *engine);
+
+    SessionSettings m_settings;
+    std::vector<Event> m_events;
+    QPointer<QThread> m_thread;
+    std::atomic<bool> m_quit;
+};
+
+#endif // SESSIONPLAYER_H
@@ -0,0 +1,241 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <QDebug>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QtEndian>
+#include "sessionrecorder.h"
+#include "synthrenderer.h"
+#include "programsettings.h"
+
+const QByteArray SessionRecorder::MAGIC = QByteArrayLiteral("FLSL");
+const quint8 SessionRecorder::VERSION = 1;
+const int SessionRecorder::FLUSH_INTERVAL = 250;
+const size_t SessionRecorder::BUFFER_EVENTS = 65536;
+
+/**
+ * Returns the settings in use: the soundfonts loaded into the renderer,
+ * and the effects and audio buffer from the program settings.
+ */
+SessionSettings SessionSettings::current(const SynthRenderer *renderer)
+{
+    SessionSettings result;
+    result.soundfonts = renderer->soundfonts();
+    result.reverbType = ProgramSettings::instance()->reverbType();
+    result.reverbLevel = ProgramSettings::instance()->reverbLevel();
+    result.chorusType = ProgramSettings::instance()->chorusType();
+    result.chorusLevel = ProgramSettings::instance()->chorusLevel();
+    result.bufferTime = ProgramSettings::instance()->bufferTime();
+    result.sampleRate = renderer->format().sampleRate();
+    result.engineProfile = QString::fromStdString(renderer->engine().profile().name);
+    result.midiDriver = renderer->midiDriver();
+    result.portName = renderer->subscription();
+    result.extraPorts = renderer->extraPorts();
+    return result;
+}
+
+void SessionSettings::apply(SynthEngine *engine) const
+{
+    for (const QString &fileName : soundfonts) {
+        if (!engine->openSoundfont(fileName.toLocal8Bit().toStdString())) {
+            qWarning() << Q_FUNC_INFO << "failed to load" << fileName;
+        }
+    }
+    engine->setReverbLevel(reverbLevel);
+    engine->initReverb(reverbType);
+    engine->setChorusLevel(chorusLevel);
+    engine->initChorus(chorusType);
+}
+
+QByteArray SessionSettings::toJson() const
+{
+    QJsonObject obj;
+    obj["soundfonts"] = QJsonArray::fromStringList(soundfonts);
+    obj["reverb_type"] = reverbType;
+    obj["reverb_level"] = reverbLevel;
+    obj["chorus_type"] = chorusType;
+    obj["chorus_level"] = chorusLevel;
+    obj["buffer_msecs"] = bufferTime;
+    obj["sample_rate"] = sampleRate;
+    obj["engine_profile"] = engineProfile;
+    obj["midi_driver"] = midiDriver;
+    obj["port_name"] = portName;
+    obj["extra_ports"] = QJsonArray::fromStringList(extraPorts);
+    return QJsonDocument(obj).toJson(QJsonDocument::Compact);
+}
+
+SessionSettings SessionSettings::fromJson(const QByteArray &json)
+{
+    SessionSettings result;
+    const QJsonObject obj = QJsonDocument::fromJson(json).object();
+    for (const auto &value : obj["soundfonts"].toArray()) {
+        result.soundfonts << value.toString();
+    }
+    result.reverbType = obj["reverb_type"].toInt();
+    result.reverbLevel = obj["reverb_level"].toInt();
+    result.chorusType = obj["chorus_type"].toInt();
+    result.chorusLevel = obj["chorus_level"].toInt();
+    result.bufferTime = obj["buffer_msecs"].toInt();
+    result.sampleRate = obj["sample_rate"].toInt();
+    result.engineProfile = obj["engine_profile"].toString();
+    result.midiDriver = obj["midi_driver"].toString();
+    result.portName = obj["port_name"].toString();
+    for (const auto &value : obj["extra_ports"].toArray()) {
+        result.extraPorts << value.toString();
+    }
+    return result;
+}
+
+SessionRecorder::SessionRecorder(QObject *parent):
+    QObject(parent),
+    m_pending(unsigned(BUFFER_EVENTS)),
+    m_lastTime(0),
+    m_recorded(0),
+    m_lost(0),
+    m_reportedLost(0),
+    m_recording(false)
+{
+    connect(&m_timer, &QTimer::timeout, this, &SessionRecorder::flush);
+}
+
+SessionRecorder::~SessionRecorder()
+{
+    stop();
+}
+
+bool SessionRecorder::start(const QString &fileName, const SessionSettings &settings)
+{
+    //qDebug() << Q_FUNC_INFO << fileName;
+    stop();
+    m_file.setFileName(fileName);
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << Q_FUNC_INFO << m_file.errorString();
+        return false;
+    }
+    const QByteArray json = settings.toJson();
+    uchar length[4];
+    qToLittleEndian<quint32>(json.size(), length);
+    m_file.write(MAGIC);
+    m_file.write(reinterpret_cast<const char *>(&VERSION), 1);
+    m_file.write(reinterpret_cast<const char *>(length), sizeof(length));
+    m_file.write(json);
+    Record record;
+    while (m_pending.pop(record)) {
+    }
+    m_lastTime = 0;
+    m_recorded = 0;
+    m_lost = 0;
+    m_reportedLost = 0;
+    m_clock.start();
+    m_recording.store(true, std::memory_order_release);
+    m_timer.start(FLUSH_INTERVAL);
+    return true;
+}
+
+void SessionRecorder::stop()
+{
+    if (!m_file.isOpen()) {
+        return;
+    }
+    m_recording.store(false, std::memory_order_release);
+    m_timer.stop();
+    flush();
+    m_file.close();
+}
+
+bool SessionRecorder::isRecording() const
+{
+    return m_file.isOpen();
+}
+
+quint64 SessionRecorder::recordedEvents() const
+{
+    return m_recorded;
+}
+
+/**
+ * Events lost because the ring was full when they arrived.
+ */
+quint64 SessionRecorder::lostEvents() const
+{
+    return m_lost;
+}
+
+/**
+ * Called by SynthEngine::postEvent() from any thread, without locking or
+ * allocating. When the ring is full, the event is counted and lost.
+ */
+void SessionRecorder::eventPosted(const MidiEvent &ev)
+{
+    if (!m_recording.load(std::memory_order_acquire)) {
+        return;
+    }
+    if (m_pending.push({m_clock.nsecsElapsed(), ev})) {
+        ++m_recorded;
+    } else {
+        ++m_lost;
+    }
+}
+
+static void appendVarint(QByteArray &out, quint64 value)
+{
+    while (value >= 0x80) {
+        out.append(char((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.append(char(value));
+}
+
+static void appendInt16(QByteArray &out, qint16 value)
+{
+    uchar bytes[2];
+    qToLittleEndian<qint16>(value, bytes);
+    out.append(reinterpret_cast<const char *>(bytes), sizeof(bytes));
+}
+
+/**
+ * Writes the pending records. Threads posting at the same time may push
+ * their records slightly out of time order: those get a zero delta.
+ */
+void SessionRecorder::flush()
+{
+    const quint64 lost = m_lost;
+    if (lost != m_reportedLost) {
+        qWarning() << Q_FUNC_INFO << "session log ring overflow:" << lost - m_reportedLost << "events lost";
+        m_reportedLost = lost;
+    }
+    QByteArray out;
+    Record record;
+    while (m_pending.pop(record)) {
+        appendVarint(out, quint64(qMax<qint64>(record.nsecs - m_lastTime, 0)));
+        out.append(char(record.event.type));
+        out.append(char(record.event.chan));
+        appendInt16(out, record.event.param1);
+        appendInt16(out, record.event.param2);
+        m_lastTime = qMax(m_lastTime, record.nsecs);
+    }
+    if (out.isEmpty()) {
+        return;
+    }
+    if (m_file.write(out) != out.size()) {
+        qWarning() << Q_FUNC_INFO << m_file.errorString();
+    }
+}
@@ -0,0 +1,115 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef SESSIONRECORDER_H
+#define SESSIONRECORDER_H
+
+#include <atomic>
+#include <QObject>
+#include <QFile>
+#include <QTimer>
+#include <QStringList>
+#include <QElapsedTimer>
+#include "synthengine.h"
+#include "eventqueue.h"
+
+class SynthRenderer;
+
+/**
+ * The synthesizer settings stored at the beginning of a session log, and
+ * applied to a synthesis engine before replaying it.
+ */
+struct SessionSettings
+{
+    QStringList soundfonts;
+    int reverbType = 0;
+    int reverbLevel = 0;
+    int chorusType = 0;
+    int chorusLevel = 0;
+    int bufferTime = 0;
+    int sampleRate = 0;
+    QString engineProfile;
+    QString midiDriver;
+    QString portName;
+    QStringList extraPorts;
+
+    static SessionSettings current(const SynthRenderer *renderer);
+    void apply(SynthEngine *engine) const;
+    QByteArray toJson() const;
+    static SessionSettings fromJson(const QByteArray &json);
+};
+
+/**
+ * Writes every MIDI event posted to a SynthEngine into a compact binary
+ * session log, with the nanoseconds elapsed since the previous event. The
+ * log starts with a header and the session settings in JSON:
+ *
+ *   "FLSL" | version (1 byte) | settings length (4 bytes) | settings
+ *
+ * followed by one record per event:
+ *
+ *   delta time (LEB128) | type | channel | param1 (2 bytes) | param2 (2 bytes)
+ *
+ * Multi-byte integers are little endian. The MIDI threads only push the
+ * events into a lock-free ring, which is written to the file by a timer.
+ * Events arriving while the ring is full are counted and lost.
+ */
+class SessionRecorder : public QObject, public EventObserver
+{
+    Q_OBJECT
+
+public:
+    explicit SessionRecorder(QObject *parent = nullptr);
+    virtual ~SessionRecorder();
+
+    bool start(const QString &fileName, const SessionSettings &settings);
+    void stop();
+    bool isRecording() const;
+    quint64 recordedEvents() const;
+    quint64 lostEvents() const;
+
+    /* EventObserver, any thread */
+    void eventPosted(const MidiEvent &ev) override;
+
+    static const QByteArray MAGIC;
+    static const quint8 VERSION;
+    static const int FLUSH_INTERVAL;
+    static const size_t BUFFER_EVENTS;
+
+private slots:
+    void flush();
+
+private:
+    struct Record {
+        qint64 nsecs;
+        MidiEvent event;
+    };
+
+    QFile m_file;
+    QTimer m_timer;
+    QElapsedTimer m_clock;
+    LockFreeQueue<Record> m_pending;
+    qint64 m_lastTime;
+    std::atomic<quint64> m_recorded;
+    std::atomic<quint64> m_lost;
+    quint64 m_reportedLost;
+    std::atomic<bool> m_recording;
+};
+
+#endif // SESSIONRECORDER_H
@@ -0,0 +1,159 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cstring>
+#include <limits>
+#include <QDebug>
+#include "sinkfeeder.h"
+#include "tracer.h"
+
+const int SinkFeeder::FADE_FRAMES = 512;
+
+SinkFeeder::SinkFeeder(SynthRenderer *renderer, State initial, QObject *parent):
+    QIODevice(parent),
+    m_renderer(renderer),
+    m_channels(renderer->format().channelCount()),
+    m_fadePosition(FADE_FRAMES),
+    m_state(initial),
+    m_next(nullptr),
+    m_primed(false),
+    m_delivered(0)
+{ }
+
+qint64 SinkFeeder::readData(char *data, qint64 maxlen)
+{
+    const qint64 frameBytes = m_channels * sizeof(float);
+    SinkFeeder *next = m_next.load(std::memory_order_acquire);
+    if (next != nullptr && m_state.load(std::memory_order_relaxed) == Driving) {
+        // the last block of this output fades out, and the next output
+        // continues the synth timeline from the following block
+        qint64 len = m_renderer->render(data, qMin(maxlen, FADE_FRAMES * frameBytes));
+        ramp(reinterpret_cast<float *>(data), len / frameBytes, false);
+        Tracer::instant("audio", "hand over", len, len / frameBytes);
+        m_state.store(Retired, std::memory_order_relaxed);
+        next->m_fadePosition = 0;
+        next->m_state.store(Driving, std::memory_order_release);
+        m_delivered += len;
+        return len;
+    }
+    switch (m_state.load(std::memory_order_acquire)) {
+    case Driving: {
+        qint64 len = m_renderer->render(data, maxlen);
+        if (m_fadePosition < FADE_FRAMES) {
+            ramp(reinterpret_cast<float *>(data), len / frameBytes, true);
+        }
+        m_delivered += len;
+        return len;
+    }
+    case Priming:
+        m_primed.store(true, std::memory_order_release);
+        /* fall through */
+    default:
+        std::memset(data, 0, maxlen);
+        m_delivered += maxlen;
+        return maxlen;
+    }
+}
+
+qint64 SinkFeeder::writeData(const char *data, qint64 len)
+{
+    Q_UNUSED(data);
+    Q_UNUSED(len);
+    return 0;
+}
+
+qint64 SinkFeeder::size() const
+{
+    return std::numeric_limits<qint64>::max();
+}
+
+qint64 SinkFeeder::bytesAvailable() const
+{
+    return std::numeric_limits<qint64>::max();
+}
+
+void SinkFeeder::start()
+{
+    open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+}
+
+void SinkFeeder::stop()
+{
+    if (isOpen()) {
+        close();
+    }
+}
+
+quint64 SinkFeeder::deliveredBytes() const
+{
+    return m_delivered.load(std::memory_order_relaxed);
+}
+
+SinkFeeder::State SinkFeeder::state() const
+{
+    return static_cast<State>(m_state.load(std::memory_order_acquire));
+}
+
+/**
+ * True once the audio output has started reading this feeder.
+ */
+bool SinkFeeder::isPrimed() const
+{
+    return m_primed.load(std::memory_order_acquire);
+}
+
+/**
+ * Requests the driving feeder to pass the synth to the next one
+ * at its next block boundary, in the audio thread.
+ */
+void SinkFeeder::handOverTo(SinkFeeder *next)
+{
+    //qDebug() << Q_FUNC_INFO;
+    m_next.store(next, std::memory_order_release);
+}
+
+/**
+ * Starts driving without a hand over. The previous feeder must be already
+ * stopped, because it didn't reach a block boundary in time.
+ */
+void SinkFeeder::takeOver()
+{
+    //qDebug() << Q_FUNC_INFO;
+    if (m_state.load(std::memory_order_acquire) == Priming) {
+        m_fadePosition = 0;
+        m_state.store(Driving, std::memory_order_release);
+    }
+}
+
+void SinkFeeder::ramp(float *buffer, qint64 frames, bool fadeIn)
+{
+    for (qint64 frame = 0; frame < frames; ++frame) {
+        float gain;
+        if (fadeIn) {
+            if (m_fadePosition >= FADE_FRAMES) {
+                break;
+            }
+            gain = float(m_fadePosition++) / FADE_FRAMES;
+        } else {
+            gain = 1.0f - float(frame + 1) / frames;
+        }
+        for (int chan = 0; chan < m_channels; ++chan) {
+            *buffer++ *= gain;
+        }
+    }
+}
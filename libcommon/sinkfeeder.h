@@ -0,0 +1,76 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SINKFEEDER_H
+#define SINKFEEDER_H
+
+#include <atomic>
+#include <QIODevice>
+#include "synthrenderer.h"
+
+/**
+ * The device read by one audio output. Only the driving feeder renders
+ * audio from the synth; a priming feeder outputs silence until the driving
+ * one hands the synth over at a block boundary. The two outputs are not
+ * mixed: the old one fades out its last block, then the new one fades in
+ * from the following block. The synth state is never reset. Nothing is
+ * signalled from the audio thread; the controller polls isPrimed() and
+ * state() instead.
+ */
+class SinkFeeder : public QIODevice
+{
+    Q_OBJECT
+
+public:
+    enum State {
+        Priming,
+        Driving,
+        Retired
+    };
+
+    explicit SinkFeeder(SynthRenderer *renderer, State initial, QObject *parent = nullptr);
+
+    /* QIODevice */
+    qint64 readData(char *data, qint64 maxlen) override;
+    qint64 writeData(const char *data, qint64 len) override;
+    qint64 size() const override;
+    qint64 bytesAvailable() const override;
+
+    void start();
+    void stop();
+    State state() const;
+    bool isPrimed() const;
+    void handOverTo(SinkFeeder *next);
+    void takeOver();
+    quint64 deliveredBytes() const;
+
+    static const int FADE_FRAMES;
+
+private:
+    void ramp(float *buffer, qint64 frames, bool fadeIn);
+
+    SynthRenderer *m_renderer;
+    int m_channels;
+    int m_fadePosition;
+    std::atomic<int> m_state;
+    std::atomic<SinkFeeder*> m_next;
+    std::atomic<bool> m_primed;
+    std::atomic<quint64> m_delivered;
+};
+
+#endif // SINKFEEDER_H
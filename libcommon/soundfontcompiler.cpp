@@ -0,0 +1,520 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <algorithm>
+#include <cstring>
+#include <QSaveFile>
+#include <QtEndian>
+#include "soundfontcompiler.h"
+
+#if defined(VORBIS_SUPPORT)
+#include <vorbis/vorbisfile.h>
+#endif
+
+static const quint16 GEN_INSTRUMENT = 41;
+static const quint16 GEN_KEY_RANGE = 43;
+static const quint16 GEN_VELOCITY_RANGE = 44;
+static const quint16 GEN_SAMPLE_ID = 53;
+static const quint16 LAST_VALID_GENERATOR = 58;
+static const quint16 UNUSED_GENERATORS[] = {14, 18, 19, 20, 42, 49, 55};
+// sample offsets, key and velocity overrides, sample modes and exclusive class
+static const quint16 INSTRUMENT_GENERATORS[] = {0, 1, 2, 3, 4, 12, 45, 46, 47, 50, 54, 57, 58};
+static const quint16 SAMPLE_COMPRESSED = 0x10;
+static const quint16 SAMPLE_ROM = 0x8000;
+static const int MIN_SAMPLE_FRAMES = 8;
+
+static quint16 u16(const QByteArray &data, int offset)
+{
+    return qFromLittleEndian<quint16>(data.constData() + offset);
+}
+
+static quint32 u32(const QByteArray &data, int offset)
+{
+    return qFromLittleEndian<quint32>(data.constData() + offset);
+}
+
+template <size_t N>
+static bool listed(const quint16 (&list)[N], quint16 value)
+{
+    return std::find(list, list + N, value) != list + N;
+}
+
+/**
+ * Converts a SoundFont modulator source to FluidLite's index and flags.
+ */
+static void convertSource(quint16 source, uint8_t &index, uint8_t &flags, double &amount)
+{
+    index = uint8_t(source & 127);
+    flags = uint8_t(((source & (1 << 7)) ? FLUID_MOD_CC : FLUID_MOD_GC)
+                    | ((source & (1 << 8)) ? FLUID_MOD_NEGATIVE : FLUID_MOD_POSITIVE)
+                    | ((source & (1 << 9)) ? FLUID_MOD_BIPOLAR : FLUID_MOD_UNIPOLAR));
+    switch (source >> 10) {
+    case 0:
+        flags |= FLUID_MOD_LINEAR;
+        break;
+    case 1:
+        flags |= FLUID_MOD_CONCAVE;
+        break;
+    case 2:
+        flags |= FLUID_MOD_CONVEX;
+        break;
+    case 3:
+        flags |= FLUID_MOD_SWITCH;
+        break;
+    default:
+        // unknown curves disable the modulator
+        amount = 0;
+    }
+}
+
+static bool identical(const SoundfontImageModulator &a, const SoundfontImageModulator &b)
+{
+    return a.destination == b.destination && a.source1 == b.source1 && a.flags1 == b.flags1
+            && a.source2 == b.source2 && a.flags2 == b.flags2;
+}
+
+static void addModulator(QVector<SoundfontImageModulator> &list, const SoundfontImageModulator &mod)
+{
+    for (int i = 0; i < list.size(); ++i) {
+        if (identical(list[i], mod)) {
+            list.remove(i);
+            break;
+        }
+    }
+    list << mod;
+}
+
+static void copyName(char *target, size_t size, const QByteArray &name)
+{
+    std::memset(target, 0, size);
+    std::strncpy(target, name.constData(), size - 1);
+}
+
+#if defined(VORBIS_SUPPORT)
+struct VorbisStream {
+    const char *data;
+    size_t size;
+    size_t position;
+};
+
+static size_t vorbisRead(void *ptr, size_t size, size_t count, void *source)
+{
+    VorbisStream *stream = static_cast<VorbisStream *>(source);
+    const size_t bytes = std::min(size * count, stream->size - stream->position);
+    std::memcpy(ptr, stream->data + stream->position, bytes);
+    stream->position += bytes;
+    return size > 0 ? bytes / size : 0;
+}
+
+static int vorbisSeek(void *source, ogg_int64_t offset, int whence)
+{
+    VorbisStream *stream = static_cast<VorbisStream *>(source);
+    const ogg_int64_t base = whence == SEEK_CUR ? ogg_int64_t(stream->position)
+                           : whence == SEEK_END ? ogg_int64_t(stream->size) : 0;
+    if (base + offset < 0 || base + offset > ogg_int64_t(stream->size)) {
+        return -1;
+    }
+    stream->position = size_t(base + offset);
+    return 0;
+}
+
+static long vorbisTell(void *source)
+{
+    return long(static_cast<VorbisStream *>(source)->position);
+}
+
+/**
+ * Decodes a compressed SoundFont 3 sample, a mono Ogg Vorbis stream.
+ */
+static bool decodeVorbis(const QByteArray &ogg, QVector<qint16> &frames)
+{
+    VorbisStream stream = {ogg.constData(), size_t(ogg.size()), 0};
+    ov_callbacks callbacks = {vorbisRead, vorbisSeek, nullptr, vorbisTell};
+    OggVorbis_File file;
+    if (ov_open_callbacks(&stream, &file, nullptr, 0, callbacks) != 0) {
+        return false;
+    }
+    bool ok = ov_info(&file, -1)->channels == 1;
+    char buffer[4096];
+    int section;
+    long bytes;
+    while (ok && (bytes = ov_read(&file, buffer, sizeof(buffer), Q_BYTE_ORDER == Q_BIG_ENDIAN, 2, 1, &section)) != 0) {
+        if (bytes < 0) {
+            ok = false;
+            break;
+        }
+        const int first = frames.size();
+        frames.resize(first + int(bytes / 2));
+        std::memcpy(frames.data() + first, buffer, size_t(bytes / 2) * 2);
+    }
+    ov_clear(&file);
+    return ok;
+}
+#endif
+
+bool SoundfontCompiler::canDecompress()
+{
+#if defined(VORBIS_SUPPORT)
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool SoundfontCompiler::fail(const QString &error)
+{
+    m_error = error;
+    return false;
+}
+
+const QString &SoundfontCompiler::errorString() const
+{
+    return m_error;
+}
+
+int SoundfontCompiler::presetCount() const
+{
+    return m_presets.size();
+}
+
+int SoundfontCompiler::zoneCount() const
+{
+    return m_zones.size();
+}
+
+int SoundfontCompiler::sampleCount() const
+{
+    return m_samples.size();
+}
+
+qint64 SoundfontCompiler::imageBytes() const
+{
+    return m_imageBytes;
+}
+
+/**
+ * Reads the zones between two bags, following the rules of the FluidLite
+ * SoundFont loader: the ranges must come first and the target last, and
+ * only the first zone may lack a target, being the global zone.
+ */
+SoundfontCompiler::ZoneList SoundfontCompiler::readZones(const QByteArray &bags, const QByteArray &gens, const QByteArray &mods,
+                                                         int firstBag, int lastBag, quint16 targetGenerator, int targets, bool presetLevel) const
+{
+    ZoneList result;
+    const int bagCount = bags.size() / SoundfontFile::BAG_SIZE;
+    const int genCount = gens.size() / SoundfontFile::GEN_SIZE;
+    const int modCount = mods.size() / SoundfontFile::MOD_SIZE;
+    lastBag = qMin(lastBag, bagCount - 1);
+    for (int b = firstBag; b < lastBag; ++b) {
+        Zone zone;
+        int level = 0;
+        bool hasTarget = false;
+        const int lastGen = qMin<int>(u16(bags, (b + 1) * SoundfontFile::BAG_SIZE), genCount);
+        for (int g = u16(bags, b * SoundfontFile::BAG_SIZE); g < lastGen && !hasTarget; ++g) {
+            const quint16 op = u16(gens, g * SoundfontFile::GEN_SIZE);
+            const quint16 amount = u16(gens, g * SoundfontFile::GEN_SIZE + 2);
+            if (op == GEN_KEY_RANGE) {
+                if (level == 0) {
+                    zone.keyLow = amount & 0xff;
+                    zone.keyHigh = amount >> 8;
+                }
+                level = qMax(level, 1);
+            } else if (op == GEN_VELOCITY_RANGE) {
+                if (level <= 1) {
+                    zone.velocityLow = amount & 0xff;
+                    zone.velocityHigh = amount >> 8;
+                }
+                level = 2;
+            } else if (op == targetGenerator) {
+                zone.target = amount < targets ? amount : -1;
+                hasTarget = true;
+            } else {
+                level = 2;
+                if (op <= LAST_VALID_GENERATOR && op != GEN_INSTRUMENT && op != GEN_SAMPLE_ID
+                        && !listed(UNUSED_GENERATORS, op) && !(presetLevel && listed(INSTRUMENT_GENERATORS, op))) {
+                    zone.values[op] = float(qint16(amount));
+                    zone.generators |= Q_UINT64_C(1) << op;
+                }
+            }
+        }
+        const int lastMod = qMin<int>(u16(bags, (b + 1) * SoundfontFile::BAG_SIZE + 2), modCount);
+        for (int m = u16(bags, b * SoundfontFile::BAG_SIZE + 2); m < lastMod; ++m) {
+            const int offset = m * SoundfontFile::MOD_SIZE;
+            SoundfontImageModulator mod = {};
+            const quint16 destination = u16(mods, offset + 2);
+            if (destination >= SoundfontImageZone::GENERATORS) {
+                // linked modulators are not supported
+                continue;
+            }
+            mod.destination = uint8_t(destination);
+            mod.amount = qint16(u16(mods, offset + 4));
+            convertSource(u16(mods, offset), mod.source1, mod.flags1, mod.amount);
+            convertSource(u16(mods, offset + 6), mod.source2, mod.flags2, mod.amount);
+            if (u16(mods, offset + 8) != 0) {
+                // only the linear transform is defined
+                mod.amount = 0;
+            }
+            addModulator(zone.modulators, mod);
+        }
+        if (hasTarget) {
+            if (zone.target >= 0) {
+                result.zones << zone;
+            }
+        } else if (b == firstBag) {
+            result.global = zone;
+        }
+    }
+    return result;
+}
+
+/**
+ * Appends a sample to the image data, decoded and followed by the silent
+ * padding, and returns its index in the image or -1 when FluidLite would
+ * not play it.
+ */
+int SoundfontCompiler::addSample(int index)
+{
+    auto known = m_sampleIndex.constFind(index);
+    if (known != m_sampleIndex.constEnd()) {
+        return known.value();
+    }
+    m_sampleIndex.insert(index, -1);
+    const QByteArray record = m_file.m_shdr.mid(index * SoundfontFile::SHDR_SIZE, SoundfontFile::SHDR_SIZE);
+    const quint16 type = u16(record, 44);
+    const quint32 start = u32(record, 20);
+    const quint32 end = qMax(start, u32(record, 24));
+    qint64 loopStart = u32(record, 28);
+    qint64 loopEnd = u32(record, 32);
+    if ((type & SAMPLE_ROM) != 0) {
+        return -1;
+    }
+    QVector<qint16> frames;
+    if ((type & SAMPLE_COMPRESSED) != 0) {
+        // the loop points are already relative to the sample
+        if (end > m_file.m_smplSize) {
+            fail("compressed sample data out of range");
+            return -1;
+        }
+        m_source.seek(m_file.m_smplOffset + start);
+#if defined(VORBIS_SUPPORT)
+        if (!decodeVorbis(m_source.read(end - start), frames)) {
+            fail("unable to decode a compressed sample");
+            return -1;
+        }
+#else
+        fail("compressed samples need Ogg Vorbis support");
+        return -1;
+#endif
+    } else {
+        if (qint64(end) * 2 > m_file.m_smplSize) {
+            fail("sample data out of range");
+            return -1;
+        }
+        m_source.seek(m_file.m_smplOffset + qint64(start) * 2);
+        const QByteArray data = m_source.read(qint64(end - start) * 2);
+        frames.resize(data.size() / 2);
+        for (int i = 0; i < frames.size(); ++i) {
+            frames[i] = qint16(u16(data, i * 2));
+        }
+        loopStart -= start;
+        loopEnd -= start;
+    }
+    const int count = frames.size();
+    if (count < MIN_SAMPLE_FRAMES) {
+        return -1;
+    }
+    if (loopEnd > count || loopStart >= loopEnd || loopStart <= 0) {
+        // FluidLite replaces the broken loops
+        loopStart = count >= 20 ? 8 : 1;
+        loopEnd = count >= 20 ? count - 8 : count - 1;
+    }
+    SoundfontImageSample sample = {};
+    copyName(sample.name, sizeof(sample.name), record.left(20));
+    const quint32 first = quint32(m_data.size());
+    sample.start = first;
+    sample.end = first + quint32(count) - 1;
+    sample.loopStart = first + quint32(loopStart);
+    sample.loopEnd = first + quint32(loopEnd);
+    sample.sampleRate = u32(record, 36);
+    sample.originalPitch = quint8(record.at(40));
+    sample.pitchCorrection = qint8(record.at(41));
+    sample.sampleType = type & ~SAMPLE_COMPRESSED;
+    m_data += frames;
+    m_data.resize(m_data.size() + SoundfontImageSample::PADDING);
+    m_samples << sample;
+    m_sampleIndex.insert(index, m_samples.size() - 1);
+    return m_samples.size() - 1;
+}
+
+/**
+ * Appends the modulators of a zone, those of the local zone replacing the
+ * identical ones of the global zone, and returns the first one.
+ */
+quint32 SoundfontCompiler::addModulators(const QVector<SoundfontImageModulator> &global,
+                                         const QVector<SoundfontImageModulator> &local)
+{
+    QVector<SoundfontImageModulator> list = global;
+    for (const SoundfontImageModulator &mod : local) {
+        addModulator(list, mod);
+    }
+    const quint32 first = quint32(m_modulators.size());
+    m_modulators += list;
+    return first;
+}
+
+bool SoundfontCompiler::compile(const QString &inputFile, const QString &outputFile)
+{
+    m_presets.clear();
+    m_zones.clear();
+    m_modulators.clear();
+    m_samples.clear();
+    m_data.clear();
+    m_sampleIndex.clear();
+    m_imageBytes = 0;
+    m_error.clear();
+    if (!m_file.read(inputFile)) {
+        return fail(m_file.errorString());
+    }
+    m_source.close();
+    m_source.setFileName(inputFile);
+    if (!m_source.open(QIODevice::ReadOnly)) {
+        return fail(m_source.errorString());
+    }
+    const int instrumentCount = m_file.m_inst.size() / SoundfontFile::INST_SIZE - 1;
+    const int sampleCount = m_file.m_shdr.size() / SoundfontFile::SHDR_SIZE - 1;
+    QVector<ZoneList> instruments;
+    for (int i = 0; i < instrumentCount; ++i) {
+        instruments << readZones(m_file.m_ibag, m_file.m_igen, m_file.m_imod,
+                                 u16(m_file.m_inst, i * SoundfontFile::INST_SIZE + 20),
+                                 u16(m_file.m_inst, (i + 1) * SoundfontFile::INST_SIZE + 20),
+                                 GEN_SAMPLE_ID, sampleCount, false);
+    }
+    // the first of the presets with the same numbers is used
+    QVector<int> order;
+    for (int i = 0; i < m_file.m_presets.size(); ++i) {
+        order << i;
+    }
+    std::stable_sort(order.begin(), order.end(), [this](int a, int b) {
+        const SoundfontFile::Preset &pa = m_file.m_presets[a];
+        const SoundfontFile::Preset &pb = m_file.m_presets[b];
+        return pa.bank < pb.bank || (pa.bank == pb.bank && pa.program < pb.program);
+    });
+    for (int index : order) {
+        const SoundfontFile::Preset &p = m_file.m_presets[index];
+        if (!m_presets.isEmpty() && int(m_presets.last().bank) == p.bank && int(m_presets.last().program) == p.program) {
+            continue;
+        }
+        SoundfontImagePreset preset = {};
+        copyName(preset.name, sizeof(preset.name), m_file.m_phdr.mid(index * SoundfontFile::PHDR_SIZE, 20));
+        preset.bank = quint32(p.bank);
+        preset.program = quint32(p.program);
+        preset.firstZone = quint32(m_zones.size());
+        const ZoneList presetZones = readZones(m_file.m_pbag, m_file.m_pgen, m_file.m_pmod,
+                                               u16(m_file.m_phdr, index * SoundfontFile::PHDR_SIZE + 24),
+                                               u16(m_file.m_phdr, (index + 1) * SoundfontFile::PHDR_SIZE + 24),
+                                               GEN_INSTRUMENT, instrumentCount, true);
+        for (const Zone &pz : presetZones.zones) {
+            const ZoneList &instrument = instruments[pz.target];
+            const quint32 presetModulators = addModulators(presetZones.global.modulators, pz.modulators);
+            const quint32 presetModulatorCount = quint32(m_modulators.size()) - presetModulators;
+            for (const Zone &iz : instrument.zones) {
+                const int sample = addSample(iz.target);
+                if (!m_error.isEmpty()) {
+                    return false;
+                }
+                SoundfontImageZone zone = {};
+                zone.keyLow = uint8_t(qMax(pz.keyLow, iz.keyLow));
+                zone.keyHigh = uint8_t(qMin(pz.keyHigh, iz.keyHigh));
+                zone.velocityLow = uint8_t(qMax(pz.velocityLow, iz.velocityLow));
+                zone.velocityHigh = uint8_t(qMin(pz.velocityHigh, iz.velocityHigh));
+                if (sample < 0 || zone.keyLow > zone.keyHigh || zone.velocityLow > zone.velocityHigh) {
+                    continue;
+                }
+                zone.sample = quint32(sample);
+                for (int gen = 0; gen < SoundfontImageZone::GENERATORS; ++gen) {
+                    const quint64 bit = Q_UINT64_C(1) << gen;
+                    if ((iz.generators | instrument.global.generators) & bit) {
+                        zone.instrument[gen] = (iz.generators & bit) ? iz.values[gen] : instrument.global.values[gen];
+                        zone.instrumentGenerators |= bit;
+                    }
+                    if ((pz.generators | presetZones.global.generators) & bit) {
+                        zone.preset[gen] = (pz.generators & bit) ? pz.values[gen] : presetZones.global.values[gen];
+                        zone.presetGenerators |= bit;
+                    }
+                }
+                zone.firstInstrumentModulator = addModulators(instrument.global.modulators, iz.modulators);
+                zone.instrumentModulators = quint16(quint32(m_modulators.size()) - zone.firstInstrumentModulator);
+                zone.firstPresetModulator = presetModulators;
+                zone.presetModulators = quint16(presetModulatorCount);
+                m_zones << zone;
+            }
+        }
+        preset.zoneCount = quint32(m_zones.size()) - preset.firstZone;
+        m_presets << preset;
+    }
+    return writeImage(outputFile);
+}
+
+static qint64 aligned(qint64 offset)
+{
+    const qint64 alignment = SoundfontImageHeader::ALIGNMENT;
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+static bool writeSection(QSaveFile &file, const void *data, qint64 bytes, qint64 offset)
+{
+    if (file.pos() < offset && file.write(QByteArray(int(offset - file.pos()), '\0')) < 0) {
+        return false;
+    }
+    return bytes == 0 || file.write(static_cast<const char *>(data), bytes) == bytes;
+}
+
+bool SoundfontCompiler::writeImage(const QString &outputFile)
+{
+    SoundfontImageHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, SoundfontImageHeader::MAGIC, sizeof(header.magic));
+    header.version = SoundfontImageHeader::VERSION;
+    header.byteOrder = SoundfontImageHeader::BYTE_ORDER_MARK;
+    copyName(header.name, sizeof(header.name), m_file.name().toUtf8());
+    header.presetCount = quint32(m_presets.size());
+    header.zoneCount = quint32(m_zones.size());
+    header.modulatorCount = quint32(m_modulators.size());
+    header.sampleCount = quint32(m_samples.size());
+    header.dataFrames = quint64(m_data.size());
+    header.presetOffset = quint64(aligned(sizeof(header)));
+    header.zoneOffset = quint64(aligned(header.presetOffset + m_presets.size() * sizeof(SoundfontImagePreset)));
+    header.modulatorOffset = quint64(aligned(header.zoneOffset + m_zones.size() * sizeof(SoundfontImageZone)));
+    header.sampleOffset = quint64(aligned(header.modulatorOffset + m_modulators.size() * sizeof(SoundfontImageModulator)));
+    header.dataOffset = quint64(aligned(header.sampleOffset + m_samples.size() * sizeof(SoundfontImageSample)));
+    header.fileBytes = header.dataOffset + header.dataFrames * sizeof(qint16);
+    QSaveFile file(outputFile);
+    if (!file.open(QIODevice::WriteOnly)
+            || !writeSection(file, &header, sizeof(header), 0)
+            || !writeSection(file, m_presets.constData(), m_presets.size() * sizeof(SoundfontImagePreset), header.presetOffset)
+            || !writeSection(file, m_zones.constData(), m_zones.size() * sizeof(SoundfontImageZone), header.zoneOffset)
+            || !writeSection(file, m_modulators.constData(), m_modulators.size() * sizeof(SoundfontImageModulator), header.modulatorOffset)
+            || !writeSection(file, m_samples.constData(), m_samples.size() * sizeof(SoundfontImageSample), header.sampleOffset)
+            || !writeSection(file, m_data.constData(), m_data.size() * sizeof(qint16), header.dataOffset)
+            || !file.commit()) {
+        return fail(file.errorString());
+    }
+    m_imageBytes = qint64(header.fileBytes);
+    return true;
+}
@@ -0,0 +1,84 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef SOUNDFONTCOMPILER_H
+#define SOUNDFONTCOMPILER_H
+
+#include <QString>
+#include <QVector>
+#include <QHash>
+#include <QFile>
+#include "soundfontfile.h"
+#include "soundfontimage.h"
+
+/**
+ * Compiles a SoundFont 2 or 3 file into a soundfont image: the preset and
+ * instrument zones are resolved like FluidLite does when a note starts,
+ * and the samples used by them decoded into 16-bit PCM with FluidLite's
+ * loop corrections. Compressed samples need Ogg Vorbis support.
+ */
+class SoundfontCompiler
+{
+public:
+    bool compile(const QString &inputFile, const QString &outputFile);
+    const QString &errorString() const;
+    int presetCount() const;
+    int zoneCount() const;
+    int sampleCount() const;
+    qint64 imageBytes() const;
+
+    static bool canDecompress();
+
+private:
+    struct Zone {
+        int keyLow = 0;
+        int keyHigh = 127;
+        int velocityLow = 0;
+        int velocityHigh = 127;
+        int target = -1;
+        quint64 generators = 0;
+        float values[SoundfontImageZone::GENERATORS] = {};
+        QVector<SoundfontImageModulator> modulators;
+    };
+    struct ZoneList {
+        Zone global;
+        QVector<Zone> zones;
+    };
+
+    ZoneList readZones(const QByteArray &bags, const QByteArray &gens, const QByteArray &mods,
+                       int firstBag, int lastBag, quint16 targetGenerator, int targets, bool presetLevel) const;
+    int addSample(int index);
+    quint32 addModulators(const QVector<SoundfontImageModulator> &global,
+                          const QVector<SoundfontImageModulator> &local);
+    bool writeImage(const QString &outputFile);
+    bool fail(const QString &error);
+
+    SoundfontFile m_file;
+    QString m_error;
+    QFile m_source;
+    QVector<SoundfontImagePreset> m_presets;
+    QVector<SoundfontImageZone> m_zones;
+    QVector<SoundfontImageModulator> m_modulators;
+    QVector<SoundfontImageSample> m_samples;
+    QVector<qint16> m_data;
+    QHash<int, int> m_sampleIndex;
+    qint64 m_imageBytes = 0;
+};
+
+#endif // SOUNDFONTCOMPILER_H
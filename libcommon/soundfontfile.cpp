@@ -0,0 +1,441 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <QFile>
+#include <QSaveFile>
+#include <QtEndian>
+#include "soundfontfile.h"
+
+const int SoundfontFile::PHDR_SIZE = 38;
+const int SoundfontFile::BAG_SIZE = 4;
+const int SoundfontFile::MOD_SIZE = 10;
+const int SoundfontFile::GEN_SIZE = 4;
+const int SoundfontFile::INST_SIZE = 22;
+const int SoundfontFile::SHDR_SIZE = 46;
+const int SoundfontFile::SAMPLE_PADDING = 46;
+
+static const int NAME_SIZE = 20;
+static const quint16 GEN_INSTRUMENT = 41;
+static const quint16 GEN_SAMPLE_ID = 53;
+static const quint16 SAMPLE_MONO = 1;
+static const quint16 SAMPLE_LINKS = 2 | 4 | 8;
+static const quint16 SAMPLE_COMPRESSED = 0x10;
+
+static quint16 u16(const QByteArray &data, int offset)
+{
+    return qFromLittleEndian<quint16>(data.constData() + offset);
+}
+
+static quint32 u32(const QByteArray &data, int offset)
+{
+    return qFromLittleEndian<quint32>(data.constData() + offset);
+}
+
+static void setU16(QByteArray &data, int offset, quint16 value)
+{
+    qToLittleEndian(value, data.data() + offset);
+}
+
+static void setU32(QByteArray &data, int offset, quint32 value)
+{
+    qToLittleEndian(value, data.data() + offset);
+}
+
+static QString zeroTerminated(const QByteArray &text)
+{
+    const int end = text.indexOf('\0');
+    return QString::fromLatin1(end < 0 ? text : text.left(end)).trimmed();
+}
+
+static QString recordName(const QByteArray &data, int offset)
+{
+    return zeroTerminated(data.mid(offset, NAME_SIZE));
+}
+
+static QByteArray chunk(const char *id, const QByteArray &data)
+{
+    QByteArray result(id, 4);
+    char size[4];
+    qToLittleEndian(quint32(data.size()), size);
+    result.append(size, 4);
+    result.append(data);
+    if (data.size() % 2 != 0) {
+        result.append('\0');
+    }
+    return result;
+}
+
+static QByteArray list(const char *type, const QByteArray &chunks)
+{
+    return chunk("LIST", QByteArray(type, 4) + chunks);
+}
+
+static QByteArray terminal(int size, const char *name = nullptr)
+{
+    QByteArray record(size, '\0');
+    if (name != nullptr) {
+        record.replace(0, int(qstrlen(name)), name);
+    }
+    return record;
+}
+
+/**
+ * Reads the INFO and pdta chunks, and the position of the sample data.
+ */
+bool SoundfontFile::read(const QString &fileName)
+{
+    m_fileName = fileName;
+    m_presets.clear();
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return fail(file.errorString());
+    }
+    const QByteArray riff = file.read(12);
+    if (riff.size() < 12 || !riff.startsWith("RIFF") || riff.mid(8, 4) != "sfbk") {
+        return fail("not a SoundFont file");
+    }
+    const qint64 end = qMin<qint64>(file.size(), 8 + qint64(u32(riff, 4)));
+    qint64 pos = 12;
+    while (pos + 12 <= end) {
+        file.seek(pos);
+        const QByteArray header = file.read(12);
+        const qint64 listEnd = pos + 8 + u32(header, 4);
+        if (header.size() < 12 || !header.startsWith("LIST") || listEnd > end) {
+            return fail("corrupt RIFF structure");
+        }
+        const QByteArray type = header.mid(8, 4);
+        qint64 sub = pos + 12;
+        while (sub + 8 <= listEnd) {
+            file.seek(sub);
+            const QByteArray subHeader = file.read(8);
+            const QByteArray id = subHeader.left(4);
+            const qint64 size = u32(subHeader, 4);
+            if (sub + 8 + size > listEnd) {
+                return fail("corrupt RIFF structure");
+            }
+            if (type == "INFO") {
+                if (id == "ifil" && size >= 4) {
+                    const QByteArray version = file.read(4);
+                    m_versionMajor = u16(version, 0);
+                    m_versionMinor = u16(version, 2);
+                } else if (id == "INAM") {
+                    m_name = zeroTerminated(file.read(size));
+                }
+            } else if (type == "sdta") {
+                // the sample data is not read, only located
+                if (id == "smpl") {
+                    m_smplOffset = sub + 8;
+                    m_smplSize = size;
+                }
+            } else if (type == "pdta") {
+                QByteArray *target = id == "phdr" ? &m_phdr : id == "pbag" ? &m_pbag
+                                   : id == "pmod" ? &m_pmod : id == "pgen" ? &m_pgen
+                                   : id == "inst" ? &m_inst : id == "ibag" ? &m_ibag
+                                   : id == "imod" ? &m_imod : id == "igen" ? &m_igen
+                                   : id == "shdr" ? &m_shdr : nullptr;
+                if (target != nullptr) {
+                    *target = file.read(size);
+                }
+            }
+            sub += 8 + size + (size % 2);
+        }
+        pos = listEnd + ((listEnd - pos) % 2);
+    }
+    if (m_phdr.size() < 2 * PHDR_SIZE || m_phdr.size() % PHDR_SIZE != 0
+            || m_pbag.size() % BAG_SIZE != 0 || m_pgen.size() % GEN_SIZE != 0 || m_pmod.size() % MOD_SIZE != 0
+            || m_inst.size() % INST_SIZE != 0 || m_ibag.size() % BAG_SIZE != 0
+            || m_igen.size() % GEN_SIZE != 0 || m_imod.size() % MOD_SIZE != 0
+            || m_shdr.size() % SHDR_SIZE != 0 || m_smplSize == 0) {
+        return fail("missing or corrupt preset data");
+    }
+    if (m_name.isEmpty()) {
+        m_name = fileName.section('/', -1);
+    }
+    const int count = m_phdr.size() / PHDR_SIZE - 1;
+    m_presets.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        Preset preset;
+        preset.name = recordName(m_phdr, i * PHDR_SIZE);
+        preset.program = u16(m_phdr, i * PHDR_SIZE + 20);
+        preset.bank = u16(m_phdr, i * PHDR_SIZE + 22);
+        QVector<int> samples;
+        foreach(int instrument, presetInstruments(i)) {
+            foreach(int sample, instrumentSamples(instrument)) {
+                if (!samples.contains(sample)) {
+                    samples << sample;
+                    preset.sampleBytes += sampleBytes(sample);
+                }
+            }
+        }
+        m_presets << preset;
+    }
+    m_error.clear();
+    return true;
+}
+
+const QString &SoundfontFile::fileName() const
+{
+    return m_fileName;
+}
+
+const QString &SoundfontFile::name() const
+{
+    return m_name;
+}
+
+/**
+ * SoundFont 3 files contain compressed samples.
+ */
+bool SoundfontFile::isCompressed() const
+{
+    return m_versionMajor >= 3;
+}
+
+const QVector<SoundfontFile::Preset> &SoundfontFile::presets() const
+{
+    return m_presets;
+}
+
+const QString &SoundfontFile::errorString() const
+{
+    return m_error;
+}
+
+bool SoundfontFile::fail(const QString &error)
+{
+    m_error = error;
+    return false;
+}
+
+/**
+ * The instruments used by the zones of a preset, without repetitions.
+ */
+QVector<int> SoundfontFile::presetInstruments(int preset) const
+{
+    QVector<int> result;
+    const int bags = m_pbag.size() / BAG_SIZE;
+    const int gens = m_pgen.size() / GEN_SIZE;
+    const int instruments = m_inst.size() / INST_SIZE - 1;
+    const int firstBag = u16(m_phdr, preset * PHDR_SIZE + 24);
+    const int lastBag = qMin<int>(u16(m_phdr, (preset + 1) * PHDR_SIZE + 24), bags - 1);
+    for (int b = firstBag; b < lastBag; ++b) {
+        const int lastGen = qMin<int>(u16(m_pbag, (b + 1) * BAG_SIZE), gens);
+        for (int g = u16(m_pbag, b * BAG_SIZE); g < lastGen; ++g) {
+            if (u16(m_pgen, g * GEN_SIZE) == GEN_INSTRUMENT) {
+                const int instrument = u16(m_pgen, g * GEN_SIZE + 2);
+                if (instrument < instruments && !result.contains(instrument)) {
+                    result << instrument;
+                }
+            }
+        }
+    }
+    return result;
+}
+
+/**
+ * The samples used by the zones of an instrument, without repetitions.
+ */
+QVector<int> SoundfontFile::instrumentSamples(int instrument) const
+{
+    QVector<int> result;
+    const int bags = m_ibag.size() / BAG_SIZE;
+    const int gens = m_igen.size() / GEN_SIZE;
+    const int samples = m_shdr.size() / SHDR_SIZE - 1;
+    const int firstBag = u16(m_inst, instrument * INST_SIZE + 20);
+    const int lastBag = qMin<int>(u16(m_inst, (instrument + 1) * INST_SIZE + 20), bags - 1);
+    for (int b = firstBag; b < lastBag; ++b) {
+        const int lastGen = qMin<int>(u16(m_ibag, (b + 1) * BAG_SIZE), gens);
+        for (int g = u16(m_ibag, b * BAG_SIZE); g < lastGen; ++g) {
+            if (u16(m_igen, g * GEN_SIZE) == GEN_SAMPLE_ID) {
+                const int sample = u16(m_igen, g * GEN_SIZE + 2);
+                if (sample < samples && !result.contains(sample)) {
+                    result << sample;
+                }
+            }
+        }
+    }
+    return result;
+}
+
+quint64 SoundfontFile::sampleBytes(int sample) const
+{
+    const quint32 start = u32(m_shdr, sample * SHDR_SIZE + 20);
+    const quint32 end = u32(m_shdr, sample * SHDR_SIZE + 24);
+    if (end <= start) {
+        return 0;
+    }
+    const bool compressed = (u16(m_shdr, sample * SHDR_SIZE + 44) & SAMPLE_COMPRESSED) != 0;
+    return compressed ? end - start : quint64(end - start) * 2;
+}
+
+/**
+ * Writes a SoundFont with a single preset, its instruments and their
+ * samples, keeping the bank and program numbers. Sample links to samples
+ * left out are removed. Compressed samples are copied as they are.
+ */
+bool SoundfontFile::extractPreset(int bank, int program, const QString &outputFile)
+{
+    int preset = -1;
+    for (int i = 0; i < m_presets.size(); ++i) {
+        if (m_presets[i].bank == bank && m_presets[i].program == program) {
+            preset = i;
+            break;
+        }
+    }
+    if (preset < 0) {
+        return fail(QString("preset %1:%2 not found").arg(bank).arg(program));
+    }
+    QFile source(m_fileName);
+    if (!source.open(QIODevice::ReadOnly)) {
+        return fail(source.errorString());
+    }
+    const QVector<int> instruments = presetInstruments(preset);
+    QVector<int> samples;
+    foreach(int instrument, instruments) {
+        foreach(int sample, instrumentSamples(instrument)) {
+            if (!samples.contains(sample)) {
+                samples << sample;
+            }
+        }
+    }
+
+    QByteArray phdr, pbag, pmod, pgen;
+    phdr = m_phdr.mid(preset * PHDR_SIZE, PHDR_SIZE);
+    setU16(phdr, 24, 0);
+    const int firstBag = u16(m_phdr, preset * PHDR_SIZE + 24);
+    const int lastBag = qMin<int>(u16(m_phdr, (preset + 1) * PHDR_SIZE + 24), m_pbag.size() / BAG_SIZE - 1);
+    for (int b = firstBag; b < lastBag; ++b) {
+        QByteArray bag(BAG_SIZE, '\0');
+        setU16(bag, 0, quint16(pgen.size() / GEN_SIZE));
+        setU16(bag, 2, quint16(pmod.size() / MOD_SIZE));
+        pbag += bag;
+        const int lastGen = qMin<int>(u16(m_pbag, (b + 1) * BAG_SIZE), m_pgen.size() / GEN_SIZE);
+        for (int g = u16(m_pbag, b * BAG_SIZE); g < lastGen; ++g) {
+            QByteArray gen = m_pgen.mid(g * GEN_SIZE, GEN_SIZE);
+            if (u16(gen, 0) == GEN_INSTRUMENT) {
+                setU16(gen, 2, quint16(instruments.indexOf(u16(gen, 2))));
+            }
+            pgen += gen;
+        }
+        const int firstMod = u16(m_pbag, b * BAG_SIZE + 2);
+        pmod += m_pmod.mid(firstMod * MOD_SIZE, qMax(0, u16(m_pbag, (b + 1) * BAG_SIZE + 2) - firstMod) * MOD_SIZE);
+    }
+    QByteArray eop = terminal(PHDR_SIZE, "EOP");
+    setU16(eop, 24, quint16(pbag.size() / BAG_SIZE));
+    phdr += eop;
+    QByteArray bagEnd(BAG_SIZE, '\0');
+    setU16(bagEnd, 0, quint16(pgen.size() / GEN_SIZE));
+    setU16(bagEnd, 2, quint16(pmod.size() / MOD_SIZE));
+    pbag += bagEnd;
+    pmod += terminal(MOD_SIZE);
+    pgen += terminal(GEN_SIZE);
+
+    QByteArray inst, ibag, imod, igen;
+    foreach(int instrument, instruments) {
+        QByteArray record = m_inst.mid(instrument * INST_SIZE, INST_SIZE);
+        setU16(record, 20, quint16(ibag.size() / BAG_SIZE));
+        inst += record;
+        const int last = qMin<int>(u16(m_inst, (instrument + 1) * INST_SIZE + 20), m_ibag.size() / BAG_SIZE - 1);
+        for (int b = u16(m_inst, instrument * INST_SIZE + 20); b < last; ++b) {
+            QByteArray bag(BAG_SIZE, '\0');
+            setU16(bag, 0, quint16(igen.size() / GEN_SIZE));
+            setU16(bag, 2, quint16(imod.size() / MOD_SIZE));
+            ibag += bag;
+            const int lastGen = qMin<int>(u16(m_ibag, (b + 1) * BAG_SIZE), m_igen.size() / GEN_SIZE);
+            for (int g = u16(m_ibag, b * BAG_SIZE); g < lastGen; ++g) {
+                QByteArray gen = m_igen.mid(g * GEN_SIZE, GEN_SIZE);
+                if (u16(gen, 0) == GEN_SAMPLE_ID) {
+                    setU16(gen, 2, quint16(samples.indexOf(u16(gen, 2))));
+                }
+                igen += gen;
+            }
+            const int firstMod = u16(m_ibag, b * BAG_SIZE + 2);
+            imod += m_imod.mid(firstMod * MOD_SIZE, qMax(0, u16(m_ibag, (b + 1) * BAG_SIZE + 2) - firstMod) * MOD_SIZE);
+        }
+    }
+    QByteArray eoi = terminal(INST_SIZE, "EOI");
+    setU16(eoi, 20, quint16(ibag.size() / BAG_SIZE));
+    inst += eoi;
+    setU16(bagEnd, 0, quint16(igen.size() / GEN_SIZE));
+    setU16(bagEnd, 2, quint16(imod.size() / MOD_SIZE));
+    ibag += bagEnd;
+    imod += terminal(MOD_SIZE);
+    igen += terminal(GEN_SIZE);
+
+    QByteArray shdr, smpl;
+    foreach(int sample, samples) {
+        QByteArray record = m_shdr.mid(sample * SHDR_SIZE, SHDR_SIZE);
+        const quint32 start = u32(record, 20);
+        const quint32 end = qMax(start, u32(record, 24));
+        quint16 type = u16(record, 44);
+        const bool compressed = (type & SAMPLE_COMPRESSED) != 0;
+        const qint64 offset = compressed ? start : qint64(start) * 2;
+        const qint64 length = compressed ? end - start : qint64(end - start) * 2;
+        if (offset + length > m_smplSize) {
+            return fail("sample data out of range");
+        }
+        source.seek(m_smplOffset + offset);
+        const QByteArray data = source.read(length);
+        if (data.size() != length) {
+            return fail(source.errorString());
+        }
+        const quint32 newStart = compressed ? quint32(smpl.size()) : quint32(smpl.size() / 2);
+        smpl += data;
+        if (compressed) {
+            // the loop points of compressed samples are relative to them
+            setU32(record, 20, newStart);
+            setU32(record, 24, newStart + quint32(length));
+        } else {
+            smpl += QByteArray(SAMPLE_PADDING * 2, '\0');
+            const qint64 delta = qint64(newStart) - start;
+            for (int field = 20; field <= 32; field += 4) {
+                setU32(record, field, quint32(u32(record, field) + delta));
+            }
+        }
+        const int link = samples.indexOf(u16(record, 42));
+        if ((type & SAMPLE_LINKS) != 0 && link < 0) {
+            type = quint16((type & ~SAMPLE_LINKS) | SAMPLE_MONO);
+            setU16(record, 44, type);
+        }
+        setU16(record, 42, quint16(qMax(link, 0)));
+        shdr += record;
+    }
+    shdr += terminal(SHDR_SIZE, "EOS");
+
+    QByteArray version(4, '\0');
+    setU16(version, 0, m_versionMajor);
+    setU16(version, 2, m_versionMinor);
+    QByteArray name = QString("%1 - %2").arg(m_name, m_presets[preset].name).toLatin1();
+    name.append('\0');
+    const QByteArray body = QByteArray("sfbk")
+            + list("INFO", chunk("ifil", version) + chunk("isng", QByteArray("EMU8000", 8)) + chunk("INAM", name))
+            + list("sdta", chunk("smpl", smpl))
+            + list("pdta", chunk("phdr", phdr) + chunk("pbag", pbag) + chunk("pmod", pmod) + chunk("pgen", pgen)
+                           + chunk("inst", inst) + chunk("ibag", ibag) + chunk("imod", imod) + chunk("igen", igen)
+                           + chunk("shdr", shdr));
+    QSaveFile output(outputFile);
+    if (!output.open(QIODevice::WriteOnly)) {
+        return fail(output.errorString());
+    }
+    output.write(chunk("RIFF", body));
+    if (!output.commit()) {
+        return fail(output.errorString());
+    }
+    return true;
+}
@@ -0,0 +1,87 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef SOUNDFONTFILE_H
+#define SOUNDFONTFILE_H
+
+#include <QString>
+#include <QByteArray>
+#include <QVector>
+
+/**
+ * Reads the preset headers of a SoundFont 2 (or SoundFont 3, with
+ * compressed samples) file without reading its sample data, which is
+ * skipped over, and extracts single presets into new, much smaller files
+ * containing only the instruments and samples they need.
+ */
+class SoundfontFile
+{
+public:
+    struct Preset {
+        QString name;
+        int bank = 0;
+        int program = 0;
+        quint64 sampleBytes = 0;
+    };
+
+    bool read(const QString &fileName);
+    const QString &fileName() const;
+    const QString &name() const;
+    bool isCompressed() const;
+    const QVector<Preset> &presets() const;
+    const QString &errorString() const;
+
+    bool extractPreset(int bank, int program, const QString &outputFile);
+
+    static const int PHDR_SIZE;
+    static const int BAG_SIZE;
+    static const int MOD_SIZE;
+    static const int GEN_SIZE;
+    static const int INST_SIZE;
+    static const int SHDR_SIZE;
+    static const int SAMPLE_PADDING;
+
+private:
+    friend class SoundfontCompiler;
+
+    bool fail(const QString &error);
+    QVector<int> presetInstruments(int preset) const;
+    QVector<int> instrumentSamples(int instrument) const;
+    quint64 sampleBytes(int sample) const;
+
+    QString m_fileName;
+    QString m_name;
+    QString m_error;
+    quint16 m_versionMajor = 0;
+    quint16 m_versionMinor = 0;
+    qint64 m_smplOffset = 0;
+    qint64 m_smplSize = 0;
+    QByteArray m_phdr;
+    QByteArray m_pbag;
+    QByteArray m_pmod;
+    QByteArray m_pgen;
+    QByteArray m_inst;
+    QByteArray m_ibag;
+    QByteArray m_imod;
+    QByteArray m_igen;
+    QByteArray m_shdr;
+    QVector<Preset> m_presets;
+};
+
+#endif // SOUNDFONTFILE_H
@@ -0,0 +1,310 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <algorithm>
+#include <QDebug>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QRegularExpression>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include "soundfontlibrary.h"
+
+const quint32 SoundfontLibrary::INDEX_MAGIC = 0x53464c58; // "SFLX"
+const quint32 SoundfontLibrary::INDEX_VERSION = 1;
+
+static int programKey(int bank, int program)
+{
+    return (bank << 7) | (program & 0x7f);
+}
+
+SoundfontLibrary::SoundfontLibrary(const QString &indexFile):
+    m_indexFile(indexFile)
+{ }
+
+/**
+ * The index file in the user cache directory.
+ */
+QString SoundfontLibrary::defaultIndexFile()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/soundfonts.index";
+}
+
+/**
+ * Reads the index file. A missing or outdated index is not an error: the
+ * library is empty until updated.
+ */
+bool SoundfontLibrary::load()
+{
+    //qDebug() << Q_FUNC_INFO << m_indexFile;
+    m_fonts.clear();
+    QFile file(m_indexFile);
+    if (!file.open(QIODevice::ReadOnly)) {
+        buildLookup();
+        return !file.exists();
+    }
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_5_12);
+    quint32 magic, version, count;
+    in >> magic >> version >> count;
+    if (magic != INDEX_MAGIC || version != INDEX_VERSION) {
+        buildLookup();
+        return true;
+    }
+    m_fonts.reserve(int(count));
+    for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+        Font font;
+        quint32 presets;
+        in >> font.path >> font.size >> font.modified >> font.name >> font.compressed >> presets;
+        font.presets.reserve(int(presets));
+        for (quint32 j = 0; j < presets && in.status() == QDataStream::Ok; ++j) {
+            SoundfontFile::Preset preset;
+            qint32 bank, program;
+            in >> preset.name >> bank >> program >> preset.sampleBytes;
+            preset.bank = bank;
+            preset.program = program;
+            font.presets << preset;
+        }
+        m_fonts << font;
+    }
+    if (in.status() != QDataStream::Ok) {
+        m_error = "corrupt index file";
+        m_fonts.clear();
+        buildLookup();
+        return false;
+    }
+    buildLookup();
+    return true;
+}
+
+bool SoundfontLibrary::save() const
+{
+    //qDebug() << Q_FUNC_INFO << m_indexFile;
+    QDir().mkpath(QFileInfo(m_indexFile).absolutePath());
+    QSaveFile file(m_indexFile);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << Q_FUNC_INFO << file.errorString();
+        return false;
+    }
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_5_12);
+    out << INDEX_MAGIC << INDEX_VERSION << quint32(m_fonts.size());
+    for (const Font &font : m_fonts) {
+        out << font.path << font.size << font.modified << font.name << font.compressed
+            << quint32(font.presets.size());
+        for (const SoundfontFile::Preset &preset : font.presets) {
+            out << preset.name << qint32(preset.bank) << qint32(preset.program) << preset.sampleBytes;
+        }
+    }
+    if (!file.commit()) {
+        qWarning() << Q_FUNC_INFO << file.errorString();
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Scans the directories for SoundFont files, reading only those not
+ * indexed yet or changed since, and forgetting the ones not found.
+ * Returns the number of files read.
+ */
+int SoundfontLibrary::update(const QStringList &directories)
+{
+    //qDebug() << Q_FUNC_INFO << directories;
+    QHash<QString, int> known;
+    for (int i = 0; i < m_fonts.size(); ++i) {
+        known.insert(m_fonts[i].path, i);
+    }
+    const QString excluded = presetDirectory() + '/';
+    QVector<Font> fonts;
+    int parsed = 0;
+    for (const QString &directory : directories) {
+        QDirIterator it(directory, {"*.sf2", "*.sf3"}, QDir::Files, QDirIterator::Subdirectories | QDirIterator::FollowSymlinks);
+        while (it.hasNext()) {
+            const QFileInfo info(it.next());
+            const QString path = info.canonicalFilePath();
+            if (path.isEmpty() || path.startsWith(excluded)) {
+                continue;
+            }
+            const qint64 modified = info.lastModified().toMSecsSinceEpoch();
+            auto k = known.constFind(path);
+            if (k != known.constEnd()) {
+                const Font &font = m_fonts[k.value()];
+                if (font.size == info.size() && font.modified == modified) {
+                    fonts << font;
+                    known.remove(path);
+                    continue;
+                }
+            }
+            SoundfontFile file;
+            ++parsed;
+            if (!file.read(path)) {
+                qWarning() << Q_FUNC_INFO << path << file.errorString();
+                continue;
+            }
+            Font font;
+            font.path = path;
+            font.size = info.size();
+            font.modified = modified;
+            font.name = file.name();
+            font.compressed = file.isCompressed();
+            font.presets = file.presets();
+            fonts << font;
+            known.remove(path);
+        }
+    }
+    std::sort(fonts.begin(), fonts.end(), [](const Font &a, const Font &b) {
+        return a.path < b.path;
+    });
+    m_fonts = fonts;
+    buildLookup();
+    return parsed;
+}
+
+/**
+ * Builds the lookup tables: a hash table of the bank and program numbers,
+ * and the case folded preset names in a single string, searched at once.
+ */
+void SoundfontLibrary::buildLookup()
+{
+    m_programs.clear();
+    m_entries.clear();
+    m_names.clear();
+    m_nameOffsets.clear();
+    for (int f = 0; f < m_fonts.size(); ++f) {
+        for (int p = 0; p < m_fonts[f].presets.size(); ++p) {
+            const SoundfontFile::Preset &preset = m_fonts[f].presets[p];
+            Entry entry;
+            entry.font = f;
+            entry.preset = p;
+            m_programs[programKey(preset.bank, preset.program)] << entry;
+            m_entries << entry;
+            m_nameOffsets << int(m_names.size());
+            m_names += preset.name.toCaseFolded();
+            m_names += '\n';
+        }
+    }
+}
+
+QString SoundfontLibrary::presetDirectory() const
+{
+    return QFileInfo(m_indexFile).absolutePath() + "/presets";
+}
+
+const QVector<SoundfontLibrary::Font> &SoundfontLibrary::fonts() const
+{
+    return m_fonts;
+}
+
+int SoundfontLibrary::presetCount() const
+{
+    return int(m_entries.size());
+}
+
+const QString &SoundfontLibrary::errorString() const
+{
+    return m_error;
+}
+
+QVector<SoundfontLibrary::Entry> SoundfontLibrary::findProgram(int bank, int program) const
+{
+    return m_programs.value(programKey(bank, program));
+}
+
+/**
+ * The presets with names containing the text, ignoring case.
+ */
+QVector<SoundfontLibrary::Entry> SoundfontLibrary::findName(const QString &text) const
+{
+    QVector<Entry> result;
+    const QString needle = text.trimmed().toCaseFolded();
+    if (needle.isEmpty() || needle.contains('\n')) {
+        return result;
+    }
+    int from = 0;
+    while ((from = m_names.indexOf(needle, from)) >= 0) {
+        const int index = int(std::upper_bound(m_nameOffsets.constBegin(), m_nameOffsets.constEnd(), from)
+                              - m_nameOffsets.constBegin()) - 1;
+        result << m_entries[index];
+        // continue with the next name
+        from = index + 1 < m_nameOffsets.size() ? m_nameOffsets[index + 1] : m_names.size();
+    }
+    return result;
+}
+
+/**
+ * Finds "bank:program" numbers, or else preset names.
+ */
+QVector<SoundfontLibrary::Entry> SoundfontLibrary::find(const QString &query) const
+{
+    static const QRegularExpression numbers("^\\s*(\\d+)\\s*:\\s*(\\d+)\\s*$");
+    const QRegularExpressionMatch match = numbers.match(query);
+    if (match.hasMatch()) {
+        return findProgram(match.captured(1).toInt(), match.captured(2).toInt());
+    }
+    return findName(query);
+}
+
+const SoundfontLibrary::Font &SoundfontLibrary::font(const Entry &entry) const
+{
+    return m_fonts[entry.font];
+}
+
+const SoundfontFile::Preset &SoundfontLibrary::preset(const Entry &entry) const
+{
+    return m_fonts[entry.font].presets[entry.preset];
+}
+
+QString SoundfontLibrary::describe(const Entry &entry) const
+{
+    const SoundfontFile::Preset &p = preset(entry);
+    return QString("%1:%2 %3 (%4, %5 KiB)").arg(p.bank, 3, 10, QChar('0')).arg(p.program, 3, 10, QChar('0'))
+            .arg(p.name, font(entry).name).arg((p.sampleBytes + 1023) / 1024);
+}
+
+/**
+ * A soundfont with only the preset, extracted the first time it is needed
+ * into the presets directory next to the index file. Returns an empty
+ * string on failure.
+ */
+QString SoundfontLibrary::presetFile(const Entry &entry)
+{
+    const Font &f = font(entry);
+    const SoundfontFile::Preset &p = preset(entry);
+    const QByteArray key = QString("%1|%2|%3|%4|%5").arg(f.path).arg(f.size).arg(f.modified)
+            .arg(p.bank).arg(p.program).toUtf8();
+    const QString fileName = QString("%1/%2.%3").arg(presetDirectory(),
+            QCryptographicHash::hash(key, QCryptographicHash::Md5).toHex(), f.compressed ? "sf3" : "sf2");
+    if (QFileInfo::exists(fileName)) {
+        return fileName;
+    }
+    QDir().mkpath(presetDirectory());
+    SoundfontFile file;
+    if (!file.read(f.path) || !file.extractPreset(p.bank, p.program, fileName)) {
+        m_error = file.errorString();
+        qWarning() << Q_FUNC_INFO << f.path << m_error;
+        return QString();
+    }
+    return fileName;
+}
@@ -0,0 +1,87 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef SOUNDFONTLIBRARY_H
+#define SOUNDFONTLIBRARY_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QHash>
+#include "soundfontfile.h"
+
+/**
+ * An index of the presets of every soundfont found in a set of
+ * directories, built from the preset headers only and stored in a file, so
+ * that only new or modified fonts are read again when the library is
+ * updated. Presets are found by bank and program or by name, and each one
+ * can be extracted into a small soundfont containing only its samples.
+ */
+class SoundfontLibrary
+{
+public:
+    struct Font {
+        QString path;
+        qint64 size = 0;
+        qint64 modified = 0;
+        QString name;
+        bool compressed = false;
+        QVector<SoundfontFile::Preset> presets;
+    };
+
+    struct Entry {
+        int font = -1;
+        int preset = -1;
+    };
+
+    explicit SoundfontLibrary(const QString &indexFile = defaultIndexFile());
+
+    bool load();
+    bool save() const;
+    int update(const QStringList &directories);
+    const QVector<Font> &fonts() const;
+    int presetCount() const;
+    const QString &errorString() const;
+
+    QVector<Entry> findProgram(int bank, int program) const;
+    QVector<Entry> findName(const QString &text) const;
+    QVector<Entry> find(const QString &query) const;
+    const Font &font(const Entry &entry) const;
+    const SoundfontFile::Preset &preset(const Entry &entry) const;
+    QString describe(const Entry &entry) const;
+    QString presetFile(const Entry &entry);
+
+    static QString defaultIndexFile();
+    static const quint32 INDEX_MAGIC;
+    static const quint32 INDEX_VERSION;
+
+private:
+    void buildLookup();
+    QString presetDirectory() const;
+
+    QString m_indexFile;
+    QString m_error;
+    QVector<Font> m_fonts;
+    QHash<int, QVector<Entry>> m_programs;
+    QVector<Entry> m_entries;
+    QString m_names;
+    QVector<int> m_nameOffsets;
+};
+
+#endif // SOUNDFONTLIBRARY_H
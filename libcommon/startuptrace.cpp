@@ -0,0 +1,87 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cstdio>
+#include <QElapsedTimer>
+#include <QVector>
+#include <QPair>
+#include <QByteArray>
+#include "startuptrace.h"
+
+namespace {
+
+struct TraceData {
+    QElapsedTimer clock;
+    QVector<QPair<QByteArray, qint64>> marks;
+    bool enabled = false;
+};
+
+TraceData &data()
+{
+    static TraceData d;
+    return d;
+}
+
+void print(const QByteArray &milestone, qint64 nsecs)
+{
+    fprintf(stderr, "[startup] %9.3f ms  %s\n", nsecs / 1e6, milestone.constData());
+}
+
+}
+
+void StartupTrace::start()
+{
+    if (!data().clock.isValid()) {
+        data().clock.start();
+    }
+}
+
+qint64 StartupTrace::elapsed()
+{
+    return data().clock.isValid() ? data().clock.nsecsElapsed() : 0;
+}
+
+void StartupTrace::mark(const char *milestone)
+{
+    mark(milestone, elapsed());
+}
+
+void StartupTrace::mark(const char *milestone, qint64 nsecs)
+{
+    if (data().enabled) {
+        print(milestone, nsecs);
+    } else {
+        data().marks.append(qMakePair(QByteArray(milestone), nsecs));
+    }
+}
+
+bool StartupTrace::isEnabled()
+{
+    return data().enabled;
+}
+
+void StartupTrace::setEnabled(bool enable)
+{
+    data().enabled = enable;
+    if (enable) {
+        foreach(const auto &m, data().marks) {
+            print(m.first, m.second);
+        }
+    }
+    data().marks.clear();
+}
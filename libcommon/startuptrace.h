@@ -0,0 +1,41 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef STARTUPTRACE_H
+#define STARTUPTRACE_H
+
+#include <QtGlobal>
+
+/**
+ * Milestones of the program start-up, measured from the first call to
+ * StartupTrace::start(). The marks are kept until the trace is enabled,
+ * and then printed to stderr as they arrive. Only the main thread may
+ * call mark(); other threads take elapsed() and forward it.
+ */
+class StartupTrace
+{
+public:
+    static void start();
+    static qint64 elapsed();
+    static void mark(const char *milestone);
+    static void mark(const char *milestone, qint64 nsecs);
+    static bool isEnabled();
+    static void setEnabled(bool enable);
+};
+
+#endif // STARTUPTRACE_H
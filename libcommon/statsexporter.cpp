@@ -0,0 +1,71 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QDebug>
+#include <QFile>
+#include <QSaveFile>
+#include "statsexporter.h"
+#include "synthcontroller.h"
+
+const int StatsExporter::DEFAULT_INTERVAL = 1000;
+
+StatsExporter::StatsExporter(SynthController *controller, QObject *parent):
+    QObject(parent),
+    m_controller(controller),
+    m_append(false)
+{
+    connect(&m_timer, &QTimer::timeout, this, &StatsExporter::writeFile);
+}
+
+StatsExporter::~StatsExporter()
+{ }
+
+bool StatsExporter::exportToFile(const QString &fileName, int interval, bool append)
+{
+    //qDebug() << Q_FUNC_INFO << fileName << interval << append;
+    m_fileName = fileName;
+    m_append = append;
+    m_timer.start(interval);
+    writeFile();
+    return !m_fileName.isEmpty();
+}
+
+void StatsExporter::writeFile()
+{
+    if (m_append) {
+        QFile file(m_fileName);
+        if (file.open(QIODevice::WriteOnly | QIODevice::Append)
+                && file.write(m_controller->stats().toJsonLine()) > 0) {
+            return;
+        }
+        qWarning() << Q_FUNC_INFO << file.errorString();
+        m_timer.stop();
+        m_fileName.clear();
+        return;
+    }
+    QSaveFile file(m_fileName);
+    if (file.open(QIODevice::WriteOnly)) {
+        file.write(m_controller->stats().toJsonLine());
+        if (file.commit()) {
+            return;
+        }
+    }
+    qWarning() << Q_FUNC_INFO << file.errorString();
+    m_timer.stop();
+    m_fileName.clear();
+}
@@ -0,0 +1,54 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef STATSEXPORTER_H
+#define STATSEXPORTER_H
+
+#include <QObject>
+#include <QTimer>
+
+class SynthController;
+
+/**
+ * Publishes the statistics of a SynthController as a JSON document,
+ * periodically rewritten into a local file or appended to it as JSON
+ * lines. MetricsServer serves the same document at /stats.
+ */
+class StatsExporter : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit StatsExporter(SynthController *controller, QObject *parent = nullptr);
+    virtual ~StatsExporter();
+
+    bool exportToFile(const QString &fileName, int interval = DEFAULT_INTERVAL, bool append = false);
+
+    static const int DEFAULT_INTERVAL;
+
+private slots:
+    void writeFile();
+
+private:
+    SynthController *m_controller;
+    QString m_fileName;
+    bool m_append;
+    QTimer m_timer;
+};
+
+#endif // STATSEXPORTER_H
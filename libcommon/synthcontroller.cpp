@@ -16,33 +16,55 @@
     along with this program. If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <cstring>
 #include <QDebug>
+#include <QDateTime>
 #include "synthcontroller.h"
 #include "synthrenderer.h"
+#include "programsettings.h"
+#include "startuptrace.h"
+#include "sinkfeeder.h"
+#include "tracer.h"
 
-SynthController::SynthController(int bufTime, QObject *parent) 
+const int SynthController::HANDOVER_TIMEOUT = 500;
+const int SynthController::XRUN_MONITOR_INTERVAL = 10;
+const int SynthController::METRICS_INTERVAL = 1000;
+const int SynthController::FANOUT_SECONDS = 2;
+
+SynthController::SynthController(int bufTime, int midiBanks, const QString &engineProfile, QObject *parent) 
     : QObject(parent),
     m_requestedBufferTime(bufTime),
-    m_running(false)
+    m_running(false),
+    m_outputStarts(0),
+    m_stalled(false),
+    m_stalls(0),
+    m_bufferTime(0),
+    m_volume(1.0),
+    m_handoverRequested(false),
+    m_retiredTime(0)
 {
   //qDebug() << Q_FUNC_INFO;
-  m_renderer.reset(new SynthRenderer());
+  m_renderer.reset(new SynthRenderer(midiBanks, engineProfile));
   m_format = m_renderer->format();
   initAudioDevices();
   initAudio();
-  connect(&m_stallDetector, &QTimer::timeout, this, [=]{
-      if (m_running) {
-          if (m_renderer->lastBufferSize() == 0) {
-              emit stallDetected();
-          }
-          m_renderer->resetLastBufferSize();
-      }
-  });
+  StartupTrace::mark("audio output created");
+  connect(m_renderer.get(), &SynthRenderer::firstAudioRendered,
+          this, &SynthController::probeAudioDevicesLater);
+  m_xrunMonitor.setTimerType(Qt::PreciseTimer);
+  connect(&m_xrunMonitor, &QTimer::timeout, this, &SynthController::checkAudioClock);
+  connect(&m_metricsTimer, &QTimer::timeout, this, &SynthController::collectMetrics);
+  m_uptime.start();
+  m_metricsClock.start();
+  m_metricsTimer.start(METRICS_INTERVAL);
 }
 
 SynthController::~SynthController()
 {
     //qDebug() << Q_FUNC_INFO;
+    if (!m_probeThread.isNull()) {
+        m_probeThread->wait();
+    }
 }
 
 void
@@ -50,36 +72,248 @@ SynthController::start()
 {
     //qDebug() << Q_FUNC_INFO;
     m_renderer->start();
+    m_feeder.reset(new SinkFeeder(m_renderer.get(), SinkFeeder::Driving));
+    startOutput();
+    startExtraOutputs();
+}
+
+void
+SynthController::startOutput()
+{
     auto bufferBytes = m_format.bytesForDuration(m_requestedBufferTime * 1000);
     qDebug() << Q_FUNC_INFO
              << "Requested buffer size:" << bufferBytes << "bytes,"
              << m_requestedBufferTime << "milliseconds";
     m_audioOutput->setBufferSize(bufferBytes);
-    m_audioOutput->start(m_renderer.get());
+    m_audioOutput->setVolume(m_volume);
+    m_feeder->start();
+    m_audioOutput->start(m_feeder.get());
     auto bufferTime = m_format.durationForBytes(m_audioOutput->bufferSize()) / 1000;
     qDebug() << Q_FUNC_INFO
              << "Applied Audio Output buffer size:" << m_audioOutput->bufferSize() << "bytes,"
              << bufferTime << "milliseconds";
+    StartupTrace::mark("audio output started");
+    m_bufferTime = bufferTime;
+    // the startup latency of the device is not a dropout
+    m_running = false;
+    m_stalled = false;
+    m_xrunDetector.restart();
+    m_audioClock.start();
+    m_xrunMonitor.start(XRUN_MONITOR_INTERVAL);
+    const int outputStart = ++m_outputStarts;
     QTimer::singleShot(bufferTime * 2, this, [=]{
-        m_running = true;
-        m_stallDetector.start(bufferTime * 4);
+        if (outputStart == m_outputStarts) {
+            m_running = true;
+        }
      });
 }
 
+/**
+ * Compares the audio clock of the output device with the wall clock and
+ * with the audio delivered to it, accounting every dropout.
+ */
+void
+SynthController::checkAudioClock()
+{
+    if (m_audioOutput.isNull() || m_feeder.isNull()) {
+        return;
+    }
+    pollHandover();
+    m_renderer->notifyFirstAudio();
+    const qint64 wall = m_audioClock.nsecsElapsed() / 1000;
+    const qint64 processed = m_audioOutput->processedUSecs();
+    const qint64 deliveredFrames = m_feeder->deliveredBytes() / m_format.bytesPerFrame();
+    const qint64 delivered = deliveredFrames * 1000000 / m_format.sampleRate();
+    if (m_xrunDetector.update(wall, processed, delivered, m_running)) {
+        Tracer::instant("state", "xrun detected", int(m_xrunDetector.lastXrunTime()));
+        emit underrunDetected();
+    }
+    if (m_running && m_xrunDetector.isStalled(wall, m_bufferTime * 4000)) {
+        if (!m_stalled) {
+            m_stalled = true;
+            ++m_stalls;
+            Tracer::instant("state", "stall detected");
+            emit stallDetected();
+        }
+    } else {
+        m_stalled = false;
+    }
+}
+
+SynthStats
+SynthController::stats() const
+{
+    const SynthEngine::Stats engine = m_renderer->engine().stats();
+    SynthStats s;
+    s.timestamp = QDateTime::currentMSecsSinceEpoch();
+    s.xruns = m_xrunDetector.xruns();
+    s.xrunTime = m_xrunDetector.xrunTime();
+    s.lastXrunTime = m_xrunDetector.lastXrunTime();
+    s.stalls = m_stalls;
+    s.processedTime = m_xrunDetector.processedTime();
+    s.bufferedTime = m_xrunDetector.bufferedTime();
+    s.bufferTime = m_bufferTime * 1000;
+    s.renderedFrames = engine.renderedFrames;
+    s.bypassedFrames = engine.bypassedFrames;
+    s.silencedFrames = engine.silencedFrames;
+    s.coalescedEvents = engine.coalescedEvents;
+    s.droppedEvents = engine.droppedEvents;
+    s.realtimeStatus = m_renderer->realtimeStatus();
+    const EngineProfile &profile = m_renderer->engine().profile();
+    s.engineProfile = QString::fromStdString(profile.name);
+    s.sampleRate = profile.sampleRate;
+    s.blockFrames = profile.blockFrames;
+    s.polyphony = profile.polyphony;
+    s.uptime = m_uptime.nsecsElapsed() / 1000;
+    s.activeVoices = engine.activeVoices;
+    s.peakVoices = engine.peakVoices;
+    s.midiEvents = engine.midiEvents;
+    s.eventsPerSecond = m_renderSummary.eventsPerSecond;
+    s.dspLoad50 = m_renderSummary.load50;
+    s.dspLoad95 = m_renderSummary.load95;
+    s.dspLoad99 = m_renderSummary.load99;
+    s.dspLoadMax = m_renderSummary.loadMax;
+    s.soundfontMemory = engine.soundfontMemory;
+    s.drumCacheHits = engine.drumCacheHits;
+    s.drumCacheMisses = engine.drumCacheMisses;
+    s.drumCacheMemory = engine.drumCacheMemory;
+    s.extraOutputs = int(m_extraOutputs.size());
+    for (const auto &extra : m_extraOutputs) {
+        if (!extra->feeder.isNull()) {
+            const FanoutReader::Stats fanout = extra->feeder->stats();
+            s.extraOutputUnderruns += fanout.underruns;
+            s.extraOutputOverruns += fanout.overruns;
+            s.extraOutputDrift = qMax(s.extraOutputDrift, qAbs(fanout.ratio - 1.0) * 1e6);
+        }
+    }
+    if (m_renderer->netMidiInput() != nullptr) {
+        const JitterBuffer::Stats network = m_renderer->netMidiInput()->stats();
+        s.networkPackets = network.packets;
+        s.networkLatePackets = network.late;
+        s.networkReorderedPackets = network.reordered;
+        s.networkLostPackets = network.lost;
+        s.networkDuplicatePackets = network.duplicates;
+        s.networkDroppedEvents = m_renderer->netMidiInput()->droppedEvents();
+        s.networkPlayoutDelay = network.delayUsecs;
+    }
+    return s;
+}
+
+/**
+ * Summarizes the DSP load percentiles and the MIDI event rate of the
+ * last metrics interval.
+ */
+void
+SynthController::collectMetrics()
+{
+    m_renderSummary = m_renderer->metrics().collect(m_metricsClock.nsecsElapsed());
+    m_metricsClock.restart();
+}
+
 void
 SynthController::stop()
 {
     //qDebug() << Q_FUNC_INFO;
     m_running = false;
-    m_stallDetector.stop();
+    ++m_outputStarts;
+    m_xrunMonitor.stop();
+    stopExtraOutputs();
+    finishHandover();
     if (!m_audioOutput.isNull()) {
         m_audioOutput->stop();
     }
+    if (!m_feeder.isNull()) {
+        m_feeder->stop();
+    }
     if(!m_renderer.isNull()) {
         m_renderer->stop();
     }
 }
 
+bool
+SynthController::isActive() const
+{
+    return !m_audioOutput.isNull() && !m_feeder.isNull() && m_feeder->isOpen();
+}
+
+/**
+ * Replaces the audio output by a new one, with the current device and
+ * buffer time, while the old one keeps playing. The new output is primed
+ * with silence, and the synth is handed over at a block boundary.
+ */
+void
+SynthController::switchAudioOutput()
+{
+    //qDebug() << Q_FUNC_INFO;
+    finishHandover();
+    m_retiredOutput.reset(m_audioOutput.take());
+    m_retiredFeeder.reset(m_feeder.take());
+    initAudio();
+    if (m_audioOutput.isNull()) {
+        m_audioOutput.reset(m_retiredOutput.take());
+        m_feeder.reset(m_retiredFeeder.take());
+        return;
+    }
+    SinkFeeder *previous = m_retiredFeeder.data();
+    m_feeder.reset(new SinkFeeder(m_renderer.get(), SinkFeeder::Priming));
+    m_retiredTime = m_format.durationForBytes(m_retiredOutput->bufferSize()) / 1000;
+    m_handoverRequested = false;
+    m_handoverClock.invalidate();
+    startOutput();
+    const int timeout = int(qMax<qint64>(m_retiredTime, m_requestedBufferTime)) * 4 + HANDOVER_TIMEOUT;
+    QTimer::singleShot(timeout, this, [=]{
+        if (m_retiredFeeder.data() == previous) {
+            qWarning() << Q_FUNC_INFO << "The previous audio output didn't hand over in time";
+            finishHandover();
+        }
+    });
+}
+
+/**
+ * Advances a pending hand over from the xrun monitor timer: once the new
+ * output reads its feeder, the old one is asked to pass the synth, and it
+ * is stopped after playing its buffered audio.
+ */
+void
+SynthController::pollHandover()
+{
+    if (m_retiredFeeder.isNull()) {
+        return;
+    }
+    if (!m_handoverRequested) {
+        if (m_feeder->isPrimed()) {
+            m_retiredFeeder->handOverTo(m_feeder.data());
+            m_handoverRequested = true;
+        }
+    } else if (!m_handoverClock.isValid()) {
+        if (m_retiredFeeder->state() == SinkFeeder::Retired) {
+            m_handoverClock.start();
+        }
+    } else if (m_handoverClock.elapsed() >= m_retiredTime * 2) {
+        finishHandover();
+    }
+}
+
+void
+SynthController::finishHandover()
+{
+    if (m_retiredFeeder.isNull()) {
+        return;
+    }
+    //qDebug() << Q_FUNC_INFO;
+    if (!m_retiredOutput.isNull()) {
+        m_retiredOutput->stop();
+    }
+    m_retiredFeeder->stop();
+    if (!m_feeder.isNull()) {
+        m_feeder->takeOver();
+    }
+    m_retiredOutput.reset();
+    m_retiredFeeder.reset();
+    m_handoverRequested = false;
+    m_handoverClock.invalidate();
+}
+
 SynthRenderer*
 SynthController::renderer() const
 {
@@ -97,18 +331,23 @@ SynthController::initAudio()
 #if QT_VERSION < QT_VERSION_CHECK(6,0,0)
     m_audioOutput.reset(new QAudioOutput(m_audioDevice, m_format));
     m_audioOutput->setCategory("MIDI Synthesizer");
-    QObject::connect(m_audioOutput.data(), &QAudioOutput::stateChanged, this, [=](QAudio::State state){
+    auto output = m_audioOutput.data();
+    QObject::connect(output, &QAudioOutput::stateChanged, this, [=](QAudio::State state){
 #else
     m_audioOutput.reset(new QAudioSink(m_audioDevice, m_format));
-    QObject::connect(m_audioOutput.data(), &QAudioSink::stateChanged, this, [=](QAudio::State state){
+    auto output = m_audioOutput.data();
+    QObject::connect(output, &QAudioSink::stateChanged, this, [=](QAudio::State state){
 #endif
-        qDebug() << "Audio Output state:" << state << "error:" << m_audioOutput->error();
-        if (m_running && (m_audioOutput->error() == QAudio::UnderrunError)) {
-            emit underrunDetected();
-        }
+        qDebug() << "Audio Output state:" << state << "error:" << output->error();
+        Tracer::instant("state", "audio output state", state, output->error());
     });
 }
 
+/**
+ * Enumerates the audio outputs without probing them. Only the probe results
+ * cached by a previous run are trusted here; the devices are probed again
+ * in a background thread once the first audio block has been rendered.
+ */
 void
 SynthController::initAudioDevices()
 {
@@ -116,25 +355,98 @@ SynthController::initAudioDevices()
     auto devices = QAudioDeviceInfo::availableDevices(QAudio::AudioOutput);
     m_audioDevice = QAudioDeviceInfo::defaultOutputDevice();
     foreach(auto &dev, devices) {
-        if (dev.isFormatSupported(m_format)) {
-            //qDebug() << Q_FUNC_INFO << dev.deviceName();
-            m_availableDevices.insert(dev.deviceName(), dev);
-        }
+        m_allDevices.insert(dev.deviceName(), dev);
     }
 #else
     QMediaDevices mediaDevices;
     auto devices = mediaDevices.audioOutputs();
     m_audioDevice = mediaDevices.defaultAudioOutput();
     foreach(auto &dev, devices) {
-        if (dev.isFormatSupported(m_format)) {
-            //qDebug() << Q_FUNC_INFO << dev.description();
-            m_availableDevices.insert(dev.description(), dev);
-        }
+        m_allDevices.insert(dev.description(), dev);
     }
 #endif
+    const QVariantMap &probes = ProgramSettings::instance()->audioDeviceProbes();
+    for (auto it = m_allDevices.constBegin(); it != m_allDevices.constEnd(); ++it) {
+        if (probes.value(probeKey(it.key())).toBool()) {
+            m_availableDevices.insert(it.key(), it.value());
+        }
+    }
     //qDebug() << Q_FUNC_INFO << audioDeviceName();
 }
 
+QString
+SynthController::probeKey(const QString &name) const
+{
+    return QString("%1@%2").arg(name).arg(m_format.sampleRate());
+}
+
+void
+SynthController::probeAudioDevices()
+{
+    //qDebug() << Q_FUNC_INFO;
+    QMap<QString,bool> results;
+    for (auto it = m_allDevices.constBegin(); it != m_allDevices.constEnd(); ++it) {
+        results.insert(it.key(), it.value().isFormatSupported(m_format));
+    }
+    updateAudioDevices(results);
+}
+
+void
+SynthController::probeAudioDevicesLater()
+{
+    //qDebug() << Q_FUNC_INFO;
+    if (!m_probeThread.isNull()) {
+        return;
+    }
+    const QMap<QString,AudioDevice> devices = m_allDevices;
+    const QAudioFormat format = m_format;
+    m_probeThread = QThread::create([this, devices, format]{
+        QMap<QString,bool> results;
+        for (auto it = devices.constBegin(); it != devices.constEnd(); ++it) {
+            results.insert(it.key(), it.value().isFormatSupported(format));
+        }
+        QMetaObject::invokeMethod(this, [this, results]{
+            updateAudioDevices(results);
+        }, Qt::QueuedConnection);
+    });
+    connect(m_probeThread.data(), &QThread::finished, m_probeThread.data(), &QObject::deleteLater);
+    m_probeThread->start(QThread::LowPriority);
+}
+
+bool
+SynthController::probeAudioDevice(const QString &name)
+{
+    if (!m_allDevices.contains(name)) {
+        return false;
+    }
+    bool supported = m_allDevices.value(name).isFormatSupported(m_format);
+    QMap<QString,bool> results;
+    results.insert(name, supported);
+    updateAudioDevices(results);
+    return supported;
+}
+
+void
+SynthController::updateAudioDevices(const QMap<QString,bool> &results)
+{
+    bool changed = false;
+    QVariantMap probes = ProgramSettings::instance()->audioDeviceProbes();
+    for (auto it = results.constBegin(); it != results.constEnd(); ++it) {
+        probes.insert(probeKey(it.key()), it.value());
+        if (it.value() && !m_availableDevices.contains(it.key())) {
+            m_availableDevices.insert(it.key(), m_allDevices.value(it.key()));
+            changed = true;
+        } else if (!it.value() && m_availableDevices.contains(it.key())) {
+            m_availableDevices.remove(it.key());
+            changed = true;
+        }
+    }
+    ProgramSettings::instance()->setAudioDeviceProbes(probes);
+    if (changed) {
+        emit audioDevicesChanged();
+    }
+}
+
 #if QT_VERSION < QT_VERSION_CHECK(6,0,0)
 const QAudioDeviceInfo&
 SynthController::audioDevice() const
@@ -187,12 +499,19 @@ void
 SynthController::setAudioDeviceName(const QString newName)
 {
     qDebug() << Q_FUNC_INFO << newName;
+    if (!m_availableDevices.contains(newName)) {
+        probeAudioDevice(newName);
+    }
     if (m_availableDevices.contains(newName) &&
         (m_audioDevice.isNull() || (audioDeviceName() != newName) )) {
-        stop();
         m_audioDevice = m_availableDevices.value(newName);
-        initAudio();
-        start();
+        if (isActive()) {
+            switchAudioOutput();
+        } else {
+            stop();
+            initAudio();
+            start();
+        }
     }
 }
 
@@ -200,17 +519,137 @@ void SynthController::setBufferSize(int milliseconds)
 {
     //qDebug() << Q_FUNC_INFO << milliseconds;
     if (milliseconds != m_requestedBufferTime) {
-        stop();
-        m_requestedBufferTime = milliseconds;
-        start();
+        if (isActive()) {
+            m_requestedBufferTime = milliseconds;
+            switchAudioOutput();
+        } else {
+            stop();
+            m_requestedBufferTime = milliseconds;
+            start();
+        }
     }
 }
 
 void SynthController::setVolume(int volume)
 {
     //qDebug() << Q_FUNC_INFO << volume;
-    qreal linearVolume = QAudio::convertVolume(volume / 100.0,
-                                               QAudio::LogarithmicVolumeScale,
-                                               QAudio::LinearVolumeScale);
-    m_audioOutput->setVolume(linearVolume);
+    m_volume = QAudio::convertVolume(volume / 100.0,
+                                     QAudio::LogarithmicVolumeScale,
+                                     QAudio::LinearVolumeScale);
+    m_audioOutput->setVolume(m_volume);
+    for (const auto &extra : m_extraOutputs) {
+        if (!extra->output.isNull()) {
+            extra->output->setVolume(m_volume);
+        }
+    }
+}
+
+QStringList
+SynthController::extraOutputs() const
+{
+    QStringList result;
+    for (const auto &extra : m_extraOutputs) {
+        result << extra->name;
+    }
+    return result;
+}
+
+/**
+ * Plays the synth on additional audio devices besides the main one. The
+ * synth is rendered once for the main output, and each extra output reads
+ * the same audio from a shared ring with its own buffer, following the
+ * clock of its device, so the synthesis cost doesn't depend on the number
+ * of outputs. The latency of an extra output is the buffer time of both
+ * outputs, which keeps the ring between them from running dry.
+ */
+void
+SynthController::setExtraOutputs(const QStringList &deviceNames)
+{
+    //qDebug() << Q_FUNC_INFO << deviceNames;
+    stopExtraOutputs();
+    m_extraOutputs.clear();
+    foreach(const auto &name, deviceNames) {
+        if (!m_availableDevices.contains(name)) {
+            probeAudioDevice(name);
+        }
+        if (!m_availableDevices.contains(name) || name == audioDeviceName()) {
+            qWarning() << Q_FUNC_INFO << "audio device unavailable:" << name;
+            continue;
+        }
+        std::unique_ptr<ExtraOutput> extra(new ExtraOutput);
+        extra->name = name;
+        extra->device = m_availableDevices.value(name);
+        m_extraOutputs.push_back(std::move(extra));
+    }
+    if (!m_extraOutputs.empty() && m_fanout.isNull()) {
+        m_fanout.reset(new FanoutRing(m_format.channelCount(), m_format.sampleRate() * FANOUT_SECONDS));
+        m_renderer->setFanout(m_fanout.data());
+    }
+    if (isActive()) {
+        startExtraOutputs();
+    }
+}
+
+QString
+SynthController::sharedMemoryTap() const
+{
+    return m_shmTap.isNull() ? QString() : QString::fromStdString(m_shmTap->name());
+}
+
+/**
+ * Publishes the rendered audio into a POSIX shared memory object for local
+ * consumer processes, which map it instead of capturing the audio output.
+ * The renderer writes into it without blocking, so it is opened once and
+ * kept until the controller is destroyed.
+ */
+bool
+SynthController::openSharedMemoryTap(const QString &name)
+{
+    //qDebug() << Q_FUNC_INFO << name;
+    if (!m_shmTap.isNull()) {
+        qWarning() << Q_FUNC_INFO << "already publishing to" << sharedMemoryTap();
+        return false;
+    }
+    QScopedPointer<ShmTap> tap(new ShmTap);
+    int error = 0;
+    if (!tap->open(name.toStdString(), m_format.sampleRate(), m_format.channelCount(),
+                   m_format.sampleRate() * ShmTap::DEFAULT_SECONDS, &error)) {
+        qWarning() << Q_FUNC_INFO << name << strerror(error);
+        return false;
+    }
+    m_shmTap.reset(tap.take());
+    m_renderer->setShmTap(m_shmTap.data());
+    return true;
+}
+
+void
+SynthController::startExtraOutputs()
+{
+    // the buffer time of the main output plus the one of each extra output
+    const int targetFrames = m_format.framesForDuration(m_requestedBufferTime * 2000);
+    for (const auto &extra : m_extraOutputs) {
+        extra->feeder.reset(new FanoutFeeder(m_fanout.data(), targetFrames));
+        extra->output.reset(new AudioSink(extra->device, m_format));
+        extra->output->setBufferSize(m_format.bytesForDuration(m_requestedBufferTime * 1000));
+        extra->output->setVolume(m_volume);
+        extra->feeder->start();
+        extra->output->start(extra->feeder.data());
+        qDebug() << Q_FUNC_INFO << extra->name
+                 << "buffer size:" << extra->output->bufferSize() << "bytes";
+    }
+}
+
+void
+SynthController::stopExtraOutputs()
+{
+    for (const auto &extra : m_extraOutputs) {
+        if (!extra->output.isNull()) {
+            extra->output->stop();
+        }
+        if (!extra->feeder.isNull()) {
+            extra->feeder->stop();
+        }
+        extra->output.reset();
+        extra->feeder.reset();
+    }
 }
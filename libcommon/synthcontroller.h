@@ -21,7 +21,12 @@
 
 #include <QObject>
 #include <QTimer>
+#include <QElapsedTimer>
 #include <QScopedPointer>
+#include <QPointer>
+#include <QThread>
+#include <memory>
+#include <vector>
 #if QT_VERSION < QT_VERSION_CHECK(6,0,0)
 #include <QAudioOutput>
 #else
@@ -30,12 +35,16 @@
 #include <QMediaDevices>
 #endif
 #include "synthrenderer.h"
+#include "sinkfeeder.h"
+#include "fanoutfeeder.h"
+#include "synthstats.h"
+#include "xrundetector.h"
 
 class SynthController : public QObject
 {
     Q_OBJECT
 public:
-    explicit SynthController(int bufTime, QObject *parent = 0);
+    SynthController(int bufTime, int midiBanks, const QString &engineProfile, QObject *parent = 0);
     virtual ~SynthController();
     SynthRenderer *renderer() const;
 
@@ -47,10 +56,22 @@ public:
     void setAudioDevice(const QAudioDevice &newAudioDevice);
 #endif
     QStringList availableAudioDevices() const;
+    void probeAudioDevices();
     QString audioDeviceName() const;
     void setAudioDeviceName(const QString newName);
     void setBufferSize(int milliseconds);
     void setVolume(int volume);
+    QStringList extraOutputs() const;
+    void setExtraOutputs(const QStringList &deviceNames);
+    QString sharedMemoryTap() const;
+    bool openSharedMemoryTap(const QString &name);
+    bool isActive() const;
+    SynthStats stats() const;
+
+    static const int HANDOVER_TIMEOUT;
+    static const int XRUN_MONITOR_INTERVAL;
+    static const int METRICS_INTERVAL;
+    static const int FANOUT_SECONDS;
 
 public slots:
     void start();
@@ -60,23 +81,74 @@ signals:
     void finished();
     void underrunDetected();
     void stallDetected();
+    void audioDevicesChanged();
 
 private:
     void initAudio();
     void initAudioDevices();
+    void startOutput();
+    void switchAudioOutput();
+    void pollHandover();
+    void finishHandover();
+    void startExtraOutputs();
+    void stopExtraOutputs();
+    void checkAudioClock();
+    void collectMetrics();
+    void probeAudioDevicesLater();
+    bool probeAudioDevice(const QString &name);
+    void updateAudioDevices(const QMap<QString,bool> &results);
+    QString probeKey(const QString &name) const;
 
 private:
+#if QT_VERSION < QT_VERSION_CHECK(6,0,0)
+    typedef QAudioOutput AudioSink;
+    typedef QAudioDeviceInfo AudioDevice;
+#else
+    typedef QAudioSink AudioSink;
+    typedef QAudioDevice AudioDevice;
+#endif
+    struct ExtraOutput {
+        QString name;
+        AudioDevice device;
+        QScopedPointer<FanoutFeeder> feeder;
+        QScopedPointer<AudioSink> output;
+    };
+
+    QScopedPointer<FanoutRing> m_fanout;
+    QScopedPointer<ShmTap> m_shmTap;
     QScopedPointer<SynthRenderer> m_renderer;
-    QTimer m_stallDetector;
+    QTimer m_xrunMonitor;
+    QElapsedTimer m_audioClock;
+    XrunDetector m_xrunDetector;
+    QTimer m_metricsTimer;
+    QElapsedTimer m_metricsClock;
+    QElapsedTimer m_uptime;
+    RenderMetrics::Summary m_renderSummary;
     int m_requestedBufferTime;
     bool m_running;
+    int m_outputStarts;
+    bool m_stalled;
+    quint64 m_stalls;
+    qint64 m_bufferTime;
+    qreal m_volume;
     QAudioFormat m_format;
+    QScopedPointer<SinkFeeder> m_feeder;
+    QScopedPointer<SinkFeeder> m_retiredFeeder;
+    bool m_handoverRequested;
+    qint64 m_retiredTime;
+    QElapsedTimer m_handoverClock;
+    QPointer<QThread> m_probeThread;
+    std::vector<std::unique_ptr<ExtraOutput>> m_extraOutputs;
 #if QT_VERSION < QT_VERSION_CHECK(6,0,0)
     QScopedPointer<QAudioOutput> m_audioOutput;
+    QScopedPointer<QAudioOutput> m_retiredOutput;
+    QMap<QString,QAudioDeviceInfo> m_allDevices;
     QMap<QString,QAudioDeviceInfo> m_availableDevices;
     QAudioDeviceInfo m_audioDevice;
 #else
     QScopedPointer<QAudioSink> m_audioOutput;
+    QScopedPointer<QAudioSink> m_retiredOutput;
+    QMap<QString,QAudioDevice> m_allDevices;
     QMap<QString,QAudioDevice> m_availableDevices;
     QAudioDevice m_audioDevice;
 #endif
@@ -16,26 +16,53 @@
     along with this program. If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
+#include <cerrno>
 #include <QObject>
 #include <QDebug>
 #include <QString>
 #include <QCoreApplication>
 #include <QTextStream>
+#include <QThread>
+#include <QDir>
+#include <QLibrary>
+#include <QLibraryInfo>
+#include <QPluginLoader>
 #include <drumstick/sequencererror.h>
+#if defined(RTKIT_SUPPORT)
+#include <QDBusInterface>
+#include <QDBusReply>
+#endif
 #include "programsettings.h"
 #include "synthrenderer.h"
-#include "programsettings.h"
+#include "realtime.h"
+#include "startuptrace.h"
+#include "tracer.h"
+#include "sessionrecorder.h"
 
 using namespace drumstick::rt;
 
-SynthRenderer::SynthRenderer(QObject *parent):
+SynthRenderer::SynthRenderer(int midiBanks, const QString &engineProfile, QObject *parent):
     QIODevice(parent),
     m_input(nullptr),
-    m_lastBufferSize(0)
+    m_carriedFrames(0),
+    m_realtime(false),
+    m_realtimePriority(ProgramSettings::DEFAULT_REALTIME_PRIORITY),
+    m_cpuAffinity(-1),
+    m_realtimeFlags(0),
+    m_realtimeGeneration(1),
+    m_renderThread(nullptr),
+    m_appliedGeneration(0),
+    m_lastBufferSize(0),
+    m_firstAudioTime(-1),
+    m_firstAudioNotified(false),
+    m_fanout(nullptr),
+    m_shmTap(nullptr)
 {
     //qDebug() << Q_FUNC_INFO;
+    initSynth(midiBanks, engineProfile);
     initMIDI();
-    initSynth();
+    StartupTrace::mark("synth renderer created");
 }
 
 void
@@ -50,30 +77,39 @@ SynthRenderer::initMIDI()
     }
 }
 
-const int SynthRenderer::DEFAULT_SAMPLE_RATE = 44100;
-const int SynthRenderer::DEFAULT_RENDERING_FRAMES = 64;
-const int SynthRenderer::DEFAULT_FRAME_CHANNELS = 2;
+const int SynthRenderer::DEFAULT_SAMPLE_RATE = SynthEngine::DEFAULT_SAMPLE_RATE;
+const int SynthRenderer::DEFAULT_RENDERING_FRAMES = SynthEngine::DEFAULT_RENDERING_FRAMES;
+const int SynthRenderer::DEFAULT_FRAME_CHANNELS = SynthEngine::DEFAULT_FRAME_CHANNELS;
+
+static const int DRUM_BANK = 128;
+static const int DRUM_CHANNEL = 9;
+static const int BANK_SELECT = 0;
+// the real-time flags describing the render thread
+static const int RENDER_THREAD_FLAGS = SynthRenderer::RealtimeScheduling | SynthRenderer::RealtimeKit
+        | SynthRenderer::CpuAffinity | SynthRenderer::DenormalsFlushed
+        | SynthRenderer::SchedulingDenied | SynthRenderer::MainThreadRendering;
 
 void
-SynthRenderer::initSynth()
+SynthRenderer::initSynth(int midiBanks, const QString &engineProfile)
 {
-    m_sampleRate = DEFAULT_SAMPLE_RATE;
-    m_renderingFrames = DEFAULT_RENDERING_FRAMES;
-    m_channels = DEFAULT_FRAME_CHANNELS;
-    m_sample_size = sizeof(float) * CHAR_BIT;
+    const EngineProfile *profile = EngineProfile::find(engineProfile.toStdString());
+    if (profile == nullptr) {
+        qWarning() << Q_FUNC_INFO << "unknown engine profile:" << engineProfile;
+        profile = &EngineProfile::defaults();
+    }
+    m_engine.reset(new SynthEngine(*profile, midiBanks));
+    qDebug() << Q_FUNC_INFO << "profile:" << profile->name.c_str() << "synthesis frames:" << m_engine->blockFrames() << "sample rate:" << m_engine->sampleRate()
+             << "audio channels:" << m_engine->channels()
+             << "MIDI channels:" << m_engine->midiBanks() * MidiEvent::BANK_CHANNELS;
 
-    /* FluidLite initialization */
-    m_settings = new_fluid_settings();
-    fluid_settings_setnum(m_settings, "synth.sample-rate", m_sampleRate);
-    fluid_settings_setnum(m_settings, "synth.gain", 1.0);
-    m_synth = new_fluid_synth(m_settings);
-    qDebug() << Q_FUNC_INFO << "synthesis frames:" << m_renderingFrames << "sample rate:" << m_sampleRate << "audio channels:" << m_channels;
+    m_carry.resize(m_engine->blockFrames() * m_engine->channels());
+    m_carriedFrames = 0;
 
     /* QAudioFormat initialization */
-    m_format.setSampleRate(m_sampleRate);
-    m_format.setChannelCount(m_channels);
+    m_format.setSampleRate(m_engine->sampleRate());
+    m_format.setChannelCount(m_engine->channels());
 #if QT_VERSION < QT_VERSION_CHECK(6,0,0)
-    m_format.setSampleSize(m_sample_size);
+    m_format.setSampleSize(sizeof(float) * CHAR_BIT);
     m_format.setCodec("audio/pcm");
     m_format.setSampleType(QAudioFormat::Float);
     m_format.setByteOrder(QAudioFormat::LittleEndian);
@@ -85,32 +121,68 @@ SynthRenderer::initSynth()
 
 SynthRenderer::~SynthRenderer()
 {
+    closeExtraPorts();
     if (m_input != nullptr) {
         m_input->disconnect();
         m_input->close();
     }
-    delete_fluid_synth(m_synth);
-    delete_fluid_settings(m_settings);
+    m_engine.reset();
     //qDebug() << Q_FUNC_INFO;
 }
 
 qint64 SynthRenderer::readData(char *data, qint64 maxlen)
+{
+    return render(data, maxlen);
+}
+
+/**
+ * Fills the whole request, as long as it holds whole frames. The engine
+ * renders whole synthesis blocks only, so when the request ends inside a
+ * block, the rest of that block is kept for the next call.
+ */
+qint64 SynthRenderer::render(char *data, qint64 maxlen)
 {
     //qDebug() << Q_FUNC_INFO << "starting with maxlen:" << maxlen;
-    const qint64 bufferSamples = m_renderingFrames * m_channels;
-    const qint64 bufferBytes = bufferSamples * sizeof(float);
-    Q_ASSERT(bufferBytes > 0 && bufferBytes <= maxlen);
-    qint64 buflen = (maxlen / bufferBytes) * bufferBytes;
-    qint64 length = buflen;
-    
+    const Qt::HANDLE thread = QThread::currentThreadId();
+    if (thread != m_renderThread.load(std::memory_order_relaxed)
+            || m_appliedGeneration != m_realtimeGeneration.load(std::memory_order_acquire)) {
+        prepareRenderThread(thread);
+    }
+    TraceScope trace("audio", "readData", maxlen);
+    const int channels = m_engine->channels();
+    const qint64 frameBytes = channels * qint64(sizeof(float));
     float *buffer = reinterpret_cast<float *>(data);
-    while (length > 0) {
-        fluid_synth_write_float(m_synth, m_renderingFrames, buffer, 0, m_channels, buffer, 1, m_channels);
-        length -= bufferBytes;
-        buffer += bufferSamples;
+    qint64 frames = maxlen / frameBytes;
+    const qint64 carried = qMin<qint64>(frames, m_carriedFrames);
+    if (carried > 0) {
+        const float *source = m_carry.data() + (m_engine->blockFrames() - m_carriedFrames) * channels;
+        std::copy(source, source + carried * channels, buffer);
+        m_carriedFrames -= int(carried);
+        buffer += carried * channels;
+        frames -= carried;
     }
-
+    const qint64 rendered = frames > 0 ? m_engine->render(buffer, frames) : 0;
+    buffer += rendered * channels;
+    frames -= rendered;
+    if (frames > 0) {
+        m_engine->render(m_carry.data(), m_engine->blockFrames());
+        std::copy(m_carry.data(), m_carry.data() + frames * channels, buffer);
+        m_carriedFrames = m_engine->blockFrames() - int(frames);
+    }
+    const qint64 buflen = (maxlen / frameBytes) * frameBytes;
     m_lastBufferSize = buflen;
+    FanoutRing *fanout = m_fanout.load(std::memory_order_acquire);
+    if (fanout != nullptr) {
+        fanout->write(reinterpret_cast<const float *>(data), int(buflen / frameBytes));
+    }
+    ShmTap *tap = m_shmTap.load(std::memory_order_acquire);
+    if (tap != nullptr) {
+        tap->write(reinterpret_cast<const float *>(data), int(buflen / frameBytes),
+                   m_engine->renderedFrames() - m_carriedFrames);
+    }
+    if (m_firstAudioTime.load(std::memory_order_relaxed) < 0) {
+        m_firstAudioTime.store(StartupTrace::elapsed(), std::memory_order_release);
+    }
     //qDebug() << Q_FUNC_INFO << "before returning" << buflen;
     return buflen;
 }
@@ -146,6 +218,8 @@ void
 SynthRenderer::start()
 {
     //qDebug() << Q_FUNC_INFO;
+    // events received while stopped
+    m_engine->processEvents();
     open(QIODevice::ReadOnly | QIODevice::Unbuffered);
 }
 
@@ -156,6 +230,7 @@ SynthRenderer::stop()
     if (isOpen()) {
         close();
     }
+    m_engine->processEvents();
 }
 
 QStringList 
@@ -201,6 +276,24 @@ SynthRenderer::subscribe(const QString& portName)
     }
 }
 
+/**
+ * Returns the synthetic input backend, when it is the current MIDI driver.
+ */
+LoadGenerator *
+SynthRenderer::loadGenerator() const
+{
+    return qobject_cast<LoadGenerator*>(m_input);
+}
+
+/**
+ * Returns the timestamped network backend, when it has been loaded.
+ */
+NetMidiInput *
+SynthRenderer::netMidiInput() const
+{
+    return qobject_cast<NetMidiInput*>(m_backends.value(NetMidiInput::BACKEND_NAME));
+}
+
 const QString 
 SynthRenderer::midiDriver() const
 {
@@ -218,132 +311,627 @@ SynthRenderer::setMidiDriver(const QString newMidiDriver)
             m_input->disconnect();
             m_input->close();
         }
-        m_input = m_man.inputBackendByName(m_midiDriver);
+        m_input = loadInputBackend(m_midiDriver);
         if (m_input != nullptr) {
-            QObject::connect(m_input, &MIDIInput::midiNoteOn, this, &SynthRenderer::noteOn);
-            QObject::connect(m_input, &MIDIInput::midiNoteOff, this, &SynthRenderer::noteOff);
-            QObject::connect(m_input, &MIDIInput::midiKeyPressure, this, &SynthRenderer::keyPressure);
-            QObject::connect(m_input, &MIDIInput::midiController, this, &SynthRenderer::controller);
-            QObject::connect(m_input, &MIDIInput::midiProgram, this, &SynthRenderer::program);
-            QObject::connect(m_input, &MIDIInput::midiChannelPressure, this, &SynthRenderer::channelPressure);
-            QObject::connect(m_input, &MIDIInput::midiPitchBend, this, &SynthRenderer::pitchBend);
+            StartupTrace::mark("MIDI backend loaded");
+            for (int i = m_extraPorts.size() - 1; i >= 0; --i) {
+                if (m_extraPorts[i].input == m_input) {
+                    qWarning() << Q_FUNC_INFO << "closing the extra port" << m_extraPorts[i].name;
+                    m_input->disconnect();
+                    m_input->close();
+                    m_extraPorts.remove(i);
+                }
+            }
+            connectInput(m_input, 0);
+        }
+    }
+}
+
+/**
+ * Connects the events of an input backend to the channels starting at
+ * firstChannel. The events go straight from the backend thread into the
+ * event queue.
+ */
+void
+SynthRenderer::connectInput(MIDIInput *input, int firstChannel)
+{
+    auto network = qobject_cast<NetMidiInput*>(input);
+    if (network != nullptr) {
+        // timestamped events skip the signals, to be applied at their frames
+        network->setRenderer(this, firstChannel);
+        return;
+    }
+    if (firstChannel == 0) {
+        QObject::connect(input, &MIDIInput::midiNoteOn, this, &SynthRenderer::noteOn, Qt::DirectConnection);
+        QObject::connect(input, &MIDIInput::midiNoteOff, this, &SynthRenderer::noteOff, Qt::DirectConnection);
+        QObject::connect(input, &MIDIInput::midiKeyPressure, this, &SynthRenderer::keyPressure, Qt::DirectConnection);
+        QObject::connect(input, &MIDIInput::midiController, this, &SynthRenderer::controller, Qt::DirectConnection);
+        QObject::connect(input, &MIDIInput::midiProgram, this, &SynthRenderer::program, Qt::DirectConnection);
+        QObject::connect(input, &MIDIInput::midiChannelPressure, this, &SynthRenderer::channelPressure, Qt::DirectConnection);
+        QObject::connect(input, &MIDIInput::midiPitchBend, this, &SynthRenderer::pitchBend, Qt::DirectConnection);
+        return;
+    }
+    QObject::connect(input, &MIDIInput::midiNoteOn, this, [this, firstChannel](int chan, int note, int vel) {
+        noteOn(firstChannel + chan, note, vel);
+    }, Qt::DirectConnection);
+    QObject::connect(input, &MIDIInput::midiNoteOff, this, [this, firstChannel](int chan, int note, int vel) {
+        noteOff(firstChannel + chan, note, vel);
+    }, Qt::DirectConnection);
+    QObject::connect(input, &MIDIInput::midiKeyPressure, this, [this, firstChannel](int chan, int note, int value) {
+        keyPressure(firstChannel + chan, note, value);
+    }, Qt::DirectConnection);
+    QObject::connect(input, &MIDIInput::midiController, this, [this, firstChannel](int chan, int control, int value) {
+        controller(firstChannel + chan, control, value);
+    }, Qt::DirectConnection);
+    QObject::connect(input, &MIDIInput::midiProgram, this, [this, firstChannel](int chan, int program) {
+        this->program(firstChannel + chan, program);
+    }, Qt::DirectConnection);
+    QObject::connect(input, &MIDIInput::midiChannelPressure, this, [this, firstChannel](int chan, int value) {
+        channelPressure(firstChannel + chan, value);
+    }, Qt::DirectConnection);
+    QObject::connect(input, &MIDIInput::midiPitchBend, this, [this, firstChannel](int chan, int value) {
+        pitchBend(firstChannel + chan, value);
+    }, Qt::DirectConnection);
+}
+
+/**
+ * The number of banks of 16 MIDI channels of the synth, fixed when it is
+ * created: one for the main port and one for each extra port.
+ */
+int
+SynthRenderer::midiBanks() const
+{
+    return m_engine->midiBanks();
+}
+
+QStringList
+SynthRenderer::extraPorts() const
+{
+    QStringList result;
+    foreach(const auto &port, m_extraPorts) {
+        result << port.name;
+    }
+    return result;
+}
+
+/**
+ * Opens additional MIDI input ports, given as "driver:port" strings, each
+ * one playing the next bank of 16 channels. A Drumstick backend opens a
+ * single connection, so a driver already playing the main port or another
+ * extra port is rejected; only the built-in load generator gets a new
+ * instance for each port. Returns false, with the reasons in error, when
+ * any port couldn't be opened; the others are opened anyway.
+ */
+bool
+SynthRenderer::setExtraPorts(const QStringList &ports, QString *error)
+{
+    //qDebug() << Q_FUNC_INFO << ports;
+    closeExtraPorts();
+    QStringList errors;
+    for (int i = 0; i < ports.size(); ++i) {
+        const int bank = i + 1;
+        if (bank >= m_engine->midiBanks()) {
+            errors << QString("No MIDI channels left for %1").arg(ports[i]);
+            continue;
+        }
+        const int separator = ports[i].indexOf(':');
+        if (separator <= 0) {
+            errors << QString("Wrong MIDI port: %1").arg(ports[i]);
+            continue;
+        }
+        const QString driver = ports[i].left(separator);
+        const QString portName = ports[i].mid(separator + 1);
+        MIDIInput *input = loadInputBackend(driver);
+        if (input == nullptr) {
+            errors << QString("MIDI driver unavailable for %1").arg(ports[i]);
+            continue;
+        }
+        bool busy = input == m_input;
+        QString busyPort = m_portName;
+        foreach(const auto &port, m_extraPorts) {
+            if (port.input == input) {
+                busy = true;
+                busyPort = port.name;
+            }
+        }
+        bool owned = false;
+        if (busy && driver == LoadGenerator::BACKEND_NAME) {
+            input = new LoadGenerator(this);
+            owned = true;
+        } else if (busy) {
+            errors << QString("The %1 driver opens a single MIDI port, already used by %2: %3 is ignored")
+                      .arg(driver, busyPort, ports[i]);
+            continue;
+        }
+        auto avail = input->connections(true);
+        auto it = std::find_if(avail.constBegin(), avail.constEnd(),
+                               [portName](const MIDIConnection& c) {
+                                   return c.first == portName;
+                               });
+        if (it == avail.constEnd()) {
+            errors << QString("MIDI port not found: %1").arg(ports[i]);
+            if (owned) {
+                delete input;
+            }
+            continue;
+        }
+        connectInput(input, bank * MidiEvent::BANK_CHANNELS);
+        input->open(*it);
+        m_extraPorts << ExtraPort{ports[i], input, owned};
+    }
+    foreach(const auto &message, errors) {
+        qWarning() << Q_FUNC_INFO << message;
+    }
+    if (error != nullptr) {
+        *error = errors.join('\n');
+    }
+    return errors.isEmpty();
+}
+
+void
+SynthRenderer::closeExtraPorts()
+{
+    foreach(const auto &port, m_extraPorts) {
+        port.input->disconnect();
+        port.input->close();
+        if (port.owned) {
+            delete port.input;
+        }
+    }
+    m_extraPorts.clear();
+}
+
+/**
+ * Loads only the plugin providing the requested input backend. The plugin
+ * path is remembered in the program settings, so after the first run no
+ * other plugin is scanned. The Drumstick BackendManager, which loads every
+ * plugin, is the last resort. The load generator and the timestamped
+ * network input are built in.
+ */
+MIDIInput *
+SynthRenderer::loadInputBackend(const QString &name)
+{
+    if (m_backends.contains(name)) {
+        return m_backends.value(name);
+    }
+    if (name == LoadGenerator::BACKEND_NAME) {
+        auto input = new LoadGenerator(this);
+        m_backends.insert(name, input);
+        return input;
+    }
+    if (name == NetMidiInput::BACKEND_NAME) {
+        auto input = new NetMidiInput(this);
+        m_backends.insert(name, input);
+        return input;
+    }
+    QVariantMap paths = ProgramSettings::instance()->midiBackendPaths();
+    QString cached = paths.value(name).toString();
+    if (!cached.isEmpty()) {
+        QPluginLoader loader(cached);
+        auto input = qobject_cast<MIDIInput*>(loader.instance());
+        if (input != nullptr && input->backendName() == name) {
+            m_backends.insert(name, input);
+            return input;
+        }
+        paths.remove(name);
+    }
+    foreach(const auto &dir, backendPaths()) {
+        QDir pluginsDir(dir);
+        foreach(const auto &fileName, pluginsDir.entryList(QDir::Files)) {
+            const QString path = pluginsDir.absoluteFilePath(fileName);
+            if (!QLibrary::isLibrary(path) || path == cached) {
+                continue;
+            }
+            QPluginLoader loader(path);
+            auto input = qobject_cast<MIDIInput*>(loader.instance());
+            if (input == nullptr) {
+                loader.unload();
+                continue;
+            }
+            m_backends.insert(input->backendName(), input);
+            paths.insert(input->backendName(), path);
+            if (input->backendName() == name) {
+                ProgramSettings::instance()->setMidiBackendPaths(paths);
+                return input;
+            }
         }
     }
+    ProgramSettings::instance()->setMidiBackendPaths(paths);
+    if (m_man.isNull()) {
+        m_man.reset(new BackendManager());
+    }
+    auto input = m_man->inputBackendByName(name);
+    if (input != nullptr) {
+        m_backends.insert(name, input);
+    }
+    return input;
+}
+
+QStringList
+SynthRenderer::backendPaths()
+{
+    // the same locations searched by drumstick::rt::BackendManager
+    const QString drumstick = QStringLiteral("drumstick2");
+    QStringList result;
+    QString envdir = qEnvironmentVariable("DRUMSTICKRT");
+    if (!envdir.isEmpty()) {
+        result << envdir;
+    }
+    QString appPath = QCoreApplication::applicationDirPath() + QDir::separator();
+#if defined(Q_OS_WIN)
+    result << appPath + drumstick;
+#elif defined(Q_OS_MAC)
+    result << appPath + QStringLiteral("../PlugIns/") + drumstick;
+#else
+    result << appPath + QStringLiteral("../lib/") + drumstick;
+#endif
+#if QT_VERSION < QT_VERSION_CHECK(6,0,0)
+    result << QLibraryInfo::location(QLibraryInfo::PluginsPath) + QDir::separator() + drumstick;
+#else
+    result << QLibraryInfo::path(QLibraryInfo::PluginsPath) + QDir::separator() + drumstick;
+#endif
+    foreach(const auto &path, QCoreApplication::libraryPaths()) {
+        result << path + QDir::separator() + drumstick;
+    }
+    result.removeDuplicates();
+    return result;
 }
 
 void SynthRenderer::noteOn(const int chan, const int note, const int vel)
 {
     //qDebug() << Q_FUNC_INFO << chan << note << vel;
-    fluid_synth_noteon(m_synth, chan, note, vel);
-    emit midiNoteOn(note, vel);
+    m_engine->noteOn(chan, note, vel);
 }
 
 void SynthRenderer::noteOff(const int chan, const int note, const int vel)
 {
     //qDebug() << Q_FUNC_INFO << chan << note;
-    fluid_synth_noteoff(m_synth, chan, note);
-    emit midiNoteOff(note, vel);
+    m_engine->noteOff(chan, note, vel);
 }
 
 void SynthRenderer::keyPressure(const int chan, const int note, const int value) 
 {
     //qDebug() << Q_FUNC_INFO << chan << note << value;
-    fluid_synth_key_pressure(m_synth, chan, note, value);
+    m_engine->keyPressure(chan, note, value);
 }
 
 void SynthRenderer::controller(const int chan, const int control, const int value) 
 {
     //qDebug() << Q_FUNC_INFO << chan << control << value;
-    fluid_synth_cc(m_synth, chan, control, value);
+    m_engine->controller(chan, control, value);
 }
 
 void SynthRenderer::program(const int chan, const int program) 
 {
     //qDebug() << Q_FUNC_INFO << chan << program;
-    fluid_synth_program_change(m_synth, chan, program);
+    m_engine->program(chan, program);
 }
 
 void SynthRenderer::channelPressure(const int chan, const int value) 
 {
     //qDebug() << Q_FUNC_INFO << chan << value;
-    fluid_synth_channel_pressure(m_synth, chan, value);
+    m_engine->channelPressure(chan, value);
 }
 
 void SynthRenderer::pitchBend(const int chan, const int value) 
 {
     //qDebug() << Q_FUNC_INFO << chan << value;
-    fluid_synth_pitch_bend(m_synth, chan, value);
+    m_engine->pitchBend(chan, value);
+}
+
+/**
+ * Logs every posted MIDI event into a session recorder, or stops logging
+ * when the recorder is null. The recorder must outlive its use here.
+ */
+void SynthRenderer::setRecorder(SessionRecorder *recorder)
+{
+    m_engine->setObserver(recorder);
+}
+
+bool SynthRenderer::scheduleEvent(qint64 frame, const MidiEvent &ev)
+{
+    return m_engine->scheduleEvent(frame, ev);
+}
+
+qint64 SynthRenderer::frameAt(qint64 steadyNsecs) const
+{
+    return m_engine->frameAt(steadyNsecs);
+}
+
+bool SynthRenderer::controllerCoalescing() const
+{
+    return m_engine->controllerCoalescing();
+}
+
+void SynthRenderer::setControllerCoalescing(bool enabled)
+{
+    m_engine->setControllerCoalescing(enabled);
+}
+
+quint64 SynthRenderer::coalescedEvents() const
+{
+    return m_engine->coalescedEvents();
+}
+
+quint64 SynthRenderer::droppedEvents() const
+{
+    return m_engine->droppedEvents();
+}
+
+const KeyboardState &SynthRenderer::keyboardState() const
+{
+    return m_engine->keyboardState();
+}
+
+/**
+ * The synthesis engine, for the users needing its plain C++ interface.
+ */
+SynthEngine &SynthRenderer::engine()
+{
+    return *m_engine;
+}
+
+const SynthEngine &SynthRenderer::engine() const
+{
+    return *m_engine;
+}
+
+RenderMetrics &SynthRenderer::metrics()
+{
+    return m_engine->metrics();
+}
+
+qint64 SynthRenderer::soundfontMemory() const
+{
+    return m_engine->soundfontMemory();
+}
+
+bool SynthRenderer::profiling() const
+{
+    return m_engine->profiling();
+}
+
+void SynthRenderer::setProfiling(bool enabled)
+{
+    m_engine->setProfiling(enabled);
+}
+
+VoiceProfiler &SynthRenderer::profiler()
+{
+    return m_engine->profiler();
+}
+
+bool SynthRenderer::drumCaching() const
+{
+    return m_engine->drumCaching();
+}
+
+void SynthRenderer::setDrumCaching(bool enabled, size_t memoryLimit)
+{
+    //qDebug() << Q_FUNC_INFO << enabled << memoryLimit;
+    m_engine->setDrumCaching(enabled, memoryLimit);
+}
+
+const DrumCache &SynthRenderer::drumCache() const
+{
+    return m_engine->drumCache();
+}
+
+bool SynthRenderer::realtimeMode() const
+{
+    return m_realtime;
+}
+
+void SynthRenderer::setRealtimeMode(bool enabled, int priority, int cpu)
+{
+    //qDebug() << Q_FUNC_INFO << enabled << priority << cpu;
+    m_realtime = enabled;
+    m_realtimePriority = priority;
+    m_cpuAffinity = cpu;
+    if (enabled) {
+        if (RealtimeSupport::lockMemory()) {
+            updateRealtimeFlags(MemoryLocked, 0);
+        } else {
+            qWarning() << Q_FUNC_INFO << "Unable to lock the process memory";
+        }
+    } else if (m_realtimeFlags & MemoryLocked) {
+        RealtimeSupport::unlockMemory();
+        updateRealtimeFlags(0, MemoryLocked);
+    }
+    // the audio thread applies the remaining settings on its next buffer
+    ++m_realtimeGeneration;
+}
+
+int SynthRenderer::realtimeFlags() const
+{
+    return m_realtimeFlags;
+}
+
+QString SynthRenderer::realtimeStatus() const
+{
+    if (!m_realtime) {
+        return QStringLiteral("real-time mode: off");
+    }
+    const int flags = m_realtimeFlags;
+    QStringList status;
+    if (flags & MainThreadRendering) {
+        status << QStringLiteral("not applied to the main thread");
+    } else if (flags & RealtimeScheduling) {
+        status << QString("SCHED_FIFO priority %1%2").arg(m_realtimePriority)
+                  .arg(flags & RealtimeKit ? " (rtkit)" : "");
+    } else if (flags & SchedulingDenied) {
+        status << QStringLiteral("SCHED_FIFO denied");
+    } else {
+        status << QStringLiteral("pending");
+    }
+    if (m_cpuAffinity >= 0) {
+        status << (flags & CpuAffinity ? QString("cpu %1").arg(m_cpuAffinity)
+                                       : QString("cpu %1 denied").arg(m_cpuAffinity));
+    }
+    status << (flags & MemoryLocked ? QStringLiteral("memory locked")
+                                    : QStringLiteral("memory not locked"));
+    if (flags & DenormalsFlushed) {
+        status << QStringLiteral("denormals flushed");
+    }
+    return QStringLiteral("real-time mode: ") + status.join(", ");
+}
+
+/**
+ * Sets and clears real-time flags atomically: the render thread and the
+ * thread owning the renderer both update them.
+ */
+void SynthRenderer::updateRealtimeFlags(int set, int clear)
+{
+    int flags = m_realtimeFlags.load(std::memory_order_relaxed);
+    while (!m_realtimeFlags.compare_exchange_weak(flags, (flags & ~clear) | set)) {
+    }
+}
+
+/**
+ * Applies the real-time settings to the thread rendering the audio, once
+ * for every change of the settings or of the render thread. The main
+ * thread runs the event loop, and is never given a real-time priority.
+ */
+void SynthRenderer::prepareRenderThread(Qt::HANDLE thread)
+{
+    m_renderThread.store(thread, std::memory_order_relaxed);
+    m_appliedGeneration = m_realtimeGeneration.load(std::memory_order_acquire);
+    const QCoreApplication *app = QCoreApplication::instance();
+    const bool mainThread = app != nullptr && QThread::currentThread() == app->thread();
+    Tracer::prepareThread();
+    if (!mainThread) {
+        Tracer::setThreadName("audio render");
+    }
+    const int previous = m_realtimeFlags.load(std::memory_order_relaxed);
+    int flags = 0;
+    if (m_realtime && mainThread) {
+        flags |= MainThreadRendering;
+    } else if (m_realtime) {
+        RealtimeSupport::prefaultStack();
+        if (RealtimeSupport::flushDenormals()) {
+            flags |= DenormalsFlushed;
+        }
+        int error = 0;
+        if (RealtimeSupport::setFifoScheduling(m_realtimePriority, &error)) {
+            flags |= RealtimeScheduling;
+        } else {
+            flags |= SchedulingDenied;
+#if defined(RTKIT_SUPPORT)
+            if (error == EPERM) {
+                const qint64 tid = RealtimeSupport::threadId();
+                QMetaObject::invokeMethod(this, [this, tid]{ requestRealtimeKit(tid); }, Qt::QueuedConnection);
+            }
+#endif
+        }
+        if (m_cpuAffinity >= 0 && RealtimeSupport::setAffinity(m_cpuAffinity)) {
+            flags |= CpuAffinity;
+        }
+    } else if ((previous & RealtimeScheduling) && !mainThread) {
+        RealtimeSupport::setNormalScheduling();
+    }
+    updateRealtimeFlags(flags, RENDER_THREAD_FLAGS);
+}
+
+void SynthRenderer::requestRealtimeKit(qint64 threadId)
+{
+#if defined(RTKIT_SUPPORT)
+    QDBusInterface rtkit(QStringLiteral("org.freedesktop.RealtimeKit1"),
+                         QStringLiteral("/org/freedesktop/RealtimeKit1"),
+                         QStringLiteral("org.freedesktop.RealtimeKit1"),
+                         QDBusConnection::systemBus());
+    if (!rtkit.isValid()) {
+        qWarning() << Q_FUNC_INFO << "RealtimeKit is not available";
+        return;
+    }
+    int priority = m_realtimePriority;
+    QVariant maxPriority = rtkit.property("MaxRealtimePriority");
+    if (maxPriority.isValid() && priority > maxPriority.toInt()) {
+        priority = maxPriority.toInt();
+    }
+    // RealtimeKit refuses threads of processes without a RLIMIT_RTTIME
+    qint64 maxRuntime = rtkit.property("RTTimeUSecMax").toLongLong();
+    RealtimeSupport::limitRealtimeRuntime(maxRuntime > 0 ? maxRuntime : 200000);
+    QDBusReply<void> reply = rtkit.call(QStringLiteral("MakeThreadRealtime"),
+                                        QVariant::fromValue(quint64(threadId)),
+                                        QVariant::fromValue(quint32(priority)));
+    if (reply.isValid()) {
+        m_realtimePriority = priority;
+        updateRealtimeFlags(RealtimeScheduling | RealtimeKit, SchedulingDenied);
+    } else {
+        qWarning() << Q_FUNC_INFO << reply.error().message();
+    }
+#else
+    Q_UNUSED(threadId)
+#endif
 }
 
 void
 SynthRenderer::initReverb(int reverb_type)
 {
     //qDebug() << Q_FUNC_INFO << reverb_type;
-    switch( reverb_type ) {
-    case 1:
-        fluid_synth_set_reverb(m_synth, 0.2, 0.2, 0.75, 0.8);
-        break;
-    case 2:
-        fluid_synth_set_reverb(m_synth, 0.4, 0.2, 0.75, 0.8);
-        break;
-    case 3:
-        fluid_synth_set_reverb(m_synth, 0.6, 0.2, 0.75, 0.8);
-        break;
-    case 4:
-        fluid_synth_set_reverb(m_synth, 0.8, 0.2, 0.75, 0.8);
-        break;
-    case 5:
-        fluid_synth_set_reverb(m_synth, 1.0, 0.2, 0.75, 0.8);
-        break;
-    };
-    fluid_synth_set_reverb_on(m_synth, reverb_type > 0 ?  1 : 0 );
+    m_engine->initReverb(reverb_type);
 }
 
 void
 SynthRenderer::initChorus(int chorus_type)
 {
     //qDebug() << Q_FUNC_INFO << chorus_type;
-    fluid_synth_set_chorus_on(m_synth, chorus_type > 0 ?  1 : 0 );
+    m_engine->initChorus(chorus_type);
 }
 
 void
 SynthRenderer::setReverbLevel(int amount)
 {
-    qreal newlevel = amount / 100.0;
-    qreal level = fluid_synth_get_reverb_level(m_synth);
-    //qDebug() << Q_FUNC_INFO << level << newlevel;
-    if (newlevel != level) {
-        qreal roomsize = fluid_synth_get_reverb_roomsize(m_synth); 
-        qreal damping = fluid_synth_get_reverb_damp(m_synth);
-        qreal width = fluid_synth_get_reverb_width(m_synth); 
-        fluid_synth_set_reverb(m_synth, roomsize, damping, width, newlevel);
-    }
+    m_engine->setReverbLevel(amount);
 }
 
 void
 SynthRenderer::setChorusLevel(int amount)
 {
-    qreal newlevel = amount / 100.0;
-    qreal level = fluid_synth_get_chorus_level(m_synth);
-    //qDebug() << Q_FUNC_INFO << level << newlevel;
-    if (newlevel != level) {
-        int nr = fluid_synth_get_chorus_nr(m_synth);
-        qreal speed = fluid_synth_get_chorus_speed_Hz(m_synth);
-        qreal depth = fluid_synth_get_chorus_depth_ms(m_synth);
-        int type = fluid_synth_get_chorus_type(m_synth);
-        fluid_synth_set_chorus(m_synth, nr, newlevel, speed, depth, type);
-    }
+    m_engine->setChorusLevel(amount);
 }
 
 void
 SynthRenderer::openSoundfont(const QString fileName)
 {
     //qDebug() << Q_FUNC_INFO << fileName;
-    m_file = fileName;
-    if (m_synth != nullptr) {
-        auto result = fluid_synth_sfload(m_synth, fileName.toLocal8Bit(), 1);
-        m_sf2loaded = result != -1;
+    m_engine->openSoundfont(fileName.toLocal8Bit().toStdString());
+}
+
+bool
+SynthRenderer::closeSoundfont(const QString fileName)
+{
+    //qDebug() << Q_FUNC_INFO << fileName;
+    return m_engine->closeSoundfont(fileName.toLocal8Bit().toStdString());
+}
+
+/**
+ * Plays a preset: percussion banks on the MIDI channel 10, and melodic
+ * ones on the first channel with a bank select.
+ */
+void
+SynthRenderer::selectPreset(int bank, int program)
+{
+    //qDebug() << Q_FUNC_INFO << bank << program;
+    if (bank == DRUM_BANK) {
+        m_engine->program(DRUM_CHANNEL, program);
+        return;
     }
+    m_engine->controller(0, BANK_SELECT, bank);
+    m_engine->program(0, program);
+}
+
+/**
+ * The soundfonts loaded successfully, in loading order.
+ */
+QStringList
+SynthRenderer::soundfonts() const
+{
+    QStringList result;
+    for (const auto &fileName : m_engine->soundfonts()) {
+        result << QString::fromLocal8Bit(fileName.c_str());
+    }
+    return result;
 }
 
 qint64 SynthRenderer::lastBufferSize() const
@@ -351,11 +939,56 @@ qint64 SynthRenderer::lastBufferSize() const
     return m_lastBufferSize;
 }
 
+/**
+ * Emits firstAudioRendered once after the audio thread has rendered its
+ * first buffer. Called periodically from the thread owning the renderer,
+ * so the audio thread never needs to post anything.
+ */
+void SynthRenderer::notifyFirstAudio()
+{
+    const qint64 nsecs = m_firstAudioTime.load(std::memory_order_acquire);
+    if (nsecs >= 0 && !m_firstAudioNotified) {
+        m_firstAudioNotified = true;
+        StartupTrace::mark("first audio block rendered", nsecs);
+        emit firstAudioRendered();
+    }
+}
+
+quint64 SynthRenderer::bypassedFrames() const
+{
+    return m_engine->bypassedFrames();
+}
+
+quint64 SynthRenderer::renderedFrames() const
+{
+    return m_engine->renderedFrames();
+}
+
 void SynthRenderer::resetLastBufferSize()
 {
     m_lastBufferSize = 0;
 }
 
+/**
+ * Publishes every rendered buffer into a ring read by the extra audio
+ * outputs, or stops publishing when null. The ring must outlive the
+ * renderer once set.
+ */
+void SynthRenderer::setFanout(FanoutRing *ring)
+{
+    m_fanout.store(ring, std::memory_order_release);
+}
+
+/**
+ * Publishes every rendered buffer into a shared memory ring for other
+ * processes, or stops publishing when null. Like the fanout ring, the tap
+ * must outlive the renderer once set.
+ */
+void SynthRenderer::setShmTap(ShmTap *tap)
+{
+    m_shmTap.store(tap, std::memory_order_release);
+}
+
 const QAudioFormat&
 SynthRenderer::format() const
 {
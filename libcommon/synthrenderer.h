@@ -23,16 +23,31 @@
 #include <QIODevice>
 #include <QScopedPointer>
 #include <QAudioFormat>
+#include <QMap>
+#include <QVector>
+#include <vector>
 #include <drumstick/backendmanager.h>
 #include <drumstick/rtmidiinput.h>
-#include <fluidlite.h>
-
+#include "synthengine.h"
+#include "fanoutring.h"
+#include "shmtap.h"
+#include "loadgenerator.h"
+#include "netmidiinput.h"
+
+class SessionRecorder;
+
+/**
+ * Plays a SynthEngine through Qt Multimedia, as the QIODevice read by the
+ * audio output, and feeds it from the Drumstick::RT input backends. The
+ * engine owns the synthesis; this class adds the MIDI ports, the real-time
+ * scheduling of the audio thread and the audio format.
+ */
 class SynthRenderer : public QIODevice
 {
     Q_OBJECT
 
 public:
-    explicit SynthRenderer(QObject *parent = 0);
+    SynthRenderer(int midiBanks, const QString &engineProfile, QObject *parent = 0);
     virtual ~SynthRenderer();
 
     /* QIODevice */
@@ -40,6 +55,7 @@ public:
     qint64 writeData(const char *data, qint64 len) override;
 	qint64 size() const override;
 	qint64 bytesAvailable() const override;
+    qint64 render(char *data, qint64 maxlen);
 
     /* Drumstick::RT */
     const QString midiDriver() const;
@@ -47,6 +63,11 @@ public:
     QStringList connections() const;
     QString subscription() const;
     void subscribe(const QString& portName);
+    LoadGenerator *loadGenerator() const;
+    NetMidiInput *netMidiInput() const;
+    int midiBanks() const;
+    QStringList extraPorts() const;
+    bool setExtraPorts(const QStringList &ports, QString *error = nullptr);
     void start();
     void stop();
     bool stopped();
@@ -57,6 +78,48 @@ public:
     void setReverbLevel(int amount);
     void setChorusLevel(int amount);
     void openSoundfont(const QString fileName);
+    bool closeSoundfont(const QString fileName);
+    QStringList soundfonts() const;
+    void selectPreset(int bank, int program);
+
+    /* MIDI event queue */
+    bool controllerCoalescing() const;
+    void setControllerCoalescing(bool enabled);
+    quint64 coalescedEvents() const;
+    quint64 droppedEvents() const;
+    const KeyboardState &keyboardState() const;
+    void setRecorder(SessionRecorder *recorder);
+    bool scheduleEvent(qint64 frame, const MidiEvent &ev);
+    qint64 frameAt(qint64 steadyNsecs) const;
+
+    /* Metrics */
+    SynthEngine &engine();
+    const SynthEngine &engine() const;
+    RenderMetrics &metrics();
+    qint64 soundfontMemory() const;
+    bool profiling() const;
+    void setProfiling(bool enabled);
+    VoiceProfiler &profiler();
+
+    /* Drum cache */
+    bool drumCaching() const;
+    void setDrumCaching(bool enabled, size_t memoryLimit = DrumCache::DEFAULT_MEMORY_LIMIT);
+    const DrumCache &drumCache() const;
+
+    /* Real time */
+    enum RealtimeFlag {
+        RealtimeScheduling = 0x01,
+        RealtimeKit = 0x02,
+        CpuAffinity = 0x04,
+        MemoryLocked = 0x08,
+        DenormalsFlushed = 0x10,
+        SchedulingDenied = 0x20,
+        MainThreadRendering = 0x40
+    };
+    bool realtimeMode() const;
+    void setRealtimeMode(bool enabled, int priority, int cpu = -1);
+    int realtimeFlags() const;
+    QString realtimeStatus() const;
 
     static const int DEFAULT_SAMPLE_RATE;
     static const int DEFAULT_RENDERING_FRAMES;
@@ -65,11 +128,15 @@ public:
     /* Qt Multimedia */
     const QAudioFormat &format() const;
     qint64 lastBufferSize() const;
+    quint64 renderedFrames() const;
+    quint64 bypassedFrames() const;
+    void notifyFirstAudio();
     void resetLastBufferSize();
+    void setFanout(FanoutRing *ring);
+    void setShmTap(ShmTap *tap);
 
 signals:
-    void midiNoteOn(const int note, const int vel);
-    void midiNoteOff(const int note, const int vel);
+    void firstAudioRendered();
 
 public slots:
     void noteOn(const int chan, const int note, const int vel);
@@ -82,24 +149,49 @@ public slots:
 
 private:
     void initMIDI();
-    void initSynth();
+    drumstick::rt::MIDIInput *loadInputBackend(const QString &name);
+    void connectInput(drumstick::rt::MIDIInput *input, int firstChannel);
+    void closeExtraPorts();
+    static QStringList backendPaths();
+    void initSynth(int midiBanks, const QString &engineProfile);
+    void updateRealtimeFlags(int set, int clear);
+    void prepareRenderThread(Qt::HANDLE thread);
+    void requestRealtimeKit(qint64 threadId);
 
 private:
     /* Drumstick RT*/
     QString m_midiDriver;
     QString m_portName;
-    drumstick::rt::BackendManager m_man;
+    QScopedPointer<drumstick::rt::BackendManager> m_man;
+    QMap<QString, drumstick::rt::MIDIInput*> m_backends;
     drumstick::rt::MIDIInput *m_input;
+    struct ExtraPort {
+        QString name;
+        drumstick::rt::MIDIInput *input;
+        bool owned;
+    };
+    QVector<ExtraPort> m_extraPorts;
 
     /* FluidLite */
-    int m_sampleRate, m_renderingFrames, m_channels, m_sample_size;
-    fluid_settings_t *m_settings;
-    fluid_synth_t *m_synth;
-    bool m_sf2loaded;
-    QString m_file;
-    
+    QScopedPointer<SynthEngine> m_engine;
+    std::vector<float> m_carry;
+    int m_carriedFrames;
+
+    /* Real time */
+    std::atomic<bool> m_realtime;
+    std::atomic<int> m_realtimePriority;
+    std::atomic<int> m_cpuAffinity;
+    std::atomic<int> m_realtimeFlags;
+    std::atomic<unsigned> m_realtimeGeneration;
+    std::atomic<Qt::HANDLE> m_renderThread;
+    unsigned m_appliedGeneration;
+
     /* Qt Multimedia */
     int m_lastBufferSize;
+    std::atomic<qint64> m_firstAudioTime;
+    bool m_firstAudioNotified;
+    std::atomic<FanoutRing*> m_fanout;
+    std::atomic<ShmTap*> m_shmTap;
     QAudioFormat m_format;
 };
 
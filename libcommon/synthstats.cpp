@@ -0,0 +1,141 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QJsonDocument>
+#include <QTextStream>
+#include "synthstats.h"
+
+QJsonObject SynthStats::toJson() const
+{
+    QJsonObject obj;
+    obj["timestamp"] = timestamp;
+    obj["xruns"] = qint64(xruns);
+    obj["xrun_usecs"] = xrunTime;
+    obj["last_xrun_usecs"] = lastXrunTime;
+    obj["stalls"] = qint64(stalls);
+    obj["processed_usecs"] = processedTime;
+    obj["buffered_usecs"] = bufferedTime;
+    obj["buffer_usecs"] = bufferTime;
+    obj["rendered_frames"] = qint64(renderedFrames);
+    obj["bypassed_frames"] = qint64(bypassedFrames);
+    obj["silenced_frames"] = qint64(silencedFrames);
+    obj["coalesced_events"] = qint64(coalescedEvents);
+    obj["dropped_events"] = qint64(droppedEvents);
+    obj["realtime"] = realtimeStatus;
+    obj["engine_profile"] = engineProfile;
+    obj["sample_rate"] = sampleRate;
+    obj["block_frames"] = blockFrames;
+    obj["polyphony"] = polyphony;
+    obj["uptime_usecs"] = uptime;
+    obj["active_voices"] = activeVoices;
+    obj["peak_voices"] = peakVoices;
+    obj["midi_events"] = qint64(midiEvents);
+    obj["midi_events_per_second"] = eventsPerSecond;
+    obj["dsp_load_p50"] = dspLoad50;
+    obj["dsp_load_p95"] = dspLoad95;
+    obj["dsp_load_p99"] = dspLoad99;
+    obj["dsp_load_max"] = dspLoadMax;
+    obj["soundfont_bytes"] = soundfontMemory;
+    obj["drum_cache_hits"] = qint64(drumCacheHits);
+    obj["drum_cache_misses"] = qint64(drumCacheMisses);
+    obj["drum_cache_bytes"] = drumCacheMemory;
+    obj["network_packets"] = qint64(networkPackets);
+    obj["network_late_packets"] = qint64(networkLatePackets);
+    obj["network_reordered_packets"] = qint64(networkReorderedPackets);
+    obj["network_lost_packets"] = qint64(networkLostPackets);
+    obj["network_duplicate_packets"] = qint64(networkDuplicatePackets);
+    obj["network_dropped_events"] = qint64(networkDroppedEvents);
+    obj["network_playout_delay_usecs"] = networkPlayoutDelay;
+    obj["extra_outputs"] = extraOutputs;
+    obj["extra_output_underruns"] = qint64(extraOutputUnderruns);
+    obj["extra_output_overruns"] = qint64(extraOutputOverruns);
+    obj["extra_output_drift_ppm"] = extraOutputDrift;
+    return obj;
+}
+
+QByteArray SynthStats::toJsonLine() const
+{
+    return QJsonDocument(toJson()).toJson(QJsonDocument::Compact) + '\n';
+}
+
+static void addHeader(QTextStream &out, const char *name, const char *type, const char *help)
+{
+    out << "# HELP fluidlite_" << name << ' ' << help << '\n';
+    out << "# TYPE fluidlite_" << name << ' ' << type << '\n';
+}
+
+static void addSample(QTextStream &out, const char *name, double value, const char *labels = "")
+{
+    out << "fluidlite_" << name << labels << ' ' << value << '\n';
+}
+
+static void addMetric(QTextStream &out, const char *name, const char *type, const char *help, double value)
+{
+    addHeader(out, name, type, help);
+    addSample(out, name, value);
+}
+
+/**
+ * Returns the statistics in the Prometheus text exposition format.
+ */
+QByteArray SynthStats::toPrometheus() const
+{
+    QByteArray result;
+    QTextStream out(&result);
+    out.setRealNumberPrecision(12);
+    addMetric(out, "uptime_seconds", "gauge", "Time since the synthesizer was created.", uptime / 1e6);
+    addHeader(out, "engine_info", "gauge", "Engine profile and the parameters it sets.");
+    const QByteArray labels = QString("{profile=\"%1\",sample_rate=\"%2\",block_frames=\"%3\",polyphony=\"%4\"}")
+            .arg(engineProfile).arg(sampleRate).arg(blockFrames).arg(polyphony).toUtf8();
+    addSample(out, "engine_info", 1, labels.constData());
+    addMetric(out, "active_voices", "gauge", "Voices currently playing.", activeVoices);
+    addMetric(out, "peak_voices", "gauge", "Maximum number of voices playing at once.", peakVoices);
+    addMetric(out, "dsp_load_p50_percent", "gauge", "Median rendering time relative to the buffer duration in the last interval.", dspLoad50);
+    addMetric(out, "dsp_load_p95_percent", "gauge", "95th percentile of the rendering time relative to the buffer duration in the last interval.", dspLoad95);
+    addMetric(out, "dsp_load_p99_percent", "gauge", "99th percentile of the rendering time relative to the buffer duration in the last interval.", dspLoad99);
+    addMetric(out, "dsp_load_max_percent", "gauge", "Maximum rendering time relative to the buffer duration in the last interval.", dspLoadMax);
+    addMetric(out, "xruns_total", "counter", "Audio dropouts detected with the audio clock.", xruns);
+    addMetric(out, "xrun_seconds_total", "counter", "Accumulated duration of the audio dropouts.", xrunTime / 1e6);
+    addMetric(out, "stalls_total", "counter", "Audio output stalls.", stalls);
+    addMetric(out, "midi_events_total", "counter", "MIDI events applied to the synthesizer.", midiEvents);
+    addMetric(out, "midi_events_per_second", "gauge", "MIDI event rate in the last interval.", eventsPerSecond);
+    addMetric(out, "coalesced_events_total", "counter", "Controller events superseded before being applied.", coalescedEvents);
+    addMetric(out, "dropped_events_total", "counter", "MIDI events dropped because the event queue was full.", droppedEvents);
+    addMetric(out, "rendered_frames_total", "counter", "Audio frames rendered.", renderedFrames);
+    addMetric(out, "bypassed_frames_total", "counter", "Silent audio frames output without running the synthesis.", bypassedFrames);
+    addMetric(out, "silenced_frames_total", "counter", "Audio frames muted while a soundfont was loaded or unloaded.", silencedFrames);
+    addMetric(out, "soundfont_bytes", "gauge", "Memory used by the loaded soundfonts.", soundfontMemory);
+    addMetric(out, "drum_cache_hits_total", "counter", "Percussion hits played from the drum cache.", drumCacheHits);
+    addMetric(out, "drum_cache_misses_total", "counter", "Percussion hits not found in the drum cache.", drumCacheMisses);
+    addMetric(out, "drum_cache_bytes", "gauge", "Memory used by the drum cache.", drumCacheMemory);
+    addMetric(out, "network_packets_total", "counter", "Timestamped network MIDI packets received.", networkPackets);
+    addMetric(out, "network_late_packets_total", "counter", "Network MIDI packets arrived after their playout time.", networkLatePackets);
+    addMetric(out, "network_reordered_packets_total", "counter", "Network MIDI packets arrived out of order.", networkReorderedPackets);
+    addMetric(out, "network_lost_packets_total", "counter", "Network MIDI packets never received.", networkLostPackets);
+    addMetric(out, "network_duplicate_packets_total", "counter", "Network MIDI packets received more than once and discarded.", networkDuplicatePackets);
+    addMetric(out, "network_dropped_events_total", "counter", "Network MIDI events dropped because the scheduler was full.", networkDroppedEvents);
+    addMetric(out, "network_playout_delay_seconds", "gauge", "Jitter buffer delay of the network MIDI events.", networkPlayoutDelay / 1e6);
+    addMetric(out, "extra_outputs", "gauge", "Extra audio outputs playing the rendered audio.", extraOutputs);
+    addMetric(out, "extra_output_underruns_total", "counter", "Extra audio outputs running out of rendered audio.", extraOutputUnderruns);
+    addMetric(out, "extra_output_overruns_total", "counter", "Extra audio outputs left behind by the rendered audio.", extraOutputOverruns);
+    addMetric(out, "extra_output_drift_ppm", "gauge", "Largest clock drift compensated for an extra audio output.", extraOutputDrift);
+    addMetric(out, "buffer_latency_seconds", "gauge", "Duration of the audio output buffer.", bufferTime / 1e6);
+    addMetric(out, "buffered_seconds", "gauge", "Audio delivered to the output and not yet played.", bufferedTime / 1e6);
+    out.flush();
+    return result;
+}
@@ -0,0 +1,79 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SYNTHSTATS_H
+#define SYNTHSTATS_H
+
+#include <QString>
+#include <QJsonObject>
+
+/**
+ * A snapshot of the synthesizer statistics. Times are in microseconds,
+ * and the DSP load percentiles of the last interval in percent.
+ */
+struct SynthStats
+{
+    qint64 timestamp = 0;
+    quint64 xruns = 0;
+    qint64 xrunTime = 0;
+    qint64 lastXrunTime = 0;
+    quint64 stalls = 0;
+    qint64 processedTime = 0;
+    qint64 bufferedTime = 0;
+    qint64 bufferTime = 0;
+    quint64 renderedFrames = 0;
+    quint64 bypassedFrames = 0;
+    quint64 silencedFrames = 0;
+    quint64 coalescedEvents = 0;
+    quint64 droppedEvents = 0;
+    QString realtimeStatus;
+    QString engineProfile;
+    int sampleRate = 0;
+    int blockFrames = 0;
+    int polyphony = 0;
+    qint64 uptime = 0;
+    int activeVoices = 0;
+    int peakVoices = 0;
+    quint64 midiEvents = 0;
+    double eventsPerSecond = 0;
+    double dspLoad50 = 0;
+    double dspLoad95 = 0;
+    double dspLoad99 = 0;
+    double dspLoadMax = 0;
+    qint64 soundfontMemory = 0;
+    quint64 drumCacheHits = 0;
+    quint64 drumCacheMisses = 0;
+    qint64 drumCacheMemory = 0;
+    quint64 networkPackets = 0;
+    quint64 networkLatePackets = 0;
+    quint64 networkReorderedPackets = 0;
+    quint64 networkLostPackets = 0;
+    quint64 networkDuplicatePackets = 0;
+    quint64 networkDroppedEvents = 0;
+    qint64 networkPlayoutDelay = 0;
+    int extraOutputs = 0;
+    quint64 extraOutputUnderruns = 0;
+    quint64 extraOutputOverruns = 0;
+    double extraOutputDrift = 0;
+
+    QJsonObject toJson() const;
+    QByteArray toJsonLine() const;
+    QByteArray toPrometheus() const;
+};
+
+#endif // SYNTHSTATS_H
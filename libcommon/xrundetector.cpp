@@ -0,0 +1,141 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <cstdlib>
+#include "xrundetector.h"
+
+const int64_t XrunDetector::MIN_TOLERANCE = 2000;
+const double XrunDetector::DRIFT_ALLOWANCE = 200e-6;
+
+XrunDetector::XrunDetector():
+    m_xruns(0),
+    m_xrunTime(0),
+    m_lastXrunTime(0)
+{
+    restart();
+}
+
+/**
+ * Starts measuring a new audio clock, keeping the accumulated counters.
+ */
+void XrunDetector::restart()
+{
+    m_first = true;
+    m_inXrun = false;
+    m_prevWall = 0;
+    m_prevProcessed = 0;
+    m_lastProgress = 0;
+    m_jitter = 0;
+    m_debt = 0;
+    m_buffered = 0;
+    m_starved = 0;
+}
+
+/**
+ * Takes a new sample of the clocks. While not settled, only the jitter of
+ * the audio clock is measured. Returns true when a new xrun begins.
+ */
+bool XrunDetector::update(int64_t wall, int64_t processed, int64_t delivered, bool settled)
+{
+    if (m_first) {
+        m_first = false;
+        m_prevWall = wall;
+        m_prevProcessed = processed;
+        m_lastProgress = wall;
+        m_buffered = delivered - processed;
+        return false;
+    }
+    const int64_t elapsed = wall - m_prevWall;
+    const int64_t advanced = processed - m_prevProcessed;
+    const int64_t gap = elapsed - advanced;
+    m_prevWall = wall;
+    m_prevProcessed = processed;
+    m_buffered = delivered - processed;
+    if (advanced > 0) {
+        m_lastProgress = wall;
+    }
+    if (!settled) {
+        m_jitter = std::max(m_jitter, std::abs(gap));
+        return false;
+    }
+
+    int64_t missing = 0;
+    m_debt += gap - static_cast<int64_t>(elapsed * DRIFT_ALLOWANCE);
+    if (m_debt < 0) {
+        m_debt = 0;
+    } else if (m_debt > tolerance()) {
+        missing = m_debt;
+        m_debt = 0;
+    }
+    // the device consumed audio that was never delivered
+    const int64_t starved = m_buffered < 0 ? -m_buffered : 0;
+    if (starved > m_starved) {
+        missing = std::max(missing, starved - m_starved);
+    }
+    m_starved = starved;
+
+    if (missing == 0) {
+        m_inXrun = false;
+        return false;
+    }
+    m_xrunTime += missing;
+    if (m_inXrun) {
+        m_lastXrunTime += missing;
+        return false;
+    }
+    m_inXrun = true;
+    m_lastXrunTime = missing;
+    ++m_xruns;
+    return true;
+}
+
+bool XrunDetector::isStalled(int64_t wall, int64_t window) const
+{
+    return !m_first && (wall - m_lastProgress) > window;
+}
+
+uint64_t XrunDetector::xruns() const
+{
+    return m_xruns;
+}
+
+int64_t XrunDetector::xrunTime() const
+{
+    return m_xrunTime;
+}
+
+int64_t XrunDetector::lastXrunTime() const
+{
+    return m_lastXrunTime;
+}
+
+int64_t XrunDetector::bufferedTime() const
+{
+    return m_buffered;
+}
+
+int64_t XrunDetector::processedTime() const
+{
+    return m_prevProcessed;
+}
+
+int64_t XrunDetector::tolerance() const
+{
+    return std::max(MIN_TOLERANCE, m_jitter * 3 / 2);
+}
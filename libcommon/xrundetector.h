@@ -0,0 +1,66 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef XRUNDETECTOR_H
+#define XRUNDETECTOR_H
+
+#include <cstdint>
+
+/**
+ * Detects audio dropouts comparing the audio clock of the output device
+ * (the processed time) with the wall clock and with the audio delivered
+ * to the device. Any time the audio clock falls behind the wall clock by
+ * more than the measured jitter, or the device consumes more audio than
+ * was delivered, is accounted as an xrun of that duration.
+ * All the times are in microseconds.
+ */
+class XrunDetector
+{
+public:
+    XrunDetector();
+
+    void restart();
+    bool update(int64_t wall, int64_t processed, int64_t delivered, bool settled);
+    bool isStalled(int64_t wall, int64_t window) const;
+
+    uint64_t xruns() const;
+    int64_t xrunTime() const;
+    int64_t lastXrunTime() const;
+    int64_t bufferedTime() const;
+    int64_t processedTime() const;
+    int64_t tolerance() const;
+
+    static const int64_t MIN_TOLERANCE;
+    static const double DRIFT_ALLOWANCE;
+
+private:
+    bool m_first;
+    bool m_inXrun;
+    int64_t m_prevWall;
+    int64_t m_prevProcessed;
+    int64_t m_lastProgress;
+    int64_t m_jitter;
+    int64_t m_debt;
+    int64_t m_buffered;
+    int64_t m_starved;
+    uint64_t m_xruns;
+    int64_t m_xrunTime;
+    int64_t m_lastXrunTime;
+};
+
+#endif // XRUNDETECTOR_H
@@ -0,0 +1,485 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include "drumcache.h"
+#include "soundfontimage.h"
+
+#if defined(__linux__)
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#elif defined(__unix__) || defined(__APPLE__)
+#include <pthread.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#endif
+
+const size_t DrumCache::DEFAULT_MEMORY_LIMIT = 64 * 1024 * 1024;
+const int DrumCache::VELOCITY_LEVELS = 32;
+const int DrumCache::MAX_HIT_SECONDS = 6;
+const int DrumCache::WORKER_INTERVAL = 10;
+
+static const int RENDER_CHANNEL = 9;
+static const int RENDER_FRAMES = 64;
+/* maximum difference, relative to the peak, to consider two renderings equal */
+static const float EQUALITY_TOLERANCE = 1e-4f;
+/* the audio thread gives up after these many table probes */
+static const int MAX_PROBES = 32;
+/* level below which the tail of the effects is over */
+static const float EFFECTS_SILENCE = 1e-7f;
+/* nice value of the worker thread */
+static const int WORKER_NICE = 10;
+
+static unsigned slotOf(uint64_t key, int slots)
+{
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return unsigned(key % slots);
+}
+
+static bool sameSound(const std::vector<float> &a, const std::vector<float> &b)
+{
+    if (a.size() != b.size()) {
+        return false;
+    }
+    float peak = 0, difference = 0;
+    for (size_t i = 0; i < a.size(); ++i) {
+        peak = std::max(peak, std::fabs(a[i]));
+        difference = std::max(difference, std::fabs(a[i] - b[i]));
+    }
+    return difference <= peak * EQUALITY_TOLERANCE;
+}
+
+/**
+ * Lowers the priority of the calling thread, so that filling the cache
+ * never competes with the audio and MIDI threads.
+ */
+static void lowerThreadPriority()
+{
+#if defined(__linux__)
+    // the nice value is per thread on Linux
+    setpriority(PRIO_PROCESS, id_t(syscall(SYS_gettid)), WORKER_NICE);
+#elif defined(__unix__) || defined(__APPLE__)
+    int policy;
+    struct sched_param param;
+    if (pthread_getschedparam(pthread_self(), &policy, &param) == 0) {
+        param.sched_priority = sched_get_priority_min(policy);
+        pthread_setschedparam(pthread_self(), policy, &param);
+    }
+#elif defined(_WIN32)
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL);
+#endif
+}
+
+DrumCache::DrumCache(int sampleRate, int channels, int interpolation):
+    m_sampleRate(sampleRate),
+    m_channels(channels),
+    m_interpolation(interpolation),
+    m_memoryLimit(DEFAULT_MEMORY_LIMIT),
+    m_requestHead(0),
+    m_requestTail(0),
+    m_generation(0),
+    m_seenGeneration(0),
+    m_audioBuffers(0),
+    m_hits(0),
+    m_misses(0),
+    m_memory(0),
+    m_quit(false),
+    m_audioGeneration(0),
+    m_retiredStamp(0),
+    m_effectsDirty(false),
+    m_reloading(false),
+    m_settings(nullptr),
+    m_synth(nullptr)
+{
+    for (int i = 0; i < TABLE_SLOTS; ++i) {
+        m_table[i] = nullptr;
+    }
+}
+
+DrumCache::~DrumCache()
+{
+    stop();
+    for (Entry *entry : m_entries) {
+        delete entry;
+    }
+    for (Entry *entry : m_retired) {
+        delete entry;
+    }
+}
+
+/**
+ * Starts the worker thread, which loads the soundfonts of the live synth.
+ */
+void DrumCache::start(const Soundfonts &soundfonts, size_t memoryLimit)
+{
+    m_memoryLimit = memoryLimit;
+    reload(soundfonts);
+    if (isActive()) {
+        return;
+    }
+    m_quit = false;
+    m_thread = std::thread([this]{ work(); });
+}
+
+/**
+ * Stops the worker thread and releases its soundfonts. The cached hits are
+ * kept until destruction, because the audio thread may still be playing
+ * them.
+ */
+void DrumCache::stop()
+{
+    if (m_thread.joinable()) {
+        m_quit = true;
+        m_thread.join();
+    }
+    std::lock_guard<std::mutex> locker(m_mutex);
+    deleteSynth();
+}
+
+bool DrumCache::isActive() const
+{
+    return m_thread.joinable();
+}
+
+/**
+ * Follows the soundfonts of the live synth after loading or unloading one.
+ * The hits cached so far are discarded at once, and the worker loads the
+ * soundfonts again before rendering any other hit.
+ */
+void DrumCache::reload(const Soundfonts &soundfonts)
+{
+    std::lock_guard<std::mutex> locker(m_mutex);
+    m_soundfonts = soundfonts;
+    m_reloading = true;
+    m_generation.fetch_add(1, std::memory_order_release);
+}
+
+void DrumCache::loadSoundfonts()
+{
+    std::lock_guard<std::mutex> locker(m_mutex);
+    if (!m_reloading) {
+        return;
+    }
+    m_reloading = false;
+    deleteSynth();
+    createSynth();
+    m_sfontIds.clear();
+    for (const auto &soundfont : m_soundfonts) {
+        const int id = fluid_synth_sfload(m_synth, soundfont.first.c_str(), 0);
+        if (id != -1) {
+            m_sfontIds.push_back({soundfont.second, id});
+        }
+    }
+}
+
+void DrumCache::createSynth()
+{
+    m_settings = new_fluid_settings();
+    fluid_settings_setnum(m_settings, "synth.sample-rate", m_sampleRate);
+    fluid_settings_setnum(m_settings, "synth.gain", 1.0);
+    m_synth = new_fluid_synth(m_settings);
+    fluid_synth_add_sfloader(m_synth, SoundfontImage::newLoader());
+    // the hits must sound like the live synth
+    fluid_synth_set_interp_method(m_synth, -1, m_interpolation);
+    m_effectsDirty = false;
+}
+
+void DrumCache::deleteSynth()
+{
+    if (m_synth != nullptr) {
+        delete_fluid_synth(m_synth);
+        m_synth = nullptr;
+    }
+    if (m_settings != nullptr) {
+        delete_fluid_settings(m_settings);
+        m_settings = nullptr;
+    }
+}
+
+/**
+ * Called by the audio thread before rendering each buffer. Returns true when
+ * the cache has been reloaded, and then every hit being played must be
+ * dropped before the next lookup.
+ */
+bool DrumCache::beginBuffer()
+{
+    m_audioBuffers.fetch_add(1, std::memory_order_release);
+    const unsigned generation = m_generation.load(std::memory_order_acquire);
+    if (generation != m_audioGeneration) {
+        m_audioGeneration = generation;
+        m_seenGeneration.store(generation, std::memory_order_release);
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Finds a cached hit without blocking. Missing hits are requested to the
+ * worker, and synthesized normally meanwhile.
+ */
+const DrumCache::Entry *DrumCache::lookup(uint64_t key)
+{
+    unsigned slot = slotOf(key, TABLE_SLOTS);
+    for (int i = 0; i < MAX_PROBES; ++i) {
+        const Entry *entry = m_table[slot].load(std::memory_order_acquire);
+        if (entry == nullptr) {
+            break;
+        }
+        if (entry->key == key && entry->generation == m_audioGeneration) {
+            if (entry->eligible) {
+                m_hits.fetch_add(1, std::memory_order_relaxed);
+            }
+            return entry;
+        }
+        slot = (slot + 1) % TABLE_SLOTS;
+    }
+    m_misses.fetch_add(1, std::memory_order_relaxed);
+    const unsigned head = m_requestHead.load(std::memory_order_relaxed);
+    if (head - m_requestTail.load(std::memory_order_acquire) < unsigned(REQUEST_SLOTS)) {
+        m_requests[head % REQUEST_SLOTS] = key;
+        m_requestHead.store(head + 1, std::memory_order_release);
+    }
+    return nullptr;
+}
+
+uint64_t DrumCache::hits() const
+{
+    return m_hits.load(std::memory_order_relaxed);
+}
+
+uint64_t DrumCache::misses() const
+{
+    return m_misses.load(std::memory_order_relaxed);
+}
+
+size_t DrumCache::memoryUsage() const
+{
+    return m_memory.load(std::memory_order_relaxed);
+}
+
+/**
+ * The key of a hit. The soundfont is the id given by the live synth, and
+ * the banks above 511 are not told apart.
+ */
+uint64_t DrumCache::makeKey(int sfont, int bank, int program, int note, int velocity,
+                            int volume, int pan, int expression)
+{
+    const uint64_t level = uint64_t(velocity) * VELOCITY_LEVELS / 128;
+    return (uint64_t(sfont & 0x7fff) << 49) | (uint64_t(bank & 0x1ff) << 40)
+         | (uint64_t(program & 0x7f) << 33) | (uint64_t(note & 0x7f) << 26)
+         | ((level & 0x1f) << 21) | (uint64_t(volume & 0x7f) << 14)
+         | (uint64_t(pan & 0x7f) << 7) | uint64_t(expression & 0x7f);
+}
+
+void DrumCache::work()
+{
+    lowerThreadPriority();
+    while (!m_quit) {
+        loadSoundfonts();
+        reclaim();
+        unsigned tail = m_requestTail.load(std::memory_order_relaxed);
+        while (!m_quit && tail != m_requestHead.load(std::memory_order_acquire)) {
+            const uint64_t key = m_requests[tail % REQUEST_SLOTS];
+            m_requestTail.store(++tail, std::memory_order_release);
+            renderHit(key);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(WORKER_INTERVAL));
+    }
+}
+
+/**
+ * Frees the hits of the previous soundfonts in two steps: once the audio
+ * thread has seen the reload they are removed from the table, and once it
+ * has started another buffer nobody may be reading them.
+ */
+void DrumCache::reclaim()
+{
+    const unsigned generation = m_generation.load(std::memory_order_acquire);
+    if (!m_retired.empty()) {
+        if (m_audioBuffers.load(std::memory_order_acquire) > m_retiredStamp + 1) {
+            for (Entry *entry : m_retired) {
+                m_memory.fetch_sub(sizeof(Entry) + entry->samples.size() * sizeof(float), std::memory_order_relaxed);
+                delete entry;
+            }
+            m_retired.clear();
+        }
+        return;
+    }
+    if (m_seenGeneration.load(std::memory_order_acquire) != generation) {
+        return;
+    }
+    auto stale = std::partition(m_entries.begin(), m_entries.end(),
+                                [generation](const Entry *entry) { return entry->generation == generation; });
+    if (stale == m_entries.end()) {
+        return;
+    }
+    m_retired.assign(stale, m_entries.end());
+    m_entries.erase(stale, m_entries.end());
+    for (int i = 0; i < TABLE_SLOTS; ++i) {
+        m_table[i].store(nullptr, std::memory_order_release);
+    }
+    m_present.clear();
+    for (Entry *entry : m_entries) {
+        insert(entry);
+    }
+    m_retiredStamp = m_audioBuffers.load(std::memory_order_acquire);
+}
+
+void DrumCache::renderHit(uint64_t key)
+{
+    if (m_present.count(key) > 0 || m_entries.size() >= size_t(TABLE_SLOTS / 2)
+            || m_memory.load(std::memory_order_relaxed) >= m_memoryLimit) {
+        return;
+    }
+    std::lock_guard<std::mutex> locker(m_mutex);
+    // a hit rendered before loading the new soundfonts would be stale
+    if (m_reloading || m_synth == nullptr) {
+        return;
+    }
+    Entry *entry = new Entry;
+    entry->key = key;
+    entry->generation = m_generation.load(std::memory_order_acquire);
+    bool exclusive = false;
+    entry->frames = renderNote(key, false, false, entry->samples, &exclusive);
+    entry->eligible = entry->frames > 0 && !exclusive;
+    if (entry->eligible) {
+        std::vector<float> other;
+        // the hit must ignore the note off...
+        entry->eligible = renderNote(key, true, false, other, nullptr) == entry->frames
+                          && sameSound(entry->samples, other);
+        // ...and must not feed the reverb and chorus
+        if (entry->eligible) {
+            if (m_effectsDirty) {
+                flushEffects();
+            }
+            entry->eligible = renderNote(key, false, true, other, nullptr) == entry->frames
+                              && sameSound(entry->samples, other);
+            // an effects tail could spoil the next comparison
+            m_effectsDirty = !entry->eligible;
+        }
+    }
+    if (!entry->eligible) {
+        entry->frames = 0;
+        std::vector<float>().swap(entry->samples);
+    }
+    m_memory.fetch_add(sizeof(Entry) + entry->samples.size() * sizeof(float), std::memory_order_relaxed);
+    m_entries.push_back(entry);
+    insert(entry);
+}
+
+/**
+ * Renders the effects without voices until their tail is over.
+ */
+void DrumCache::flushEffects()
+{
+    fluid_synth_system_reset(m_synth);
+    fluid_synth_set_reverb_on(m_synth, 1);
+    fluid_synth_set_chorus_on(m_synth, 1);
+    std::vector<float> buffer(RENDER_FRAMES * m_channels);
+    for (int frames = 0; frames < MAX_HIT_SECONDS * m_sampleRate; frames += RENDER_FRAMES) {
+        fluid_synth_write_float(m_synth, RENDER_FRAMES, buffer.data(), 0, m_channels, buffer.data(), 1, m_channels);
+        float peak = 0;
+        for (float sample : buffer) {
+            peak = std::max(peak, std::fabs(sample));
+        }
+        if (peak < EFFECTS_SILENCE) {
+            break;
+        }
+    }
+    m_effectsDirty = false;
+}
+
+/**
+ * Renders a single note until all its voices are finished, and returns
+ * the number of frames, or -1 if it lasts too long.
+ */
+int DrumCache::renderNote(uint64_t key, bool noteOff, bool effects, std::vector<float> &out, bool *exclusive)
+{
+    const int sfont = int(key >> 49) & 0x7fff;
+    const int bank = int(key >> 40) & 0x1ff;
+    const int program = int(key >> 33) & 0x7f;
+    const int note = int(key >> 26) & 0x7f;
+    const int level = int(key >> 21) & 0x1f;
+    const int velocity = std::min(127, std::max(1, (level * 128 + 64) / VELOCITY_LEVELS));
+    auto copy = std::find_if(m_sfontIds.begin(), m_sfontIds.end(),
+                             [sfont](const std::pair<int, int> &ids) { return (ids.first & 0x7fff) == sfont; });
+    out.clear();
+    if (exclusive != nullptr) {
+        *exclusive = false;
+    }
+    if (copy == m_sfontIds.end()) {
+        return 0;
+    }
+
+    fluid_synth_system_reset(m_synth);
+    fluid_synth_set_reverb_on(m_synth, effects ? 1 : 0);
+    fluid_synth_set_chorus_on(m_synth, effects ? 1 : 0);
+    if (fluid_synth_program_select(m_synth, RENDER_CHANNEL, unsigned(copy->second), unsigned(bank), unsigned(program)) != FLUID_OK) {
+        return 0;
+    }
+    fluid_synth_cc(m_synth, RENDER_CHANNEL, 7, int(key >> 14) & 0x7f);
+    fluid_synth_cc(m_synth, RENDER_CHANNEL, 10, int(key >> 7) & 0x7f);
+    fluid_synth_cc(m_synth, RENDER_CHANNEL, 11, int(key) & 0x7f);
+    fluid_synth_noteon(m_synth, RENDER_CHANNEL, note, velocity);
+
+    std::vector<fluid_voice_t*> voices(fluid_synth_get_polyphony(m_synth) + 1);
+    fluid_synth_get_voicelist(m_synth, voices.data(), int(voices.size()), -1);
+    if (exclusive != nullptr) {
+        for (auto v = voices.data(); *v != nullptr; ++v) {
+            if (fluid_voice_gen_get(*v, GEN_EXCLUSIVECLASS) != 0) {
+                *exclusive = true;
+            }
+        }
+    }
+    if (voices.front() == nullptr) {
+        return 0;
+    }
+    const int maxFrames = MAX_HIT_SECONDS * m_sampleRate;
+    for (int frames = 0; frames < maxFrames; frames += RENDER_FRAMES) {
+        if (noteOff && frames == RENDER_FRAMES) {
+            fluid_synth_noteoff(m_synth, RENDER_CHANNEL, note);
+        }
+        out.resize((frames + RENDER_FRAMES) * m_channels);
+        float *buffer = out.data() + frames * m_channels;
+        fluid_synth_write_float(m_synth, RENDER_FRAMES, buffer, 0, m_channels, buffer, 1, m_channels);
+        fluid_synth_get_voicelist(m_synth, voices.data(), int(voices.size()), -1);
+        if (voices.front() == nullptr) {
+            out.shrink_to_fit();
+            return frames + RENDER_FRAMES;
+        }
+    }
+    return -1;
+}
+
+void DrumCache::insert(Entry *entry)
+{
+    unsigned slot = slotOf(entry->key, TABLE_SLOTS);
+    for (int i = 0; i < TABLE_SLOTS; ++i) {
+        if (m_table[slot].load(std::memory_order_relaxed) == nullptr) {
+            m_table[slot].store(entry, std::memory_order_release);
+            m_present.insert(entry->key);
+            return;
+        }
+        slot = (slot + 1) % TABLE_SLOTS;
+    }
+}
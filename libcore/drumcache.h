@@ -0,0 +1,135 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DRUMCACHE_H
+#define DRUMCACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <unordered_set>
+#include <fluidlite.h>
+
+/**
+ * A bounded cache of percussion hits rendered in advance. A hit is keyed by
+ * the soundfont and preset, note, quantized velocity and the channel
+ * volume, expression and pan. Missing hits are requested from the audio
+ * thread without blocking, and rendered by a low priority worker thread
+ * with an auxiliary synth, which loads its own copies of the soundfonts of
+ * the live one so that nothing is shared between them. Only hits that sound the same regardless
+ * of the note off, without exclusive class and without effect sends are
+ * eligible; other hits are remembered as such and synthesized normally.
+ */
+class DrumCache
+{
+public:
+    struct Entry {
+        uint64_t key;
+        unsigned generation;
+        bool eligible;
+        int frames;
+        std::vector<float> samples;
+    };
+
+    /* the file names of the soundfonts of the live synth, and their ids */
+    typedef std::vector<std::pair<std::string, int>> Soundfonts;
+
+    DrumCache(int sampleRate, int channels, int interpolation);
+    ~DrumCache();
+
+    /* control thread */
+    void start(const Soundfonts &soundfonts, size_t memoryLimit);
+    void stop();
+    bool isActive() const;
+    void reload(const Soundfonts &soundfonts);
+
+    /* audio thread */
+    bool beginBuffer();
+    const Entry *lookup(uint64_t key);
+
+    /* any thread */
+    uint64_t hits() const;
+    uint64_t misses() const;
+    size_t memoryUsage() const;
+
+    static uint64_t makeKey(int sfont, int bank, int program, int note, int velocity,
+                            int volume, int pan, int expression);
+
+    static const size_t DEFAULT_MEMORY_LIMIT;
+    static const int VELOCITY_LEVELS;
+    static const int MAX_HIT_SECONDS;
+    static const int WORKER_INTERVAL;
+
+private:
+    static const int TABLE_SLOTS = 8192;
+    static const int REQUEST_SLOTS = 256;
+
+    void work();
+    void loadSoundfonts();
+    void reclaim();
+    void renderHit(uint64_t key);
+    void flushEffects();
+    int renderNote(uint64_t key, bool noteOff, bool effects, std::vector<float> &out, bool *exclusive);
+    void insert(Entry *entry);
+    void createSynth();
+    void deleteSynth();
+
+    int m_sampleRate;
+    int m_channels;
+    int m_interpolation;
+    size_t m_memoryLimit;
+
+    /* shared between the audio thread and the worker */
+    std::atomic<Entry*> m_table[TABLE_SLOTS];
+    uint64_t m_requests[REQUEST_SLOTS];
+    std::atomic<unsigned> m_requestHead;
+    std::atomic<unsigned> m_requestTail;
+    std::atomic<unsigned> m_generation;
+    std::atomic<unsigned> m_seenGeneration;
+    std::atomic<uint64_t> m_audioBuffers;
+    std::atomic<uint64_t> m_hits;
+    std::atomic<uint64_t> m_misses;
+    std::atomic<size_t> m_memory;
+    std::atomic<bool> m_quit;
+
+    /* audio thread only */
+    unsigned m_audioGeneration;
+
+    /* worker only */
+    std::vector<Entry*> m_entries;
+    std::vector<Entry*> m_retired;
+    uint64_t m_retiredStamp;
+    std::unordered_set<uint64_t> m_present;
+    bool m_effectsDirty;
+
+    /* the live soundfont ids, and the ids of their copies */
+    std::vector<std::pair<int, int>> m_sfontIds;
+
+    std::mutex m_mutex;
+    Soundfonts m_soundfonts;
+    bool m_reloading;
+    fluid_settings_t *m_settings;
+    fluid_synth_t *m_synth;
+    std::thread m_thread;
+};
+
+#endif // DRUMCACHE_H
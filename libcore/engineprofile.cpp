@@ -0,0 +1,65 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cstdio>
+#include "engineprofile.h"
+
+const char *const EngineProfile::DEFAULT_NAME = "default";
+
+/**
+ * The built-in profiles. The default one keeps the engine parameters used
+ * before the profiles existed; the buffer times fit the range accepted by
+ * the programs (10 to 200 ms).
+ */
+const std::vector<EngineProfile> &EngineProfile::all()
+{
+    static const std::vector<EngineProfile> profiles {
+        {DEFAULT_NAME, 44100, 64, 256, FourthOrderInterpolation, AllEffects, 100},
+        {"low-latency", 48000, 32, 128, LinearInterpolation, ReverbOnly, 20},
+        {"high-polyphony", 44100, 128, 1024, FourthOrderInterpolation, AllEffects, 100},
+        {"low-power", 22050, 256, 64, LinearInterpolation, NoEffects, 200},
+        {"offline-max-throughput", 44100, 1024, 256, FourthOrderInterpolation, AllEffects, 200}
+    };
+    return profiles;
+}
+
+const EngineProfile *EngineProfile::find(const std::string &name)
+{
+    for (const EngineProfile &profile : all()) {
+        if (profile.name == name) {
+            return &profile;
+        }
+    }
+    return nullptr;
+}
+
+const EngineProfile &EngineProfile::defaults()
+{
+    return all().front();
+}
+
+std::string EngineProfile::description() const
+{
+    static const char *const EFFECTS[] = { "no effects", "reverb only", "reverb and chorus" };
+    char text[256];
+    std::snprintf(text, sizeof(text),
+                  "%s: %d Hz, %d frames per block, %d voices, interpolation order %d, %s, %d ms buffer",
+                  name.c_str(), sampleRate, blockFrames, polyphony, int(interpolation),
+                  EFFECTS[effects], bufferTime);
+    return text;
+}
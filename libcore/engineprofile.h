@@ -0,0 +1,64 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ENGINEPROFILE_H
+#define ENGINEPROFILE_H
+
+#include <string>
+#include <vector>
+
+/**
+ * A named set of engine parameters trading latency, polyphony and CPU
+ * usage against each other: the sample rate, the synthesis block size,
+ * the maximum number of voices, the interpolation order, the effects and
+ * the suggested audio buffer time. The sample rate and the block size are
+ * fixed when a SynthEngine is created.
+ */
+struct EngineProfile
+{
+    enum Interpolation {
+        NoInterpolation = 0,
+        LinearInterpolation = 1,
+        FourthOrderInterpolation = 4,
+        SeventhOrderInterpolation = 7
+    };
+
+    enum Effects {
+        NoEffects,
+        ReverbOnly,
+        AllEffects
+    };
+
+    std::string name;
+    int sampleRate;
+    int blockFrames;
+    int polyphony;
+    Interpolation interpolation;
+    Effects effects;
+    int bufferTime;
+
+    std::string description() const;
+
+    static const std::vector<EngineProfile> &all();
+    static const EngineProfile *find(const std::string &name);
+    static const EngineProfile &defaults();
+
+    static const char *const DEFAULT_NAME;
+};
+
+#endif // ENGINEPROFILE_H
@@ -0,0 +1,161 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include "eventqueue.h"
+
+EventCoalescer::EventCoalescer()
+{
+    clear();
+}
+
+bool EventCoalescer::isCoalescable(const MidiEvent &ev)
+{
+    switch (ev.type) {
+    case MidiEvent::ChannelPressure:
+    case MidiEvent::PitchBend:
+        return true;
+    case MidiEvent::Controller:
+        switch (ev.param1) {
+        case 0:   // bank select MSB
+        case 6:   // data entry MSB
+        case 32:  // bank select LSB
+        case 38:  // data entry LSB
+            return false;
+        default:
+            // switches, (N)RPN and channel mode messages change state
+            // depending on the sequence, and are never collapsed
+            return (ev.param1 > 0 && ev.param1 < 64) ||
+                   (ev.param1 >= 70 && ev.param1 <= 79) ||
+                   (ev.param1 >= 91 && ev.param1 <= 95);
+        }
+    default:
+        return false;
+    }
+}
+
+/**
+ * Stores the value of a continuous event until the next flush.
+ * Returns true when a previous pending value was overwritten,
+ * meaning that one event has been dropped by coalescing.
+ */
+bool EventCoalescer::defer(const MidiEvent &ev)
+{
+    int slot;
+    int16_t value;
+    switch (ev.type) {
+    case MidiEvent::ChannelPressure:
+        slot = SLOT_CHANNEL_PRESSURE;
+        value = ev.param1;
+        break;
+    case MidiEvent::PitchBend:
+        slot = SLOT_PITCH_BEND;
+        value = ev.param1;
+        break;
+    default:
+        slot = ev.param1;
+        value = ev.param2;
+        break;
+    }
+    const int chan = ev.chan % MIDI_CHANNELS;
+    bool replaced = m_isPending[chan][slot];
+    m_pending[chan][slot] = value;
+    if (!replaced) {
+        m_isPending[chan][slot] = true;
+        ++m_dirty[chan];
+    }
+    return replaced;
+}
+
+void EventCoalescer::clear()
+{
+    for (int chan = 0; chan < MIDI_CHANNELS; ++chan) {
+        for (int slot = 0; slot < SLOTS; ++slot) {
+            m_pending[chan][slot] = 0;
+            m_isPending[chan][slot] = false;
+        }
+        m_dirty[chan] = 0;
+    }
+}
+
+EventScheduler::EventScheduler(unsigned capacity):
+    m_mask(0),
+    m_head(0),
+    m_tail(0),
+    m_order(0),
+    m_heapSize(0)
+{
+    unsigned size = 1;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    m_ring.reset(new Entry[size]);
+    m_heap.reset(new Entry[size]);
+    m_mask = size - 1;
+}
+
+bool EventScheduler::push(int64_t frame, const MidiEvent &ev)
+{
+    const unsigned tail = m_tail.load(std::memory_order_relaxed);
+    if (tail - m_head.load(std::memory_order_acquire) > m_mask) {
+        return false;
+    }
+    m_ring[tail & m_mask] = {frame, 0, ev};
+    m_tail.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+bool EventScheduler::later(const Entry &a, const Entry &b)
+{
+    return a.frame > b.frame || (a.frame == b.frame && a.order > b.order);
+}
+
+/**
+ * Moves the pushed events into the heap, while there is room for them.
+ */
+void EventScheduler::collect()
+{
+    const unsigned tail = m_tail.load(std::memory_order_acquire);
+    unsigned head = m_head.load(std::memory_order_relaxed);
+    for (; head != tail && m_heapSize <= m_mask; ++head) {
+        Entry &entry = m_heap[m_heapSize++];
+        entry = m_ring[head & m_mask];
+        entry.order = m_order++;
+        std::push_heap(&m_heap[0], &m_heap[0] + m_heapSize, later);
+    }
+    m_head.store(head, std::memory_order_release);
+}
+
+/**
+ * True when the earliest collected event is due before the given frame.
+ */
+bool EventScheduler::isDue(int64_t frame) const
+{
+    return m_heapSize > 0 && m_heap[0].frame < frame;
+}
+
+const EventScheduler::Entry &EventScheduler::next() const
+{
+    return m_heap[0];
+}
+
+void EventScheduler::pop()
+{
+    std::pop_heap(&m_heap[0], &m_heap[0] + m_heapSize, later);
+    --m_heapSize;
+}
@@ -0,0 +1,263 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef EVENTQUEUE_H
+#define EVENTQUEUE_H
+
+#include <atomic>
+#include <memory>
+#include <cstdint>
+
+struct MidiEvent
+{
+    enum Type : uint8_t {
+        NoteOn,
+        NoteOff,
+        KeyPressure,
+        Controller,
+        Program,
+        ChannelPressure,
+        PitchBend
+    };
+
+    /* every MIDI input port owns a bank of 16 synth channels */
+    static const int BANK_CHANNELS = 16;
+    static const int MAX_BANKS = 8;
+    static const int MAX_CHANNELS = BANK_CHANNELS * MAX_BANKS;
+
+    Type type;
+    uint8_t chan;
+    int16_t param1;
+    int16_t param2;
+};
+
+/**
+ * Multiple producer, single consumer lock-free ring, with a sequence number
+ * in each cell. For MIDI events, the producers are the threads of the MIDI
+ * input backends and the user interface, and the consumer is the audio
+ * thread inside SynthRenderer::readData(). Neither side allocates memory
+ * or blocks.
+ */
+template<typename T>
+class LockFreeQueue
+{
+public:
+    explicit LockFreeQueue(unsigned capacity = DEFAULT_CAPACITY);
+
+    bool push(const T &item);
+    bool pop(T &item);
+    bool isEmpty() const;
+    unsigned capacity() const;
+
+    static const unsigned DEFAULT_CAPACITY = 4096;
+
+private:
+    struct Cell {
+        std::atomic<unsigned> sequence;
+        T item;
+    };
+
+    std::unique_ptr<Cell[]> m_ring;
+    unsigned m_mask;
+    std::atomic<unsigned> m_head;
+    std::atomic<unsigned> m_tail;
+};
+
+typedef LockFreeQueue<MidiEvent> EventQueue;
+
+template<typename T>
+LockFreeQueue<T>::LockFreeQueue(unsigned capacity):
+    m_mask(0),
+    m_head(0),
+    m_tail(0)
+{
+    unsigned size = 1;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    m_ring.reset(new Cell[size]);
+    m_mask = size - 1;
+    for (unsigned i = 0; i < size; ++i) {
+        m_ring[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * A cell is free for the producer claiming position pos when its sequence
+ * equals pos, and holds an item for the consumer when it equals pos + 1.
+ */
+template<typename T>
+bool LockFreeQueue<T>::push(const T &item)
+{
+    unsigned tail = m_tail.load(std::memory_order_relaxed);
+    for (;;) {
+        Cell &cell = m_ring[tail & m_mask];
+        const int diff = int(cell.sequence.load(std::memory_order_acquire) - tail);
+        if (diff == 0) {
+            if (m_tail.compare_exchange_weak(tail, tail + 1, std::memory_order_relaxed)) {
+                cell.item = item;
+                cell.sequence.store(tail + 1, std::memory_order_release);
+                return true;
+            }
+        } else if (diff < 0) {
+            return false;
+        } else {
+            tail = m_tail.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+template<typename T>
+bool LockFreeQueue<T>::pop(T &item)
+{
+    const unsigned head = m_head.load(std::memory_order_relaxed);
+    Cell &cell = m_ring[head & m_mask];
+    if (cell.sequence.load(std::memory_order_acquire) != head + 1) {
+        return false;
+    }
+    item = cell.item;
+    cell.sequence.store(head + m_mask + 1, std::memory_order_release);
+    m_head.store(head + 1, std::memory_order_relaxed);
+    return true;
+}
+
+template<typename T>
+bool LockFreeQueue<T>::isEmpty() const
+{
+    const unsigned head = m_head.load(std::memory_order_relaxed);
+    return m_ring[head & m_mask].sequence.load(std::memory_order_acquire) != head + 1;
+}
+
+template<typename T>
+unsigned LockFreeQueue<T>::capacity() const
+{
+    return m_mask + 1;
+}
+
+/**
+ * Collapses redundant continuous controller updates (controllers, channel
+ * pressure and pitch bend) so that only the latest value of each one reaches
+ * the synth. Any other event on a channel flushes the pending values of that
+ * channel first, so the ordering relative to notes and programs is preserved.
+ */
+class EventCoalescer
+{
+public:
+    EventCoalescer();
+
+    static bool isCoalescable(const MidiEvent &ev);
+
+    bool defer(const MidiEvent &ev);
+    template<typename F> void flush(int chan, F apply);
+    template<typename F> void flushAll(F apply);
+    void clear();
+
+    static const int MIDI_CHANNELS = MidiEvent::MAX_CHANNELS;
+    static const int SLOT_CHANNEL_PRESSURE = 128;
+    static const int SLOT_PITCH_BEND = 129;
+    static const int SLOTS = 130;
+
+private:
+    int16_t m_pending[MIDI_CHANNELS][SLOTS];
+    bool m_isPending[MIDI_CHANNELS][SLOTS];
+    int m_dirty[MIDI_CHANNELS];
+};
+
+template<typename F>
+void EventCoalescer::flush(int chan, F apply)
+{
+    if (chan < 0 || chan >= MIDI_CHANNELS || m_dirty[chan] == 0) {
+        return;
+    }
+    for (int slot = 0; slot < SLOTS && m_dirty[chan] > 0; ++slot) {
+        if (!m_isPending[chan][slot]) {
+            continue;
+        }
+        int16_t value = m_pending[chan][slot];
+        MidiEvent ev;
+        ev.chan = static_cast<uint8_t>(chan);
+        switch (slot) {
+        case SLOT_CHANNEL_PRESSURE:
+            ev.type = MidiEvent::ChannelPressure;
+            ev.param1 = value;
+            ev.param2 = 0;
+            break;
+        case SLOT_PITCH_BEND:
+            ev.type = MidiEvent::PitchBend;
+            ev.param1 = value;
+            ev.param2 = 0;
+            break;
+        default:
+            ev.type = MidiEvent::Controller;
+            ev.param1 = static_cast<int16_t>(slot);
+            ev.param2 = value;
+            break;
+        }
+        m_isPending[chan][slot] = false;
+        --m_dirty[chan];
+        apply(ev);
+    }
+}
+
+template<typename F>
+void EventCoalescer::flushAll(F apply)
+{
+    for (int chan = 0; chan < MIDI_CHANNELS; ++chan) {
+        flush(chan, apply);
+    }
+}
+
+/**
+ * MIDI events to be applied at given output frame positions. A single
+ * producer thread pushes them into a lock-free ring in any order; the
+ * audio thread collects them into a preallocated heap ordered by frame,
+ * keeping the arrival order of the events sharing a frame.
+ */
+class EventScheduler
+{
+public:
+    struct Entry {
+        int64_t frame;
+        uint64_t order;
+        MidiEvent event;
+    };
+
+    explicit EventScheduler(unsigned capacity = EventQueue::DEFAULT_CAPACITY);
+
+    /* producer thread */
+    bool push(int64_t frame, const MidiEvent &ev);
+
+    /* audio thread */
+    void collect();
+    bool isDue(int64_t frame) const;
+    const Entry &next() const;
+    void pop();
+
+private:
+    static bool later(const Entry &a, const Entry &b);
+
+    std::unique_ptr<Entry[]> m_ring;
+    unsigned m_mask;
+    std::atomic<unsigned> m_head;
+    std::atomic<unsigned> m_tail;
+    uint64_t m_order;
+    std::unique_ptr<Entry[]> m_heap;
+    unsigned m_heapSize;
+};
+
+#endif // EVENTQUEUE_H
@@ -0,0 +1,173 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <algorithm>
+#include "fanoutring.h"
+
+const double FanoutReader::SMOOTHING = 0.02;
+const double FanoutReader::PROPORTIONAL_GAIN = 5e-4;
+const double FanoutReader::INTEGRAL_GAIN = 5e-7;
+const double FanoutReader::MAX_CORRECTION = 2e-3;
+
+FanoutRing::FanoutRing(int channels, int capacityFrames):
+    m_channels(channels),
+    m_capacity(1),
+    m_written(0)
+{
+    while (m_capacity < capacityFrames) {
+        m_capacity <<= 1;
+    }
+    m_mask = uint64_t(m_capacity) - 1;
+    m_samples.reset(new std::atomic<float>[size_t(m_capacity) * m_channels]);
+    for (int i = 0; i < m_capacity * m_channels; ++i) {
+        m_samples[i].store(0.0f, std::memory_order_relaxed);
+    }
+}
+
+void FanoutRing::write(const float *frames, int count)
+{
+    uint64_t frame = m_written.load(std::memory_order_relaxed);
+    for (int i = 0; i < count; ++i, ++frame) {
+        std::atomic<float> *cell = &m_samples[(frame & m_mask) * m_channels];
+        for (int c = 0; c < m_channels; ++c) {
+            cell[c].store(*frames++, std::memory_order_relaxed);
+        }
+    }
+    m_written.store(frame, std::memory_order_release);
+}
+
+int FanoutRing::channels() const
+{
+    return m_channels;
+}
+
+int FanoutRing::capacity() const
+{
+    return m_capacity;
+}
+
+uint64_t FanoutRing::written() const
+{
+    return m_written.load(std::memory_order_acquire);
+}
+
+float FanoutRing::sample(uint64_t frame, int channel) const
+{
+    return m_samples[(frame & m_mask) * m_channels + channel].load(std::memory_order_relaxed);
+}
+
+FanoutReader::FanoutReader(const FanoutRing &ring, int targetFrames):
+    m_ring(ring),
+    m_target(std::max(1, std::min(targetFrames, ring.capacity() / 4))),
+    m_primed(false),
+    m_started(false),
+    m_position(0),
+    m_fill(0),
+    m_integral(0),
+    m_ratio(1.0),
+    m_lastFill(0),
+    m_underruns(0),
+    m_overruns(0)
+{ }
+
+/**
+ * Outputs the requested number of frames, interpolated from the ring
+ * at the current resampling ratio. Silence is output while the fill level
+ * recovers the target after starting or after an underrun.
+ */
+void FanoutReader::read(float *out, int frames)
+{
+    const int channels = m_ring.channels();
+    const uint64_t written = m_ring.written();
+    if (!m_started) {
+        m_started = true;
+        m_position = double(written);
+    }
+    double fill = double(written) - m_position;
+    if (fill > m_ring.capacity() / 2) {
+        m_overruns.fetch_add(1, std::memory_order_relaxed);
+        m_position = double(written - m_target);
+        fill = m_target;
+    }
+    if (!m_primed) {
+        if (fill < m_target) {
+            std::fill(out, out + frames * channels, 0.0f);
+            return;
+        }
+        m_primed = true;
+        m_fill = fill;
+    }
+    adjustRatio(fill);
+    const double ratio = m_ratio.load(std::memory_order_relaxed);
+    const uint64_t first = uint64_t(m_position);
+    int i = 0;
+    for (; i < frames; ++i) {
+        const uint64_t frame = uint64_t(m_position);
+        if (frame + 1 >= written) {
+            break;
+        }
+        const float frac = float(m_position - double(frame));
+        for (int c = 0; c < channels; ++c) {
+            const float a = m_ring.sample(frame, c);
+            const float b = m_ring.sample(frame + 1, c);
+            *out++ = a + (b - a) * frac;
+        }
+        m_position += ratio;
+    }
+    if (i < frames) {
+        m_underruns.fetch_add(1, std::memory_order_relaxed);
+        m_primed = false;
+        std::fill(out, out + (frames - i) * channels, 0.0f);
+    }
+    // the frames read are valid unless the writer, which may be writing
+    // a buffer not yet published, has come close to them meanwhile
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const uint64_t now = m_ring.written();
+    if (now - first > uint64_t(m_ring.capacity() / 2)) {
+        m_overruns.fetch_add(1, std::memory_order_relaxed);
+        std::fill(out - i * channels, out, 0.0f);
+        m_position = double(now - m_target);
+    }
+}
+
+void FanoutReader::adjustRatio(double fill)
+{
+    m_fill += SMOOTHING * (fill - m_fill);
+    const double error = (m_fill - m_target) / m_target;
+    m_integral = std::max(-MAX_CORRECTION, std::min(MAX_CORRECTION, m_integral + INTEGRAL_GAIN * error));
+    const double correction = PROPORTIONAL_GAIN * error + m_integral;
+    m_ratio.store(1.0 + std::max(-MAX_CORRECTION, std::min(MAX_CORRECTION, correction)),
+                  std::memory_order_relaxed);
+    m_lastFill.store(m_fill, std::memory_order_relaxed);
+}
+
+int FanoutReader::targetFrames() const
+{
+    return m_target;
+}
+
+FanoutReader::Stats FanoutReader::stats() const
+{
+    Stats s;
+    s.underruns = m_underruns.load(std::memory_order_relaxed);
+    s.overruns = m_overruns.load(std::memory_order_relaxed);
+    s.ratio = m_ratio.load(std::memory_order_relaxed);
+    s.fill = m_lastFill.load(std::memory_order_relaxed);
+    return s;
+}
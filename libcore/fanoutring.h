@@ -0,0 +1,105 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef FANOUTRING_H
+#define FANOUTRING_H
+
+#include <atomic>
+#include <memory>
+#include <cstdint>
+
+/**
+ * Single writer, multiple reader lock-free ring of audio frames. The
+ * writer is the audio thread rendering the synth, which publishes every
+ * rendered buffer once; each reader keeps its own position, so the
+ * synthesis cost doesn't depend on the number of readers. The writer
+ * never waits: a reader left behind by more than half the ring capacity,
+ * the other half being room for the buffer being written, detects it and
+ * skips ahead.
+ */
+class FanoutRing
+{
+public:
+    FanoutRing(int channels, int capacityFrames);
+
+    /* writer thread */
+    void write(const float *frames, int count);
+
+    /* any thread */
+    int channels() const;
+    int capacity() const;
+    uint64_t written() const;
+    float sample(uint64_t frame, int channel) const;
+
+private:
+    int m_channels;
+    int m_capacity;
+    uint64_t m_mask;
+    std::unique_ptr<std::atomic<float>[]> m_samples;
+    std::atomic<uint64_t> m_written;
+};
+
+/**
+ * A reader of a FanoutRing, used by one audio output with its own clock.
+ * The fill level between the writer and this reader is kept around a
+ * target by resampling the frames slightly faster or slower, following
+ * a proportional-integral controller, which compensates the clock drift
+ * between both audio devices without audible jumps.
+ */
+class FanoutReader
+{
+public:
+    struct Stats {
+        uint64_t underruns = 0;
+        uint64_t overruns = 0;
+        double ratio = 1.0;
+        double fill = 0;
+    };
+
+    FanoutReader(const FanoutRing &ring, int targetFrames);
+
+    /* reader thread */
+    void read(float *out, int frames);
+
+    /* any thread */
+    int targetFrames() const;
+    Stats stats() const;
+
+    static const double SMOOTHING;
+    static const double PROPORTIONAL_GAIN;
+    static const double INTEGRAL_GAIN;
+    static const double MAX_CORRECTION;
+
+private:
+    void adjustRatio(double fill);
+
+    const FanoutRing &m_ring;
+    int m_target;
+    bool m_primed;
+    bool m_started;
+    double m_position;
+    double m_fill;
+    double m_integral;
+    std::atomic<double> m_ratio;
+    std::atomic<double> m_lastFill;
+    std::atomic<uint64_t> m_underruns;
+    std::atomic<uint64_t> m_overruns;
+};
+
+#endif // FANOUTRING_H
@@ -0,0 +1,143 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <algorithm>
+#include <limits>
+#include "jitterbuffer.h"
+
+const int JitterBuffer::WINDOW_PACKETS = 1000;
+const int JitterBuffer::HISTORY_PACKETS = 64;
+const int64_t JitterBuffer::MIN_DELAY_USECS = 1000;
+const int64_t JitterBuffer::MAX_DELAY_USECS = 100000;
+
+JitterBuffer::JitterBuffer(int sampleRate):
+    m_sampleRate(sampleRate)
+{
+    reset();
+}
+
+void JitterBuffer::reset()
+{
+    m_started = false;
+    m_origin = 0;
+    m_nextSequence = 0;
+    m_received = 0;
+    m_windowMin[0] = std::numeric_limits<int64_t>::max();
+    m_windowMin[1] = std::numeric_limits<int64_t>::max();
+    m_windowPackets = 0;
+    m_windowMax[0] = 0;
+    m_windowMax[1] = 0;
+    m_lastTarget = std::numeric_limits<int64_t>::min();
+    m_packets = 0;
+    m_late = 0;
+    m_reordered = 0;
+    m_lost = 0;
+    m_duplicates = 0;
+    m_delayFrames = MIN_DELAY_USECS * m_sampleRate / 1000000;
+}
+
+/**
+ * Changes the output sample rate, restarting the playout.
+ */
+void JitterBuffer::setSampleRate(int sampleRate)
+{
+    m_sampleRate = sampleRate;
+    reset();
+}
+
+/**
+ * Returns the output frame where the events of a packet must be applied,
+ * given its sequence number, its sender timestamp and the output frame
+ * position at its arrival, or -1 when the packet is a duplicate.
+ */
+int64_t JitterBuffer::schedule(uint32_t sequence, int64_t senderUsecs, int64_t arrivalFrame)
+{
+    if (!m_started) {
+        m_started = true;
+        m_origin = senderUsecs;
+        m_nextSequence = sequence;
+    }
+    m_packets.fetch_add(1, std::memory_order_relaxed);
+    // bit n of m_received is set when m_nextSequence - 1 - n has arrived
+    const int32_t gap = int32_t(sequence - m_nextSequence);
+    if (gap < 0) {
+        const int32_t age = -gap - 1;
+        const uint64_t bit = age < HISTORY_PACKETS ? uint64_t(1) << age : 0;
+        if (bit != 0 && (m_received & bit) != 0) {
+            m_duplicates.fetch_add(1, std::memory_order_relaxed);
+            return -1;
+        }
+        m_reordered.fetch_add(1, std::memory_order_relaxed);
+        // counted as lost when the gap appeared; older packets can't be
+        // told from duplicates, and stay counted as lost
+        if (bit != 0) {
+            m_received |= bit;
+            if (m_lost.load(std::memory_order_relaxed) > 0) {
+                m_lost.fetch_sub(1, std::memory_order_relaxed);
+            }
+        }
+    } else {
+        m_lost.fetch_add(uint64_t(gap), std::memory_order_relaxed);
+        m_received = gap < HISTORY_PACKETS - 1 ? (m_received << (gap + 1)) | 1 : 1;
+        m_nextSequence = sequence + 1;
+    }
+
+    const int64_t senderFrame = (senderUsecs - m_origin) * m_sampleRate / 1000000;
+    const int64_t offset = arrivalFrame - senderFrame;
+    m_windowMin[1] = std::min(m_windowMin[1], offset);
+    const int64_t baseline = std::min(m_windowMin[0], m_windowMin[1]);
+    const int64_t jitter = offset - baseline;
+
+    const int64_t delay = m_delayFrames.load(std::memory_order_relaxed);
+    int64_t target = senderFrame + baseline + delay;
+    if (target < arrivalFrame) {
+        m_late.fetch_add(1, std::memory_order_relaxed);
+        target = arrivalFrame;
+    }
+    // when the delay shrinks, the packet waits for the previous one
+    target = std::max(target, m_lastTarget);
+    m_lastTarget = target;
+
+    // the delay covers the largest jitter of the last one or two windows
+    m_windowMax[1] = std::max(m_windowMax[1], jitter);
+    const int64_t minFrames = MIN_DELAY_USECS * m_sampleRate / 1000000;
+    const int64_t maxFrames = MAX_DELAY_USECS * m_sampleRate / 1000000;
+    m_delayFrames.store(std::max(minFrames, std::min(maxFrames, std::max(m_windowMax[0], m_windowMax[1]))),
+                        std::memory_order_relaxed);
+    if (++m_windowPackets >= WINDOW_PACKETS) {
+        m_windowMin[0] = m_windowMin[1];
+        m_windowMin[1] = std::numeric_limits<int64_t>::max();
+        m_windowMax[0] = m_windowMax[1];
+        m_windowMax[1] = 0;
+        m_windowPackets = 0;
+    }
+    return target;
+}
+
+JitterBuffer::Stats JitterBuffer::stats() const
+{
+    Stats s;
+    s.packets = m_packets.load(std::memory_order_relaxed);
+    s.late = m_late.load(std::memory_order_relaxed);
+    s.reordered = m_reordered.load(std::memory_order_relaxed);
+    s.lost = m_lost.load(std::memory_order_relaxed);
+    s.duplicates = m_duplicates.load(std::memory_order_relaxed);
+    s.delayUsecs = m_delayFrames.load(std::memory_order_relaxed) * 1000000 / m_sampleRate;
+    return s;
+}
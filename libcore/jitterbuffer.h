@@ -0,0 +1,85 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef JITTERBUFFER_H
+#define JITTERBUFFER_H
+
+#include <atomic>
+#include <cstdint>
+
+/**
+ * Maps the timestamps of network MIDI packets to output frame positions.
+ * The offset between the local arrival frame and the sender timestamp of
+ * each packet is compared with the minimum offset of the recent packets,
+ * which tracks the transit time of the least delayed ones and any clock
+ * drift. The playout delay is the largest excess over that minimum seen in
+ * the recent packets, so it grows at once and shrinks when the network
+ * calms down; packets exceeding the current delay are late and played as
+ * soon as possible. The frames returned never go backwards, so a shrinking
+ * delay can't reorder the events of consecutive packets. Sequence numbers
+ * reveal reordered, lost and duplicated packets; the sequences received
+ * recently are remembered, so a duplicate is not mistaken for a lost
+ * packet arriving late, and schedule() returns -1 for it.
+ *
+ * schedule() is called by a single receiving thread; the statistics may
+ * be read from any thread.
+ */
+class JitterBuffer
+{
+public:
+    struct Stats {
+        uint64_t packets = 0;
+        uint64_t late = 0;
+        uint64_t reordered = 0;
+        uint64_t lost = 0;
+        uint64_t duplicates = 0;
+        int64_t delayUsecs = 0;
+    };
+
+    explicit JitterBuffer(int sampleRate);
+
+    void reset();
+    void setSampleRate(int sampleRate);
+    int64_t schedule(uint32_t sequence, int64_t senderUsecs, int64_t arrivalFrame);
+    Stats stats() const;
+
+    static const int WINDOW_PACKETS;
+    static const int HISTORY_PACKETS;
+    static const int64_t MIN_DELAY_USECS;
+    static const int64_t MAX_DELAY_USECS;
+
+private:
+    int m_sampleRate;
+    bool m_started;
+    int64_t m_origin;
+    uint32_t m_nextSequence;
+    uint64_t m_received;
+    int64_t m_windowMin[2];
+    int m_windowPackets;
+    int64_t m_windowMax[2];
+    int64_t m_lastTarget;
+    std::atomic<uint64_t> m_packets;
+    std::atomic<uint64_t> m_late;
+    std::atomic<uint64_t> m_reordered;
+    std::atomic<uint64_t> m_lost;
+    std::atomic<uint64_t> m_duplicates;
+    std::atomic<int64_t> m_delayFrames;
+};
+
+#endif // JITTERBUFFER_H
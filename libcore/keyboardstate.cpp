@@ -0,0 +1,119 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "keyboardstate.h"
+
+bool KeyboardState::Snapshot::isPressed(int chan, int note) const
+{
+    return (pressed[chan][note >> 6] >> (note & 63)) & 1;
+}
+
+bool KeyboardState::Snapshot::isPressed(int note) const
+{
+    for (int chan = 0; chan < MIDI_CHANNELS; ++chan) {
+        if (isPressed(chan, note)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int KeyboardState::Snapshot::velocityOf(int note) const
+{
+    for (int chan = 0; chan < MIDI_CHANNELS; ++chan) {
+        if (isPressed(chan, note)) {
+            return velocity[chan][note];
+        }
+    }
+    return 0;
+}
+
+KeyboardState::KeyboardState()
+{
+    clear();
+}
+
+void KeyboardState::noteOn(int chan, int note, int vel)
+{
+    if (chan < 0 || chan >= MIDI_CHANNELS || note < 0 || note >= MIDI_NOTES) {
+        return;
+    }
+    if (vel == 0) {
+        noteOff(chan, note);
+        return;
+    }
+    m_velocity[chan][note].store(static_cast<uint8_t>(vel), std::memory_order_relaxed);
+    m_pressed[chan][note >> 6].fetch_or(uint64_t(1) << (note & 63), std::memory_order_relaxed);
+    m_serial.fetch_add(1, std::memory_order_release);
+}
+
+void KeyboardState::noteOff(int chan, int note)
+{
+    if (chan < 0 || chan >= MIDI_CHANNELS || note < 0 || note >= MIDI_NOTES) {
+        return;
+    }
+    m_pressed[chan][note >> 6].fetch_and(~(uint64_t(1) << (note & 63)), std::memory_order_relaxed);
+    m_serial.fetch_add(1, std::memory_order_release);
+}
+
+void KeyboardState::allNotesOff(int chan)
+{
+    if (chan < 0 || chan >= MIDI_CHANNELS) {
+        return;
+    }
+    m_pressed[chan][0].store(0, std::memory_order_relaxed);
+    m_pressed[chan][1].store(0, std::memory_order_relaxed);
+    m_serial.fetch_add(1, std::memory_order_release);
+}
+
+void KeyboardState::clear()
+{
+    for (int chan = 0; chan < MIDI_CHANNELS; ++chan) {
+        m_pressed[chan][0].store(0, std::memory_order_relaxed);
+        m_pressed[chan][1].store(0, std::memory_order_relaxed);
+        for (int note = 0; note < MIDI_NOTES; ++note) {
+            m_velocity[chan][note].store(0, std::memory_order_relaxed);
+        }
+    }
+    m_serial.fetch_add(1, std::memory_order_release);
+}
+
+unsigned KeyboardState::serial() const
+{
+    return m_serial.load(std::memory_order_acquire);
+}
+
+void KeyboardState::snapshot(Snapshot &s) const
+{
+    // a few retries are enough: a torn copy only shows a stale key for one frame
+    int retries = 4;
+    unsigned before, after;
+    do {
+        before = m_serial.load(std::memory_order_acquire);
+        for (int chan = 0; chan < MIDI_CHANNELS; ++chan) {
+            s.pressed[chan][0] = m_pressed[chan][0].load(std::memory_order_relaxed);
+            s.pressed[chan][1] = m_pressed[chan][1].load(std::memory_order_relaxed);
+            for (int note = 0; note < MIDI_NOTES; ++note) {
+                s.velocity[chan][note] = m_velocity[chan][note].load(std::memory_order_relaxed);
+            }
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        after = m_serial.load(std::memory_order_relaxed);
+    } while (before != after && --retries > 0);
+    s.serial = after;
+}
@@ -0,0 +1,64 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef KEYBOARDSTATE_H
+#define KEYBOARDSTATE_H
+
+#include <atomic>
+#include <cstdint>
+#include "eventqueue.h"
+
+/**
+ * Aggregated state of the pressed keys of every MIDI channel, written by
+ * the thread applying the MIDI events and polled by the user interface.
+ * Writing and reading never block: readers take a consistent snapshot by
+ * retrying when the serial number changes during the copy.
+ */
+class KeyboardState
+{
+public:
+    static const int MIDI_CHANNELS = MidiEvent::MAX_CHANNELS;
+    static const int MIDI_NOTES = 128;
+
+    struct Snapshot {
+        uint64_t pressed[MIDI_CHANNELS][2];
+        uint8_t velocity[MIDI_CHANNELS][MIDI_NOTES];
+        unsigned serial;
+
+        bool isPressed(int chan, int note) const;
+        bool isPressed(int note) const;
+        int velocityOf(int note) const;
+    };
+
+    KeyboardState();
+
+    void noteOn(int chan, int note, int vel);
+    void noteOff(int chan, int note);
+    void allNotesOff(int chan);
+    void clear();
+
+    unsigned serial() const;
+    void snapshot(Snapshot &s) const;
+
+private:
+    std::atomic<uint64_t> m_pressed[MIDI_CHANNELS][2];
+    std::atomic<uint8_t> m_velocity[MIDI_CHANNELS][MIDI_NOTES];
+    std::atomic<unsigned> m_serial;
+};
+
+#endif // KEYBOARDSTATE_H
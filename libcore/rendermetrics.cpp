@@ -0,0 +1,126 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include "rendermetrics.h"
+
+RenderMetrics::RenderMetrics():
+    m_events(0),
+    m_buffers(0),
+    m_voices(0),
+    m_peakVoices(0),
+    m_collectedEvents(0)
+{
+    for (int i = 0; i < MAX_BUCKETS; ++i) {
+        m_histogram[i] = 0;
+        m_collected[i] = 0;
+    }
+}
+
+void RenderMetrics::addBuffer(int64_t renderNsecs, int64_t periodNsecs)
+{
+    if (periodNsecs <= 0) {
+        return;
+    }
+    const int64_t load = renderNsecs * 100 / periodNsecs;
+    const int bucket = int(std::min<int64_t>(std::max<int64_t>(load, 0), MAX_BUCKETS - 1));
+    m_histogram[bucket].fetch_add(1, std::memory_order_relaxed);
+    m_buffers.fetch_add(1, std::memory_order_relaxed);
+}
+
+void RenderMetrics::addEvents(unsigned count)
+{
+    if (count > 0) {
+        m_events.fetch_add(count, std::memory_order_relaxed);
+    }
+}
+
+void RenderMetrics::setVoices(int voices)
+{
+    m_voices.store(voices, std::memory_order_relaxed);
+    if (voices > m_peakVoices.load(std::memory_order_relaxed)) {
+        m_peakVoices.store(voices, std::memory_order_relaxed);
+    }
+}
+
+int RenderMetrics::voices() const
+{
+    return m_voices.load(std::memory_order_relaxed);
+}
+
+int RenderMetrics::peakVoices() const
+{
+    return m_peakVoices.load(std::memory_order_relaxed);
+}
+
+uint64_t RenderMetrics::events() const
+{
+    return m_events.load(std::memory_order_relaxed);
+}
+
+uint64_t RenderMetrics::buffers() const
+{
+    return m_buffers.load(std::memory_order_relaxed);
+}
+
+/**
+ * Summarizes the buffers rendered and the events applied since the
+ * previous call. The load percentiles are expressed in percent.
+ */
+RenderMetrics::Summary RenderMetrics::collect(int64_t elapsedNsecs)
+{
+    Summary summary;
+    uint64_t counts[MAX_BUCKETS];
+    uint64_t total = 0;
+    for (int i = 0; i < MAX_BUCKETS; ++i) {
+        const uint64_t current = m_histogram[i].load(std::memory_order_relaxed);
+        counts[i] = current - m_collected[i];
+        m_collected[i] = current;
+        total += counts[i];
+        if (counts[i] > 0) {
+            summary.loadMax = i;
+        }
+    }
+    summary.buffers = total;
+    summary.load50 = percentile(counts, total, 0.50);
+    summary.load95 = percentile(counts, total, 0.95);
+    summary.load99 = percentile(counts, total, 0.99);
+
+    const uint64_t events = m_events.load(std::memory_order_relaxed);
+    if (elapsedNsecs > 0) {
+        summary.eventsPerSecond = (events - m_collectedEvents) * 1e9 / elapsedNsecs;
+    }
+    m_collectedEvents = events;
+    return summary;
+}
+
+double RenderMetrics::percentile(const uint64_t *counts, uint64_t total, double fraction) const
+{
+    if (total == 0) {
+        return 0;
+    }
+    const uint64_t rank = uint64_t(fraction * total + 0.5);
+    uint64_t accumulated = 0;
+    for (int i = 0; i < MAX_BUCKETS; ++i) {
+        accumulated += counts[i];
+        if (accumulated >= rank && accumulated > 0) {
+            return i;
+        }
+    }
+    return MAX_BUCKETS - 1;
+}
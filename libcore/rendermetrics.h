@@ -0,0 +1,74 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef RENDERMETRICS_H
+#define RENDERMETRICS_H
+
+#include <atomic>
+#include <cstdint>
+
+/**
+ * Performance counters updated by the audio thread without locks or
+ * allocations, and summarized periodically by a single reader thread.
+ * The DSP load of every rendered buffer (rendering time relative to the
+ * buffer duration) is accumulated into a histogram of 1% buckets.
+ */
+class RenderMetrics
+{
+public:
+    struct Summary {
+        double load50 = 0;
+        double load95 = 0;
+        double load99 = 0;
+        double loadMax = 0;
+        double eventsPerSecond = 0;
+        uint64_t buffers = 0;
+    };
+
+    RenderMetrics();
+
+    /* audio thread */
+    void addBuffer(int64_t renderNsecs, int64_t periodNsecs);
+    void addEvents(unsigned count);
+    void setVoices(int voices);
+
+    /* any thread */
+    int voices() const;
+    int peakVoices() const;
+    uint64_t events() const;
+    uint64_t buffers() const;
+
+    /* reader thread */
+    Summary collect(int64_t elapsedNsecs);
+
+private:
+    /* the last bucket accounts for any load above 199% */
+    static const int MAX_BUCKETS = 201;
+
+    double percentile(const uint64_t *counts, uint64_t total, double fraction) const;
+
+    std::atomic<uint64_t> m_histogram[MAX_BUCKETS];
+    std::atomic<uint64_t> m_events;
+    std::atomic<uint64_t> m_buffers;
+    std::atomic<int> m_voices;
+    std::atomic<int> m_peakVoices;
+    uint64_t m_collected[MAX_BUCKETS];
+    uint64_t m_collectedEvents;
+};
+
+#endif // RENDERMETRICS_H
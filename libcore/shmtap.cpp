@@ -0,0 +1,291 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <new>
+#include "shmtap.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+static_assert(sizeof(ShmTapHeader) <= ShmTapHeader::HEADER_BYTES, "ShmTapHeader too large");
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "64 bit atomics must be lock free to be shared");
+
+const char ShmTapHeader::MAGIC[8] = { 'F', 'L', 'S', 'Y', 'N', 'P', 'C', 'M' };
+const uint32_t ShmTapHeader::VERSION;
+const uint32_t ShmTapHeader::FLOAT32_INTERLEAVED;
+const uint32_t ShmTapHeader::HEADER_BYTES;
+
+const int ShmTap::DEFAULT_SECONDS = 2;
+
+static std::string objectName(const std::string &name)
+{
+    return name.empty() || name[0] == '/' ? name : '/' + name;
+}
+
+ShmTap::ShmTap():
+    m_header(nullptr),
+    m_samples(nullptr),
+    m_size(0),
+    m_mask(0)
+{ }
+
+ShmTap::~ShmTap()
+{
+    close();
+}
+
+/**
+ * Creates the shared memory object, replacing any previous one with the
+ * same name, with room for at least capacityFrames frames.
+ */
+bool ShmTap::open(const std::string &name, int sampleRate, int channels, int capacityFrames, int *error)
+{
+    close();
+#if defined(__unix__) || defined(__APPLE__)
+    uint32_t capacity = 1;
+    while (capacity < uint32_t(capacityFrames)) {
+        capacity <<= 1;
+    }
+    const std::string path = objectName(name);
+    const size_t size = ShmTapHeader::HEADER_BYTES + size_t(capacity) * channels * sizeof(float);
+    shm_unlink(path.c_str());
+    int fd = shm_open(path.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0 || ftruncate(fd, off_t(size)) != 0) {
+        if (error != nullptr) {
+            *error = errno;
+        }
+        if (fd >= 0) {
+            ::close(fd);
+            shm_unlink(path.c_str());
+        }
+        return false;
+    }
+    void *memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (memory == MAP_FAILED) {
+        if (error != nullptr) {
+            *error = errno;
+        }
+        shm_unlink(path.c_str());
+        return false;
+    }
+    // the pages are touched now, and not by the audio thread
+    std::memset(memory, 0, size);
+    m_header = new (memory) ShmTapHeader;
+    std::memcpy(m_header->magic, ShmTapHeader::MAGIC, sizeof(m_header->magic));
+    m_header->version = ShmTapHeader::VERSION;
+    m_header->headerBytes = ShmTapHeader::HEADER_BYTES;
+    m_header->sampleRate = uint32_t(sampleRate);
+    m_header->channels = uint32_t(channels);
+    m_header->sampleFormat = ShmTapHeader::FLOAT32_INTERLEAVED;
+    m_header->capacityFrames = capacity;
+    m_header->sequence.store(0, std::memory_order_relaxed);
+    m_header->reserveIndex.store(0, std::memory_order_relaxed);
+    m_header->writeIndex.store(0, std::memory_order_relaxed);
+    m_header->frameClock.store(0, std::memory_order_relaxed);
+    m_header->clockNsecs.store(0, std::memory_order_release);
+    m_samples = reinterpret_cast<float *>(static_cast<char *>(memory) + ShmTapHeader::HEADER_BYTES);
+    m_size = size;
+    m_mask = capacity - 1;
+    m_name = path;
+    return true;
+#else
+    (void) name;
+    (void) sampleRate;
+    (void) channels;
+    (void) capacityFrames;
+    if (error != nullptr) {
+        *error = ENOSYS;
+    }
+    return false;
+#endif
+}
+
+void ShmTap::close()
+{
+#if defined(__unix__) || defined(__APPLE__)
+    if (m_header != nullptr) {
+        munmap(m_header, m_size);
+        shm_unlink(m_name.c_str());
+    }
+#endif
+    m_header = nullptr;
+    m_samples = nullptr;
+    m_name.clear();
+}
+
+bool ShmTap::isOpen() const
+{
+    return m_header != nullptr;
+}
+
+const std::string &ShmTap::name() const
+{
+    return m_name;
+}
+
+void ShmTap::write(const float *frames, int count, uint64_t frameClock)
+{
+    if (m_header == nullptr || count <= 0) {
+        return;
+    }
+    const uint64_t first = m_header->writeIndex.load(std::memory_order_relaxed);
+    const uint64_t last = first + uint64_t(count);
+    const int channels = int(m_header->channels);
+    m_header->reserveIndex.store(last, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    uint64_t index = first;
+    while (index < last) {
+        const uint64_t offset = index & m_mask;
+        const uint64_t chunk = std::min<uint64_t>(last - index, m_mask + 1 - offset);
+        std::memcpy(m_samples + offset * channels, frames, chunk * channels * sizeof(float));
+        frames += chunk * channels;
+        index += chunk;
+    }
+    const int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+    m_header->sequence.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    m_header->frameClock.store(frameClock, std::memory_order_relaxed);
+    m_header->clockNsecs.store(now, std::memory_order_relaxed);
+    m_header->writeIndex.store(last, std::memory_order_relaxed);
+    m_header->sequence.fetch_add(1, std::memory_order_release);
+}
+
+ShmTapReader::ShmTapReader():
+    m_header(nullptr),
+    m_samples(nullptr),
+    m_size(0),
+    m_mask(0)
+{ }
+
+ShmTapReader::~ShmTapReader()
+{
+    close();
+}
+
+bool ShmTapReader::open(const std::string &name, int *error)
+{
+    close();
+#if defined(__unix__) || defined(__APPLE__)
+    int fd = shm_open(objectName(name).c_str(), O_RDONLY, 0);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        if (error != nullptr) {
+            *error = errno;
+        }
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        return false;
+    }
+    const size_t size = size_t(st.st_size);
+    void *memory = size >= ShmTapHeader::HEADER_BYTES ? mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    ::close(fd);
+    if (memory == MAP_FAILED) {
+        if (error != nullptr) {
+            *error = size >= ShmTapHeader::HEADER_BYTES ? errno : EINVAL;
+        }
+        return false;
+    }
+    const ShmTapHeader *header = static_cast<const ShmTapHeader *>(memory);
+    if (std::memcmp(header->magic, ShmTapHeader::MAGIC, sizeof(header->magic)) != 0
+            || header->version != ShmTapHeader::VERSION
+            || header->headerBytes + size_t(header->capacityFrames) * header->channels * sizeof(float) > size) {
+        munmap(memory, size);
+        if (error != nullptr) {
+            *error = EINVAL;
+        }
+        return false;
+    }
+    m_header = header;
+    m_samples = reinterpret_cast<const float *>(static_cast<const char *>(memory) + header->headerBytes);
+    m_size = size;
+    m_mask = header->capacityFrames - 1;
+    return true;
+#else
+    (void) name;
+    if (error != nullptr) {
+        *error = ENOSYS;
+    }
+    return false;
+#endif
+}
+
+void ShmTapReader::close()
+{
+#if defined(__unix__) || defined(__APPLE__)
+    if (m_header != nullptr) {
+        munmap(const_cast<ShmTapHeader *>(m_header), m_size);
+    }
+#endif
+    m_header = nullptr;
+    m_samples = nullptr;
+}
+
+bool ShmTapReader::isOpen() const
+{
+    return m_header != nullptr;
+}
+
+const ShmTapHeader *ShmTapReader::header() const
+{
+    return m_header;
+}
+
+uint64_t ShmTapReader::writeIndex() const
+{
+    return m_header->writeIndex.load(std::memory_order_acquire);
+}
+
+/**
+ * Returns the samples of a frame, in place.
+ */
+const float *ShmTapReader::frame(uint64_t index) const
+{
+    return m_samples + (index & m_mask) * m_header->channels;
+}
+
+/**
+ * Returns how many frames follow the given one in memory, before the ring
+ * wraps around.
+ */
+int ShmTapReader::contiguousFrames(uint64_t index) const
+{
+    return int(m_mask + 1 - (index & m_mask));
+}
+
+/**
+ * Checks after reading them that the frames from index onwards have not
+ * been overwritten meanwhile.
+ */
+bool ShmTapReader::valid(uint64_t index) const
+{
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const uint64_t reserved = m_header->reserveIndex.load(std::memory_order_relaxed);
+    return reserved <= index + m_mask + 1;
+}
@@ -0,0 +1,119 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef SHMTAP_H
+#define SHMTAP_H
+
+#include <atomic>
+#include <string>
+#include <cstdint>
+
+/**
+ * The header at the start of the shared memory object of a ShmTap,
+ * followed by the interleaved 32-bit float samples at headerBytes. The
+ * ring holds capacityFrames frames, a power of two; frame n is at
+ * (n & (capacityFrames - 1)) * channels.
+ *
+ * The writer stores reserveIndex before overwriting any sample, and
+ * writeIndex after the samples up to it are complete. A reader may use the
+ * frames from writeIndex - capacityFrames to writeIndex, and they were
+ * valid if, after reading them, reserveIndex - capacityFrames is still not
+ * past the first one. frameClock is the synth output frame at writeIndex,
+ * rendered at clockNsecs of the steady (monotonic) clock; the three are
+ * updated together under the odd/even sequence.
+ */
+struct ShmTapHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t headerBytes;
+    uint32_t sampleRate;
+    uint32_t channels;
+    uint32_t sampleFormat;
+    uint32_t capacityFrames;
+    std::atomic<uint32_t> sequence;
+    uint32_t reserved;
+    std::atomic<uint64_t> reserveIndex;
+    std::atomic<uint64_t> writeIndex;
+    std::atomic<uint64_t> frameClock;
+    std::atomic<int64_t> clockNsecs;
+
+    static const char MAGIC[8];
+    static const uint32_t VERSION = 1;
+    static const uint32_t FLOAT32_INTERLEAVED = 1;
+    static const uint32_t HEADER_BYTES = 128;
+};
+
+/**
+ * Publishes the rendered audio into a POSIX shared memory ring, for other
+ * processes like visualizers and recorders. The writer never waits for
+ * the readers and doesn't make system calls while writing; readers map
+ * the same object and read the samples in place.
+ */
+class ShmTap
+{
+public:
+    ShmTap();
+    ~ShmTap();
+
+    bool open(const std::string &name, int sampleRate, int channels, int capacityFrames, int *error = nullptr);
+    void close();
+    bool isOpen() const;
+    const std::string &name() const;
+
+    /* writer thread */
+    void write(const float *frames, int count, uint64_t frameClock);
+
+    static const int DEFAULT_SECONDS;
+
+private:
+    std::string m_name;
+    ShmTapHeader *m_header;
+    float *m_samples;
+    size_t m_size;
+    uint64_t m_mask;
+};
+
+/**
+ * Read only mapping of the ring published by a ShmTap in another process.
+ */
+class ShmTapReader
+{
+public:
+    ShmTapReader();
+    ~ShmTapReader();
+
+    bool open(const std::string &name, int *error = nullptr);
+    void close();
+    bool isOpen() const;
+
+    const ShmTapHeader *header() const;
+    uint64_t writeIndex() const;
+    const float *frame(uint64_t index) const;
+    int contiguousFrames(uint64_t index) const;
+    bool valid(uint64_t index) const;
+
+private:
+    const ShmTapHeader *m_header;
+    const float *m_samples;
+    size_t m_size;
+    uint64_t m_mask;
+};
+
+#endif // SHMTAP_H
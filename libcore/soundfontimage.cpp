@@ -0,0 +1,462 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include "soundfontimage.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+const char SoundfontImageHeader::MAGIC[8] = {'F', 'L', 'S', 'F', 'I', 'M', 'G', '\0'};
+
+static_assert(sizeof(SoundfontImageHeader) == 152, "unexpected image header layout");
+static_assert(sizeof(SoundfontImagePreset) == 40, "unexpected image preset layout");
+static_assert(sizeof(SoundfontImageZone) == 520, "unexpected image zone layout");
+static_assert(sizeof(SoundfontImageModulator) == 16, "unexpected image modulator layout");
+static_assert(sizeof(SoundfontImageSample) == 56, "unexpected image sample layout");
+
+SoundfontImage::SoundfontImage():
+    m_data(nullptr),
+    m_size(0),
+    m_mapped(false)
+{ }
+
+SoundfontImage::~SoundfontImage()
+{
+    close();
+}
+
+/**
+ * Maps the image file, with its pages read in advance where possible so
+ * the audio thread does not wait for them. Other systems read the file.
+ */
+bool SoundfontImage::open(const std::string &fileName, std::string *error)
+{
+    close();
+#if defined(__unix__) || defined(__APPLE__)
+    int fd = ::open(fileName.c_str(), O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0) {
+        if (error != nullptr) {
+            *error = std::strerror(errno);
+        }
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        return false;
+    }
+    int flags = MAP_PRIVATE;
+#if defined(MAP_POPULATE)
+    flags |= MAP_POPULATE;
+#endif
+    const size_t size = size_t(info.st_size);
+    void *memory = size > 0 ? mmap(nullptr, size, PROT_READ, flags, fd, 0) : MAP_FAILED;
+    ::close(fd);
+    if (memory == MAP_FAILED) {
+        if (error != nullptr) {
+            *error = size > 0 ? std::strerror(errno) : "empty file";
+        }
+        return false;
+    }
+    m_data = static_cast<const char *>(memory);
+    m_size = size;
+    m_mapped = true;
+#else
+    std::ifstream file(fileName, std::ios::binary | std::ios::ate);
+    if (!file) {
+        if (error != nullptr) {
+            *error = std::strerror(errno);
+        }
+        return false;
+    }
+    m_buffer.resize(size_t(file.tellg()));
+    file.seekg(0);
+    file.read(m_buffer.data(), std::streamsize(m_buffer.size()));
+    m_data = m_buffer.data();
+    m_size = m_buffer.size();
+#endif
+    if (!validate(error)) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void SoundfontImage::close()
+{
+#if defined(__unix__) || defined(__APPLE__)
+    if (m_mapped) {
+        munmap(const_cast<char *>(m_data), m_size);
+    }
+#endif
+    std::vector<char>().swap(m_buffer);
+    m_data = nullptr;
+    m_size = 0;
+    m_mapped = false;
+}
+
+bool SoundfontImage::isOpen() const
+{
+    return m_data != nullptr;
+}
+
+static bool fits(uint64_t offset, uint64_t count, uint64_t recordSize, size_t size)
+{
+    return offset % SoundfontImageHeader::ALIGNMENT == 0 && offset <= size
+            && count <= (size - offset) / recordSize;
+}
+
+static bool terminated(const char *name, size_t size)
+{
+    return std::memchr(name, '\0', size) != nullptr;
+}
+
+/**
+ * Checks the header and the references between the tables, so that no
+ * record points outside of the image. It does not look into the samples.
+ */
+bool SoundfontImage::validate(std::string *error) const
+{
+    const char *problem = nullptr;
+    const SoundfontImageHeader &h = header();
+    if (m_size < sizeof(SoundfontImageHeader) || std::memcmp(h.magic, SoundfontImageHeader::MAGIC, sizeof(h.magic)) != 0) {
+        problem = "not a soundfont image";
+    } else if (h.version != SoundfontImageHeader::VERSION || h.byteOrder != SoundfontImageHeader::BYTE_ORDER_MARK) {
+        problem = "unsupported image version or byte order";
+    } else if (h.fileBytes != m_size) {
+        problem = "truncated image";
+    } else if (!terminated(h.name, sizeof(h.name))
+               || !fits(h.presetOffset, h.presetCount, sizeof(SoundfontImagePreset), m_size)
+               || !fits(h.zoneOffset, h.zoneCount, sizeof(SoundfontImageZone), m_size)
+               || !fits(h.modulatorOffset, h.modulatorCount, sizeof(SoundfontImageModulator), m_size)
+               || !fits(h.sampleOffset, h.sampleCount, sizeof(SoundfontImageSample), m_size)
+               || !fits(h.dataOffset, h.dataFrames, sizeof(int16_t), m_size)) {
+        problem = "corrupt image tables";
+    }
+    for (uint32_t i = 0; problem == nullptr && i < h.presetCount; ++i) {
+        const SoundfontImagePreset &p = presets()[i];
+        if (!terminated(p.name, sizeof(p.name)) || p.firstZone > h.zoneCount || p.zoneCount > h.zoneCount - p.firstZone
+                || (i > 0 && (p.bank < presets()[i - 1].bank
+                              || (p.bank == presets()[i - 1].bank && p.program <= presets()[i - 1].program)))) {
+            problem = "corrupt image presets";
+        }
+    }
+    for (uint32_t i = 0; problem == nullptr && i < h.zoneCount; ++i) {
+        const SoundfontImageZone &z = zones()[i];
+        if (z.sample >= h.sampleCount
+                || z.firstInstrumentModulator > h.modulatorCount
+                || z.instrumentModulators > h.modulatorCount - z.firstInstrumentModulator
+                || z.firstPresetModulator > h.modulatorCount
+                || z.presetModulators > h.modulatorCount - z.firstPresetModulator) {
+            problem = "corrupt image zones";
+        }
+    }
+    for (uint32_t i = 0; problem == nullptr && i < h.modulatorCount; ++i) {
+        if (modulators()[i].destination >= SoundfontImageZone::GENERATORS) {
+            problem = "corrupt image modulators";
+        }
+    }
+    for (uint32_t i = 0; problem == nullptr && i < h.sampleCount; ++i) {
+        const SoundfontImageSample &s = samples()[i];
+        if (!terminated(s.name, sizeof(s.name)) || s.start > s.end
+                || uint64_t(s.end) + 1 + SoundfontImageSample::PADDING > h.dataFrames) {
+            problem = "corrupt image samples";
+        }
+    }
+    if (problem != nullptr && error != nullptr) {
+        *error = problem;
+    }
+    return problem == nullptr;
+}
+
+const SoundfontImageHeader &SoundfontImage::header() const
+{
+    return *reinterpret_cast<const SoundfontImageHeader *>(m_data);
+}
+
+const SoundfontImagePreset *SoundfontImage::presets() const
+{
+    return reinterpret_cast<const SoundfontImagePreset *>(m_data + header().presetOffset);
+}
+
+const SoundfontImageZone *SoundfontImage::zones() const
+{
+    return reinterpret_cast<const SoundfontImageZone *>(m_data + header().zoneOffset);
+}
+
+const SoundfontImageModulator *SoundfontImage::modulators() const
+{
+    return reinterpret_cast<const SoundfontImageModulator *>(m_data + header().modulatorOffset);
+}
+
+const SoundfontImageSample *SoundfontImage::samples() const
+{
+    return reinterpret_cast<const SoundfontImageSample *>(m_data + header().sampleOffset);
+}
+
+const int16_t *SoundfontImage::sampleData() const
+{
+    return reinterpret_cast<const int16_t *>(m_data + header().dataOffset);
+}
+
+/**
+ * Binary search of the presets, which are sorted by bank and program.
+ */
+const SoundfontImagePreset *SoundfontImage::findPreset(unsigned bank, unsigned program) const
+{
+    const SoundfontImagePreset *first = presets();
+    const SoundfontImagePreset *last = first + header().presetCount;
+    const SoundfontImagePreset *it = std::lower_bound(first, last, std::make_pair(bank, program),
+        [](const SoundfontImagePreset &p, const std::pair<unsigned, unsigned> &key) {
+            return p.bank < key.first || (p.bank == key.first && p.program < key.second);
+        });
+    return it != last && it->bank == bank && it->program == program ? it : nullptr;
+}
+
+bool SoundfontImage::isImage(const std::string &fileName)
+{
+    char magic[sizeof(SoundfontImageHeader::MAGIC)];
+    std::ifstream file(fileName, std::ios::binary);
+    return file.read(magic, sizeof(magic)) && std::memcmp(magic, SoundfontImageHeader::MAGIC, sizeof(magic)) == 0;
+}
+
+/* FluidLite soundfont loader */
+
+struct ImageFont
+{
+    SoundfontImage image;
+    std::string name;
+    std::vector<fluid_sample_t> samples;
+    std::vector<fluid_mod_t*> modulators;
+    uint32_t iteration = 0;
+};
+
+static ImageFont *imageFont(fluid_sfont_t *sfont)
+{
+    return static_cast<ImageFont *>(sfont->data);
+}
+
+static const SoundfontImagePreset *imagePreset(fluid_preset_t *preset)
+{
+    return static_cast<const SoundfontImagePreset *>(preset->data);
+}
+
+static char *presetName(fluid_preset_t *preset)
+{
+    return const_cast<char *>(imagePreset(preset)->name);
+}
+
+static int presetBank(fluid_preset_t *preset)
+{
+    return int(imagePreset(preset)->bank);
+}
+
+static int presetProgram(fluid_preset_t *preset)
+{
+    return int(imagePreset(preset)->program);
+}
+
+/**
+ * Starts a voice for every zone of the preset covering the key and the
+ * velocity, like the FluidLite soundfont loader does after merging the
+ * zones.
+ */
+static int presetNoteOn(fluid_preset_t *preset, fluid_synth_t *synth, int chan, int key, int vel)
+{
+    ImageFont *font = imageFont(preset->sfont);
+    const SoundfontImagePreset *p = imagePreset(preset);
+    const SoundfontImageZone *zone = font->image.zones() + p->firstZone;
+    const SoundfontImageZone *end = zone + p->zoneCount;
+    for (; zone != end; ++zone) {
+        if (key < zone->keyLow || key > zone->keyHigh || vel < zone->velocityLow || vel > zone->velocityHigh) {
+            continue;
+        }
+        fluid_voice_t *voice = fluid_synth_alloc_voice(synth, &font->samples[zone->sample], chan, key, vel);
+        if (voice == nullptr) {
+            return FLUID_FAILED;
+        }
+        for (int gen = 0; gen < SoundfontImageZone::GENERATORS; ++gen) {
+            if ((zone->instrumentGenerators >> gen) & 1) {
+                fluid_voice_gen_set(voice, gen, zone->instrument[gen]);
+            }
+        }
+        for (int i = 0; i < zone->instrumentModulators; ++i) {
+            fluid_voice_add_mod(voice, font->modulators[zone->firstInstrumentModulator + i], FLUID_VOICE_OVERWRITE);
+        }
+        for (int gen = 0; gen < SoundfontImageZone::GENERATORS; ++gen) {
+            if ((zone->presetGenerators >> gen) & 1) {
+                fluid_voice_gen_incr(voice, gen, zone->preset[gen]);
+            }
+        }
+        for (int i = 0; i < zone->presetModulators; ++i) {
+            fluid_voice_add_mod(voice, font->modulators[zone->firstPresetModulator + i], FLUID_VOICE_ADD);
+        }
+        fluid_synth_start_voice(synth, voice);
+    }
+    return FLUID_OK;
+}
+
+static void setupPreset(fluid_preset_t *preset, fluid_sfont_t *sfont, const SoundfontImagePreset *p)
+{
+    preset->data = const_cast<SoundfontImagePreset *>(p);
+    preset->sfont = sfont;
+    preset->get_name = presetName;
+    preset->get_banknum = presetBank;
+    preset->get_num = presetProgram;
+    preset->noteon = presetNoteOn;
+    preset->notify = nullptr;
+}
+
+static int freePreset(fluid_preset_t *preset)
+{
+    delete preset;
+    return 0;
+}
+
+/**
+ * The soundfont is kept while its samples are still played.
+ */
+static int freeFont(fluid_sfont_t *sfont)
+{
+    ImageFont *font = imageFont(sfont);
+    for (const fluid_sample_t &sample : font->samples) {
+        if (sample.refcount != 0) {
+            return -1;
+        }
+    }
+    for (fluid_mod_t *mod : font->modulators) {
+        fluid_mod_delete(mod);
+    }
+    delete font;
+    delete sfont;
+    return 0;
+}
+
+static char *fontName(fluid_sfont_t *sfont)
+{
+    return &imageFont(sfont)->name[0];
+}
+
+static fluid_preset_t *fontPreset(fluid_sfont_t *sfont, unsigned int bank, unsigned int program)
+{
+    const SoundfontImagePreset *p = imageFont(sfont)->image.findPreset(bank, program);
+    if (p == nullptr) {
+        return nullptr;
+    }
+    fluid_preset_t *preset = new fluid_preset_t();
+    setupPreset(preset, sfont, p);
+    preset->free = freePreset;
+    return preset;
+}
+
+static void fontIterationStart(fluid_sfont_t *sfont)
+{
+    imageFont(sfont)->iteration = 0;
+}
+
+static int fontIterationNext(fluid_sfont_t *sfont, fluid_preset_t *preset)
+{
+    ImageFont *font = imageFont(sfont);
+    if (font->iteration >= font->image.header().presetCount) {
+        return 0;
+    }
+    // the caller owns the preset
+    setupPreset(preset, sfont, font->image.presets() + font->iteration++);
+    preset->free = nullptr;
+    return 1;
+}
+
+static fluid_sfont_t *loadImage(fluid_sfloader_t *loader, const char *fileName)
+{
+    (void) loader;
+    if (!SoundfontImage::isImage(fileName)) {
+        return nullptr;
+    }
+    std::unique_ptr<ImageFont> font(new ImageFont);
+    std::string error;
+    if (!font->image.open(fileName, &error)) {
+        static char format[] = "Unable to load the soundfont image %s: %s";
+        fluid_log(FLUID_ERR, format, fileName, error.c_str());
+        return nullptr;
+    }
+    const SoundfontImageHeader &header = font->image.header();
+    font->name = header.name;
+    // the samples use the image data in place
+    short *data = const_cast<short *>(reinterpret_cast<const short *>(font->image.sampleData()));
+    font->samples.resize(header.sampleCount);
+    for (uint32_t i = 0; i < header.sampleCount; ++i) {
+        const SoundfontImageSample &s = font->image.samples()[i];
+        fluid_sample_t &sample = font->samples[i];
+        std::strncpy(sample.name, s.name, sizeof(sample.name) - 1);
+        sample.start = s.start;
+        sample.end = s.end;
+        sample.loopstart = s.loopStart;
+        sample.loopend = s.loopEnd;
+        sample.samplerate = s.sampleRate;
+        sample.origpitch = s.originalPitch;
+        sample.pitchadj = s.pitchCorrection;
+        sample.sampletype = int(s.sampleType);
+        sample.valid = 1;
+        sample.data = data;
+    }
+    font->modulators.reserve(header.modulatorCount);
+    for (uint32_t i = 0; i < header.modulatorCount; ++i) {
+        const SoundfontImageModulator &m = font->image.modulators()[i];
+        fluid_mod_t *mod = fluid_mod_new();
+        fluid_mod_set_source1(mod, m.source1, m.flags1);
+        fluid_mod_set_source2(mod, m.source2, m.flags2);
+        fluid_mod_set_dest(mod, m.destination);
+        fluid_mod_set_amount(mod, m.amount);
+        font->modulators.push_back(mod);
+    }
+    fluid_sfont_t *sfont = new fluid_sfont_t();
+    sfont->data = font.release();
+    sfont->free = freeFont;
+    sfont->get_name = fontName;
+    sfont->get_preset = fontPreset;
+    sfont->iteration_start = fontIterationStart;
+    sfont->iteration_next = fontIterationNext;
+    return sfont;
+}
+
+static int freeLoader(fluid_sfloader_t *loader)
+{
+    delete loader;
+    return 0;
+}
+
+/**
+ * A soundfont loader for the images, to be added to a synth, which owns
+ * it afterwards.
+ */
+fluid_sfloader_t *SoundfontImage::newLoader()
+{
+    fluid_sfloader_t *loader = new fluid_sfloader_t();
+    loader->free = freeLoader;
+    loader->load = loadImage;
+    return loader;
+}
@@ -0,0 +1,167 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef SOUNDFONTIMAGE_H
+#define SOUNDFONTIMAGE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <fluidlite.h>
+
+/**
+ * The header at the start of a soundfont image: a soundfont compiled with
+ * its zones resolved and its samples decoded, to be mapped and used in
+ * place. The tables follow at their offsets, aligned to ALIGNMENT bytes:
+ * the presets sorted by bank and program, their zones, the modulators of
+ * the zones, the sample headers and the 16-bit sample data. Everything is
+ * in the byte order of the machine that compiled it, which is checked
+ * with byteOrder.
+ */
+struct SoundfontImageHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    char name[64];
+    uint32_t presetCount;
+    uint32_t zoneCount;
+    uint32_t modulatorCount;
+    uint32_t sampleCount;
+    uint64_t presetOffset;
+    uint64_t zoneOffset;
+    uint64_t modulatorOffset;
+    uint64_t sampleOffset;
+    uint64_t dataOffset;
+    uint64_t dataFrames;
+    uint64_t fileBytes;
+
+    static const char MAGIC[8];
+    static const uint32_t VERSION = 1;
+    static const uint32_t BYTE_ORDER_MARK = 0x01020304;
+    static const int ALIGNMENT = 64;
+};
+
+struct SoundfontImagePreset
+{
+    char name[24];
+    uint32_t bank;
+    uint32_t program;
+    uint32_t firstZone;
+    uint32_t zoneCount;
+};
+
+/**
+ * A preset zone combined with one of the zones of its instrument, with the
+ * global zones merged in: the instrument generators are set on the voice,
+ * the preset ones added to them, like the modulators.
+ */
+struct SoundfontImageZone
+{
+    uint8_t keyLow;
+    uint8_t keyHigh;
+    uint8_t velocityLow;
+    uint8_t velocityHigh;
+    uint32_t sample;
+    uint32_t firstInstrumentModulator;
+    uint32_t firstPresetModulator;
+    uint16_t instrumentModulators;
+    uint16_t presetModulators;
+    uint32_t reserved;
+    uint64_t instrumentGenerators;
+    uint64_t presetGenerators;
+    float instrument[60];
+    float preset[60];
+
+    static const int GENERATORS = 60;
+};
+
+/**
+ * A modulator, with the sources and flags as FluidLite uses them.
+ */
+struct SoundfontImageModulator
+{
+    uint8_t destination;
+    uint8_t source1;
+    uint8_t flags1;
+    uint8_t source2;
+    uint8_t flags2;
+    uint8_t reserved[3];
+    double amount;
+};
+
+/**
+ * A sample as FluidLite uses it: the positions are frame numbers in the
+ * sample data, end being the last frame, followed by PADDING silent ones.
+ */
+struct SoundfontImageSample
+{
+    char name[24];
+    uint32_t start;
+    uint32_t end;
+    uint32_t loopStart;
+    uint32_t loopEnd;
+    uint32_t sampleRate;
+    int32_t originalPitch;
+    int32_t pitchCorrection;
+    uint32_t sampleType;
+
+    static const int PADDING = 46;
+};
+
+/**
+ * A soundfont image file mapped into memory, read only, after checking
+ * that its tables are consistent. newLoader() creates a FluidLite
+ * soundfont loader playing the images in place, without copying nor
+ * parsing them; other files are left to the following loaders.
+ */
+class SoundfontImage
+{
+public:
+    SoundfontImage();
+    ~SoundfontImage();
+
+    bool open(const std::string &fileName, std::string *error = nullptr);
+    void close();
+    bool isOpen() const;
+
+    const SoundfontImageHeader &header() const;
+    const SoundfontImagePreset *presets() const;
+    const SoundfontImageZone *zones() const;
+    const SoundfontImageModulator *modulators() const;
+    const SoundfontImageSample *samples() const;
+    const int16_t *sampleData() const;
+    const SoundfontImagePreset *findPreset(unsigned bank, unsigned program) const;
+
+    static bool isImage(const std::string &fileName);
+    static fluid_sfloader_t *newLoader();
+
+private:
+    SoundfontImage(const SoundfontImage &) = delete;
+    SoundfontImage &operator=(const SoundfontImage &) = delete;
+
+    bool validate(std::string *error) const;
+
+    const char *m_data;
+    size_t m_size;
+    bool m_mapped;
+    std::vector<char> m_buffer;
+};
+
+#endif // SOUNDFONTIMAGE_H
@@ -0,0 +1,974 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <thread>
+#include "synthengine.h"
+#include "tracer.h"
+#include "soundfontimage.h"
+
+/* below -100 dBFS, and without voices, the synth output is considered silent */
+static const float SILENCE_THRESHOLD = 1e-5f;
+
+/* the synth loading a soundfont for the engine never plays */
+static const int STAGING_POLYPHONY = 16;
+
+static const char *const EVENT_ARRIVED[] = {
+    "noteOn arrived", "noteOff arrived", "keyPressure arrived", "controller arrived",
+    "program arrived", "channelPressure arrived", "pitchBend arrived"
+};
+
+static const char *const EVENT_APPLIED[] = {
+    "noteOn applied", "noteOff applied", "keyPressure applied", "controller applied",
+    "program applied", "channelPressure applied", "pitchBend applied"
+};
+
+static float peakLevel(const float *buffer, int64_t count)
+{
+    float peak = 0;
+    for (int64_t i = 0; i < count; ++i) {
+        peak = std::max(peak, std::fabs(buffer[i]));
+    }
+    return peak;
+}
+
+static uint32_t readLE32(const unsigned char *p)
+{
+    return uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24;
+}
+
+/**
+ * Returns the PCM frames of a compressed sample: the granule position of
+ * the last Ogg page found in its data, or -1.
+ */
+static int64_t oggFrames(std::ifstream &file, int64_t start, int64_t end)
+{
+    // an Ogg page is at most 65307 bytes long
+    const int64_t length = std::min<int64_t>(end - start, 65307);
+    if (length < 27) {
+        return -1;
+    }
+    std::vector<unsigned char> tail(static_cast<size_t>(length));
+    file.seekg(end - length);
+    if (!file.read(reinterpret_cast<char *>(tail.data()), length)) {
+        return -1;
+    }
+    for (int64_t i = length - 27; i >= 0; --i) {
+        if (std::memcmp(tail.data() + i, "OggS", 4) == 0) {
+            const int64_t granule = int64_t(readLE32(tail.data() + i + 6))
+                    | int64_t(readLE32(tail.data() + i + 10)) << 32;
+            return granule >= 0 ? granule : -1;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Estimates the memory used by a loaded soundfont. FluidLite keeps the
+ * whole sample data in memory, so it is the file size, except for the
+ * compressed samples of SoundFont 3 files, which are decoded into 16-bit
+ * PCM: their decoded size replaces their compressed one.
+ */
+static int64_t soundfontFootprint(const std::string &fileName)
+{
+    std::ifstream file(fileName, std::ios::binary | std::ios::ate);
+    if (!file) {
+        return 0;
+    }
+    const int64_t size = int64_t(file.tellg());
+    unsigned char header[12];
+    file.seekg(0);
+    if (!file.read(reinterpret_cast<char *>(header), sizeof(header))
+            || std::memcmp(header, "RIFF", 4) != 0 || std::memcmp(header + 8, "sfbk", 4) != 0) {
+        return size;
+    }
+    int64_t smplOffset = -1, shdrOffset = -1, shdrSize = 0;
+    int64_t position = sizeof(header);
+    while (position + 8 <= size) {
+        unsigned char chunk[12];
+        file.seekg(position);
+        if (!file.read(reinterpret_cast<char *>(chunk), sizeof(chunk))) {
+            break;
+        }
+        const int64_t chunkSize = readLE32(chunk + 4);
+        if (std::memcmp(chunk, "LIST", 4) == 0) {
+            // the sub-chunks follow the list type
+            position += 12;
+            continue;
+        }
+        if (std::memcmp(chunk, "smpl", 4) == 0) {
+            smplOffset = position + 8;
+        } else if (std::memcmp(chunk, "shdr", 4) == 0) {
+            shdrOffset = position + 8;
+            shdrSize = chunkSize;
+        }
+        position += 8 + chunkSize + (chunkSize & 1);
+    }
+    if (smplOffset < 0 || shdrOffset < 0) {
+        return size;
+    }
+    int64_t footprint = size;
+    const int64_t samples = shdrSize / 46 - 1;
+    for (int64_t i = 0; i < samples; ++i) {
+        unsigned char record[46];
+        file.clear();
+        file.seekg(shdrOffset + i * 46);
+        if (!file.read(reinterpret_cast<char *>(record), sizeof(record))) {
+            return size;
+        }
+        const int64_t start = readLE32(record + 20);
+        const int64_t end = readLE32(record + 24);
+        const unsigned type = unsigned(record[44]) | unsigned(record[45]) << 8;
+        if ((type & 0x10) == 0 || end <= start || smplOffset + end > size) {
+            continue;
+        }
+        const int64_t frames = oggFrames(file, smplOffset + start, smplOffset + end);
+        if (frames > 0) {
+            footprint += frames * int64_t(sizeof(int16_t)) - (end - start);
+        }
+    }
+    return footprint;
+}
+
+const int SynthEngine::DEFAULT_SAMPLE_RATE = 44100;
+const int SynthEngine::DEFAULT_RENDERING_FRAMES = 64;
+const int SynthEngine::DEFAULT_FRAME_CHANNELS = 2;
+
+SynthEngine::SynthEngine(const EngineProfile &profile, int midiBanks):
+    m_profile(profile),
+    m_sampleRate(profile.sampleRate),
+    m_renderingFrames(std::max(profile.blockFrames, 1)),
+    m_channels(DEFAULT_FRAME_CHANNELS),
+    m_midiBanks(std::min(std::max(midiBanks, 1), int(MidiEvent::MAX_BANKS))),
+    m_soundfontMemory(0),
+    m_paused(false),
+    m_rendering(false),
+    m_clockSequence(0),
+    m_clockFrame(0),
+    m_clockNsecs(0),
+    m_coalescing(true),
+    m_coalescedEvents(0),
+    m_droppedEvents(0),
+    m_notesDropped(false),
+    m_observer(nullptr),
+    m_profiling(false),
+    m_renderedFrames(0),
+    m_bypassedFrames(0),
+    m_silencedFrames(0),
+    m_idle(false),
+    m_drumCache(profile.sampleRate, DEFAULT_FRAME_CHANNELS, profile.interpolation),
+    m_drumCaching(false),
+    m_reverbOn(false),
+    m_chorusOn(false),
+    m_cachedHitCount(0)
+{
+    std::fill_n(m_channelPressed, KeyboardState::MIDI_CHANNELS, false);
+    for (auto &dropped : m_channelNotesDropped) {
+        dropped.store(false, std::memory_order_relaxed);
+    }
+    m_settings = new_fluid_settings();
+    fluid_settings_setnum(m_settings, "synth.sample-rate", m_sampleRate);
+    fluid_settings_setnum(m_settings, "synth.gain", 1.0);
+    fluid_settings_setint(m_settings, "synth.midi-channels", m_midiBanks * MidiEvent::BANK_CHANNELS);
+    fluid_settings_setint(m_settings, "synth.polyphony", m_profile.polyphony);
+    fluid_settings_setstr(m_settings, "synth.reverb.active", m_profile.effects != EngineProfile::NoEffects ? "yes" : "no");
+    fluid_settings_setstr(m_settings, "synth.chorus.active", m_profile.effects == EngineProfile::AllEffects ? "yes" : "no");
+    m_synth = new_fluid_synth(m_settings);
+    // tried before the SoundFont loader
+    fluid_synth_add_sfloader(m_synth, SoundfontImage::newLoader());
+    fluid_synth_set_interp_method(m_synth, -1, m_profile.interpolation);
+    // FluidLite only makes the tenth channel of the first bank percussive
+    for (int bank = 1; bank < m_midiBanks; ++bank) {
+        fluid_synth_bank_select(m_synth, bank * MidiEvent::BANK_CHANNELS + 9, 128);
+    }
+    m_voiceList.resize(fluid_synth_get_polyphony(m_synth) + 1);
+}
+
+SynthEngine::~SynthEngine()
+{
+    m_drumCache.stop();
+    // deleting the synth stops the voices, releasing every sample
+    delete_fluid_synth(m_synth);
+    delete_fluid_settings(m_settings);
+    for (fluid_sfont_t *sfont : m_retiredSoundfonts) {
+        sfont->free(sfont);
+    }
+}
+
+/**
+ * Renders as many whole synthesis blocks as fit in the given frames,
+ * applying the pending events before each block, and returns the number
+ * of frames rendered. The output is interleaved float stereo. When the
+ * control thread is adding or removing a soundfont, the buffer is silent
+ * and the events wait for the next one.
+ */
+int64_t SynthEngine::render(float *buffer, int64_t frames)
+{
+    const auto renderStart = std::chrono::steady_clock::now();
+    const int64_t blocks = frames / m_renderingFrames;
+    const int64_t rendered = blocks * m_renderingFrames;
+    if (m_drumCache.beginBuffer()) {
+        m_cachedHitCount = 0;
+    }
+    // publish the render clock: seqlock with an odd sequence while writing
+    int64_t firstFrame = int64_t(m_renderedFrames.load(std::memory_order_relaxed));
+    m_clockSequence.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    m_clockFrame.store(firstFrame, std::memory_order_relaxed);
+    m_clockNsecs.store(std::chrono::duration_cast<std::chrono::nanoseconds>(renderStart.time_since_epoch()).count(),
+                       std::memory_order_relaxed);
+    m_clockSequence.fetch_add(1, std::memory_order_release);
+    // Dekker handshake with pauseRendering(): both sides store their flag
+    // before reading the other one, so they never use the synth together
+    m_rendering.store(true, std::memory_order_seq_cst);
+    if (m_paused.load(std::memory_order_seq_cst)) {
+        m_rendering.store(false, std::memory_order_release);
+        std::memset(buffer, 0, size_t(rendered * m_channels) * sizeof(float));
+        m_renderedFrames.fetch_add(rendered, std::memory_order_relaxed);
+        m_silencedFrames.fetch_add(rendered, std::memory_order_relaxed);
+        return rendered;
+    }
+    float *block = buffer;
+    int64_t bypassed = 0;
+    for (int64_t i = 0; i < blocks; ++i) {
+        processEvents();
+        renderBlock(block, firstFrame, bypassed);
+        if (m_cachedHitCount > 0) {
+            mixCachedHits(block, m_renderingFrames);
+        }
+        block += m_renderingFrames * m_channels;
+        firstFrame += m_renderingFrames;
+    }
+
+    m_renderedFrames.fetch_add(rendered, std::memory_order_relaxed);
+    fluid_synth_get_voicelist(m_synth, m_voiceList.data(), int(m_voiceList.size()), -1);
+    const int voices = int(std::find(m_voiceList.begin(), m_voiceList.end(), nullptr) - m_voiceList.begin());
+    m_metrics.setVoices(voices);
+    if (bypassed > 0) {
+        m_bypassedFrames.fetch_add(bypassed, std::memory_order_relaxed);
+    } else if (voices == 0 && m_cachedHitCount == 0) {
+        // the reverb and chorus tails have faded out
+        m_idle = peakLevel(buffer, rendered * m_channels) < SILENCE_THRESHOLD;
+    }
+    const auto renderTime = std::chrono::steady_clock::now() - renderStart;
+    const int64_t renderNsecs = std::chrono::duration_cast<std::chrono::nanoseconds>(renderTime).count();
+    m_metrics.addBuffer(renderNsecs, rendered * 1000000000 / m_sampleRate);
+    if (m_profiling.load(std::memory_order_relaxed)) {
+        m_profiler.addBuffer(m_voiceList.data(), renderNsecs);
+    }
+    m_rendering.store(false, std::memory_order_release);
+    return rendered;
+}
+
+/**
+ * Keeps render() away from the synth until resumeRendering(), waiting for
+ * the buffer being rendered, if any; meanwhile render() outputs silence.
+ * Called from the control thread only, for the short time of a change.
+ */
+void SynthEngine::pauseRendering()
+{
+    m_paused.store(true, std::memory_order_seq_cst);
+    while (m_rendering.load(std::memory_order_seq_cst)) {
+        std::this_thread::yield();
+    }
+}
+
+void SynthEngine::resumeRendering()
+{
+    m_paused.store(false, std::memory_order_release);
+}
+
+/**
+ * Renders one synthesis block, split at the frames of the scheduled events
+ * falling inside it.
+ */
+void SynthEngine::renderBlock(float *buffer, int64_t firstFrame, int64_t &bypassed)
+{
+    m_scheduler.collect();
+    const int64_t endFrame = firstFrame + m_renderingFrames;
+    int done = 0;
+    unsigned count = 0;
+    while (m_scheduler.isDue(endFrame)) {
+        const EventScheduler::Entry &entry = m_scheduler.next();
+        const int offset = int(std::min<int64_t>(std::max<int64_t>(done, entry.frame - firstFrame), m_renderingFrames));
+        if (offset > done) {
+            synthesize(buffer + done * m_channels, offset - done, bypassed);
+            done = offset;
+        }
+        m_coalescer.flush(entry.event.chan, [this](const MidiEvent &ev) { applyEvent(ev); });
+        applyEvent(entry.event);
+        m_scheduler.pop();
+        ++count;
+    }
+    if (done < m_renderingFrames) {
+        synthesize(buffer + done * m_channels, m_renderingFrames - done, bypassed);
+    }
+    if (count > 0) {
+        m_metrics.addEvents(count);
+    }
+}
+
+void SynthEngine::synthesize(float *buffer, int frames, int64_t &bypassed)
+{
+    if (m_idle) {
+        // nothing is sounding: skip the synthesis and the effects
+        std::memset(buffer, 0, frames * m_channels * sizeof(float));
+        bypassed += frames;
+    } else {
+        Tracer::begin("audio", "fluid_synth_write_float",
+                      int32_t(frames * m_channels * sizeof(float)), frames);
+        fluid_synth_write_float(m_synth, frames, buffer, 0, m_channels, buffer, 1, m_channels);
+        Tracer::end("audio", "fluid_synth_write_float");
+    }
+}
+
+void SynthEngine::noteOn(int chan, int note, int vel)
+{
+    postEvent({MidiEvent::NoteOn, uint8_t(chan), int16_t(note), int16_t(vel)});
+}
+
+void SynthEngine::noteOff(int chan, int note, int vel)
+{
+    postEvent({MidiEvent::NoteOff, uint8_t(chan), int16_t(note), int16_t(vel)});
+}
+
+void SynthEngine::keyPressure(int chan, int note, int value)
+{
+    postEvent({MidiEvent::KeyPressure, uint8_t(chan), int16_t(note), int16_t(value)});
+}
+
+void SynthEngine::controller(int chan, int control, int value)
+{
+    postEvent({MidiEvent::Controller, uint8_t(chan), int16_t(control), int16_t(value)});
+}
+
+void SynthEngine::program(int chan, int program)
+{
+    postEvent({MidiEvent::Program, uint8_t(chan), int16_t(program), 0});
+}
+
+void SynthEngine::channelPressure(int chan, int value)
+{
+    postEvent({MidiEvent::ChannelPressure, uint8_t(chan), int16_t(value), 0});
+}
+
+void SynthEngine::pitchBend(int chan, int value)
+{
+    postEvent({MidiEvent::PitchBend, uint8_t(chan), int16_t(value), 0});
+}
+
+/**
+ * Queues an event to be applied before the next synthesis block.
+ */
+void SynthEngine::postEvent(const MidiEvent &ev)
+{
+    Tracer::instant("midi", EVENT_ARRIVED[ev.type], ev.chan, ev.param1, ev.param2);
+    EventObserver *observer = m_observer.load(std::memory_order_acquire);
+    if (observer != nullptr) {
+        observer->eventPosted(ev);
+    }
+    if (!m_events.push(ev)) {
+        dropEvent(ev);
+    }
+}
+
+/**
+ * Queues an event to be applied at an output frame, or as soon as possible
+ * when that frame has been rendered already. Only one thread may schedule
+ * events.
+ */
+bool SynthEngine::scheduleEvent(int64_t frame, const MidiEvent &ev)
+{
+    Tracer::instant("midi", EVENT_ARRIVED[ev.type], ev.chan, ev.param1, ev.param2);
+    EventObserver *observer = m_observer.load(std::memory_order_acquire);
+    if (observer != nullptr) {
+        observer->eventPosted(ev);
+    }
+    if (!m_scheduler.push(frame, ev)) {
+        dropEvent(ev);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Counts an event lost because its queue was full. A lost note release
+ * would leave notes sounding forever, so all the notes of its channel are
+ * released instead once the queue has been drained.
+ */
+void SynthEngine::dropEvent(const MidiEvent &ev)
+{
+    ++m_droppedEvents;
+    const bool release = ev.type == MidiEvent::NoteOff
+            || (ev.type == MidiEvent::NoteOn && ev.param2 == 0)
+            || (ev.type == MidiEvent::Controller && (ev.param1 == 120 || ev.param1 == 123));
+    if (release) {
+        m_channelNotesDropped[ev.chan % MidiEvent::MAX_CHANNELS].store(true, std::memory_order_relaxed);
+        m_notesDropped.store(true, std::memory_order_release);
+    }
+}
+
+void SynthEngine::releaseDroppedNotes()
+{
+    if (!m_notesDropped.exchange(false, std::memory_order_acquire)) {
+        return;
+    }
+    auto apply = [this](const MidiEvent &ev) { applyEvent(ev); };
+    for (int chan = 0; chan < MidiEvent::MAX_CHANNELS; ++chan) {
+        if (m_channelNotesDropped[chan].exchange(false, std::memory_order_relaxed)) {
+            m_coalescer.flush(chan, apply);
+            applyEvent({MidiEvent::Controller, uint8_t(chan), 123, 0});
+        }
+    }
+}
+
+/**
+ * Estimates the output frame being rendered at a steady clock time, from
+ * the frame count and the time of the last render() call.
+ */
+int64_t SynthEngine::frameAt(int64_t steadyNsecs) const
+{
+    unsigned sequence;
+    int64_t frame, nsecs;
+    do {
+        sequence = m_clockSequence.load(std::memory_order_acquire);
+        frame = m_clockFrame.load(std::memory_order_relaxed);
+        nsecs = m_clockNsecs.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+    } while ((sequence & 1) != 0 || sequence != m_clockSequence.load(std::memory_order_relaxed));
+    if (nsecs == 0) {
+        return 0;
+    }
+    return frame + (steadyNsecs - nsecs) * m_sampleRate / 1000000000;
+}
+
+/**
+ * Passes every posted MIDI event to an observer, or stops when it is null.
+ * The observer must outlive its use here.
+ */
+void SynthEngine::setObserver(EventObserver *observer)
+{
+    m_observer.store(observer, std::memory_order_release);
+}
+
+/**
+ * Applies the queued events. Called by render() before every block, and
+ * by the owner while nothing is rendering.
+ */
+void SynthEngine::processEvents()
+{
+    auto apply = [this](const MidiEvent &ev) { applyEvent(ev); };
+    const bool coalescing = m_coalescing;
+    MidiEvent ev;
+    unsigned count = 0;
+    while (m_events.pop(ev)) {
+        ++count;
+        if (coalescing && EventCoalescer::isCoalescable(ev)) {
+            if (m_coalescer.defer(ev)) {
+                ++m_coalescedEvents;
+            }
+        } else {
+            m_coalescer.flush(ev.chan, apply);
+            applyEvent(ev);
+        }
+    }
+    m_coalescer.flushAll(apply);
+    releaseDroppedNotes();
+    m_metrics.addEvents(count);
+}
+
+void SynthEngine::applyEvent(const MidiEvent &ev)
+{
+    Tracer::instant("midi", EVENT_APPLIED[ev.type], ev.chan, ev.param1, ev.param2);
+    switch (ev.type) {
+    case MidiEvent::NoteOn:
+        m_idle = false;
+        if (ev.param2 > 0 && m_drumCaching.load(std::memory_order_relaxed) && playCachedHit(ev)) {
+            m_keyboardState.noteOn(ev.chan, ev.param1, ev.param2);
+            break;
+        }
+        fluid_synth_noteon(m_synth, ev.chan, ev.param1, ev.param2);
+        m_keyboardState.noteOn(ev.chan, ev.param1, ev.param2);
+        if (m_profiling.load(std::memory_order_relaxed)) {
+            fluid_synth_get_voicelist(m_synth, m_voiceList.data(), int(m_voiceList.size()), -1);
+            m_profiler.assignVoices(m_voiceList.data(), ev.chan, fluid_synth_get_channel_preset(m_synth, ev.chan));
+        }
+        break;
+    case MidiEvent::NoteOff:
+        fluid_synth_noteoff(m_synth, ev.chan, ev.param1);
+        m_keyboardState.noteOff(ev.chan, ev.param1);
+        break;
+    case MidiEvent::KeyPressure:
+        fluid_synth_key_pressure(m_synth, ev.chan, ev.param1, ev.param2);
+        m_channelPressed[ev.chan % KeyboardState::MIDI_CHANNELS] |= ev.param2 > 0;
+        break;
+    case MidiEvent::Controller:
+        fluid_synth_cc(m_synth, ev.chan, ev.param1, ev.param2);
+        if (ev.param1 == 120 || ev.param1 == 123) {
+            m_keyboardState.allNotesOff(ev.chan);
+        }
+        if (ev.param1 == 120) {
+            stopCachedHits(ev.chan);
+        } else if (ev.param1 == 121) {
+            m_channelPressed[ev.chan % KeyboardState::MIDI_CHANNELS] = false;
+        }
+        break;
+    case MidiEvent::Program:
+        // FluidLite allocates a preset on every program change: skip the redundant ones
+        if (!isCurrentProgram(ev.chan, ev.param1)) {
+            fluid_synth_program_change(m_synth, ev.chan, ev.param1);
+        }
+        break;
+    case MidiEvent::ChannelPressure:
+        fluid_synth_channel_pressure(m_synth, ev.chan, ev.param1);
+        m_channelPressed[ev.chan % KeyboardState::MIDI_CHANNELS] |= ev.param1 > 0;
+        break;
+    case MidiEvent::PitchBend:
+        fluid_synth_pitch_bend(m_synth, ev.chan, ev.param1);
+        break;
+    }
+}
+
+/**
+ * Plays a percussion hit from the drum cache instead of synthesizing it,
+ * when the channel state matches the neutral conditions of the cached
+ * rendering. Returns false when the hit must be synthesized.
+ */
+bool SynthEngine::playCachedHit(const MidiEvent &ev)
+{
+    if (m_cachedHitCount >= MAX_CACHED_HITS || m_channelPressed[ev.chan % KeyboardState::MIDI_CHANNELS]) {
+        return false;
+    }
+    fluid_preset_t *preset = fluid_synth_get_channel_preset(m_synth, ev.chan);
+    if (preset == nullptr || preset->get_banknum(preset) != 128) {
+        return false;
+    }
+    int value = 0;
+    if (fluid_synth_get_pitch_bend(m_synth, ev.chan, &value) != FLUID_OK || value != 8192) {
+        return false;
+    }
+    if (fluid_synth_get_cc(m_synth, ev.chan, 1, &value) != FLUID_OK || value != 0) {
+        return false;
+    }
+    if (m_reverbOn && (fluid_synth_get_cc(m_synth, ev.chan, 91, &value) != FLUID_OK || value != 0)) {
+        return false;
+    }
+    if (m_chorusOn && (fluid_synth_get_cc(m_synth, ev.chan, 93, &value) != FLUID_OK || value != 0)) {
+        return false;
+    }
+    int volume = 0, pan = 0, expression = 0;
+    fluid_synth_get_cc(m_synth, ev.chan, 7, &volume);
+    fluid_synth_get_cc(m_synth, ev.chan, 10, &pan);
+    fluid_synth_get_cc(m_synth, ev.chan, 11, &expression);
+    const uint64_t key = DrumCache::makeKey(int(preset->sfont->id), preset->get_banknum(preset), preset->get_num(preset),
+                                            ev.param1, ev.param2, volume, pan, expression);
+    const DrumCache::Entry *entry = m_drumCache.lookup(key);
+    if (entry == nullptr || !entry->eligible) {
+        return false;
+    }
+    m_cachedHits[m_cachedHitCount++] = {entry, 0, ev.chan};
+    return true;
+}
+
+void SynthEngine::stopCachedHits(int chan)
+{
+    int i = 0;
+    while (i < m_cachedHitCount) {
+        if (m_cachedHits[i].chan == chan) {
+            m_cachedHits[i] = m_cachedHits[--m_cachedHitCount];
+        } else {
+            ++i;
+        }
+    }
+}
+
+void SynthEngine::mixCachedHits(float *buffer, int frames)
+{
+    int i = 0;
+    while (i < m_cachedHitCount) {
+        CachedHit &hit = m_cachedHits[i];
+        const int count = std::min(frames, hit.entry->frames - hit.position) * m_channels;
+        const float *samples = hit.entry->samples.data() + hit.position * m_channels;
+        for (int s = 0; s < count; ++s) {
+            buffer[s] += samples[s];
+        }
+        hit.position += frames;
+        if (hit.position >= hit.entry->frames) {
+            hit = m_cachedHits[--m_cachedHitCount];
+        } else {
+            ++i;
+        }
+    }
+}
+
+
+/**
+ * Returns true when a program change would select the same preset already
+ * selected in the channel.
+ */
+bool SynthEngine::isCurrentProgram(int chan, int program)
+{
+    fluid_preset_t *preset = fluid_synth_get_channel_preset(m_synth, chan);
+    unsigned int sfont = 0, bank = 0, current = 0;
+    if (preset == nullptr || fluid_synth_get_program(m_synth, chan, &sfont, &bank, &current) != FLUID_OK) {
+        return false;
+    }
+    return current == unsigned(program) && preset->get_num(preset) == program
+           && unsigned(preset->get_banknum(preset)) == bank;
+}
+
+bool SynthEngine::controllerCoalescing() const
+{
+    return m_coalescing;
+}
+
+void SynthEngine::setControllerCoalescing(bool enabled)
+{
+    m_coalescing = enabled;
+}
+
+uint64_t SynthEngine::coalescedEvents() const
+{
+    return m_coalescedEvents;
+}
+
+uint64_t SynthEngine::droppedEvents() const
+{
+    return m_droppedEvents;
+}
+
+const KeyboardState &SynthEngine::keyboardState() const
+{
+    return m_keyboardState;
+}
+
+/**
+ * The profile the engine was created with.
+ */
+const EngineProfile &SynthEngine::profile() const
+{
+    return m_profile;
+}
+
+int SynthEngine::sampleRate() const
+{
+    return m_sampleRate;
+}
+
+int SynthEngine::channels() const
+{
+    return m_channels;
+}
+
+/**
+ * The synthesis block size: render() outputs whole blocks only.
+ */
+int SynthEngine::blockFrames() const
+{
+    return m_renderingFrames;
+}
+
+/**
+ * The number of banks of 16 MIDI channels of the synth, fixed when it is
+ * created.
+ */
+int SynthEngine::midiBanks() const
+{
+    return m_midiBanks;
+}
+
+uint64_t SynthEngine::renderedFrames() const
+{
+    return m_renderedFrames.load(std::memory_order_relaxed);
+}
+
+/**
+ * Frames output as silence without running the synthesis, while no voice
+ * was playing and the effects were silent.
+ */
+uint64_t SynthEngine::bypassedFrames() const
+{
+    return m_bypassedFrames;
+}
+
+/**
+ * Frames output as silence while a soundfont was being loaded or unloaded,
+ * whatever the synth was playing.
+ */
+uint64_t SynthEngine::silencedFrames() const
+{
+    return m_silencedFrames;
+}
+
+RenderMetrics &SynthEngine::metrics()
+{
+    return m_metrics;
+}
+
+bool SynthEngine::profiling() const
+{
+    return m_profiling;
+}
+
+/**
+ * Enables attributing the rendering time to the MIDI channels and presets.
+ * Enabling it discards the previous profile.
+ */
+void SynthEngine::setProfiling(bool enabled)
+{
+    if (enabled && !m_profiling) {
+        m_profiler.reset();
+    }
+    m_profiling = enabled;
+}
+
+VoiceProfiler &SynthEngine::profiler()
+{
+    return m_profiler;
+}
+
+/**
+ * A snapshot of the engine counters, readable from any thread.
+ */
+SynthEngine::Stats SynthEngine::stats() const
+{
+    Stats s;
+    s.renderedFrames = renderedFrames();
+    s.bypassedFrames = bypassedFrames();
+    s.silencedFrames = silencedFrames();
+    s.coalescedEvents = coalescedEvents();
+    s.droppedEvents = droppedEvents();
+    s.activeVoices = m_metrics.voices();
+    s.peakVoices = m_metrics.peakVoices();
+    s.midiEvents = m_metrics.events();
+    s.soundfontMemory = m_soundfontMemory;
+    s.drumCacheHits = m_drumCache.hits();
+    s.drumCacheMisses = m_drumCache.misses();
+    s.drumCacheMemory = int64_t(m_drumCache.memoryUsage());
+    return s;
+}
+
+bool SynthEngine::drumCaching() const
+{
+    return m_drumCaching;
+}
+
+/**
+ * Enables playing the percussion hits from a cache of renderings, using at
+ * most the given amount of memory.
+ */
+void SynthEngine::setDrumCaching(bool enabled, size_t memoryLimit)
+{
+    if (enabled) {
+        m_drumCache.start(drumCacheSoundfonts(), memoryLimit);
+    } else {
+        m_drumCache.stop();
+    }
+    m_drumCaching = enabled;
+}
+
+const DrumCache &SynthEngine::drumCache() const
+{
+    return m_drumCache;
+}
+
+void SynthEngine::initReverb(int reverb_type)
+{
+    switch( reverb_type ) {
+    case 1:
+        fluid_synth_set_reverb(m_synth, 0.2, 0.2, 0.75, 0.8);
+        break;
+    case 2:
+        fluid_synth_set_reverb(m_synth, 0.4, 0.2, 0.75, 0.8);
+        break;
+    case 3:
+        fluid_synth_set_reverb(m_synth, 0.6, 0.2, 0.75, 0.8);
+        break;
+    case 4:
+        fluid_synth_set_reverb(m_synth, 0.8, 0.2, 0.75, 0.8);
+        break;
+    case 5:
+        fluid_synth_set_reverb(m_synth, 1.0, 0.2, 0.75, 0.8);
+        break;
+    };
+    // the profile may leave the effects out to save CPU
+    const bool on = reverb_type > 0 && m_profile.effects != EngineProfile::NoEffects;
+    fluid_synth_set_reverb_on(m_synth, on ?  1 : 0 );
+    m_reverbOn = on;
+}
+
+void SynthEngine::initChorus(int chorus_type)
+{
+    const bool on = chorus_type > 0 && m_profile.effects == EngineProfile::AllEffects;
+    fluid_synth_set_chorus_on(m_synth, on ?  1 : 0 );
+    m_chorusOn = on;
+}
+
+void SynthEngine::setReverbLevel(int amount)
+{
+    double newlevel = amount / 100.0;
+    double level = fluid_synth_get_reverb_level(m_synth);
+    if (newlevel != level) {
+        double roomsize = fluid_synth_get_reverb_roomsize(m_synth);
+        double damping = fluid_synth_get_reverb_damp(m_synth);
+        double width = fluid_synth_get_reverb_width(m_synth);
+        fluid_synth_set_reverb(m_synth, roomsize, damping, width, newlevel);
+    }
+}
+
+void SynthEngine::setChorusLevel(int amount)
+{
+    double newlevel = amount / 100.0;
+    double level = fluid_synth_get_chorus_level(m_synth);
+    if (newlevel != level) {
+        int nr = fluid_synth_get_chorus_nr(m_synth);
+        double speed = fluid_synth_get_chorus_speed_Hz(m_synth);
+        double depth = fluid_synth_get_chorus_depth_ms(m_synth);
+        int type = fluid_synth_get_chorus_type(m_synth);
+        fluid_synth_set_chorus(m_synth, nr, newlevel, speed, depth, type);
+    }
+}
+
+/**
+ * Loads a soundfont file, given in the local 8 bit encoding, on top of the
+ * previous ones. Soundfont images are mapped and used in place. The file
+ * is read while rendering goes on, which only pauses while the soundfont
+ * is added to the synth. Returns false when FluidLite rejects it.
+ */
+bool SynthEngine::openSoundfont(const std::string &fileName)
+{
+    freeRetiredSoundfonts();
+    fluid_sfont_t *sfont = loadSoundfont(fileName);
+    if (sfont == nullptr) {
+        return false;
+    }
+    pauseRendering();
+    const int id = fluid_synth_add_sfont(m_synth, sfont);
+    resumeRendering();
+    m_soundfonts.push_back(fileName);
+    m_soundfontIds.push_back(id);
+    const int64_t size = soundfontFootprint(fileName);
+    m_soundfontSizes.push_back(size);
+    m_soundfontMemory += size;
+    if (m_drumCache.isActive()) {
+        m_drumCache.reload(drumCacheSoundfonts());
+    }
+    return true;
+}
+
+/**
+ * Unloads the most recently loaded instance of a soundfont file, releasing
+ * its sample data. The programs of the channels are selected again.
+ */
+bool SynthEngine::closeSoundfont(const std::string &fileName)
+{
+    auto it = std::find(m_soundfonts.rbegin(), m_soundfonts.rend(), fileName);
+    if (it == m_soundfonts.rend()) {
+        return false;
+    }
+    size_t index = size_t(std::distance(it, m_soundfonts.rend()) - 1);
+    fluid_sfont_t *sfont = fluid_synth_get_sfont_by_id(m_synth, unsigned(m_soundfontIds[index]));
+    if (sfont == nullptr) {
+        return false;
+    }
+    pauseRendering();
+    fluid_synth_remove_sfont(m_synth, sfont);
+    resumeRendering();
+    m_retiredSoundfonts.push_back(sfont);
+    freeRetiredSoundfonts();
+    m_soundfontMemory -= m_soundfontSizes[index];
+    m_soundfonts.erase(m_soundfonts.begin() + index);
+    m_soundfontIds.erase(m_soundfontIds.begin() + index);
+    m_soundfontSizes.erase(m_soundfontSizes.begin() + index);
+    if (m_drumCache.isActive()) {
+        m_drumCache.reload(drumCacheSoundfonts());
+    }
+    return true;
+}
+
+/**
+ * Reads a soundfont with a staging synth, which only lends its loaders,
+ * so the engine's synth keeps rendering meanwhile. The caller owns the
+ * returned soundfont.
+ */
+fluid_sfont_t *SynthEngine::loadSoundfont(const std::string &fileName)
+{
+    fluid_settings_t *settings = new_fluid_settings();
+    fluid_settings_setnum(settings, "synth.sample-rate", m_sampleRate);
+    fluid_settings_setint(settings, "synth.polyphony", STAGING_POLYPHONY);
+    fluid_settings_setstr(settings, "synth.reverb.active", "no");
+    fluid_settings_setstr(settings, "synth.chorus.active", "no");
+    fluid_synth_t *staging = new_fluid_synth(settings);
+    fluid_synth_add_sfloader(staging, SoundfontImage::newLoader());
+    fluid_sfont_t *sfont = nullptr;
+    const int id = fluid_synth_sfload(staging, fileName.c_str(), 0);
+    if (id != -1) {
+        sfont = fluid_synth_get_sfont_by_id(staging, unsigned(id));
+        fluid_synth_remove_sfont(staging, sfont);
+    }
+    delete_fluid_synth(staging);
+    delete_fluid_settings(settings);
+    return sfont;
+}
+
+/**
+ * Frees the soundfonts removed from the synth. A soundfont refuses to be
+ * freed while a voice still plays its samples, and is tried again later.
+ */
+void SynthEngine::freeRetiredSoundfonts()
+{
+    if (m_retiredSoundfonts.empty()) {
+        return;
+    }
+    // waits for the buffer being rendered, so the voices it released are seen
+    pauseRendering();
+    resumeRendering();
+    auto retired = std::remove_if(m_retiredSoundfonts.begin(), m_retiredSoundfonts.end(),
+                                  [](fluid_sfont_t *sfont) { return sfont->free(sfont) == 0; });
+    m_retiredSoundfonts.erase(retired, m_retiredSoundfonts.end());
+}
+
+/**
+ * The soundfonts for the drum cache to load, with their ids in the synth.
+ */
+DrumCache::Soundfonts SynthEngine::drumCacheSoundfonts() const
+{
+    DrumCache::Soundfonts soundfonts;
+    for (size_t i = 0; i < m_soundfonts.size(); ++i) {
+        soundfonts.push_back({m_soundfonts[i], m_soundfontIds[i]});
+    }
+    return soundfonts;
+}
+
+/**
+ * The soundfonts loaded successfully, in loading order.
+ */
+const std::vector<std::string> &SynthEngine::soundfonts() const
+{
+    return m_soundfonts;
+}
+
+int64_t SynthEngine::soundfontMemory() const
+{
+    return m_soundfontMemory;
+}
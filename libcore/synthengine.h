@@ -0,0 +1,207 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SYNTHENGINE_H
+#define SYNTHENGINE_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <fluidlite.h>
+#include "eventqueue.h"
+#include "keyboardstate.h"
+#include "rendermetrics.h"
+#include "voiceprofiler.h"
+#include "drumcache.h"
+#include "engineprofile.h"
+
+/**
+ * Receives every MIDI event posted or scheduled into a SynthEngine, in the
+ * thread posting it, before the event is queued.
+ */
+class EventObserver
+{
+public:
+    virtual ~EventObserver() = default;
+    virtual void eventPosted(const MidiEvent &ev) = 0;
+};
+
+/**
+ * The synthesis engine: a FluidLite synth with its soundfonts, the MIDI
+ * event queue and scheduler, the drum cache and the rendering statistics.
+ * It has a plain C++ interface and no Qt dependency, so it can render
+ * offline or be driven by any audio output. An EngineProfile gives its
+ * sample rate, block size, polyphony, interpolation and effects. Events
+ * may be posted from any thread; render() must be called from a single
+ * thread at a time. While a soundfont is being added to the synth or
+ * removed from it, render() outputs silence.
+ */
+class SynthEngine
+{
+public:
+    struct Stats {
+        uint64_t renderedFrames = 0;
+        uint64_t bypassedFrames = 0;
+        uint64_t silencedFrames = 0;
+        uint64_t coalescedEvents = 0;
+        uint64_t droppedEvents = 0;
+        int activeVoices = 0;
+        int peakVoices = 0;
+        uint64_t midiEvents = 0;
+        int64_t soundfontMemory = 0;
+        uint64_t drumCacheHits = 0;
+        uint64_t drumCacheMisses = 0;
+        int64_t drumCacheMemory = 0;
+    };
+
+    explicit SynthEngine(const EngineProfile &profile = EngineProfile::defaults(), int midiBanks = 1);
+    ~SynthEngine();
+
+    /* FluidLite */
+    void initReverb(int reverb_type);
+    void initChorus(int chorus_type);
+    void setReverbLevel(int amount);
+    void setChorusLevel(int amount);
+    bool openSoundfont(const std::string &fileName);
+    bool closeSoundfont(const std::string &fileName);
+    const std::vector<std::string> &soundfonts() const;
+    int64_t soundfontMemory() const;
+
+    /* MIDI events, any thread */
+    void noteOn(int chan, int note, int vel);
+    void noteOff(int chan, int note, int vel);
+    void keyPressure(int chan, int note, int value);
+    void controller(int chan, int control, int value);
+    void program(int chan, int program);
+    void channelPressure(int chan, int value);
+    void pitchBend(int chan, int value);
+    void postEvent(const MidiEvent &ev);
+    bool scheduleEvent(int64_t frame, const MidiEvent &ev);
+    int64_t frameAt(int64_t steadyNsecs) const;
+    void setObserver(EventObserver *observer);
+
+    /* MIDI event queue */
+    void processEvents();
+    bool controllerCoalescing() const;
+    void setControllerCoalescing(bool enabled);
+    uint64_t coalescedEvents() const;
+    uint64_t droppedEvents() const;
+    const KeyboardState &keyboardState() const;
+
+    /* rendering thread */
+    int64_t render(float *buffer, int64_t frames);
+
+    /* Metrics */
+    const EngineProfile &profile() const;
+    int sampleRate() const;
+    int channels() const;
+    int blockFrames() const;
+    int midiBanks() const;
+    uint64_t renderedFrames() const;
+    uint64_t bypassedFrames() const;
+    uint64_t silencedFrames() const;
+    RenderMetrics &metrics();
+    bool profiling() const;
+    void setProfiling(bool enabled);
+    VoiceProfiler &profiler();
+    Stats stats() const;
+
+    /* Drum cache */
+    bool drumCaching() const;
+    void setDrumCaching(bool enabled, size_t memoryLimit = DrumCache::DEFAULT_MEMORY_LIMIT);
+    const DrumCache &drumCache() const;
+
+    static const int DEFAULT_SAMPLE_RATE;
+    static const int DEFAULT_RENDERING_FRAMES;
+    static const int DEFAULT_FRAME_CHANNELS;
+    static const int MAX_CACHED_HITS = 64;
+
+private:
+    SynthEngine(const SynthEngine &) = delete;
+    SynthEngine &operator=(const SynthEngine &) = delete;
+
+    void applyEvent(const MidiEvent &ev);
+    void dropEvent(const MidiEvent &ev);
+    void releaseDroppedNotes();
+    void renderBlock(float *buffer, int64_t firstFrame, int64_t &bypassed);
+    void synthesize(float *buffer, int frames, int64_t &bypassed);
+    bool isCurrentProgram(int chan, int program);
+    bool playCachedHit(const MidiEvent &ev);
+    void stopCachedHits(int chan);
+    void mixCachedHits(float *buffer, int frames);
+    void pauseRendering();
+    void resumeRendering();
+    fluid_sfont_t *loadSoundfont(const std::string &fileName);
+    void freeRetiredSoundfonts();
+    DrumCache::Soundfonts drumCacheSoundfonts() const;
+
+    /* FluidLite */
+    EngineProfile m_profile;
+    int m_sampleRate, m_renderingFrames, m_channels, m_midiBanks;
+    fluid_settings_t *m_settings;
+    fluid_synth_t *m_synth;
+    std::vector<std::string> m_soundfonts;
+    std::vector<int> m_soundfontIds;
+    std::vector<int64_t> m_soundfontSizes;
+    std::vector<fluid_sfont_t*> m_retiredSoundfonts;
+    int64_t m_soundfontMemory;
+    std::atomic<bool> m_paused;
+    std::atomic<bool> m_rendering;
+    std::vector<fluid_voice_t*> m_voiceList;
+
+    /* MIDI event queue */
+    EventQueue m_events;
+    EventCoalescer m_coalescer;
+    EventScheduler m_scheduler;
+    std::atomic<unsigned> m_clockSequence;
+    std::atomic<int64_t> m_clockFrame;
+    std::atomic<int64_t> m_clockNsecs;
+    std::atomic<bool> m_coalescing;
+    std::atomic<uint64_t> m_coalescedEvents;
+    std::atomic<uint64_t> m_droppedEvents;
+    std::atomic<bool> m_notesDropped;
+    std::atomic<bool> m_channelNotesDropped[MidiEvent::MAX_CHANNELS];
+    KeyboardState m_keyboardState;
+    std::atomic<EventObserver*> m_observer;
+
+    /* Metrics */
+    RenderMetrics m_metrics;
+    std::atomic<bool> m_profiling;
+    VoiceProfiler m_profiler;
+    std::atomic<uint64_t> m_renderedFrames;
+    std::atomic<uint64_t> m_bypassedFrames;
+    std::atomic<uint64_t> m_silencedFrames;
+    bool m_idle;
+
+    /* Drum cache */
+    struct CachedHit {
+        const DrumCache::Entry *entry;
+        int position;
+        int chan;
+    };
+    DrumCache m_drumCache;
+    std::atomic<bool> m_drumCaching;
+    std::atomic<bool> m_reverbOn;
+    std::atomic<bool> m_chorusOn;
+    CachedHit m_cachedHits[MAX_CACHED_HITS];
+    int m_cachedHitCount;
+    bool m_channelPressed[KeyboardState::MIDI_CHANNELS];
+};
+
+#endif // SYNTHENGINE_H
@@ -0,0 +1,183 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "tracer.h"
+
+namespace {
+
+struct TraceEvent {
+    int64_t timestamp;
+    const char *category;
+    const char *name;
+    int32_t args[3];
+    char phase;
+};
+
+struct TraceBuffer {
+    explicit TraceBuffer(int id): tid(id), name(nullptr), written(0)
+    {
+        events.resize(Tracer::BUFFER_EVENTS);
+    }
+    int tid;
+    std::atomic<const char *> name;
+    std::atomic<uint64_t> written;
+    std::vector<TraceEvent> events;
+};
+
+struct TraceRegistry {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<TraceBuffer>> buffers;
+    std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+};
+
+TraceRegistry &registry()
+{
+    static TraceRegistry r;
+    return r;
+}
+
+thread_local TraceBuffer *t_buffer = nullptr;
+
+TraceBuffer *threadBuffer()
+{
+    if (t_buffer == nullptr) {
+        // the only lock and allocation, once per thread
+        TraceRegistry &r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        r.buffers.emplace_back(new TraceBuffer(static_cast<int>(r.buffers.size()) + 1));
+        t_buffer = r.buffers.back().get();
+    }
+    return t_buffer;
+}
+
+const char *const *argNames(const char *category)
+{
+    static const char *const midi[] = { "chan", "data1", "data2" };
+    static const char *const audio[] = { "bytes", "frames", "value" };
+    static const char *const state[] = { "state", "error", "value" };
+    static const char *const other[] = { "arg0", "arg1", "arg2" };
+    if (std::strcmp(category, "midi") == 0) {
+        return midi;
+    } else if (std::strcmp(category, "audio") == 0) {
+        return audio;
+    } else if (std::strcmp(category, "state") == 0) {
+        return state;
+    }
+    return other;
+}
+
+}
+
+const unsigned Tracer::BUFFER_EVENTS = 65536;
+
+std::atomic<bool> Tracer::s_enabled(false);
+
+void Tracer::setEnabled(bool enable)
+{
+    registry();
+    s_enabled.store(enable, std::memory_order_relaxed);
+}
+
+void Tracer::setThreadName(const char *name)
+{
+    if (isEnabled()) {
+        threadBuffer()->name.store(name, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * Allocates the ring of the calling thread in advance, when tracing is
+ * enabled, so that a real-time thread never allocates while recording.
+ */
+void Tracer::prepareThread()
+{
+    if (isEnabled()) {
+        threadBuffer();
+    }
+}
+
+void Tracer::record(Phase phase, const char *category, const char *name,
+                    int32_t arg0, int32_t arg1, int32_t arg2)
+{
+    TraceBuffer *buffer = threadBuffer();
+    const uint64_t index = buffer->written.load(std::memory_order_relaxed);
+    TraceEvent &ev = buffer->events[index % BUFFER_EVENTS];
+    ev.timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - registry().origin).count();
+    ev.category = category;
+    ev.name = name;
+    ev.args[0] = arg0;
+    ev.args[1] = arg1;
+    ev.args[2] = arg2;
+    ev.phase = phase;
+    buffer->written.store(index + 1, std::memory_order_release);
+}
+
+/**
+ * Writes the events recorded so far. The threads may keep recording
+ * meanwhile; the oldest events of a full ring are skipped to avoid
+ * reading entries that are being overwritten.
+ */
+bool Tracer::writeJson(const std::string &fileName)
+{
+    static const uint64_t GUARD_EVENTS = 1024;
+    FILE *f = std::fopen(fileName.c_str(), "w");
+    if (f == nullptr) {
+        return false;
+    }
+    TraceRegistry &r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    std::fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", f);
+    bool first = true;
+    for (const auto &buffer : r.buffers) {
+        const char *threadName = buffer->name.load(std::memory_order_relaxed);
+        std::fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+                        "\"args\":{\"name\":\"%s\"}}",
+                     first ? "" : ",\n", buffer->tid,
+                     threadName != nullptr ? threadName : "thread");
+        first = false;
+        const uint64_t written = buffer->written.load(std::memory_order_acquire);
+        uint64_t start = 0;
+        if (written > BUFFER_EVENTS) {
+            start = written - BUFFER_EVENTS + GUARD_EVENTS;
+        }
+        for (uint64_t i = start; i < written; ++i) {
+            const TraceEvent &ev = buffer->events[i % BUFFER_EVENTS];
+            std::fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,"
+                            "\"pid\":1,\"tid\":%d",
+                         ev.name, ev.category, ev.phase, ev.timestamp / 1000.0, buffer->tid);
+            if (ev.phase == Instant) {
+                std::fputs(",\"s\":\"t\"", f);
+            }
+            if (ev.phase != End) {
+                const char *const *names = argNames(ev.category);
+                std::fprintf(f, ",\"args\":{\"%s\":%d,\"%s\":%d,\"%s\":%d}",
+                             names[0], ev.args[0], names[1], ev.args[1], names[2], ev.args[2]);
+            }
+            std::fputs("}", f);
+        }
+    }
+    std::fputs("\n]}\n", f);
+    return std::fclose(f) == 0;
+}
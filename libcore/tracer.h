@@ -0,0 +1,119 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+/**
+ * Timeline of trace events, written to Chrome/Perfetto JSON format.
+ * Each thread records into its own ring buffer without locks, keeping the
+ * most recent events, so the trace shows what happened before a dropout.
+ * Names and categories must be string literals. When disabled, recording
+ * costs a single relaxed atomic load.
+ */
+class Tracer
+{
+public:
+    enum Phase : char {
+        Begin = 'B',
+        End = 'E',
+        Instant = 'i',
+        Counter = 'C'
+    };
+
+    static bool isEnabled();
+    static void setEnabled(bool enable);
+    static void setThreadName(const char *name);
+    static void prepareThread();
+
+    static void record(Phase phase, const char *category, const char *name,
+                       int32_t arg0 = 0, int32_t arg1 = 0, int32_t arg2 = 0);
+    static void begin(const char *category, const char *name, int32_t arg0 = 0, int32_t arg1 = 0);
+    static void end(const char *category, const char *name);
+    static void instant(const char *category, const char *name,
+                        int32_t arg0 = 0, int32_t arg1 = 0, int32_t arg2 = 0);
+
+    static bool writeJson(const std::string &fileName);
+
+    static const unsigned BUFFER_EVENTS;
+
+private:
+    static std::atomic<bool> s_enabled;
+};
+
+class TraceScope
+{
+public:
+    TraceScope(const char *category, const char *name, int32_t arg0 = 0);
+    ~TraceScope();
+
+private:
+    const char *m_category;
+    const char *m_name;
+    bool m_active;
+};
+
+inline bool Tracer::isEnabled()
+{
+    return s_enabled.load(std::memory_order_relaxed);
+}
+
+inline void Tracer::begin(const char *category, const char *name, int32_t arg0, int32_t arg1)
+{
+    if (isEnabled()) {
+        record(Begin, category, name, arg0, arg1);
+    }
+}
+
+inline void Tracer::end(const char *category, const char *name)
+{
+    if (isEnabled()) {
+        record(End, category, name);
+    }
+}
+
+inline void Tracer::instant(const char *category, const char *name,
+                            int32_t arg0, int32_t arg1, int32_t arg2)
+{
+    if (isEnabled()) {
+        record(Instant, category, name, arg0, arg1, arg2);
+    }
+}
+
+inline TraceScope::TraceScope(const char *category, const char *name, int32_t arg0):
+    m_category(category),
+    m_name(name),
+    m_active(Tracer::isEnabled())
+{
+    if (m_active) {
+        Tracer::record(Tracer::Begin, category, name, arg0);
+    }
+}
+
+inline TraceScope::~TraceScope()
+{
+    if (m_active) {
+        Tracer::record(Tracer::End, m_category, m_name);
+    }
+}
+
+#endif // TRACER_H
@@ -0,0 +1,257 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include "voiceprofiler.h"
+
+VoiceProfiler::VoiceProfiler():
+    m_lastId(0),
+    m_resetRequested(false)
+{
+    for (int i = 0; i < OWNER_SLOTS; ++i) {
+        m_owners[i] = {0, UNKNOWN_CHANNEL, -1};
+    }
+    for (int i = 0; i < PRESET_SLOTS; ++i) {
+        m_presets[i].key = 0;
+        m_presets[i].name[0] = '\0';
+    }
+    clear();
+}
+
+void VoiceProfiler::clear()
+{
+    for (int c = 0; c <= MIDI_CHANNELS; ++c) {
+        m_channelVoiceBuffers[c] = 0;
+        m_channelTime[c] = 0;
+    }
+    for (int i = 0; i < PRESET_SLOTS; ++i) {
+        m_presets[i].voiceBuffers = 0;
+        m_presets[i].nsecs = 0;
+    }
+    m_totalTime = 0;
+    m_silentTime = 0;
+    m_buffers = 0;
+}
+
+/**
+ * Tags the voices started by the last note on. FluidLite gives the same
+ * id to all the voices of a note, and a higher id to every new note, so
+ * the new voices are those having an id never seen before.
+ */
+void VoiceProfiler::assignVoices(fluid_voice_t **voices, int chan, fluid_preset_t *preset)
+{
+    unsigned newest = m_lastId;
+    for (fluid_voice_t **v = voices; *v != nullptr; ++v) {
+        const unsigned id = fluid_voice_get_id(*v);
+        if (int(id - newest) > 0) {
+            newest = id;
+        }
+    }
+    if (newest == m_lastId) {
+        return;
+    }
+    m_lastId = newest;
+    Owner &owner = m_owners[newest % OWNER_SLOTS];
+    owner.id = newest;
+    owner.chan = int16_t(chan >= 0 && chan < MIDI_CHANNELS ? chan : UNKNOWN_CHANNEL);
+    owner.preset = int16_t(presetSlot(preset));
+}
+
+int VoiceProfiler::presetSlot(fluid_preset_t *preset)
+{
+    if (preset == nullptr) {
+        return -1;
+    }
+    const int key = preset->get_banknum(preset) * 128 + preset->get_num(preset) + 1;
+    int slot = key % PRESET_SLOTS;
+    for (int i = 0; i < PRESET_SLOTS; ++i) {
+        PresetSlot &p = m_presets[slot];
+        const int current = p.key.load(std::memory_order_relaxed);
+        if (current == key) {
+            return slot;
+        }
+        if (current == 0) {
+            const char *name = preset->get_name(preset);
+            std::strncpy(p.name, name != nullptr ? name : "", PRESET_NAME_SIZE - 1);
+            p.name[PRESET_NAME_SIZE - 1] = '\0';
+            p.key.store(key, std::memory_order_release);
+            return slot;
+        }
+        slot = (slot + 1) % PRESET_SLOTS;
+    }
+    return -1;
+}
+
+/**
+ * Shares the rendering time of a buffer among the voices playing after it.
+ */
+void VoiceProfiler::addBuffer(fluid_voice_t **voices, int64_t nsecs)
+{
+    if (m_resetRequested.exchange(false)) {
+        clear();
+    }
+    std::fill_n(m_voices, MIDI_CHANNELS + 1, 0);
+    std::fill_n(m_presetVoices, PRESET_SLOTS, 0);
+    int total = 0;
+    for (fluid_voice_t **v = voices; *v != nullptr; ++v) {
+        const unsigned id = fluid_voice_get_id(*v);
+        const Owner &owner = m_owners[id % OWNER_SLOTS];
+        if (owner.id == id) {
+            ++m_voices[owner.chan];
+            if (owner.preset >= 0) {
+                ++m_presetVoices[owner.preset];
+            }
+        } else {
+            ++m_voices[UNKNOWN_CHANNEL];
+        }
+        if (int(id - m_lastId) > 0) {
+            m_lastId = id;
+        }
+        ++total;
+    }
+    m_buffers.fetch_add(1, std::memory_order_relaxed);
+    m_totalTime.fetch_add(nsecs, std::memory_order_relaxed);
+    if (total == 0) {
+        m_silentTime.fetch_add(nsecs, std::memory_order_relaxed);
+        return;
+    }
+    for (int c = 0; c <= MIDI_CHANNELS; ++c) {
+        if (m_voices[c] > 0) {
+            m_channelVoiceBuffers[c].fetch_add(m_voices[c], std::memory_order_relaxed);
+            m_channelTime[c].fetch_add(nsecs * m_voices[c] / total, std::memory_order_relaxed);
+        }
+    }
+    for (int i = 0; i < PRESET_SLOTS; ++i) {
+        if (m_presetVoices[i] > 0) {
+            m_presets[i].voiceBuffers.fetch_add(m_presetVoices[i], std::memory_order_relaxed);
+            m_presets[i].nsecs.fetch_add(nsecs * m_presetVoices[i] / total, std::memory_order_relaxed);
+        }
+    }
+}
+
+/**
+ * Discards the accumulated profile when the next buffer is rendered.
+ */
+void VoiceProfiler::reset()
+{
+    m_resetRequested = true;
+}
+
+int64_t VoiceProfiler::totalTime() const
+{
+    return m_totalTime.load(std::memory_order_relaxed);
+}
+
+int64_t VoiceProfiler::silentTime() const
+{
+    return m_silentTime.load(std::memory_order_relaxed);
+}
+
+uint64_t VoiceProfiler::buffers() const
+{
+    return m_buffers.load(std::memory_order_relaxed);
+}
+
+static bool costlier(const VoiceProfiler::Entry &a, const VoiceProfiler::Entry &b)
+{
+    return a.nsecs > b.nsecs;
+}
+
+std::vector<VoiceProfiler::Entry> VoiceProfiler::channels() const
+{
+    std::vector<Entry> result;
+    const double total = totalTime();
+    const double buffers = this->buffers();
+    for (int c = 0; c <= MIDI_CHANNELS; ++c) {
+        Entry e;
+        e.voiceBuffers = m_channelVoiceBuffers[c].load(std::memory_order_relaxed);
+        if (e.voiceBuffers == 0) {
+            continue;
+        }
+        e.channel = c == UNKNOWN_CHANNEL ? -1 : c;
+        e.nsecs = m_channelTime[c].load(std::memory_order_relaxed);
+        e.share = total > 0 ? e.nsecs / total : 0;
+        e.averageVoices = buffers > 0 ? e.voiceBuffers / buffers : 0;
+        result.push_back(e);
+    }
+    std::sort(result.begin(), result.end(), costlier);
+    return result;
+}
+
+std::vector<VoiceProfiler::Entry> VoiceProfiler::presets() const
+{
+    std::vector<Entry> result;
+    const double total = totalTime();
+    const double buffers = this->buffers();
+    for (int i = 0; i < PRESET_SLOTS; ++i) {
+        const int key = m_presets[i].key.load(std::memory_order_acquire);
+        if (key == 0) {
+            continue;
+        }
+        Entry e;
+        e.voiceBuffers = m_presets[i].voiceBuffers.load(std::memory_order_relaxed);
+        if (e.voiceBuffers == 0) {
+            continue;
+        }
+        e.bank = (key - 1) / 128;
+        e.program = (key - 1) % 128;
+        e.name = m_presets[i].name;
+        e.nsecs = m_presets[i].nsecs.load(std::memory_order_relaxed);
+        e.share = total > 0 ? e.nsecs / total : 0;
+        e.averageVoices = buffers > 0 ? e.voiceBuffers / buffers : 0;
+        result.push_back(e);
+    }
+    std::sort(result.begin(), result.end(), costlier);
+    return result;
+}
+
+/**
+ * Returns a text report of the rendering time shares, costliest first.
+ * Channels are numbered from 1, continuing across the banks of the ports.
+ */
+std::string VoiceProfiler::report() const
+{
+    std::string result;
+    char line[256];
+    const double total = totalTime();
+    std::snprintf(line, sizeof(line),
+                  "Rendering time profile: %llu buffers, %.3f s rendering, %.1f%% without voices\n",
+                  static_cast<unsigned long long>(buffers()), total / 1e9,
+                  total > 0 ? silentTime() * 100.0 / total : 0);
+    result += line;
+    result += "\n  share  voices  channel\n";
+    for (const auto &e : channels()) {
+        if (e.channel < 0) {
+            std::snprintf(line, sizeof(line), "%5.1f%%  %6.1f  %7s\n",
+                          e.share * 100, e.averageVoices, "unknown");
+        } else {
+            std::snprintf(line, sizeof(line), "%5.1f%%  %6.1f  %7d\n",
+                          e.share * 100, e.averageVoices, e.channel + 1);
+        }
+        result += line;
+    }
+    result += "\n  share  voices  preset\n";
+    for (const auto &e : presets()) {
+        std::snprintf(line, sizeof(line), "%5.1f%%  %6.1f  %03d:%03d %s\n",
+                      e.share * 100, e.averageVoices, e.bank, e.program, e.name.c_str());
+        result += line;
+    }
+    return result;
+}
@@ -0,0 +1,106 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef VOICEPROFILER_H
+#define VOICEPROFILER_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <fluidlite.h>
+#include "eventqueue.h"
+
+/**
+ * Attributes the rendering time to the MIDI channels and to the presets
+ * owning the voices. Each voice is tagged with the channel and preset of
+ * the note that started it; after every rendered buffer the voices playing
+ * are sampled, and the buffer rendering time is shared among them evenly.
+ * Only the rendering thread writes, without locks; readers may build the
+ * report at any time.
+ */
+class VoiceProfiler
+{
+public:
+    static const int MIDI_CHANNELS = MidiEvent::MAX_CHANNELS;
+    static const int UNKNOWN_CHANNEL = MIDI_CHANNELS;
+
+    struct Entry {
+        int channel = -1;
+        int bank = -1;
+        int program = -1;
+        std::string name;
+        double share = 0;
+        double averageVoices = 0;
+        uint64_t voiceBuffers = 0;
+        int64_t nsecs = 0;
+    };
+
+    VoiceProfiler();
+
+    /* rendering thread */
+    void assignVoices(fluid_voice_t **voices, int chan, fluid_preset_t *preset);
+    void addBuffer(fluid_voice_t **voices, int64_t nsecs);
+
+    /* any thread */
+    void reset();
+    int64_t totalTime() const;
+    int64_t silentTime() const;
+    uint64_t buffers() const;
+    std::vector<Entry> channels() const;
+    std::vector<Entry> presets() const;
+    std::string report() const;
+
+private:
+    static const int OWNER_SLOTS = 4096;
+    static const int PRESET_SLOTS = 512;
+    static const int PRESET_NAME_SIZE = 24;
+
+    struct Owner {
+        unsigned id;
+        int16_t chan;
+        int16_t preset;
+    };
+
+    /* the name is copied once, before the key publishes the slot */
+    struct PresetSlot {
+        std::atomic<int> key;
+        char name[PRESET_NAME_SIZE];
+        std::atomic<uint64_t> voiceBuffers;
+        std::atomic<int64_t> nsecs;
+    };
+
+    void clear();
+    int presetSlot(fluid_preset_t *preset);
+
+    /* rendering thread only */
+    Owner m_owners[OWNER_SLOTS];
+    unsigned m_lastId;
+    int m_voices[MIDI_CHANNELS + 1];
+    int m_presetVoices[PRESET_SLOTS];
+
+    std::atomic<bool> m_resetRequested;
+    std::atomic<uint64_t> m_channelVoiceBuffers[MIDI_CHANNELS + 1];
+    std::atomic<int64_t> m_channelTime[MIDI_CHANNELS + 1];
+    PresetSlot m_presets[PRESET_SLOTS];
+    std::atomic<int64_t> m_totalTime;
+    std::atomic<int64_t> m_silentTime;
+    std::atomic<uint64_t> m_buffers;
+};
+
+#endif // VOICEPROFILER_H
@@ -0,0 +1,58 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <cstdio>
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include "soundfontcompiler.h"
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setOrganizationName("FluidLite");
+    QCoreApplication::setApplicationName("fluidlite-sfcompiler");
+    QCoreApplication::setApplicationVersion(QT_STRINGIFY(VERSION));
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Compiles a SoundFont into a load-ready soundfont image");
+    parser.addVersionOption();
+    parser.addHelpOption();
+    parser.addPositionalArgument("input", "SoundFont File (*.sf2; *.sf3)");
+    parser.addPositionalArgument("output", "Soundfont Image (*.sfimg), next to the input file by default.", "[output]");
+    parser.process(app);
+    const QStringList args = parser.positionalArguments();
+    if (args.isEmpty() || args.size() > 2) {
+        parser.showHelp(EXIT_FAILURE);
+    }
+    const QFileInfo input(args.first());
+    const QString output = args.size() > 1 ? args.last()
+                         : input.path() + '/' + input.completeBaseName() + ".sfimg";
+    QElapsedTimer timer;
+    timer.start();
+    SoundfontCompiler compiler;
+    if (!compiler.compile(input.filePath(), output)) {
+        fputs((input.filePath() + ": " + compiler.errorString() + "\n").toLocal8Bit(), stderr);
+        return EXIT_FAILURE;
+    }
+    fprintf(stderr, "%s: %d presets, %d zones, %d samples, %lld bytes in %lld ms\n",
+            output.toLocal8Bit().constData(), compiler.presetCount(), compiler.zoneCount(),
+            compiler.sampleCount(), compiler.imageBytes(), timer.elapsed());
+    return EXIT_SUCCESS;
+}
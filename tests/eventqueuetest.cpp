@@ -0,0 +1,218 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <memory>
+#include <thread>
+#include <vector>
+#include "eventqueue.h"
+#include "testing.h"
+
+static MidiEvent event(MidiEvent::Type type, int chan, int param1, int param2 = 0)
+{
+    MidiEvent ev;
+    ev.type = type;
+    ev.chan = static_cast<uint8_t>(chan);
+    ev.param1 = static_cast<int16_t>(param1);
+    ev.param2 = static_cast<int16_t>(param2);
+    return ev;
+}
+
+static void testQueueCapacity()
+{
+    LockFreeQueue<int> queue(5);
+    CHECK_EQUAL(queue.capacity(), 8u);
+    CHECK(queue.isEmpty());
+    for (int i = 0; i < 8; ++i) {
+        CHECK(queue.push(i));
+    }
+    CHECK(!queue.push(8));
+    int item = -1;
+    for (int i = 0; i < 8; ++i) {
+        CHECK(queue.pop(item));
+        CHECK_EQUAL(item, i);
+    }
+    CHECK(!queue.pop(item));
+    CHECK(queue.isEmpty());
+    // the ring wraps around after being drained
+    for (int round = 0; round < 3; ++round) {
+        for (int i = 0; i < 6; ++i) {
+            CHECK(queue.push(round * 10 + i));
+        }
+        for (int i = 0; i < 6; ++i) {
+            CHECK(queue.pop(item));
+            CHECK_EQUAL(item, round * 10 + i);
+        }
+    }
+}
+
+/**
+ * Several producers push concurrently into a small queue while the consumer
+ * drains it: no item may be lost or duplicated, and the items of each
+ * producer must arrive in the order they were pushed.
+ */
+static void testQueueProducers()
+{
+    const int PRODUCERS = 4;
+    const int ITEMS = 100000;
+    LockFreeQueue<unsigned> queue(64);
+    std::vector<std::thread> producers;
+    for (int p = 0; p < PRODUCERS; ++p) {
+        producers.emplace_back([&queue, p] {
+            for (unsigned i = 0; i < unsigned(ITEMS); ) {
+                if (queue.push((unsigned(p) << 24) | i)) {
+                    ++i;
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    std::vector<unsigned> expected(PRODUCERS, 0);
+    int received = 0, misordered = 0;
+    unsigned item;
+    while (received < PRODUCERS * ITEMS) {
+        if (!queue.pop(item)) {
+            std::this_thread::yield();
+            continue;
+        }
+        const unsigned p = item >> 24;
+        if (p >= unsigned(PRODUCERS) || (item & 0xffffff) != expected[p]) {
+            ++misordered;
+        } else {
+            ++expected[p];
+        }
+        ++received;
+    }
+    for (auto &producer : producers) {
+        producer.join();
+    }
+    CHECK_EQUAL(misordered, 0);
+    for (int p = 0; p < PRODUCERS; ++p) {
+        CHECK_EQUAL(expected[p], unsigned(ITEMS));
+    }
+    CHECK(!queue.pop(item));
+}
+
+static void testCoalescable()
+{
+    CHECK(EventCoalescer::isCoalescable(event(MidiEvent::Controller, 0, 7, 100)));
+    CHECK(EventCoalescer::isCoalescable(event(MidiEvent::Controller, 0, 74, 10)));
+    CHECK(EventCoalescer::isCoalescable(event(MidiEvent::PitchBend, 0, 8192)));
+    CHECK(EventCoalescer::isCoalescable(event(MidiEvent::ChannelPressure, 0, 64)));
+    CHECK(!EventCoalescer::isCoalescable(event(MidiEvent::Controller, 0, 0, 1)));
+    CHECK(!EventCoalescer::isCoalescable(event(MidiEvent::Controller, 0, 6, 1)));
+    CHECK(!EventCoalescer::isCoalescable(event(MidiEvent::Controller, 0, 32, 1)));
+    CHECK(!EventCoalescer::isCoalescable(event(MidiEvent::Controller, 0, 64, 127)));
+    CHECK(!EventCoalescer::isCoalescable(event(MidiEvent::Controller, 0, 101, 0)));
+    CHECK(!EventCoalescer::isCoalescable(event(MidiEvent::Controller, 0, 121, 0)));
+    CHECK(!EventCoalescer::isCoalescable(event(MidiEvent::NoteOn, 0, 60, 100)));
+    CHECK(!EventCoalescer::isCoalescable(event(MidiEvent::Program, 0, 1)));
+}
+
+static void testCoalescer()
+{
+    std::unique_ptr<EventCoalescer> coalescer(new EventCoalescer);
+    std::vector<MidiEvent> applied;
+    auto apply = [&applied](const MidiEvent &ev) { applied.push_back(ev); };
+
+    CHECK(!coalescer->defer(event(MidiEvent::Controller, 3, 7, 10)));
+    CHECK(coalescer->defer(event(MidiEvent::Controller, 3, 7, 20)));
+    CHECK(coalescer->defer(event(MidiEvent::Controller, 3, 7, 30)));
+    CHECK(!coalescer->defer(event(MidiEvent::PitchBend, 3, 1000)));
+    CHECK(coalescer->defer(event(MidiEvent::PitchBend, 3, 2000)));
+    CHECK(!coalescer->defer(event(MidiEvent::ChannelPressure, 17, 90)));
+
+    // flushing another channel leaves these pending
+    coalescer->flush(4, apply);
+    CHECK(applied.empty());
+
+    coalescer->flush(3, apply);
+    if (CHECK_EQUAL(applied.size(), size_t(2))) {
+        CHECK_EQUAL(applied[0].type, MidiEvent::Controller);
+        CHECK_EQUAL(int(applied[0].chan), 3);
+        CHECK_EQUAL(applied[0].param1, 7);
+        CHECK_EQUAL(applied[0].param2, 30);
+        CHECK_EQUAL(applied[1].type, MidiEvent::PitchBend);
+        CHECK_EQUAL(applied[1].param1, 2000);
+    }
+    applied.clear();
+    coalescer->flush(3, apply);
+    CHECK(applied.empty());
+
+    coalescer->flushAll(apply);
+    if (CHECK_EQUAL(applied.size(), size_t(1))) {
+        CHECK_EQUAL(applied[0].type, MidiEvent::ChannelPressure);
+        CHECK_EQUAL(int(applied[0].chan), 17);
+        CHECK_EQUAL(applied[0].param1, 90);
+    }
+    applied.clear();
+
+    coalescer->defer(event(MidiEvent::Controller, 0, 1, 64));
+    coalescer->clear();
+    coalescer->flushAll(apply);
+    CHECK(applied.empty());
+}
+
+static void testScheduler()
+{
+    EventScheduler scheduler(4);
+    CHECK(scheduler.push(30, event(MidiEvent::NoteOn, 0, 1, 100)));
+    CHECK(scheduler.push(10, event(MidiEvent::NoteOn, 0, 2, 100)));
+    CHECK(scheduler.push(20, event(MidiEvent::NoteOn, 0, 3, 100)));
+    CHECK(scheduler.push(10, event(MidiEvent::NoteOn, 0, 4, 100)));
+    CHECK(!scheduler.push(40, event(MidiEvent::NoteOn, 0, 5, 100)));
+    CHECK(!scheduler.isDue(100));
+
+    scheduler.collect();
+    CHECK(scheduler.push(5, event(MidiEvent::NoteOn, 0, 6, 100)));
+    CHECK(!scheduler.isDue(10));
+    CHECK(scheduler.isDue(11));
+
+    // events sharing a frame keep their arrival order
+    const int expected[] = {2, 4, 3};
+    for (int note : expected) {
+        if (CHECK(scheduler.isDue(25))) {
+            CHECK_EQUAL(scheduler.next().event.param1, note);
+            scheduler.pop();
+        }
+    }
+    CHECK(!scheduler.isDue(25));
+
+    // the event pushed while the heap was full is collected later
+    scheduler.collect();
+    if (CHECK(scheduler.isDue(100))) {
+        CHECK_EQUAL(scheduler.next().frame, int64_t(5));
+        CHECK_EQUAL(scheduler.next().event.param1, 6);
+        scheduler.pop();
+    }
+    if (CHECK(scheduler.isDue(100))) {
+        CHECK_EQUAL(scheduler.next().frame, int64_t(30));
+        scheduler.pop();
+    }
+    CHECK(!scheduler.isDue(100));
+}
+
+int main()
+{
+    testQueueCapacity();
+    testQueueProducers();
+    testCoalescable();
+    testCoalescer();
+    testScheduler();
+    return testing::result();
+}
@@ -0,0 +1,197 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <atomic>
+#include <cmath>
+#include <thread>
+#include <vector>
+#include "fanoutring.h"
+#include "testing.h"
+
+static const int CHANNELS = 2;
+static const int BLOCK = 64;
+
+/* writes frames whose samples are their frame number, negated on the right */
+static void writeRamp(FanoutRing &ring, int count)
+{
+    std::vector<float> frames(size_t(count * CHANNELS));
+    uint64_t frame = ring.written();
+    for (int i = 0; i < count; ++i, ++frame) {
+        frames[i * CHANNELS] = float(frame);
+        frames[i * CHANNELS + 1] = -float(frame);
+    }
+    ring.write(frames.data(), count);
+}
+
+static void testRing()
+{
+    FanoutRing ring(CHANNELS, 1000);
+    CHECK_EQUAL(ring.capacity(), 1024);
+    CHECK_EQUAL(ring.channels(), CHANNELS);
+    CHECK_EQUAL(ring.written(), 0u);
+    writeRamp(ring, 1000);
+    writeRamp(ring, 100);
+    CHECK_EQUAL(ring.written(), 1100u);
+    CHECK_EQUAL(ring.sample(1099, 0), 1099.0f);
+    CHECK_EQUAL(ring.sample(1099, 1), -1099.0f);
+    // overwritten by the wrap around
+    CHECK_EQUAL(ring.sample(50, 0), 1074.0f);
+    CHECK_EQUAL(ring.sample(100, 0), 100.0f);
+}
+
+/**
+ * A reader outputs silence until the target fill is reached, then the
+ * frames in order, and goes back to silence on an underrun.
+ */
+static void testReader()
+{
+    FanoutRing ring(CHANNELS, 4096);
+    FanoutReader reader(ring, 256);
+    CHECK_EQUAL(reader.targetFrames(), 256);
+    CHECK_EQUAL(FanoutReader(ring, 10000).targetFrames(), 1024);
+
+    std::vector<float> out(size_t(BLOCK * CHANNELS));
+    reader.read(out.data(), BLOCK);
+    writeRamp(ring, 128);
+    reader.read(out.data(), BLOCK);
+    CHECK_EQUAL(out[0], 0.0f);
+    CHECK_EQUAL(out[BLOCK * CHANNELS - 1], 0.0f);
+
+    writeRamp(ring, 128);
+    reader.read(out.data(), BLOCK);
+    bool ramp = true;
+    for (int i = 0; i < BLOCK; ++i) {
+        ramp = ramp && out[i * CHANNELS] == float(i) && out[i * CHANNELS + 1] == -float(i);
+    }
+    CHECK(ramp);
+    CHECK_EQUAL(reader.stats().ratio, 1.0);
+    CHECK_EQUAL(reader.stats().underruns, 0u);
+
+    // the 192 frames left are read at a ratio slowing down with the fill
+    for (int i = 0; i < 3; ++i) {
+        reader.read(out.data(), BLOCK);
+    }
+    CHECK_EQUAL(reader.stats().underruns, 0u);
+    CHECK(reader.stats().ratio < 1.0);
+    CHECK(out[(BLOCK - 1) * CHANNELS] > 254.9f && out[(BLOCK - 1) * CHANNELS] < 255.0f);
+    reader.read(out.data(), BLOCK);
+    CHECK_EQUAL(reader.stats().underruns, 1u);
+    CHECK_EQUAL(out[(BLOCK - 1) * CHANNELS], 0.0f);
+    writeRamp(ring, 128);
+    reader.read(out.data(), BLOCK);
+    CHECK_EQUAL(out[0], 0.0f);
+    CHECK_EQUAL(reader.stats().underruns, 1u);
+    CHECK_EQUAL(reader.stats().overruns, 0u);
+}
+
+/**
+ * A reader left behind by more than half the ring skips ahead, keeping
+ * the target fill.
+ */
+static void testOverrun()
+{
+    FanoutRing ring(CHANNELS, 1024);
+    FanoutReader reader(ring, 128);
+    std::vector<float> out(size_t(BLOCK * CHANNELS));
+    writeRamp(ring, 128);
+    reader.read(out.data(), BLOCK);
+    reader.read(out.data(), BLOCK);
+    CHECK_EQUAL(out[0], 0.0f);
+    CHECK_EQUAL(reader.stats().overruns, 0u);
+    writeRamp(ring, 600);
+    reader.read(out.data(), BLOCK);
+    CHECK_EQUAL(reader.stats().overruns, 1u);
+    CHECK_EQUAL(out[0], float(ring.written() - 128));
+    CHECK_EQUAL(reader.stats().underruns, 0u);
+}
+
+/**
+ * The writer runs 1000 ppm faster than the reader: the resampling ratio
+ * converges to compensate it, and the fill level settles at the target
+ * without any overrun or underrun.
+ */
+static void testDrift()
+{
+    FanoutRing ring(CHANNELS, 8192);
+    FanoutReader reader(ring, 1024);
+    std::vector<float> out(size_t(BLOCK * CHANNELS));
+    int extra = 0;
+    for (int i = 0; i < 400000; ++i) {
+        int count = BLOCK;
+        extra += BLOCK;
+        if (extra >= 1000) {
+            extra -= 1000;
+            ++count;
+        }
+        writeRamp(ring, count);
+        reader.read(out.data(), BLOCK);
+    }
+    const FanoutReader::Stats s = reader.stats();
+    CHECK_EQUAL(s.underruns, 0u);
+    CHECK_EQUAL(s.overruns, 0u);
+    CHECK(std::fabs(s.ratio - 1.001) < 1e-4);
+    CHECK(std::fabs(s.fill - 1024) < 128);
+}
+
+/**
+ * Two readers follow a writer running freely in another thread: their
+ * frames may be dropped by overruns, but never mix two writes.
+ */
+static void testConcurrentReaders()
+{
+    FanoutRing ring(CHANNELS, 2048);
+    std::atomic<bool> done(false);
+    std::thread writer([&ring, &done] {
+        for (int i = 0; i < 20000; ++i) {
+            writeRamp(ring, BLOCK);
+            if (i % 8 == 0) {
+                std::this_thread::yield();
+            }
+        }
+        done.store(true);
+    });
+    std::atomic<int> torn(0);
+    auto read = [&ring, &done, &torn] {
+        FanoutReader reader(ring, 256);
+        std::vector<float> out(size_t(BLOCK * CHANNELS));
+        while (!done.load()) {
+            reader.read(out.data(), BLOCK);
+            for (int i = 0; i < BLOCK; ++i) {
+                if (out[i * CHANNELS] != -out[i * CHANNELS + 1]) {
+                    ++torn;
+                }
+            }
+        }
+    };
+    std::thread first(read);
+    std::thread second(read);
+    writer.join();
+    first.join();
+    second.join();
+    CHECK_EQUAL(torn.load(), 0);
+}
+
+int main()
+{
+    testRing();
+    testReader();
+    testOverrun();
+    testDrift();
+    testConcurrentReaders();
+    return testing::result();
+}
@@ -0,0 +1,129 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "jitterbuffer.h"
+#include "testing.h"
+
+/* 100 frames per millisecond, so the frames are easy to follow */
+static const int SAMPLE_RATE = 100000;
+
+/**
+ * Packets every 10 ms arriving 5 ms later, plus some jitter: the playout
+ * delay grows with the jitter seen, late packets play as soon as possible
+ * and the frames never go backwards.
+ */
+static void testPlayout()
+{
+    JitterBuffer jitter(SAMPLE_RATE);
+    CHECK_EQUAL(jitter.schedule(0, 0, 500), 600);
+    CHECK_EQUAL(jitter.schedule(1, 10000, 1500), 1600);
+    // 3 ms of jitter: late, and the delay grows to 3 ms
+    CHECK_EQUAL(jitter.schedule(2, 20000, 2800), 2800);
+    CHECK_EQUAL(jitter.stats().delayUsecs, 3000);
+    CHECK_EQUAL(jitter.schedule(4, 40000, 4500), 4800);
+    CHECK_EQUAL(jitter.stats().lost, 1u);
+    // the missing packet arrives late, after the next one
+    CHECK_EQUAL(jitter.schedule(3, 30000, 4600), 4800);
+    CHECK_EQUAL(jitter.stats().lost, 0u);
+    CHECK_EQUAL(jitter.stats().delayUsecs, 11000);
+
+    JitterBuffer::Stats s = jitter.stats();
+    CHECK_EQUAL(s.packets, 5u);
+    CHECK_EQUAL(s.late, 2u);
+    CHECK_EQUAL(s.reordered, 1u);
+    CHECK_EQUAL(s.lost, 0u);
+    CHECK_EQUAL(s.duplicates, 0u);
+
+    jitter.reset();
+    s = jitter.stats();
+    CHECK_EQUAL(s.packets, 0u);
+    CHECK_EQUAL(s.late, 0u);
+    CHECK_EQUAL(s.delayUsecs, JitterBuffer::MIN_DELAY_USECS);
+    CHECK_EQUAL(jitter.schedule(100, 5000000, 10000), 10100);
+}
+
+/**
+ * A duplicate is discarded without changing the lost packets count nor
+ * the playout, whether it repeats the last packet or an older one.
+ */
+static void testDuplicates()
+{
+    JitterBuffer jitter(SAMPLE_RATE);
+    CHECK_EQUAL(jitter.schedule(0, 0, 500), 600);
+    CHECK_EQUAL(jitter.schedule(1, 10000, 1500), 1600);
+    CHECK_EQUAL(jitter.schedule(4, 40000, 4500), 4600);
+    CHECK_EQUAL(jitter.stats().lost, 2u);
+    CHECK_EQUAL(jitter.schedule(4, 40000, 4510), -1);
+    CHECK_EQUAL(jitter.schedule(1, 10000, 4520), -1);
+    CHECK_EQUAL(jitter.stats().lost, 2u);
+    CHECK_EQUAL(jitter.schedule(2, 20000, 4530), 4600);
+    CHECK_EQUAL(jitter.stats().lost, 1u);
+    CHECK_EQUAL(jitter.schedule(2, 20000, 4540), -1);
+    CHECK_EQUAL(jitter.stats().lost, 1u);
+    // the late arrival of packet 2 raised the delay to 20.3 ms
+    CHECK_EQUAL(jitter.schedule(5, 50000, 5500), 7530);
+
+    const JitterBuffer::Stats s = jitter.stats();
+    CHECK_EQUAL(s.packets, 8u);
+    CHECK_EQUAL(s.duplicates, 3u);
+    CHECK_EQUAL(s.reordered, 1u);
+    CHECK_EQUAL(s.lost, 1u);
+}
+
+/**
+ * Sequence numbers wrap around, and packets older than the history are
+ * reordered but remain counted as lost.
+ */
+static void testSequences()
+{
+    JitterBuffer jitter(SAMPLE_RATE);
+    jitter.schedule(0xfffffffeu, 0, 500);
+    jitter.schedule(0xffffffffu, 10000, 1500);
+    jitter.schedule(1, 30000, 3500);
+    CHECK_EQUAL(jitter.stats().lost, 1u);
+    jitter.schedule(0, 20000, 3600);
+    CHECK_EQUAL(jitter.stats().lost, 0u);
+    CHECK_EQUAL(jitter.schedule(0, 20000, 3700), -1);
+    CHECK_EQUAL(jitter.schedule(0xffffffffu, 10000, 3800), -1);
+
+    const uint32_t last = 1 + JitterBuffer::HISTORY_PACKETS + 10;
+    jitter.schedule(last, 40000, 4500);
+    CHECK_EQUAL(jitter.stats().lost, uint64_t(last - 2));
+    // the oldest sequence in the history
+    const uint32_t oldest = last - JitterBuffer::HISTORY_PACKETS + 1;
+    jitter.schedule(oldest, 40000, 4600);
+    CHECK_EQUAL(jitter.stats().lost, uint64_t(last - 3));
+    CHECK_EQUAL(jitter.schedule(oldest, 40000, 4700), -1);
+    // beyond it
+    jitter.schedule(oldest - 1, 40000, 4800);
+    jitter.schedule(oldest - 1, 40000, 4900);
+    CHECK_EQUAL(jitter.stats().lost, uint64_t(last - 3));
+
+    const JitterBuffer::Stats s = jitter.stats();
+    CHECK_EQUAL(s.packets, 11u);
+    CHECK_EQUAL(s.duplicates, 3u);
+    CHECK_EQUAL(s.reordered, 4u);
+}
+
+int main()
+{
+    testPlayout();
+    testDuplicates();
+    testSequences();
+    return testing::result();
+}
@@ -0,0 +1,125 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include "keyboardstate.h"
+#include "testing.h"
+
+static void testNotes()
+{
+    std::unique_ptr<KeyboardState> keyboard(new KeyboardState);
+    std::unique_ptr<KeyboardState::Snapshot> s(new KeyboardState::Snapshot);
+    const unsigned serial = keyboard->serial();
+
+    keyboard->noteOn(0, 60, 100);
+    keyboard->noteOn(0, 64, 90);
+    keyboard->noteOn(9, 127, 1);
+    keyboard->noteOn(20, 0, 50);
+    keyboard->snapshot(*s);
+    CHECK_EQUAL(s->serial, serial + 4);
+    CHECK(s->isPressed(0, 60));
+    CHECK(s->isPressed(0, 64));
+    CHECK(s->isPressed(9, 127));
+    CHECK(s->isPressed(20, 0));
+    CHECK(!s->isPressed(0, 62));
+    CHECK(!s->isPressed(1, 60));
+    CHECK(s->isPressed(127));
+    CHECK_EQUAL(s->velocityOf(60), 100);
+    CHECK_EQUAL(s->velocityOf(64), 90);
+    CHECK_EQUAL(s->velocityOf(0), 50);
+    CHECK_EQUAL(s->velocityOf(61), 0);
+
+    // a note on with velocity zero is a note off
+    keyboard->noteOn(0, 60, 0);
+    keyboard->noteOff(9, 127);
+    keyboard->snapshot(*s);
+    CHECK(!s->isPressed(0, 60));
+    CHECK(!s->isPressed(127));
+    CHECK(s->isPressed(0, 64));
+
+    keyboard->allNotesOff(0);
+    keyboard->snapshot(*s);
+    CHECK(!s->isPressed(64));
+    CHECK(s->isPressed(20, 0));
+
+    // events out of range are ignored
+    const unsigned before = keyboard->serial();
+    keyboard->noteOn(-1, 60, 100);
+    keyboard->noteOn(KeyboardState::MIDI_CHANNELS, 60, 100);
+    keyboard->noteOn(0, 128, 100);
+    keyboard->noteOff(0, -1);
+    keyboard->allNotesOff(KeyboardState::MIDI_CHANNELS);
+    CHECK_EQUAL(keyboard->serial(), before);
+
+    keyboard->clear();
+    keyboard->snapshot(*s);
+    CHECK(!s->isPressed(0));
+}
+
+/**
+ * A writer plays chords while a reader takes snapshots: the serial number
+ * never goes backwards, and once the writer stops the snapshot is exact.
+ */
+static void testConcurrentSnapshots()
+{
+    std::unique_ptr<KeyboardState> keyboard(new KeyboardState);
+    std::unique_ptr<KeyboardState::Snapshot> s(new KeyboardState::Snapshot);
+    std::atomic<bool> done(false);
+    std::thread writer([&keyboard, &done] {
+        for (int round = 0; round < 20000; ++round) {
+            const int chan = round % 16;
+            for (int note = 48; note < 72; note += 4) {
+                keyboard->noteOn(chan, note, note);
+            }
+            for (int note = 48; note < 72; note += 4) {
+                keyboard->noteOff(chan, note);
+            }
+        }
+        keyboard->noteOn(5, 60, 77);
+        done.store(true);
+    });
+    unsigned lastSerial = 0;
+    int regressions = 0;
+    while (!done.load()) {
+        keyboard->snapshot(*s);
+        if (int(s->serial - lastSerial) < 0) {
+            ++regressions;
+        }
+        lastSerial = s->serial;
+    }
+    writer.join();
+    CHECK_EQUAL(regressions, 0);
+
+    keyboard->snapshot(*s);
+    CHECK_EQUAL(s->serial, keyboard->serial());
+    for (int chan = 0; chan < KeyboardState::MIDI_CHANNELS; ++chan) {
+        for (int note = 0; note < KeyboardState::MIDI_NOTES; ++note) {
+            CHECK_EQUAL(s->isPressed(chan, note), chan == 5 && note == 60);
+        }
+    }
+    CHECK_EQUAL(s->velocityOf(60), 77);
+}
+
+int main()
+{
+    testNotes();
+    testConcurrentSnapshots();
+    return testing::result();
+}
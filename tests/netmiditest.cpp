@@ -0,0 +1,169 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QThread>
+#include <QUdpSocket>
+#include "netmidiinput.h"
+#include "synthrenderer.h"
+#include "testing.h"
+
+static const int TIMEOUT = 5000;
+static const int LISTEN_TIMEOUT = 500;
+
+namespace {
+
+/* a datagram of the test, carrying a note on */
+struct Packet {
+    quint32 sequence;
+    qint64 usecs;
+    int note;
+};
+
+}
+
+static bool waitForPackets(const NetMidiInput &input, quint64 packets, int timeout)
+{
+    QElapsedTimer timer;
+    timer.start();
+    while (input.stats().packets < packets) {
+        if (timer.elapsed() > timeout) {
+            return false;
+        }
+        QThread::msleep(10);
+    }
+    return true;
+}
+
+/**
+ * Sends datagrams built with NetMidiInput::packet() over the loopback
+ * interface to an input attached to a renderer, in a disordered sequence:
+ * a packet overtaken by the next one, a duplicate, a lost one and one sent
+ * too late for its timestamp. The renderer isn't playing, so every packet
+ * arrives at frame 0, and a reference jitter buffer gives the frames the
+ * input must schedule. The counters match the disorder, the duplicate is
+ * discarded, and rendering applies every note at its frame.
+ */
+static void testLoopback()
+{
+    SynthRenderer renderer(1, QString::fromStdString(EngineProfile::defaults().name));
+    NetMidiInput input;
+    input.setRenderer(&renderer, 0);
+
+    QUdpSocket free;
+    if (!CHECK(free.bind(QHostAddress::LocalHost, 0))) {
+        return;
+    }
+    const quint16 port = free.localPort();
+    free.close();
+    input.open(drumstick::rt::MIDIConnection(QString::number(port), int(port)));
+
+    QUdpSocket sender;
+    auto send = [&sender, port](const Packet &p) {
+        const QByteArray midi = QByteArray(1, char(0x90)) + char(p.note) + char(100);
+        sender.writeDatagram(NetMidiInput::packet(p.sequence, p.usecs, midi), QHostAddress::LocalHost, port);
+    };
+    // the first packet is repeated until the receiving thread is listening
+    const Packet first = {0, 0, 60};
+    QElapsedTimer timer;
+    timer.start();
+    do {
+        send(first);
+    } while (!waitForPackets(input, 1, LISTEN_TIMEOUT) && timer.elapsed() < TIMEOUT);
+    const JitterBuffer::Stats start = input.stats();
+    if (!CHECK_EQUAL(start.packets, 1u)) {
+        return;
+    }
+
+    const std::vector<Packet> packets = {
+        {1, 10000, 61},
+        {2, 20000, 62},
+        {4, 40000, 64},
+        {3, 30000, 63},   // reordered and late
+        {3, 30000, 63},   // duplicate
+        {6, 60000, 66},   // after a lost packet
+        {7, 70000, 67},
+        {8, 20000, 68},   // late
+    };
+    for (const Packet &p : packets) {
+        send(p);
+    }
+    CHECK(waitForPackets(input, start.packets + packets.size(), TIMEOUT));
+    input.close();
+
+    const JitterBuffer::Stats s = input.stats();
+    CHECK_EQUAL(s.packets, start.packets + packets.size());
+    CHECK_EQUAL(s.late, 2u);
+    CHECK_EQUAL(s.reordered, 1u);
+    CHECK_EQUAL(s.lost, 1u);
+    CHECK_EQUAL(s.duplicates, start.duplicates + 1);
+    CHECK_EQUAL(input.droppedEvents(), 0u);
+
+    JitterBuffer reference(renderer.format().sampleRate());
+    std::vector<qint64> frames(128, -1);
+    frames[first.note] = reference.schedule(first.sequence, first.usecs, 0);
+    for (const Packet &p : packets) {
+        const qint64 frame = reference.schedule(p.sequence, p.usecs, 0);
+        if (frame >= 0) {
+            CHECK(frame >= frames[first.note]);
+            frames[p.note] = frame;
+        }
+    }
+    CHECK_EQUAL(reference.stats().late, s.late);
+    CHECK_EQUAL(reference.stats().delayUsecs, s.delayUsecs);
+
+    // render until every note has been applied, and find their blocks
+    SynthEngine &engine = renderer.engine();
+    const int blockFrames = engine.blockFrames();
+    std::vector<float> buffer(size_t(blockFrames * engine.channels()));
+    std::unique_ptr<KeyboardState::Snapshot> snapshot(new KeyboardState::Snapshot);
+    std::vector<qint64> applied(128, -1);
+    const qint64 last = *std::max_element(frames.begin(), frames.end());
+    for (qint64 block = 0; block * blockFrames <= last; ++block) {
+        engine.render(buffer.data(), blockFrames);
+        engine.keyboardState().snapshot(*snapshot);
+        for (int note = 0; note < 128; ++note) {
+            if (applied[note] < 0 && snapshot->isPressed(0, note)) {
+                applied[note] = block;
+            }
+        }
+    }
+    int misplaced = 0;
+    for (int note = 0; note < 128; ++note) {
+        const qint64 expected = frames[note] < 0 ? -1 : frames[note] / blockFrames;
+        if (applied[note] != expected) {
+            std::cerr << "note " << note << " applied in block " << applied[note]
+                      << ", expected in " << expected << std::endl;
+            ++misplaced;
+        }
+    }
+    CHECK_EQUAL(misplaced, 0);
+    // the first note, and all the others but the duplicate
+    CHECK_EQUAL(engine.stats().midiEvents, uint64_t(packets.size()));
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    testLoopback();
+    return testing::result();
+}
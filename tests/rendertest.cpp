@@ -0,0 +1,227 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Drives SynthEngine::render() with interposed malloc(), free() and
+ * pthread_mutex_lock(), counting the calls made from the rendering thread
+ * while it renders. Every count must stay at zero. Linux/glibc only.
+ */
+
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <thread>
+#include <vector>
+#include <dlfcn.h>
+#include <pthread.h>
+#include "synthengine.h"
+#include "tracer.h"
+#include "testsoundfont.h"
+#include "testing.h"
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void __libc_free(void *ptr);
+}
+
+typedef int (*MutexFunction)(pthread_mutex_t *);
+
+static thread_local bool t_watching = false;
+static std::atomic<int> s_allocations(0);
+static std::atomic<int> s_releases(0);
+static std::atomic<int> s_locks(0);
+static MutexFunction s_mutexLock = nullptr;
+static MutexFunction s_mutexTrylock = nullptr;
+
+extern "C" void *malloc(size_t size)
+{
+    if (t_watching) {
+        ++s_allocations;
+    }
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size)
+{
+    if (t_watching) {
+        ++s_allocations;
+    }
+    return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size)
+{
+    if (t_watching) {
+        ++s_allocations;
+    }
+    return __libc_realloc(ptr, size);
+}
+
+extern "C" void free(void *ptr)
+{
+    if (t_watching && ptr != nullptr) {
+        ++s_releases;
+    }
+    __libc_free(ptr);
+}
+
+extern "C" int pthread_mutex_lock(pthread_mutex_t *mutex)
+{
+    if (t_watching) {
+        ++s_locks;
+    }
+    if (s_mutexLock == nullptr) {
+        s_mutexLock = reinterpret_cast<MutexFunction>(dlsym(RTLD_NEXT, "pthread_mutex_lock"));
+    }
+    return s_mutexLock(mutex);
+}
+
+extern "C" int pthread_mutex_trylock(pthread_mutex_t *mutex)
+{
+    if (t_watching) {
+        ++s_locks;
+    }
+    if (s_mutexTrylock == nullptr) {
+        s_mutexTrylock = reinterpret_cast<MutexFunction>(dlsym(RTLD_NEXT, "pthread_mutex_trylock"));
+    }
+    return s_mutexTrylock(mutex);
+}
+
+static const char *const SOUNDFONT = "rendertest.sf2";
+
+static int64_t renderWatched(SynthEngine &engine, std::vector<float> &buffer)
+{
+    t_watching = true;
+    const int64_t rendered = engine.render(buffer.data(), int64_t(buffer.size()) / engine.channels());
+    t_watching = false;
+    return rendered;
+}
+
+static void resetCounts()
+{
+    s_allocations = 0;
+    s_releases = 0;
+    s_locks = 0;
+}
+
+static void checkCounts(const char *phase)
+{
+    const bool allocations = CHECK_EQUAL(s_allocations.load(), 0);
+    const bool releases = CHECK_EQUAL(s_releases.load(), 0);
+    const bool locks = CHECK_EQUAL(s_locks.load(), 0);
+    if (!allocations || !releases || !locks) {
+        std::cerr << "  while " << phase << std::endl;
+    }
+}
+
+static float peakLevel(const std::vector<float> &buffer)
+{
+    float peak = 0;
+    for (float sample : buffer) {
+        peak = std::max(peak, std::fabs(sample));
+    }
+    return peak;
+}
+
+/**
+ * Plays chords, controllers, pitch bends and scheduled notes, posted
+ * between the buffers like a MIDI input thread would.
+ */
+static void testRendering(SynthEngine &engine)
+{
+    std::vector<float> buffer(size_t(engine.blockFrames() * 4 * engine.channels()));
+    engine.noteOn(0, 60, 100);
+    engine.render(buffer.data(), engine.blockFrames() * 4);
+
+    float peak = 0;
+    int voices = 0;
+    resetCounts();
+    for (int i = 0; i < 400; ++i) {
+        const int note = 48 + i % 24;
+        engine.noteOn(i % 16, note, 100);
+        engine.noteOn(i % 16, note + 4, 90);
+        engine.controller(i % 16, 7, i % 128);
+        engine.controller(i % 16, 7, (i + 1) % 128);
+        engine.pitchBend(i % 16, 8192 + i % 100);
+        engine.channelPressure(i % 16, i % 128);
+        engine.scheduleEvent(int64_t(engine.renderedFrames()) + engine.blockFrames() * 2,
+                             {MidiEvent::NoteOff, uint8_t(i % 16), int16_t(note), 0});
+        if (i % 50 == 0) {
+            engine.program(i % 16, 0);
+            engine.controller(i % 16, 123, 0);
+        }
+        renderWatched(engine, buffer);
+        engine.noteOff(i % 16, note + 4, 0);
+        peak = std::max(peak, peakLevel(buffer));
+        voices = std::max(voices, engine.stats().activeVoices);
+    }
+    checkCounts("rendering");
+    CHECK(voices > 0);
+    CHECK(peak > 0);
+}
+
+/**
+ * Unloads and loads the soundfont again from this thread while another
+ * one keeps rendering: the rendering thread outputs silence meanwhile,
+ * without waiting on any lock.
+ */
+static void testSoundfontChanges(SynthEngine &engine)
+{
+    std::atomic<bool> done(false);
+    int64_t frames = 0;
+    const uint64_t renderedBefore = engine.renderedFrames();
+    resetCounts();
+    std::thread renderer([&engine, &done, &frames] {
+        std::vector<float> buffer(size_t(engine.blockFrames() * 4 * engine.channels()));
+        Tracer::prepareThread();
+        while (!done.load()) {
+            engine.noteOn(0, 69, 100);
+            frames += renderWatched(engine, buffer);
+        }
+    });
+    for (int i = 0; i < 20; ++i) {
+        CHECK(engine.closeSoundfont(SOUNDFONT));
+        CHECK(engine.openSoundfont(SOUNDFONT));
+    }
+    done.store(true);
+    renderer.join();
+    checkCounts("loading and unloading soundfonts");
+    CHECK_EQUAL(engine.renderedFrames() - renderedBefore, uint64_t(frames));
+    CHECK(engine.stats().silencedFrames <= uint64_t(frames));
+}
+
+int main()
+{
+    if (!CHECK(writeTestSoundfont(SOUNDFONT))) {
+        return testing::result();
+    }
+    // the ring of the rendering thread is allocated in advance
+    Tracer::setEnabled(true);
+    Tracer::prepareThread();
+    SynthEngine engine;
+    engine.setProfiling(true);
+    if (CHECK(engine.openSoundfont(SOUNDFONT))) {
+        testRendering(engine);
+        testSoundfontChanges(engine);
+    }
+    Tracer::setEnabled(false);
+    std::remove(SOUNDFONT);
+    return testing::result();
+}
@@ -0,0 +1,195 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <QCoreApplication>
+#include <QFile>
+#include <QTemporaryDir>
+#include "sessionrecorder.h"
+#include "sessionplayer.h"
+#include "testing.h"
+
+namespace {
+
+/* collects the events replayed into an engine */
+class EventCapture : public EventObserver
+{
+public:
+    void eventPosted(const MidiEvent &ev) override { events.push_back(ev); }
+    std::vector<MidiEvent> events;
+};
+
+}
+
+static bool sameEvent(const MidiEvent &a, const MidiEvent &b)
+{
+    return a.type == b.type && a.chan == b.chan && a.param1 == b.param1 && a.param2 == b.param2;
+}
+
+static SessionSettings testSettings()
+{
+    SessionSettings settings;
+    settings.soundfonts << "/usr/share/sounds/sf2/first.sf2" << "second.sf3";
+    settings.reverbType = 2;
+    settings.reverbLevel = 40;
+    settings.chorusType = 1;
+    settings.chorusLevel = 25;
+    settings.bufferTime = 30;
+    settings.sampleRate = 48000;
+    settings.engineProfile = "low-latency";
+    settings.midiDriver = "ALSA";
+    settings.portName = "Keyboard:0";
+    settings.extraPorts << "Pads:0" << "Sequencer:1";
+    return settings;
+}
+
+static void checkSettings(const SessionSettings &actual, const SessionSettings &expected)
+{
+    CHECK(actual.soundfonts == expected.soundfonts);
+    CHECK_EQUAL(actual.reverbType, expected.reverbType);
+    CHECK_EQUAL(actual.reverbLevel, expected.reverbLevel);
+    CHECK_EQUAL(actual.chorusType, expected.chorusType);
+    CHECK_EQUAL(actual.chorusLevel, expected.chorusLevel);
+    CHECK_EQUAL(actual.bufferTime, expected.bufferTime);
+    CHECK_EQUAL(actual.sampleRate, expected.sampleRate);
+    CHECK(actual.engineProfile == expected.engineProfile);
+    CHECK(actual.midiDriver == expected.midiDriver);
+    CHECK(actual.portName == expected.portName);
+    CHECK(actual.extraPorts == expected.extraPorts);
+}
+
+static void testSettingsJson()
+{
+    const SessionSettings settings = testSettings();
+    checkSettings(SessionSettings::fromJson(settings.toJson()), settings);
+}
+
+/**
+ * Records events posted from another thread, then loads the log and
+ * replays it offline into an engine: the settings and every event come
+ * back in order, and the offline rendering is deterministic.
+ */
+static void testRoundTrip(const QString &fileName)
+{
+    std::vector<MidiEvent> posted;
+    for (int i = 0; i < 200; ++i) {
+        const uint8_t chan = uint8_t((i * 7) % MidiEvent::MAX_CHANNELS);
+        posted.push_back({MidiEvent::NoteOn, chan, int16_t(36 + i % 60), int16_t(1 + i % 127)});
+        posted.push_back({MidiEvent::PitchBend, chan, int16_t(i * 40), 0});
+        posted.push_back({MidiEvent::Controller, chan, 7, int16_t(i % 128)});
+        posted.push_back({MidiEvent::NoteOff, chan, int16_t(36 + i % 60), 0});
+    }
+    SessionRecorder recorder;
+    CHECK(recorder.start(fileName, testSettings()));
+    CHECK(recorder.isRecording());
+    std::thread producer([&recorder, &posted] {
+        for (const MidiEvent &ev : posted) {
+            recorder.eventPosted(ev);
+            if (ev.type == MidiEvent::NoteOff) {
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+            }
+        }
+    });
+    producer.join();
+    recorder.stop();
+    CHECK(!recorder.isRecording());
+    CHECK_EQUAL(recorder.recordedEvents(), quint64(posted.size()));
+    CHECK_EQUAL(recorder.lostEvents(), quint64(0));
+    recorder.eventPosted(posted.front());
+    CHECK_EQUAL(recorder.recordedEvents(), quint64(posted.size()));
+
+    SessionPlayer player;
+    if (!CHECK(player.load(fileName))) {
+        return;
+    }
+    checkSettings(player.settings(), testSettings());
+    CHECK_EQUAL(player.eventCount(), int(posted.size()));
+    CHECK(player.duration() >= 199 * 200000);
+
+    EventCapture capture;
+    SynthEngine engine;
+    engine.setObserver(&capture);
+    const SessionPlayer::Result first = player.renderOffline(&engine);
+    engine.setObserver(nullptr);
+    if (CHECK_EQUAL(capture.events.size(), posted.size())) {
+        int different = 0;
+        for (size_t i = 0; i < posted.size(); ++i) {
+            different += sameEvent(capture.events[i], posted[i]) ? 0 : 1;
+        }
+        CHECK_EQUAL(different, 0);
+    }
+    CHECK(first.frames >= quint64(player.duration() / 1e9 * engine.sampleRate()));
+    SynthEngine other;
+    const SessionPlayer::Result second = player.renderOffline(&other);
+    CHECK_EQUAL(second.frames, first.frames);
+    CHECK(second.hash == first.hash);
+}
+
+static void testDamagedLogs(const QString &fileName, const QString &damagedName)
+{
+    QFile file(fileName);
+    if (!CHECK(file.open(QIODevice::ReadOnly))) {
+        return;
+    }
+    const QByteArray contents = file.readAll();
+    SessionPlayer player;
+
+    // a record cut short is dropped, with the previous ones kept
+    QFile damaged(damagedName);
+    CHECK(damaged.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    damaged.write(contents.left(contents.size() - 3));
+    damaged.close();
+    CHECK(player.load(damagedName));
+    CHECK_EQUAL(player.eventCount(), 799);
+
+    // a wrong magic or version is rejected
+    QByteArray wrong = contents;
+    wrong[SessionRecorder::MAGIC.size()] = char(SessionRecorder::VERSION + 1);
+    CHECK(damaged.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    damaged.write(wrong);
+    damaged.close();
+    CHECK(!player.load(damagedName));
+    wrong = contents;
+    wrong[0] = 'X';
+    CHECK(damaged.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    damaged.write(wrong);
+    damaged.close();
+    CHECK(!player.load(damagedName));
+
+    // settings longer than the file are rejected
+    CHECK(damaged.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    damaged.write(contents.left(SessionRecorder::MAGIC.size() + 1 + 4 + 10));
+    damaged.close();
+    CHECK(!player.load(damagedName));
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QTemporaryDir dir;
+    if (!CHECK(dir.isValid())) {
+        return testing::result();
+    }
+    const QString fileName = dir.filePath("session.flsl");
+    testSettingsJson();
+    testRoundTrip(fileName);
+    testDamagedLogs(fileName, dir.filePath("damaged.flsl"));
+    return testing::result();
+}
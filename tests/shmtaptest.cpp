@@ -0,0 +1,220 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <atomic>
+#include <cerrno>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "shmtap.h"
+#include "testing.h"
+
+static const int CHANNELS = 2;
+static const int SAMPLE_RATE = 48000;
+static const int BLOCK = 64;
+
+static std::string testName(const char *suffix)
+{
+    return "/fluidlite-test-" + std::to_string(getpid()) + '-' + suffix;
+}
+
+/* writes frames whose samples are their index, negated on the right */
+static void writeRamp(ShmTap &tap, uint64_t first, int count, uint64_t frameClock)
+{
+    std::vector<float> frames(size_t(count * CHANNELS));
+    for (int i = 0; i < count; ++i) {
+        frames[i * CHANNELS] = float(first + i);
+        frames[i * CHANNELS + 1] = -float(first + i);
+    }
+    tap.write(frames.data(), count, frameClock);
+}
+
+static bool isRamp(const ShmTapReader &reader, uint64_t index)
+{
+    const float *frame = reader.frame(index);
+    return frame[0] == float(index) && frame[1] == -float(index);
+}
+
+static void testRoundTrip()
+{
+    const std::string name = testName("ring");
+    ShmTap tap;
+    CHECK(!tap.isOpen());
+    int error = 0;
+    if (!CHECK(tap.open(name, SAMPLE_RATE, CHANNELS, 1000, &error))) {
+        std::cerr << "shm_open: " << error << std::endl;
+        return;
+    }
+    CHECK(tap.isOpen());
+    CHECK(tap.name() == name);
+
+    ShmTapReader reader;
+    if (!CHECK(reader.open(name.substr(1)))) {
+        return;
+    }
+    const ShmTapHeader *header = reader.header();
+    CHECK_EQUAL(header->version, ShmTapHeader::VERSION);
+    CHECK_EQUAL(header->headerBytes, ShmTapHeader::HEADER_BYTES);
+    CHECK_EQUAL(header->sampleRate, uint32_t(SAMPLE_RATE));
+    CHECK_EQUAL(header->channels, uint32_t(CHANNELS));
+    CHECK_EQUAL(header->sampleFormat, ShmTapHeader::FLOAT32_INTERLEAVED);
+    CHECK_EQUAL(header->capacityFrames, 1024u);
+    CHECK_EQUAL(reader.writeIndex(), 0u);
+    CHECK_EQUAL(header->clockNsecs.load(), 0);
+
+    writeRamp(tap, 0, 1000, 5000);
+    CHECK_EQUAL(reader.writeIndex(), 1000u);
+    CHECK_EQUAL(header->frameClock.load(), 5000u);
+    CHECK(header->clockNsecs.load() > 0);
+    CHECK_EQUAL(header->sequence.load() % 2, 0u);
+    CHECK(isRamp(reader, 0));
+    CHECK(isRamp(reader, 999));
+    CHECK_EQUAL(reader.contiguousFrames(1000), 24);
+    CHECK(reader.valid(0));
+
+    // wrapping around overwrites the oldest frames
+    writeRamp(tap, 1000, 100, 6000);
+    CHECK_EQUAL(reader.writeIndex(), 1100u);
+    CHECK(isRamp(reader, 1023));
+    CHECK(isRamp(reader, 1024));
+    CHECK(isRamp(reader, 1099));
+    CHECK_EQUAL(reader.frame(1024), reader.frame(0));
+    CHECK(!reader.valid(0));
+    CHECK(!reader.valid(75));
+    CHECK(reader.valid(76));
+
+    // closing the tap removes the object, not the mapping of the reader
+    tap.close();
+    CHECK(!tap.isOpen());
+    CHECK(isRamp(reader, 1099));
+    ShmTapReader late;
+    error = 0;
+    CHECK(!late.open(name, &error));
+    CHECK_EQUAL(error, ENOENT);
+    reader.close();
+    CHECK(!reader.isOpen());
+}
+
+/**
+ * Objects which are not a tap, or a tap of another version, are rejected.
+ */
+static void testForeignObjects()
+{
+    const std::string name = testName("foreign");
+    int fd = shm_open(name.c_str(), O_CREAT | O_RDWR, 0600);
+    if (!CHECK(fd >= 0)) {
+        return;
+    }
+    ShmTapReader reader;
+    int error = 0;
+    CHECK(!reader.open(name, &error));
+    CHECK_EQUAL(error, EINVAL);
+    CHECK_EQUAL(ftruncate(fd, 4096), 0);
+    error = 0;
+    CHECK(!reader.open(name, &error));
+    CHECK_EQUAL(error, EINVAL);
+    ::close(fd);
+    shm_unlink(name.c_str());
+
+    ShmTap tap;
+    CHECK(tap.open(name, SAMPLE_RATE, CHANNELS, 256));
+    fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (CHECK(fd >= 0)) {
+        void *memory = mmap(nullptr, ShmTapHeader::HEADER_BYTES, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (CHECK(memory != MAP_FAILED)) {
+            ShmTapHeader *header = static_cast<ShmTapHeader *>(memory);
+            header->version = ShmTapHeader::VERSION + 1;
+            CHECK(!reader.open(name, &error));
+            header->version = ShmTapHeader::VERSION;
+            header->capacityFrames *= 2;
+            CHECK(!reader.open(name, &error));
+            header->capacityFrames /= 2;
+            CHECK(reader.open(name, &error));
+            munmap(memory, ShmTapHeader::HEADER_BYTES);
+        }
+    }
+}
+
+/**
+ * A reader follows a writer in another thread, reading the frames in place
+ * at its own pace: the frames it finds valid after reading them are always
+ * the ones written, and the frame clock is consistent with the index.
+ */
+static void testConcurrentReader()
+{
+    const std::string name = testName("concurrent");
+    ShmTap tap;
+    ShmTapReader reader;
+    if (!CHECK(tap.open(name, SAMPLE_RATE, CHANNELS, 512)) || !CHECK(reader.open(name))) {
+        return;
+    }
+    std::atomic<bool> done(false);
+    std::thread writer([&tap, &done] {
+        for (uint64_t frame = 0; frame < 2000000; frame += BLOCK) {
+            writeRamp(tap, frame, BLOCK, frame + BLOCK + 1000);
+        }
+        done.store(true);
+    });
+    const ShmTapHeader *header = reader.header();
+    uint64_t checked = 0, wrong = 0, clocks = 0;
+    std::vector<float> copy(size_t(BLOCK * CHANNELS));
+    while (!done.load()) {
+        uint32_t sequence;
+        uint64_t index, clock;
+        do {
+            sequence = header->sequence.load(std::memory_order_acquire);
+            clock = header->frameClock.load(std::memory_order_relaxed);
+            index = header->writeIndex.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+        } while ((sequence & 1) != 0 || sequence != header->sequence.load(std::memory_order_relaxed));
+        if (index > 0 && clock != index + 1000) {
+            ++clocks;
+        }
+        if (index < uint64_t(BLOCK)) {
+            continue;
+        }
+        const uint64_t first = index - BLOCK;
+        for (int i = 0; i < BLOCK; ++i) {
+            const float *frame = reader.frame(first + i);
+            copy[i * CHANNELS] = frame[0];
+            copy[i * CHANNELS + 1] = frame[1];
+        }
+        if (reader.valid(first)) {
+            for (int i = 0; i < BLOCK; ++i) {
+                wrong += copy[i * CHANNELS] == float(first + i) ? 0 : 1;
+            }
+            checked += BLOCK;
+        }
+    }
+    writer.join();
+    CHECK(checked > 0);
+    CHECK_EQUAL(wrong, 0u);
+    CHECK_EQUAL(clocks, 0u);
+}
+
+int main()
+{
+    testRoundTrip();
+    testForeignObjects();
+    testConcurrentReader();
+    return testing::result();
+}
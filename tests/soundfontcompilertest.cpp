@@ -0,0 +1,196 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include <QCoreApplication>
+#include <QFile>
+#include <QFileInfo>
+#include <QTemporaryDir>
+#include "soundfontcompiler.h"
+#include "soundfontimage.h"
+#include "synthengine.h"
+#include "testsoundfont.h"
+#include "testing.h"
+
+/* SF2 generator operators */
+static const int GEN_SAMPLE_MODES = 54;
+
+static std::string localName(const QString &fileName)
+{
+    return QFile::encodeName(fileName).toStdString();
+}
+
+/**
+ * The image holds the presets sorted by numbers, one zone each, and the
+ * samples with their loops moved with them and their padding.
+ */
+static void testCompile(const QString &fileName, const QString &imageFile)
+{
+    SoundfontCompiler compiler;
+    if (!CHECK(compiler.compile(fileName, imageFile))) {
+        std::cerr << qPrintable(compiler.errorString()) << std::endl;
+        return;
+    }
+    CHECK_EQUAL(compiler.presetCount(), 2);
+    CHECK_EQUAL(compiler.zoneCount(), 2);
+    CHECK_EQUAL(compiler.sampleCount(), 2);
+    CHECK_EQUAL(compiler.imageBytes(), QFileInfo(imageFile).size());
+
+    CHECK(SoundfontImage::isImage(localName(imageFile)));
+    CHECK(!SoundfontImage::isImage(localName(fileName)));
+    SoundfontImage image;
+    std::string error;
+    if (!CHECK(image.open(localName(imageFile), &error))) {
+        std::cerr << error << std::endl;
+        return;
+    }
+    const SoundfontImageHeader &header = image.header();
+    CHECK_EQUAL(std::string(header.name), std::string(TEST_SOUNDFONT_NAME));
+    CHECK_EQUAL(header.presetCount, 2u);
+    CHECK_EQUAL(header.presetOffset % SoundfontImageHeader::ALIGNMENT, 0u);
+    CHECK_EQUAL(header.dataOffset % SoundfontImageHeader::ALIGNMENT, 0u);
+    CHECK_EQUAL(std::string(image.presets()[0].name), std::string(TEST_PRESET_NAME));
+    CHECK(image.findPreset(0, 1) == nullptr);
+    CHECK(image.findPreset(TEST_SQUARE_BANK, 0) == nullptr);
+
+    const SoundfontImagePreset *preset = image.findPreset(TEST_SQUARE_BANK, TEST_SQUARE_PROGRAM);
+    if (!CHECK(preset != nullptr)) {
+        return;
+    }
+    CHECK_EQUAL(std::string(preset->name), std::string(TEST_SQUARE_PRESET_NAME));
+    if (!CHECK_EQUAL(preset->zoneCount, 1u)) {
+        return;
+    }
+    const SoundfontImageZone &zone = image.zones()[preset->firstZone];
+    CHECK_EQUAL(int(zone.keyLow), 0);
+    CHECK_EQUAL(int(zone.keyHigh), 127);
+    CHECK(((zone.instrumentGenerators >> GEN_SAMPLE_MODES) & 1) != 0);
+    CHECK_EQUAL(zone.instrument[GEN_SAMPLE_MODES], 1.0f);
+    CHECK_EQUAL(zone.presetGenerators, 0u);
+
+    const SoundfontImageSample &sample = image.samples()[zone.sample];
+    CHECK_EQUAL(std::string(sample.name), std::string("Square"));
+    CHECK_EQUAL(sample.end - sample.start, uint32_t(TEST_SQUARE_SAMPLE_FRAMES - 1));
+    CHECK_EQUAL(sample.loopStart - sample.start, 100u);
+    CHECK_EQUAL(sample.loopEnd - sample.start, uint32_t(TEST_SQUARE_SAMPLE_FRAMES - 100));
+    CHECK_EQUAL(sample.sampleRate, 44100u);
+    CHECK_EQUAL(sample.originalPitch, 69);
+    const std::string expected = testSquareSample();
+    CHECK(std::memcmp(image.sampleData() + sample.start, expected.data(), expected.size()) == 0);
+    const int16_t *padding = image.sampleData() + sample.end + 1;
+    CHECK(std::all_of(padding, padding + SoundfontImageSample::PADDING, [](int16_t s) { return s == 0; }));
+}
+
+/**
+ * Broken inputs and images are rejected with an error.
+ */
+static void testErrors(const QString &imageFile, const QString &damagedFile)
+{
+    SoundfontCompiler compiler;
+    CHECK(!compiler.compile(imageFile, damagedFile));
+    CHECK(!compiler.errorString().isEmpty());
+    CHECK(!QFileInfo::exists(damagedFile));
+
+    QFile source(imageFile);
+    CHECK(source.open(QIODevice::ReadOnly));
+    const QByteArray data = source.readAll();
+    QFile damaged(damagedFile);
+    CHECK(damaged.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    damaged.write(data.left(data.size() - 2));
+    damaged.close();
+    SoundfontImage image;
+    std::string error;
+    CHECK(!image.open(localName(damagedFile), &error));
+    CHECK(!error.empty());
+    CHECK(!image.isOpen());
+
+    QByteArray wrong = data;
+    reinterpret_cast<SoundfontImageHeader *>(wrong.data())->zoneOffset += 8;
+    CHECK(damaged.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    damaged.write(wrong);
+    damaged.close();
+    CHECK(!image.open(localName(damagedFile), &error));
+}
+
+/**
+ * The image loader serves the presets in place, and the engine plays them.
+ */
+static void testPlayback(const QString &imageFile)
+{
+    fluid_sfloader_t *loader = SoundfontImage::newLoader();
+    CHECK(loader->load(loader, "/nonexistent.sf2") == nullptr);
+    fluid_sfont_t *sfont = loader->load(loader, localName(imageFile).c_str());
+    if (CHECK(sfont != nullptr)) {
+        CHECK_EQUAL(std::string(sfont->get_name(sfont)), std::string(TEST_SOUNDFONT_NAME));
+        fluid_preset_t *preset = sfont->get_preset(sfont, TEST_SQUARE_BANK, TEST_SQUARE_PROGRAM);
+        if (CHECK(preset != nullptr)) {
+            CHECK_EQUAL(std::string(preset->get_name(preset)), std::string(TEST_SQUARE_PRESET_NAME));
+            CHECK_EQUAL(preset->get_banknum(preset), TEST_SQUARE_BANK);
+            CHECK_EQUAL(preset->get_num(preset), TEST_SQUARE_PROGRAM);
+            preset->free(preset);
+        }
+        CHECK(sfont->get_preset(sfont, 0, 1) == nullptr);
+        fluid_preset_t iterated;
+        int presets = 0;
+        sfont->iteration_start(sfont);
+        while (sfont->iteration_next(sfont, &iterated)) {
+            ++presets;
+        }
+        CHECK_EQUAL(presets, 2);
+        CHECK_EQUAL(sfont->free(sfont), 0);
+    }
+    loader->free(loader);
+
+    SynthEngine engine;
+    if (!CHECK(engine.openSoundfont(localName(imageFile)))) {
+        return;
+    }
+    engine.controller(0, 0, TEST_SQUARE_BANK);
+    engine.program(0, TEST_SQUARE_PROGRAM);
+    engine.noteOn(0, 69, 100);
+    const int frames = engine.blockFrames() * 64;
+    std::vector<float> buffer(size_t(frames * engine.channels()));
+    engine.render(buffer.data(), frames);
+    float peak = 0;
+    for (float s : buffer) {
+        peak = std::max(peak, std::fabs(s));
+    }
+    CHECK(peak > 0.01f);
+    CHECK(engine.closeSoundfont(localName(imageFile)));
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QTemporaryDir dir;
+    if (!CHECK(dir.isValid())) {
+        return testing::result();
+    }
+    const QString fileName = dir.filePath("test.sf2");
+    if (!CHECK(writeTestSoundfont(localName(fileName)))) {
+        return testing::result();
+    }
+    const QString imageFile = dir.filePath("test.sfimg");
+    testCompile(fileName, imageFile);
+    testErrors(imageFile, dir.filePath("damaged.sfimg"));
+    testPlayback(imageFile);
+    return testing::result();
+}
@@ -0,0 +1,194 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QTemporaryDir>
+#include "soundfontfile.h"
+#include "soundfontlibrary.h"
+#include "testsoundfont.h"
+#include "testing.h"
+
+static QByteArray contents(const QString &fileName)
+{
+    QFile file(fileName);
+    return file.open(QIODevice::ReadOnly) ? file.readAll() : QByteArray();
+}
+
+static QByteArray bytes(const std::string &data)
+{
+    return QByteArray(data.data(), int(data.size()));
+}
+
+/**
+ * The preset headers are read without the samples, and a preset extracted
+ * alone keeps its name, numbers and sample data, and nothing else.
+ */
+static void testExtractPreset(const QString &fileName, const QString &outputFile)
+{
+    SoundfontFile file;
+    if (!CHECK(file.read(fileName))) {
+        std::cerr << qPrintable(file.errorString()) << std::endl;
+        return;
+    }
+    CHECK(file.name() == TEST_SOUNDFONT_NAME);
+    CHECK(!file.isCompressed());
+    if (!CHECK_EQUAL(file.presets().size(), 2)) {
+        return;
+    }
+    const SoundfontFile::Preset &sine = file.presets()[0];
+    CHECK(sine.name == TEST_PRESET_NAME);
+    CHECK_EQUAL(sine.bank, 0);
+    CHECK_EQUAL(sine.program, 0);
+    CHECK_EQUAL(sine.sampleBytes, quint64(TEST_SAMPLE_FRAMES * 2));
+    const SoundfontFile::Preset &square = file.presets()[1];
+    CHECK(square.name == TEST_SQUARE_PRESET_NAME);
+    CHECK_EQUAL(square.bank, TEST_SQUARE_BANK);
+    CHECK_EQUAL(square.program, TEST_SQUARE_PROGRAM);
+    CHECK_EQUAL(square.sampleBytes, quint64(TEST_SQUARE_SAMPLE_FRAMES * 2));
+
+    CHECK(!file.extractPreset(1, 2, outputFile));
+    CHECK(!file.errorString().isEmpty());
+    CHECK(!QFileInfo::exists(outputFile));
+    if (!CHECK(file.extractPreset(TEST_SQUARE_BANK, TEST_SQUARE_PROGRAM, outputFile))) {
+        std::cerr << qPrintable(file.errorString()) << std::endl;
+        return;
+    }
+    SoundfontFile extracted;
+    if (!CHECK(extracted.read(outputFile))) {
+        std::cerr << qPrintable(extracted.errorString()) << std::endl;
+        return;
+    }
+    CHECK(extracted.name() == QString("%1 - %2").arg(TEST_SOUNDFONT_NAME, TEST_SQUARE_PRESET_NAME));
+    if (CHECK_EQUAL(extracted.presets().size(), 1)) {
+        const SoundfontFile::Preset &p = extracted.presets()[0];
+        CHECK(p.name == TEST_SQUARE_PRESET_NAME);
+        CHECK_EQUAL(p.bank, TEST_SQUARE_BANK);
+        CHECK_EQUAL(p.program, TEST_SQUARE_PROGRAM);
+        CHECK_EQUAL(p.sampleBytes, square.sampleBytes);
+    }
+    const QByteArray data = contents(outputFile);
+    CHECK(data.contains(bytes(testSquareSample())));
+    CHECK(!data.contains(bytes(testSineSample()).left(400)));
+    CHECK(data.size() < contents(fileName).size() - TEST_SAMPLE_FRAMES * 2);
+
+    // the extracted file can be extracted again, its sample moved to the start
+    const QString again = outputFile + ".again";
+    CHECK(extracted.extractPreset(TEST_SQUARE_BANK, TEST_SQUARE_PROGRAM, again));
+    CHECK(contents(again).contains(bytes(testSquareSample())));
+}
+
+/**
+ * Damaged files are rejected with an error.
+ */
+static void testDamagedFiles(const QString &fileName, const QString &damagedFile)
+{
+    const QByteArray data = contents(fileName);
+    QFile damaged(damagedFile);
+    SoundfontFile file;
+    CHECK(!file.read(damagedFile));
+    CHECK(damaged.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    damaged.write(data.left(data.size() / 2));
+    damaged.close();
+    CHECK(!file.read(damagedFile));
+    CHECK(!file.errorString().isEmpty());
+    QByteArray wrong = data;
+    wrong.replace(8, 4, "abcd");
+    CHECK(damaged.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    damaged.write(wrong);
+    damaged.close();
+    CHECK(!file.read(damagedFile));
+    CHECK(file.presets().isEmpty());
+}
+
+/**
+ * The library indexes the fonts of a directory, finds their presets by
+ * numbers and names, keeps its index across instances, only reads changed
+ * files, and extracts the presets once, out of the scanned fonts.
+ */
+static void testLibrary(const QString &directory, const QString &indexFile)
+{
+    SoundfontLibrary library(indexFile);
+    CHECK(library.load());
+    CHECK_EQUAL(library.presetCount(), 0);
+    CHECK_EQUAL(library.update({directory}), 1);
+    CHECK_EQUAL(library.fonts().size(), 1);
+    CHECK_EQUAL(library.presetCount(), 2);
+
+    QVector<SoundfontLibrary::Entry> found = library.findProgram(TEST_SQUARE_BANK, TEST_SQUARE_PROGRAM);
+    if (CHECK_EQUAL(found.size(), 1)) {
+        CHECK(library.preset(found[0]).name == TEST_SQUARE_PRESET_NAME);
+        CHECK(library.font(found[0]).name == TEST_SOUNDFONT_NAME);
+    }
+    CHECK(library.findProgram(0, 1).isEmpty());
+    CHECK_EQUAL(library.findName("SQUARE").size(), 1);
+    CHECK_EQUAL(library.find(" test ").size(), 2);
+    CHECK_EQUAL(library.find("0:0").size(), 1);
+    CHECK(library.find("tone").isEmpty());
+    CHECK(library.save());
+
+    SoundfontLibrary other(indexFile);
+    CHECK(other.load());
+    CHECK_EQUAL(other.presetCount(), 2);
+    CHECK_EQUAL(other.update({directory}), 0);
+    found = other.find("sine");
+    if (!CHECK_EQUAL(found.size(), 1)) {
+        return;
+    }
+    CHECK(other.describe(found[0]).startsWith("000:000 Test Sine"));
+    const QString presetFile = other.presetFile(found[0]);
+    if (!CHECK(!presetFile.isEmpty())) {
+        std::cerr << qPrintable(other.errorString()) << std::endl;
+        return;
+    }
+    const QDateTime modified = QFileInfo(presetFile).lastModified();
+    CHECK(other.presetFile(found[0]) == presetFile);
+    CHECK(QFileInfo(presetFile).lastModified() == modified);
+    SoundfontFile extracted;
+    CHECK(extracted.read(presetFile));
+    CHECK_EQUAL(extracted.presets().size(), 1);
+
+    // the extracted presets are not indexed, even inside the directories
+    CHECK_EQUAL(other.update({directory}), 0);
+    CHECK_EQUAL(other.presetCount(), 2);
+
+    // a removed font is forgotten
+    CHECK(QFile::remove(QDir(directory).filePath("test.sf2")));
+    CHECK_EQUAL(other.update({directory}), 0);
+    CHECK_EQUAL(other.presetCount(), 0);
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QTemporaryDir dir;
+    if (!CHECK(dir.isValid())) {
+        return testing::result();
+    }
+    const QString fileName = dir.filePath("test.sf2");
+    if (!CHECK(writeTestSoundfont(QFile::encodeName(fileName).toStdString()))) {
+        return testing::result();
+    }
+    testExtractPreset(fileName, dir.filePath("square.out"));
+    testDamagedFiles(fileName, dir.filePath("damaged.out"));
+    testLibrary(dir.path(), dir.filePath("index/soundfonts.index"));
+    return testing::result();
+}
@@ -0,0 +1,71 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TESTING_H
+#define TESTING_H
+
+#include <iostream>
+
+/**
+ * Minimal checks for the unit tests, without any framework: every failed
+ * check is reported with its location and counted, and the test program
+ * returns the number of failures to CTest.
+ */
+namespace testing {
+
+inline int &failures()
+{
+    static int count = 0;
+    return count;
+}
+
+inline bool check(bool ok, const char *expression, const char *file, int line)
+{
+    if (!ok) {
+        std::cerr << file << ':' << line << ": check failed: " << expression << std::endl;
+        ++failures();
+    }
+    return ok;
+}
+
+template<typename A, typename B>
+bool checkEqual(const A &actual, const B &expected, const char *expression, const char *file, int line)
+{
+    if (!(actual == expected)) {
+        std::cerr << file << ':' << line << ": check failed: " << expression
+                  << "\n    actual: " << actual << "\n  expected: " << expected << std::endl;
+        ++failures();
+        return false;
+    }
+    return true;
+}
+
+inline int result()
+{
+    if (failures() > 0) {
+        std::cerr << failures() << " checks failed" << std::endl;
+    }
+    return failures() > 0 ? 1 : 0;
+}
+
+}
+
+#define CHECK(expression) testing::check(bool(expression), #expression, __FILE__, __LINE__)
+#define CHECK_EQUAL(actual, expected) testing::checkEqual((actual), (expected), #actual " == " #expected, __FILE__, __LINE__)
+
+#endif // TESTING_H
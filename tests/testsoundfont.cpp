@@ -0,0 +1,225 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <vector>
+#include "testsoundfont.h"
+
+const char *const TEST_SOUNDFONT_NAME = "Test Soundfont";
+const char *const TEST_PRESET_NAME = "Test Sine";
+const int TEST_SAMPLE_FRAMES = 4410;
+const char *const TEST_SQUARE_PRESET_NAME = "Test Square";
+const int TEST_SQUARE_BANK = 8;
+const int TEST_SQUARE_PROGRAM = 5;
+const int TEST_SQUARE_SAMPLE_FRAMES = 2200;
+
+static const int SAMPLE_RATE = 44100;
+static const int CYCLE_FRAMES = 100;
+static const int SAMPLE_PADDING = 46;
+static const double PI = 3.14159265358979323846;
+
+/* SF2 generator operators */
+static const uint16_t GEN_INSTRUMENT = 41;
+static const uint16_t GEN_SAMPLE_ID = 53;
+static const uint16_t GEN_SAMPLE_MODES = 54;
+
+namespace {
+
+/* little endian chunk writer */
+class Chunk
+{
+public:
+    void u8(uint8_t value) { m_data.push_back(char(value)); }
+    void u16(uint16_t value) { u8(uint8_t(value)); u8(uint8_t(value >> 8)); }
+    void u32(uint32_t value) { u16(uint16_t(value)); u16(uint16_t(value >> 16)); }
+    void bytes(const std::string &value) { m_data.append(value); }
+    void text(const char *value, size_t size)
+    {
+        const size_t length = std::min(std::strlen(value), size);
+        m_data.append(value, length);
+        m_data.append(size - length, '\0');
+    }
+    void chunk(const char *id, const Chunk &body)
+    {
+        m_data.append(id, 4);
+        u32(uint32_t(body.m_data.size()));
+        m_data.append(body.m_data);
+        if (body.m_data.size() % 2 != 0) {
+            u8(0);
+        }
+    }
+    void list(const char *id, const char *type, const Chunk &body)
+    {
+        Chunk list;
+        list.m_data.append(type, 4);
+        list.m_data.append(body.m_data);
+        chunk(id, list);
+    }
+    const std::string &data() const { return m_data; }
+
+private:
+    std::string m_data;
+};
+
+void presetHeader(Chunk &phdr, const char *name, uint16_t program, uint16_t bank, uint16_t bag)
+{
+    phdr.text(name, 20);
+    phdr.u16(program);
+    phdr.u16(bank);
+    phdr.u16(bag);
+    phdr.u32(0);
+    phdr.u32(0);
+    phdr.u32(0);
+}
+
+void bag(Chunk &chunk, uint16_t generator, uint16_t modulator)
+{
+    chunk.u16(generator);
+    chunk.u16(modulator);
+}
+
+void generator(Chunk &chunk, uint16_t oper, uint16_t amount)
+{
+    chunk.u16(oper);
+    chunk.u16(amount);
+}
+
+void terminalModulator(Chunk &chunk)
+{
+    for (int i = 0; i < 5; ++i) {
+        chunk.u16(0);
+    }
+}
+
+void sampleHeader(Chunk &shdr, const char *name, uint32_t start, uint32_t end,
+                  uint32_t loopStart, uint32_t loopEnd, uint32_t rate, uint8_t pitch, uint16_t type)
+{
+    shdr.text(name, 20);
+    shdr.u32(start);
+    shdr.u32(end);
+    shdr.u32(loopStart);
+    shdr.u32(loopEnd);
+    shdr.u32(rate);
+    shdr.u8(pitch);
+    shdr.u8(0);
+    shdr.u16(0);
+    shdr.u16(type);
+}
+
+}
+
+std::string testSineSample()
+{
+    Chunk smpl;
+    for (int i = 0; i < TEST_SAMPLE_FRAMES; ++i) {
+        const double phase = 2 * PI * (i % CYCLE_FRAMES) / CYCLE_FRAMES;
+        smpl.u16(uint16_t(int16_t(std::lround(16000 * std::sin(phase)))));
+    }
+    return smpl.data();
+}
+
+std::string testSquareSample()
+{
+    Chunk smpl;
+    for (int i = 0; i < TEST_SQUARE_SAMPLE_FRAMES; ++i) {
+        smpl.u16(uint16_t(int16_t(i % CYCLE_FRAMES < CYCLE_FRAMES / 2 ? 12000 : -12000)));
+    }
+    return smpl.data();
+}
+
+bool writeTestSoundfont(const std::string &fileName)
+{
+    Chunk info;
+    Chunk ifil;
+    ifil.u16(2);
+    ifil.u16(1);
+    info.chunk("ifil", ifil);
+    Chunk isng;
+    isng.text("EMU8000", 8);
+    info.chunk("isng", isng);
+    Chunk inam;
+    inam.text(TEST_SOUNDFONT_NAME, 16);
+    info.chunk("INAM", inam);
+
+    // each sample is followed by its padding
+    const std::string padding(SAMPLE_PADDING * 2, '\0');
+    const std::string data = testSineSample() + padding + testSquareSample() + padding;
+    const uint32_t squareStart = uint32_t(TEST_SAMPLE_FRAMES + SAMPLE_PADDING);
+    const uint32_t squareEnd = squareStart + uint32_t(TEST_SQUARE_SAMPLE_FRAMES);
+    Chunk smpl;
+    smpl.bytes(data);
+    Chunk sdta;
+    sdta.chunk("smpl", smpl);
+
+    Chunk phdr, pbag, pmod, pgen, inst, ibag, imod, igen, shdr;
+    presetHeader(phdr, TEST_PRESET_NAME, 0, 0, 0);
+    presetHeader(phdr, TEST_SQUARE_PRESET_NAME, TEST_SQUARE_PROGRAM, TEST_SQUARE_BANK, 1);
+    presetHeader(phdr, "EOP", 0, 0, 2);
+    bag(pbag, 0, 0);
+    bag(pbag, 1, 0);
+    bag(pbag, 2, 0);
+    terminalModulator(pmod);
+    generator(pgen, GEN_INSTRUMENT, 0);
+    generator(pgen, GEN_INSTRUMENT, 1);
+    generator(pgen, 0, 0);
+    inst.text("Sine", 20);
+    inst.u16(0);
+    inst.text("Square", 20);
+    inst.u16(1);
+    inst.text("EOI", 20);
+    inst.u16(2);
+    bag(ibag, 0, 0);
+    bag(ibag, 2, 0);
+    bag(ibag, 4, 0);
+    terminalModulator(imod);
+    generator(igen, GEN_SAMPLE_MODES, 1);
+    generator(igen, GEN_SAMPLE_ID, 0);
+    generator(igen, GEN_SAMPLE_MODES, 1);
+    generator(igen, GEN_SAMPLE_ID, 1);
+    generator(igen, 0, 0);
+    sampleHeader(shdr, "Sine", 0, TEST_SAMPLE_FRAMES, CYCLE_FRAMES, TEST_SAMPLE_FRAMES - CYCLE_FRAMES,
+                 SAMPLE_RATE, 69, 1);
+    sampleHeader(shdr, "Square", squareStart, squareEnd, squareStart + CYCLE_FRAMES, squareEnd - CYCLE_FRAMES,
+                 SAMPLE_RATE, 69, 1);
+    sampleHeader(shdr, "EOS", 0, 0, 0, 0, 0, 0, 0);
+    Chunk pdta;
+    pdta.chunk("phdr", phdr);
+    pdta.chunk("pbag", pbag);
+    pdta.chunk("pmod", pmod);
+    pdta.chunk("pgen", pgen);
+    pdta.chunk("inst", inst);
+    pdta.chunk("ibag", ibag);
+    pdta.chunk("imod", imod);
+    pdta.chunk("igen", igen);
+    pdta.chunk("shdr", shdr);
+
+    Chunk body;
+    body.list("LIST", "INFO", info);
+    body.list("LIST", "sdta", sdta);
+    body.list("LIST", "pdta", pdta);
+    Chunk file;
+    file.list("RIFF", "sfbk", body);
+
+    std::ofstream out(fileName, std::ios::binary | std::ios::trunc);
+    out.write(file.data().data(), std::streamsize(file.data().size()));
+    return bool(out);
+}
@@ -0,0 +1,45 @@
+/*
+    FluidLite Synthesizer for Qt applications
+    Copyright (C) 2022-2023, Pedro Lopez-Cabanillas <plcl@users.sf.net>
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TESTSOUNDFONT_H
+#define TESTSOUNDFONT_H
+
+#include <string>
+
+/**
+ * Writes a minimal SF2 file for the tests, named "Test Soundfont", with
+ * two presets playing one instrument each over the whole keyboard, rooted
+ * at key 69: "Test Sine" at bank 0 program 0, a looped sine wave sample
+ * of 441 Hz at 44100 Hz, and "Test Square" at bank 8 program 5, a shorter
+ * looped square wave sample.
+ */
+bool writeTestSoundfont(const std::string &fileName);
+
+extern const char *const TEST_SOUNDFONT_NAME;
+extern const char *const TEST_PRESET_NAME;
+extern const int TEST_SAMPLE_FRAMES;
+extern const char *const TEST_SQUARE_PRESET_NAME;
+extern const int TEST_SQUARE_BANK;
+extern const int TEST_SQUARE_PROGRAM;
+extern const int TEST_SQUARE_SAMPLE_FRAMES;
+
+/* the sample data of the presets, as stored in the file */
+std::string testSineSample();
+std::string testSquareSample();
+
+#endif // TESTSOUNDFONT_H